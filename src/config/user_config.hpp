@@ -871,6 +871,11 @@ namespace UserConfigParams
     // ---- Misc
     PARAM_PREFIX BoolUserConfigParam        m_cache_overworld
             PARAM_DEFAULT(  BoolUserConfigParam(true, "cache-overworld") );
+    PARAM_PREFIX IntUserConfigParam         m_track_data_cache_size
+            PARAM_DEFAULT(  IntUserConfigParam(128, "track-data-cache-size",
+            "Maximum size in MB of each directory of cached track data "
+            "(e.g. collision trees) in the cached data directory. The least "
+            "recently used files are removed first. 0 means no limit.") );
 
     // TODO : is this used with new code? does it still work?
     PARAM_PREFIX BoolUserConfigParam        m_crashed
@@ -39,8 +39,10 @@
 #include <stdexcept>
 #include <sstream>
 #include <sys/stat.h>
+#include <algorithm>
 #include <iostream>
 #include <string>
+#include <tuple>
 
 namespace irr {
     namespace io
@@ -49,15 +51,17 @@ namespace irr {
     }
 }
 
-// For mkdir
+// For mkdir and utime
 #if !defined(WIN32)
 #  include <sys/stat.h>
 #  include <sys/types.h>
 #  include <dirent.h>
 #  include <unistd.h>
+#  include <utime.h>
 #else
 #  define WIN32_LEAN_AND_MEAN
 #  include <direct.h>
+#  include <sys/utime.h>
 #  include <windows.h>
 #  include <stdio.h>
 #  if !defined(__CYGWIN__ ) && !defined(__MINGW32__)
@@ -247,6 +251,7 @@ FileManager::FileManager()
     checkAndCreateScreenshotDir();
     checkAndCreateReplayDir();
     checkAndCreateCachedTexturesDir();
+    checkAndCreateCachedDataDir();
     checkAndCreateGPDir();
 
     redirectOutput();
@@ -627,8 +632,11 @@ bool FileManager::findFile(std::string& full_path,
         i = search_path.rbegin();
         i != search_path.rend(); ++i)
     {
-        full_path = *i + file_name;
-        if(m_file_system->existFile(full_path.c_str())) return true;
+        if (isFileInDirectory(*i, file_name))
+        {
+            full_path = *i + file_name;
+            return true;
+        }
     }
     full_path="";
     return false;
@@ -650,13 +658,115 @@ bool FileManager::findFile(std::string& full_path,
         i = search_path.rbegin();
         i != search_path.rend(); ++i)
     {
-        full_path = i->m_texture_search_path + file_name;
-        if (m_file_system->existFile(full_path.c_str())) return true;
+        if (isFileInDirectory(i->m_texture_search_path, file_name))
+        {
+            full_path = i->m_texture_search_path + file_name;
+            return true;
+        }
     }
     full_path = "";
     return false;
 }   // findFile
 
+//-----------------------------------------------------------------------------
+/** Tests if a file exists in a directory. The read-only data directories
+ *  use the file index: the first time such a directory is searched all its
+ *  file names are added to the index. Other directories (e.g. addons or
+ *  cached textures) can change at any time, so they are always tested by
+ *  irrlicht's file system.
+ *  \param dir The directory to search in.
+ *  \param file_name The name of the file, which can contain subdirectories.
+ */
+bool FileManager::isFileInDirectory(const std::string& dir,
+                                    const std::string& file_name) const
+{
+    const std::string full_path = dir + file_name;
+    if (!isIndexedDirectory(dir))
+        return fileExists(full_path);
+
+    const size_t slash = full_path.find_last_of("/\\");
+    // Files without a directory are relative to the working directory
+    const std::string path = slash == std::string::npos
+                           ? "./" : full_path.substr(0, slash + 1);
+    std::string name = full_path.substr(slash + 1);
+    if (name.empty())
+        return fileExists(full_path);
+#ifdef WIN32
+    // The windows file system is case insensitive
+    name = StringUtils::toLowerCase(name);
+#endif
+
+    std::unique_lock<std::mutex> lock(m_file_index_lock);
+    auto it = m_file_index.find(path);
+    if (it == m_file_index.end())
+    {
+        it = m_file_index.insert(
+            std::make_pair(path, std::unordered_set<std::string>())).first;
+        if (isDirectory(path))
+        {
+            std::lock_guard<std::mutex> fs_lock(m_file_system_lock);
+            io::IFileList* list = m_file_system->createFileList(path.c_str());
+            for (unsigned int i = 0; i < list->getFileCount(); i++)
+            {
+#ifdef WIN32
+                it->second.insert(StringUtils::toLowerCase(
+                    list->getFileName(i).c_str()));
+#else
+                it->second.insert(list->getFileName(i).c_str());
+#endif
+            }
+            list->drop();
+        }
+        else
+            m_unindexed_dirs.insert(path);
+    }
+    if (it->second.find(name) != it->second.end())
+        return true;
+    const bool indexed = m_unindexed_dirs.find(path) == m_unindexed_dirs.end();
+    lock.unlock();
+    // Directories which are not on disk can only be tested by irrlicht's
+    // file system
+    if (!indexed)
+        return fileExists(full_path);
+
+    // Archives which are not on disk (e.g. a zip file of an addon or a
+    // compressed model) can contain the file as well
+    std::lock_guard<std::mutex> fs_lock(m_file_system_lock);
+    for (unsigned int i = 0; i < m_file_system->getFileArchiveCount(); i++)
+    {
+        io::IFileArchive* archive = m_file_system->getFileArchive(i);
+        if (archive->getType() != io::EFAT_FOLDER &&
+            archive->getFileList()->findFile(full_path.c_str()) >= 0)
+            return true;
+    }
+    return false;
+}   // isFileInDirectory
+
+//-----------------------------------------------------------------------------
+/** Returns true if the files of a directory are added to the file index,
+ *  which is only done for directories in the data roots which are not
+ *  changed by STK (so not e.g. the addons or the cache directories).
+ *  \param dir The directory to test.
+ */
+bool FileManager::isIndexedDirectory(const std::string& dir) const
+{
+    const std::string* writable[] = { &m_user_config_dir, &m_addons_dir,
+                                      &m_screenshot_dir, &m_replay_dir,
+                                      &m_cached_textures_dir,
+                                      &m_cached_data_dir, &m_gp_dir };
+    for (const std::string* w : writable)
+    {
+        if (!w->empty() && dir.compare(0, w->size(), *w) == 0)
+            return false;
+    }
+    for (const std::string& root : m_root_dirs)
+    {
+        if (dir.compare(0, root.size(), root) == 0)
+            return true;
+    }
+    return false;
+}   // isIndexedDirectory
+
 //-----------------------------------------------------------------------------
 std::string FileManager::getAssetChecked(FileManager::AssetType type,
                                          const std::string& name,
@@ -724,6 +834,15 @@ std::string FileManager::getCachedTexturesDir() const
     return m_cached_textures_dir;
 }   // getCachedTexturesDir
 
+//-----------------------------------------------------------------------------
+/** Returns the directory in which data computed from the assets (which is
+ *  not a texture) should be cached.
+ */
+std::string FileManager::getCachedDataDir() const
+{
+    return m_cached_data_dir;
+}   // getCachedDataDir
+
 //-----------------------------------------------------------------------------
 /** Returns the directory in which user-defined grand prix should be stored.
  */
@@ -754,19 +873,16 @@ std::string FileManager::searchTexture(const std::string& file_name) const
 bool FileManager::searchTextureContainerId(std::string& container_id,
     const std::string& file_name) const
 {
-    std::string full_path;
     for (std::vector<TextureSearchPath>::const_reverse_iterator
         i = m_texture_search_path.rbegin();
         i != m_texture_search_path.rend(); ++i)
     {
-        full_path = i->m_texture_search_path + file_name;
-        if (m_file_system->existFile(full_path.c_str()))
+        if (isFileInDirectory(i->m_texture_search_path, file_name))
         {
             container_id = i->m_container_id;
             return true;
         }
     }
-    full_path = "";
     return false;
 }   // findFile
 
@@ -1062,6 +1178,30 @@ void FileManager::checkAndCreateCachedTexturesDir()
 
 }   // checkAndCreateCachedTexturesDir
 
+// ----------------------------------------------------------------------------
+/** Creates the directory for other cached data, e.g. the collision trees of
+ *  tracks. This will set m_cached_data_dir with the appropriate path.
+ */
+void FileManager::checkAndCreateCachedDataDir()
+{
+#if defined(WIN32) || defined(__CYGWIN__)
+    m_cached_data_dir = m_user_config_dir + "cached-data/";
+#elif defined(__APPLE__)
+    m_cached_data_dir = getenv("HOME");
+    m_cached_data_dir += "/Library/Application Support/SuperTuxKart/CachedData/";
+#else
+    m_cached_data_dir = checkAndCreateLinuxDir("XDG_CACHE_HOME", "supertuxkart", ".cache/", ".");
+    m_cached_data_dir += "cached-data/";
+#endif
+
+    if (!checkAndCreateDirectory(m_cached_data_dir))
+    {
+        Log::error("FileManager", "Can not create cached data directory '%s', "
+            "falling back to '.'.", m_cached_data_dir.c_str());
+        m_cached_data_dir = "./";
+    }
+}   // checkAndCreateCachedDataDir
+
 // ----------------------------------------------------------------------------
 /** Creates the directories for user-defined grand prix. This will set m_gp_dir
  *  with the appropriate path.
@@ -1379,6 +1519,74 @@ bool FileManager::removeFile(const std::string &name) const
     return false;
 }   // removeFile
 
+// ----------------------------------------------------------------------------
+/** Sets the modification time of the specified file to the current time.
+ *  This is used for cache files, so that the least recently used ones are
+ *  removed first by limitDirectorySize().
+ *  \param name Name of the file.
+ */
+void FileManager::touchFile(const std::string &name) const
+{
+#if defined(WIN32)
+    _utime(name.c_str(), NULL);
+#else
+    utime(name.c_str(), NULL);
+#endif
+}   // touchFile
+
+// ----------------------------------------------------------------------------
+/** Removes the least recently modified files of a directory until the total
+ *  size of its files is at most max_size. Sub directories are not changed.
+ *  This uses the irrlicht file system, so it must be called from the main
+ *  thread.
+ *  \param dir The directory to clean.
+ *  \param max_size Maximum size of all files of the directory in bytes.
+ */
+void FileManager::limitDirectorySize(const std::string &dir,
+                                     uint64_t max_size) const
+{
+    std::set<std::string> files;
+    listFiles(files, dir);
+
+    // Modification time and size of each file, oldest files first
+    std::vector<std::tuple<time_t, uint64_t, std::string> > all_files;
+    uint64_t total_size = 0;
+    for (const std::string& file : files)
+    {
+        const std::string full_path = dir + "/" + file;
+        struct stat mystat;
+        if (stat(full_path.c_str(), &mystat) < 0 || !S_ISREG(mystat.st_mode))
+            continue;
+        all_files.emplace_back(mystat.st_mtime, (uint64_t)mystat.st_size,
+                               full_path);
+        total_size += (uint64_t)mystat.st_size;
+    }
+    std::sort(all_files.begin(), all_files.end());
+
+    for (unsigned int i = 0; i < all_files.size() && total_size > max_size;
+         i++)
+    {
+        const std::string& path = std::get<2>(all_files[i]);
+        Log::info("FileManager", "Removing '%s' to limit the size of '%s'.",
+                  path.c_str(), dir.c_str());
+        if (removeFile(path))
+            total_size -= std::get<1>(all_files[i]);
+    }
+}   // limitDirectorySize
+
+// ----------------------------------------------------------------------------
+/** Limits a sub directory of the cached data directory to the size set in
+ *  the track-data-cache-size user config option, see limitDirectorySize().
+ *  \param name Name of the sub directory, e.g. "physics".
+ */
+void FileManager::limitCachedDataDir(const std::string &name) const
+{
+    if (UserConfigParams::m_track_data_cache_size <= 0)
+        return;
+    limitDirectorySize(m_cached_data_dir + name,
+        (uint64_t)UserConfigParams::m_track_data_cache_size * 1024 * 1024);
+}   // limitCachedDataDir
+
 // ----------------------------------------------------------------------------
 /** Removes a directory (including all files contained). The function could
  *  easily recursively delete further subdirectories, but this is commented
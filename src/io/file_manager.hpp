@@ -27,6 +27,8 @@
 
 #include <mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <set>
 
@@ -37,6 +39,7 @@ using namespace irr;
 
 #include "io/xml_node.hpp"
 #include "utils/no_copy.hpp"
+#include "utils/types.hpp"
 
 struct TextureSearchPath
 {
@@ -99,6 +102,10 @@ private:
     /** Directory where resized textures are cached. */
     std::string       m_cached_textures_dir;
 
+    /** Directory where other data computed from the assets (e.g. collision
+     *  trees of tracks) is cached. */
+    std::string       m_cached_data_dir;
+
     /** Directory where user-defined grand prix are stored. */
     std::string       m_gp_dir;
 
@@ -110,6 +117,24 @@ private:
     std::vector<std::string>
                       m_model_search_path,
                       m_music_search_path;
+
+    /** Protects m_file_index, findFile can be called from several threads. */
+    mutable std::mutex m_file_index_lock;
+
+    /** The names of all files in each data directory that findFile
+     *  searched, so that testing if a file exists is a hash lookup instead
+     *  of a file system call. A directory is listed the first time it is
+     *  searched, see isIndexedDirectory(). */
+    mutable std::unordered_map<std::string, std::unordered_set<std::string> >
+                      m_file_index;
+
+    /** Directories in m_file_index which could not be listed, e.g. because
+     *  they do not exist or are in an archive. */
+    mutable std::unordered_set<std::string> m_unindexed_dirs;
+
+    bool              isFileInDirectory(const std::string& dir,
+                                        const std::string& file_name) const;
+    bool              isIndexedDirectory(const std::string& dir) const;
     bool              findFile(std::string& full_path,
                                const std::string& fname,
                                const std::vector<std::string>& search_path)
@@ -126,6 +151,7 @@ private:
     void              checkAndCreateScreenshotDir();
     void              checkAndCreateReplayDir();
     void              checkAndCreateCachedTexturesDir();
+    void              checkAndCreateCachedDataDir();
     void              checkAndCreateGPDir();
     void              discoverPaths();
 #if !defined(WIN32) && !defined(__CYGWIN__) && !defined(__APPLE__)
@@ -149,6 +175,7 @@ public:
     std::string       getScreenshotDir() const;
     std::string       getReplayDir() const;
     std::string       getCachedTexturesDir() const;
+    std::string       getCachedDataDir() const;
     std::string       getGPDir() const;
     bool              checkAndCreateDirectory(const std::string &path);
     bool              checkAndCreateDirectoryP(const std::string &path);
@@ -157,6 +184,9 @@ public:
     void checkAndCreateDirForAddons(const std::string &dir);
     bool isDirectory(const std::string &path) const;
     bool removeFile(const std::string &name) const;
+    void touchFile(const std::string &name) const;
+    void limitDirectorySize(const std::string &dir, uint64_t max_size) const;
+    void limitCachedDataDir(const std::string &name) const;
     bool removeDirectory(const std::string &name) const;
     bool copyFile(const std::string &source, const std::string &dest);
     std::vector<std::string>getMusicDirs() const;
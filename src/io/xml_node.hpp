@@ -69,6 +69,7 @@ public:
         ~XMLNode();
 
     const std::string &getName() const {return m_name; }
+    const std::string &getFileName() const {return m_file_name; }
     const XMLNode     *getNode(const std::string &name) const;
     const void         getNodes(const std::string &s, std::vector<XMLNode*>& out) const;
     const XMLNode     *getNode(unsigned int i) const;
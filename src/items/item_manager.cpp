@@ -27,12 +27,15 @@
 #include "karts/controller/spare_tire_ai.hpp"
 #include "modes/easter_egg_hunt.hpp"
 #include "modes/profile_world.hpp"
+#include "modes/world.hpp"
 #include "network/network_config.hpp"
 #include "network/race_event_manager.hpp"
 #include "physics/triangle_mesh.hpp"
 #include "tracks/arena_graph.hpp"
 #include "tracks/arena_node.hpp"
 #include "tracks/track.hpp"
+#include "utils/benchmark.hpp"
+#include "utils/random_generator.hpp"
 #include "utils/string_utils.hpp"
 
 #include <IMesh.h>
@@ -246,6 +249,7 @@ unsigned int ItemManager::insertItem(Item *item)
  */
 void ItemManager::insertItemInQuad(Item *item)
 {
+    addItemToGrid(item);
     if(m_items_in_quads)
     {
         int graph_node = item->getGraphNode();
@@ -375,44 +379,220 @@ void ItemManager::collectedItem(ItemState *item, AbstractKart *kart)
  */
 void  ItemManager::checkItemHit(AbstractKart* kart)
 {
-    // We could use m_items_in_quads to to check for item hits: take the quad
-    // of the graph node of the kart, and only check items in that quad. But
-    // then we also need to check for any adjacent quads (since an item just
-    // on the order of one quad might get hit from an adjacent quad). Then
-    // it is possible that a quad is that short that we need to test adjacent
-    // of adjacent quads. And check for items outside of the track.
-    // Since at this stace item detection is by far not a bottle neck,
-    // the original, simple and stable algorithm is left in place.
-
     /** Disable item collection detection for debug purposes. */
     if(m_disable_item_collection) return;
 
     // Spare tire karts don't collect items
     if ( dynamic_cast<SpareTireAI*>(kart->getController()) ) return;
 
-    for(AllItemTypes::iterator i =m_all_items.begin();
-                               i!=m_all_items.end();  i++)
+    // Only the items in the grid cells around the kart can be hit. They are
+    // tested in the order of their index (like the test of all items did
+    // before), so that the same items are collected in the same order.
+    getCloseItems(kart->getXYZ(), &m_close_items);
+    for(unsigned int i=0; i<m_close_items.size(); i++)
     {
-        // Ignore items that have been collected or are not available atm
-        if ((!*i) || !(*i)->isAvailable() || (*i)->isUsedUp()) continue;
+        // An item could have been removed when collecting a previous item
+        ItemState *item = m_all_items[m_close_items[i]];
+        if(item && isItemHit(item, kart, kart->getXYZ()))
+        {
+            collectedItem(item, kart);
+        }   // if hit
+    }   // for m_close_items
+}   // checkItemHit
+
+//-----------------------------------------------------------------------------
+/** Returns true if the item can be collected by the kart at the specified
+ *  location.
+ *  \param item The item to test.
+ *  \param kart The kart to test.
+ *  \param xyz Location of the kart.
+ */
+bool ItemManager::isItemHit(const ItemState *item, const AbstractKart *kart,
+                            const Vec3 &xyz) const
+{
+    // Ignore items that have been collected or are not available atm
+    if (!item->isAvailable() || item->isUsedUp()) return false;
+
+    // Shielded karts can simply drive over bubble gums without any effect
+    if ( kart->isShielded() &&
+         ( item->getType() == ItemState::ITEM_BUBBLEGUM      ||
+           item->getType() == ItemState::ITEM_BUBBLEGUM_NOLOK  ) )
+    {
+        return false;
+    }
+
+    // To allow inlining and avoid including kart.hpp in item.hpp,
+    // we pass the kart and the position separately.
+    return item->hitKart(xyz, kart);
+}   // isItemHit
+
+//-----------------------------------------------------------------------------
+/** Adds an item to the cell of the item grid of its position.
+ */
+void ItemManager::addItemToGrid(ItemState *item)
+{
+    const Vec3 &xyz = item->getXYZ();
+    m_item_grid[getItemGridKey(getItemGridCell(xyz.getX()),
+                               getItemGridCell(xyz.getZ()))].push_back(item);
+}   // addItemToGrid
+
+//-----------------------------------------------------------------------------
+/** Removes an item from the item grid. This must be called before the
+ *  position of the item is changed.
+ */
+void ItemManager::removeItemFromGrid(ItemState *item)
+{
+    const Vec3 &xyz = item->getXYZ();
+    auto cell = m_item_grid.find(getItemGridKey(getItemGridCell(xyz.getX()),
+                                                getItemGridCell(xyz.getZ())));
+    assert(cell != m_item_grid.end());
+    if (cell == m_item_grid.end())
+        return;
+    AllItemTypes &items = cell->second;
+    AllItemTypes::iterator it = std::find(items.begin(), items.end(), item);
+    assert(it != items.end());
+    if (it != items.end())
+        items.erase(it);
+    if (items.empty())
+        m_item_grid.erase(cell);
+}   // removeItemFromGrid
 
-        // Shielded karts can simply drive over bubble gums without any effect
-        if ( kart->isShielded() &&
-             ( (*i)->getType() == ItemState::ITEM_BUBBLEGUM      ||
-               (*i)->getType() == ItemState::ITEM_BUBBLEGUM_NOLOK  ) )
+//-----------------------------------------------------------------------------
+/** Returns the sorted indices of all items in the 3x3 grid cells around the
+ *  specified location, which includes all items that can be hit from there.
+ *  \param xyz The location to test.
+ *  \param indices On return the indices of the items in m_all_items.
+ */
+void ItemManager::getCloseItems(const Vec3 &xyz,
+                                std::vector<int> *indices) const
+{
+    indices->clear();
+    const int cell_x = getItemGridCell(xyz.getX());
+    const int cell_z = getItemGridCell(xyz.getZ());
+    for (int x = cell_x - 1; x <= cell_x + 1; x++)
+    {
+        for (int z = cell_z - 1; z <= cell_z + 1; z++)
         {
-            continue;
+            auto cell = m_item_grid.find(getItemGridKey(x, z));
+            if (cell == m_item_grid.end())
+                continue;
+            for (const ItemState *item : cell->second)
+                indices->push_back((int)item->getItemId());
         }
+    }
+    std::sort(indices->begin(), indices->end());
+}   // getCloseItems
 
+//-----------------------------------------------------------------------------
+/** Compares the items hit by karts using the item grid with testing all
+ *  items, and prints the time needed by both. Random items are added (and
+ *  removed again) so that at least 128 items are tested. Enabled with
+ *  --micro-benchmark=item.
+ */
+void ItemManager::benchmarkItemHit()
+{
+    World *world = World::getWorld();
+    const unsigned int num_karts = world->getNumKarts();
+    if (num_karts == 0)
+        return;
+
+    // Use the area covered by the karts and the items of the track
+    Vec3 bb_min = world->getKart(0)->getXYZ();
+    Vec3 bb_max = bb_min;
+    for (unsigned int i = 0; i < num_karts; i++)
+    {
+        bb_min.min(world->getKart(i)->getXYZ());
+        bb_max.max(world->getKart(i)->getXYZ());
+    }
+    for (ItemState *item : m_all_items)
+    {
+        if (!item) continue;
+        bb_min.min(item->getXYZ());
+        bb_max.max(item->getXYZ());
+    }
+    bb_min -= Vec3(10.0f, 1.0f, 10.0f);
+    bb_max += Vec3(10.0f, 1.0f, 10.0f);
+    const Vec3 size = bb_max - bb_min;
 
-        // To allow inlining and avoid including kart.hpp in item.hpp,
-        // we pass the kart and the position separately.
-        if((*i)->hitKart(kart->getXYZ(), kart))
+    RandomGenerator rg;
+    auto random_point = [&rg, &bb_min, &size]()
+    {
+        return Vec3(bb_min.getX() + size.getX() * rg.get(10000) / 10000.0f,
+                    bb_min.getY() + size.getY() * rg.get(10000) / 10000.0f,
+                    bb_min.getZ() + size.getZ() * rg.get(10000) / 10000.0f);
+    };
+
+    // The added items are not inserted in the quad lists and are not part
+    // of any network state, they are removed before the race starts
+    const unsigned int num_items = (unsigned int)m_all_items.size();
+    while (m_all_items.size() < 128)
+    {
+        ItemState::ItemType type = rg.get(2) == 0 ? ItemState::ITEM_BANANA
+                                                  : ItemState::ITEM_BONUS_BOX;
+        Item *item = new Item(type, random_point(), Vec3(0, 1, 0),
+                              m_item_mesh[type], m_item_lowres_mesh[type],
+                              /*prev_owner*/NULL);
+        item->setItemId((unsigned int)m_all_items.size());
+        m_all_items.push_back(item);
+        addItemToGrid(item);
+    }
+
+    // Most points are close to items, like karts driving over them
+    const unsigned int count = 100000;
+    std::vector<Vec3> points(count);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        const ItemState *item = m_all_items[rg.get((int)m_all_items.size())];
+        if (item && rg.get(4) != 0)
         {
-            collectedItem(*i, kart);
-        }   // if hit
-    }   // for m_all_items
-}   // checkItemHit
+            points[i] = item->getXYZ() +
+                Vec3(rg.get(600) / 100.0f - 3.0f, rg.get(200) / 100.0f - 1.0f,
+                     rg.get(600) / 100.0f - 3.0f);
+        }
+        else
+            points[i] = random_point();
+    }
+
+    std::vector<int> hits[2];
+    Benchmark::Timer timer[2];
+    std::vector<int> indices;
+    for (int grid = 0; grid < 2; grid++)
+    {
+        timer[grid].start();
+        for (unsigned int i = 0; i < count; i++)
+        {
+            const AbstractKart *kart = world->getKart(i % num_karts);
+            if (grid)
+                getCloseItems(points[i], &indices);
+            const unsigned int n = grid ? (unsigned int)indices.size()
+                                        : (unsigned int)m_all_items.size();
+            for (unsigned int j = 0; j < n; j++)
+            {
+                const unsigned int index = grid ? indices[j] : j;
+                const ItemState *item = m_all_items[index];
+                if (item && isItemHit(item, kart, points[i]))
+                    hits[grid].push_back(index);
+            }
+            hits[grid].push_back(-1);
+        }
+        timer[grid].stop();
+    }
+
+    Log::info("ItemManager", "Benchmark of %u points with %u karts and "
+        "%u items: %s, %u hits.", count, num_karts,
+        (unsigned int)m_all_items.size(),
+        hits[0] == hits[1] ? "same result" : "DIFFERENT RESULT",
+        (unsigned int)(hits[0].size() - count));
+    Log::info("ItemManager", "checkItemHit: all items %f ms, grid %f ms.",
+        timer[0].getTotal(), timer[1].getTotal());
+
+    for (unsigned int i = num_items; i < m_all_items.size(); i++)
+    {
+        removeItemFromGrid(m_all_items[i]);
+        delete m_all_items[i];
+    }
+    m_all_items.resize(num_items);
+}   // benchmarkItemHit
 
 //-----------------------------------------------------------------------------
 /** Resets all items and removes bubble gum that is stuck on the track.
@@ -527,6 +707,7 @@ void ItemManager::deleteItem(ItemState *item)
  */
 void ItemManager::deleteItemInQuad(ItemState* item)
 {
+    removeItemFromGrid(item);
     if(m_items_in_quads)
     {
         int sector = item->getGraphNode();
@@ -24,15 +24,19 @@
 #include "items/item.hpp"
 #include "utils/aligned_array.hpp"
 #include "utils/no_copy.hpp"
+#include "utils/types.hpp"
 #include "utils/vec3.hpp"
 
 #include <SColor.h>
 
+#include <algorithm>
 #include <assert.h>
+#include <cmath>
 #include <map>
 #include <memory>
 #include <random>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 class Kart;
@@ -110,6 +114,15 @@ private:
      *  field is undefined if no Graph exist, e.g. arena without navmesh. */
     std::vector< AllItemTypes > *m_items_in_quads;
 
+    /** All items sorted into the cells of a uniform grid in the xz plane,
+     *  so that checkItemHit only needs to test the items close to a kart.
+     *  The key is computed by getItemGridKey. */
+    std::unordered_map<uint64_t, AllItemTypes> m_item_grid;
+
+    /** Indices of the items close to a kart, kept to avoid allocations in
+     *  checkItemHit. */
+    std::vector<int> m_close_items;
+
     /** Stores all item models. */
     static std::vector<scene::IMesh *> m_item_mesh;
 
@@ -127,6 +140,28 @@ protected:
     void setSwitchItems(const std::vector<int> &switch_items);
     void insertItemInQuad(Item *item);
     void deleteItemInQuad(ItemState *item);
+    void addItemToGrid(ItemState *item);
+    void removeItemFromGrid(ItemState *item);
+    void getCloseItems(const Vec3 &xyz, std::vector<int> *indices) const;
+    bool isItemHit(const ItemState *item, const AbstractKart *kart,
+                   const Vec3 &xyz) const;
+    // ------------------------------------------------------------------------
+    /** Returns the cell of the item grid for a coordinate. */
+    static int getItemGridCell(float v)
+    {
+        // The cells need to be at least as large as the distance at which
+        // an item can be hit (see Item::hitKart: sqrt(4*1.2) < 2.2), so that
+        // only the 3x3 cells around a kart need to be tested
+        const float cell = std::floor(v / 4.0f);
+        // Avoid overflows for karts far away from the track
+        return (int)std::max(-1000000.0f, std::min(cell, 1000000.0f));
+    }   // getItemGridCell
+    // ------------------------------------------------------------------------
+    static uint64_t getItemGridKey(int x, int z)
+    {
+        return ((uint64_t)(uint32_t)x << 32) | (uint32_t)z;
+    }   // getItemGridKey
+    // ------------------------------------------------------------------------
              ItemManager();
 public:
     virtual ~ItemManager();
@@ -144,6 +179,7 @@ public:
     virtual void   collectedItem   (ItemState *item, AbstractKart *kart);
     virtual void   switchItems     ();
     bool           randomItemsForArena(const AlignedArray<btTransform>& pos);
+    void           benchmarkItemHit();
 
     // ------------------------------------------------------------------------
     /** Returns true if the items are switched atm. */
@@ -223,29 +223,17 @@ void NetworkItemManager::setItemConfirmationTime(std::weak_ptr<STKPeer> peer,
  *  to save the initial state, which is the first confirmed state by all
  *  clients.
  */
-BareNetworkString* NetworkItemManager::saveState(std::vector<std::string>* ru)
+bool NetworkItemManager::saveState(BareNetworkString* buffer)
 {
-    ru->push_back(getUniqueIdentity());
     // On the server:
     // ==============
     m_item_events.lock();
-    uint16_t n = (uint16_t)m_item_events.getData().size();
-    if(n==0)
+    for (auto& p : m_item_events.getData())
     {
-        BareNetworkString *s = new BareNetworkString();
-        m_item_events.unlock();
-        return s;
-    }
-
-    BareNetworkString *s =
-        new BareNetworkString(n * (  sizeof(int) + sizeof(uint16_t)
-                                   + sizeof(uint8_t)              ) );
-    for (auto p : m_item_events.getData())
-    {
-        p.saveState(s);
+        p.saveState(buffer);
     }
     m_item_events.unlock();
-    return s;
+    return true;
 }   // saveState
 
 //-----------------------------------------------------------------------------
@@ -488,7 +476,14 @@ void NetworkItemManager::restoreState(BareNetworkString *buffer, int count)
         // ... will be copied from item state to item
         if (is && item)
         {
+            // The position is part of the state (e.g. for a dropped item
+            // in a reused index), so the item grid needs to be updated
+            const bool moved = item->getXYZ() != is->getXYZ();
+            if (moved)
+                removeItemFromGrid(item);
             *(ItemState*)item = *is;
+            if (moved)
+                addItemToGrid(item);
         }
         else if (is && !item)
         {
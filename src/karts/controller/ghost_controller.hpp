@@ -68,6 +68,8 @@ public:
 
     void         addReplayTime(float time);
     // ------------------------------------------------------------------------
+    void         reserveReplayTimes(unsigned int n)   { m_all_times.reserve(n); }
+    // ------------------------------------------------------------------------
     bool         isReplayEnd() const
                          { return m_current_index + 1 >= m_all_times.size(); }
     // ------------------------------------------------------------------------
@@ -61,7 +61,8 @@ void GhostKart::addReplayEvent(float time,
     GhostController* gc = dynamic_cast<GhostController*>(getController());
     gc->addReplayTime(time);
 
-    m_all_transform.push_back(trans);
+    m_all_xyz.push_back(trans.getOrigin());
+    m_all_rotation.push_back(trans.getRotation());
     m_all_physic_info.push_back(pi);
     m_all_bonus_info.push_back(bi);
     m_all_replay_events.push_back(kre);
@@ -78,6 +79,22 @@ void GhostKart::addReplayEvent(float time,
 
 }   // addReplayEvent
 
+// ----------------------------------------------------------------------------
+/** Reserves memory for n replay events, used when the number of events is
+ *  known before they are added.
+ */
+void GhostKart::reserveReplayEvents(unsigned int n)
+{
+    GhostController* gc = dynamic_cast<GhostController*>(getController());
+    gc->reserveReplayTimes(n);
+
+    m_all_xyz.reserve(n);
+    m_all_rotation.reserve(n);
+    m_all_physic_info.reserve(n);
+    m_all_bonus_info.reserve(n);
+    m_all_replay_events.reserve(n);
+}   // reserveReplayEvents
+
 // ----------------------------------------------------------------------------
 /** Called once per rendered frame. It is used to only update any graphical
  *  effects.
@@ -128,13 +145,13 @@ void GhostKart::update(int ticks)
     }
 
     const float rd         = gc->getReplayDelta();
-    assert(idx < m_all_transform.size());
+    assert(idx < m_all_xyz.size());
 
-    setXYZ((1- rd)*m_all_transform[idx    ].getOrigin()
-           +  rd  *m_all_transform[idx + 1].getOrigin() );
+    setXYZ((1- rd)*m_all_xyz[idx    ]
+           +  rd  *m_all_xyz[idx + 1] );
 
-    const btQuaternion q = m_all_transform[idx].getRotation()
-        .slerp(m_all_transform[idx + 1].getRotation(), rd);
+    const btQuaternion q = m_all_rotation[idx].slerp(m_all_rotation[idx + 1],
+                                                     rd);
     setRotation(q);
 
     Moveable::updatePosition();
@@ -37,8 +37,13 @@
 class GhostKart : public Kart
 {
 private:
-    /** The transforms to assume at the corresponding time in m_all_times. */
-    std::vector<btTransform>                 m_all_transform;
+    /** The position and rotation to assume at the corresponding time in
+     *  m_all_times. They are stored separately instead of as btTransform,
+     *  which takes twice the memory and would need to convert its matrix
+     *  back to a quaternion each frame. */
+    std::vector<btVector3>                   m_all_xyz;
+
+    std::vector<btQuaternion>                m_all_rotation;
 
     std::vector<ReplayBase::PhysicInfo>      m_all_physic_info;
 
@@ -74,6 +79,8 @@ public:
                                  const ReplayBase::BonusInfo &bi,
                                  const ReplayBase::KartReplayEvent &kre);
     // ------------------------------------------------------------------------
+    void          reserveReplayEvents(unsigned int n);
+    // ------------------------------------------------------------------------
     /** Returns whether this kart is a ghost (replay) kart. */
     virtual bool  isGhostKart() const OVERRIDE { return true; }
     // ------------------------------------------------------------------------
@@ -1472,7 +1472,9 @@ void Kart::update(int ticks)
     // based on the collision speed.
     m_body->setRestitution(m_kart_properties->getRestitution(fabsf(m_speed)));
 
+    PROFILER_PUSH_CPU_MARKER("Kart::update (controller)", 0x60, 0x34, 0x7F);
     m_controller->update(ticks);
+    PROFILER_POP_CPU_MARKER();
 
 #ifndef SERVER_ONLY
 #undef DEBUG_CAMERA_SHAKE
@@ -1771,7 +1773,9 @@ void Kart::update(int ticks)
     }   // if there is material
     PROFILER_POP_CPU_MARKER();
 
+    PROFILER_PUSH_CPU_MARKER("Kart::update (item hits)", 0x60, 0x34, 0x7F);
     ItemManager::get()->checkItemHit(this);
+    PROFILER_POP_CPU_MARKER();
 
     const bool emergency = has_animation_before;
 
@@ -147,21 +147,15 @@ void KartRewinder::computeError()
 }   // computeError
 
 // ----------------------------------------------------------------------------
-/** Saves all state information for a kart in a memory buffer. The memory
- *  is allocated here and the address returned. It will then be managed
- *  by the RewindManager.
+/** Saves all state information for a kart in the given buffer.
+ *  \param buffer The state buffer to append to.
  *  \param[out] ru The unique identity of rewinder writing to.
- *  \return The address of the memory buffer with the state.
+ *  \return False if the kart is eliminated and has no state.
  */
-BareNetworkString* KartRewinder::saveState(std::vector<std::string>* ru)
+bool KartRewinder::saveState(BareNetworkString* buffer)
 {
     if (m_eliminated)
-        return nullptr;
-
-    ru->push_back(getUniqueIdentity());
-    const int MEMSIZE = 17*sizeof(float) + 9+3;
-
-    BareNetworkString *buffer = new BareNetworkString(MEMSIZE);
+        return false;
 
     // 1) Steering and other player controls
     // -------------------------------------
@@ -254,7 +248,7 @@ BareNetworkString* KartRewinder::saveState(std::vector<std::string>* ru)
     // -----------
     m_skidding->saveState(buffer);
 
-    return buffer;
+    return true;
 }   // saveState
 
 // ----------------------------------------------------------------------------
@@ -441,15 +435,14 @@ void KartRewinder::update(int ticks)
 }   // update
 
 // ----------------------------------------------------------------------------
-std::function<void()> KartRewinder::getLocalStateRestoreFunction()
+bool KartRewinder::saveLocalState(BareNetworkString *buffer)
 {
     if (m_eliminated)
-        return nullptr;
+        return false;
 
     // Variable can be saved locally if its adjustment only depends on the kart
     // itself
-    int brake_ticks = m_brake_ticks;
-    int8_t min_nitro_ticks = m_min_nitro_ticks;
+    buffer->addUInt32(m_brake_ticks).addUInt8(m_min_nitro_ticks);
 
     // Controller local state
     int steer_val_l = 0;
@@ -460,32 +453,35 @@ std::function<void()> KartRewinder::getLocalStateRestoreFunction()
         steer_val_l = pc->m_steer_val_l;
         steer_val_r = pc->m_steer_val_r;
     }
+    buffer->addUInt32(steer_val_l).addUInt32(steer_val_r);
 
     // Max speed local state (terrain)
-    float current_fraction = m_max_speed->m_speed_decrease
-        [MaxSpeed::MS_DECREASE_TERRAIN].m_current_fraction;
-    uint16_t max_speed_fraction = m_max_speed->m_speed_decrease
-        [MaxSpeed::MS_DECREASE_TERRAIN].m_max_speed_fraction;
+    buffer->addFloat(m_max_speed->m_speed_decrease
+        [MaxSpeed::MS_DECREASE_TERRAIN].m_current_fraction);
+    buffer->addUInt16(m_max_speed->m_speed_decrease
+        [MaxSpeed::MS_DECREASE_TERRAIN].m_max_speed_fraction);
 
     // Skidding local state
-    float remaining_jump_time = m_skidding->m_remaining_jump_time;
+    buffer->addFloat(m_skidding->m_remaining_jump_time);
+    return true;
+}   // saveLocalState
 
-    return [brake_ticks, min_nitro_ticks,
-        steer_val_l, steer_val_r, current_fraction,
-        max_speed_fraction, remaining_jump_time, this]()
+// ----------------------------------------------------------------------------
+void KartRewinder::restoreLocalState(BareNetworkString *buffer)
+{
+    m_brake_ticks = buffer->getUInt32();
+    m_min_nitro_ticks = buffer->getUInt8();
+    const int steer_val_l = buffer->getUInt32();
+    const int steer_val_r = buffer->getUInt32();
+    PlayerController* pc = dynamic_cast<PlayerController*>(m_controller);
+    if (pc)
     {
-        m_brake_ticks = brake_ticks;
-        m_min_nitro_ticks = min_nitro_ticks;
-        PlayerController* pc = dynamic_cast<PlayerController*>(m_controller);
-        if (pc)
-        {
-            pc->m_steer_val_l = steer_val_l;
-            pc->m_steer_val_r = steer_val_r;
-        }
-        m_max_speed->m_speed_decrease[MaxSpeed::MS_DECREASE_TERRAIN]
-            .m_current_fraction = current_fraction;
-        m_max_speed->m_speed_decrease[MaxSpeed::MS_DECREASE_TERRAIN]
-            .m_max_speed_fraction = max_speed_fraction;
-        m_skidding->m_remaining_jump_time = remaining_jump_time;
-    };
-}   // getLocalStateRestoreFunction
+        pc->m_steer_val_l = steer_val_l;
+        pc->m_steer_val_r = steer_val_r;
+    }
+    m_max_speed->m_speed_decrease[MaxSpeed::MS_DECREASE_TERRAIN]
+        .m_current_fraction = buffer->getFloat();
+    m_max_speed->m_speed_decrease[MaxSpeed::MS_DECREASE_TERRAIN]
+        .m_max_speed_fraction = buffer->getUInt16();
+    m_skidding->m_remaining_jump_time = buffer->getFloat();
+}   // restoreLocalState
@@ -40,8 +40,7 @@ public:
     ~KartRewinder() {}
     virtual void saveTransform() OVERRIDE;
     virtual void computeError() OVERRIDE;
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru)
-        OVERRIDE;
+    virtual bool saveState(BareNetworkString* buffer) OVERRIDE;
     void reset() OVERRIDE;
     virtual void restoreState(BareNetworkString *p, int count) OVERRIDE;
     virtual void rewindToEvent(BareNetworkString *p) OVERRIDE {}
@@ -72,7 +71,9 @@ public:
     // -------------------------------------------------------------------------
     virtual void undoEvent(BareNetworkString *p) OVERRIDE {}
     // ------------------------------------------------------------------------
-    virtual std::function<void()> getLocalStateRestoreFunction() OVERRIDE;
+    virtual bool saveLocalState(BareNetworkString *buffer) OVERRIDE;
+    // ------------------------------------------------------------------------
+    virtual void restoreLocalState(BareNetworkString *buffer) OVERRIDE;
 
 
 };   // Rewinder
@@ -216,7 +216,9 @@
 #include "modes/profile_world.hpp"
 #include "network/protocols/connect_to_server.hpp"
 #include "network/protocols/client_lobby.hpp"
+#include "network/protocols/game_protocol.hpp"
 #include "network/protocols/server_lobby.hpp"
+#include "network/ip_ban_index.hpp"
 #include "network/network_config.hpp"
 #include "network/network_string.hpp"
 #include "network/rewind_manager.hpp"
@@ -244,6 +246,7 @@
 #include "tracks/arena_graph.hpp"
 #include "tracks/track.hpp"
 #include "tracks/track_manager.hpp"
+#include "utils/benchmark.hpp"
 #include "utils/command_line.hpp"
 #include "utils/constants.hpp"
 #include "utils/crash_reporting.hpp"
@@ -585,6 +588,10 @@ void cmdLineHelp()
                               "laps.\n"
     "       --profile-time=n   Enable automatic driven profile mode for n "
                               "seconds.\n"
+    "       --benchmark-ticks=n Run n ticks with AI karts only and write the "
+                              "results as json.\n"
+    "       --benchmark-tracks=t1,t2 List of tracks to run the benchmark on.\n"
+    "       --benchmark-file=f Name of the benchmark result file.\n"
     "       --unlock-all       Permanently unlock all karts and tracks for testing.\n"
     "       --no-unlock-all    Disable unlock-all (i.e. base unlocking on player achievement).\n"
     "       --no-graphics      Do not display the actual race.\n"
@@ -601,6 +608,8 @@ void cmdLineHelp()
     // "
     // "    --disable-item-collection Disable item collection. Useful for\n"
     // "                          debugging client/server item management.\n"
+    // "    --micro-benchmark=n1,n2 Run the given micro benchmarks, an unknown\n"
+    // "                          name lists all of them.\n"
     // "    --network-item-debugging Print item handling debug information.\n"
     "       --server-config=file Specify the server_config.xml for server hosting, it will create\n"
     "                            one if not found.\n"
@@ -646,6 +655,11 @@ void cmdLineHelp()
     "       --log=N            Set the verbosity to a value between\n"
     "                          0 (Debug) and 5 (Only Fatal messages)\n"
     "       --logbuffer=N      Buffers up to N lines log lines before writing.\n"
+    "       --log-async        Write log messages in a separate thread.\n"
+    "       --log-binary       Like --log-async, but the log file is written in a\n"
+    "                          binary format, see tools/decode_log.py.\n"
+    "       --log-rate-limit=N Write at most N lines per second for each\n"
+    "                          component of the log (with --log-async).\n"
     "       --root=DIR         Path to add to the list of STK root directories.\n"
     "                          You can specify more than one by separating them\n"
     "                          with colons (:).\n"
@@ -735,6 +749,8 @@ int handleCmdLineOutputModifier()
     }
     if(CommandLine::has("--no-console-log"))
         Log::toggleConsoleLog(false);
+    if (CommandLine::has("--log-rate-limit", &n))
+        Log::setRateLimit(n);
 
     return 0;
 }
@@ -766,6 +782,11 @@ int handleCmdLinePreliminary()
         UserConfigParams::m_verbosity |= UserConfigParams::LOG_ALL;
     if(CommandLine::has("--online"))
         History::m_online_history_replay = true;
+    // The log file is opened by the file manager
+    if (CommandLine::has("--log-binary"))
+        Log::startWriterThread(/*binary_file*/true);
+    else if (CommandLine::has("--log-async"))
+        Log::startWriterThread(/*binary_file*/false);
 #if !(defined(SERVER_ONLY) || defined(ANDROID))
     if(CommandLine::has("--apitrace"))
     {
@@ -1205,6 +1226,15 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
     if (CommandLine::has("--disable-item-collection"))
         ItemManager::disableItemCollection();
 
+    if (CommandLine::has("--micro-benchmark", &s))
+    {
+        if (!Benchmark::enable(s))
+            return 0;
+        // The benchmarks which need a track are run when a race starts
+        if (Benchmark::runModuleBenchmarks() && !Benchmark::needsRace())
+            return 0;
+    }
+
     if (CommandLine::has("--network-item-debugging"))
         NetworkItemManager::m_network_item_debugging = true;
     
@@ -1578,6 +1608,41 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
         race_manager->setNumLaps(999999); // profile end depends on time
     }   // --profile-time
 
+    if(CommandLine::has("--benchmark-ticks", &n))
+    {
+        if (n <= 0)
+        {
+            Log::error("main", "Invalid number of benchmark-ticks: %i.", n);
+            return 0;
+        }
+        Log::verbose("main", "Benchmarking %d ticks.", n);
+        UserConfigParams::m_no_start_screen = true;
+        ProfileWorld::setProfileModeTicks(n);
+        race_manager->setNumLaps(99999); // benchmark end depends on ticks
+        // The time of each subsystem is taken from the profiler markers
+        if (ProfileWorld::isNoGraphics())
+            profiler.init();
+        UserConfigParams::m_profiler_enabled = true;
+        if (CommandLine::has("--benchmark-tracks", &s))
+        {
+            std::vector<std::string> tracks;
+            for (const std::string &ident : StringUtils::split(s, ','))
+            {
+                Track* t = track_manager->getTrack(ident);
+                if (!t || t->isArena() || t->isSoccer() || t->isInternal())
+                {
+                    Log::warn("main", "Invalid benchmark track '%s'.",
+                              ident.c_str());
+                    continue;
+                }
+                tracks.push_back(ident);
+            }
+            ProfileWorld::setBenchmarkTracks(tracks);
+        }
+        if (CommandLine::has("--benchmark-file", &s))
+            ProfileWorld::setBenchmarkFile(s);
+    }   // --benchmark-ticks
+
     if(CommandLine::has("--history"))
     {
         history->setReplayHistory(true);
@@ -2247,7 +2312,31 @@ int main(int argc, char *argv[] )
             // =========
             race_manager->setMajorMode (RaceManager::MAJOR_MODE_SINGLE);
             race_manager->setupPlayerKartInfo();
-            race_manager->startNew(false);
+            if (ProfileWorld::isBenchmarkMode())
+            {
+                // The benchmark runs one track after another. The main
+                // loop is left at the end of each track, and the world is
+                // deleted here before the next track is started.
+                std::vector<std::string> tracks =
+                    ProfileWorld::getBenchmarkTracks();
+                if (tracks.empty())
+                    tracks.push_back(race_manager->getTrackName());
+                for (unsigned int i = 0; i < tracks.size(); i++)
+                {
+                    race_manager->setTrack(tracks[i]);
+                    race_manager->startNew(false);
+                    main_loop->run();
+                    World::deleteWorld();
+                    // Don't continue if the track was aborted
+                    if (ProfileWorld::getNumBenchmarkResults() != i + 1)
+                        break;
+                    main_loop->resetAbort();
+                }
+                // Leave the main loop below immediately
+                main_loop->abort();
+            }
+            else
+                race_manager->startNew(false);
         }
         main_loop->run();
 
@@ -2442,6 +2531,8 @@ void runUnitTests()
     NetworkString::unitTesting();
     Log::info("UnitTest", "TransportAddress");
     TransportAddress::unitTesting();
+    Log::info("UnitTest", "IPBanIndex");
+    IPBanIndex::unitTesting();
     Log::info("UnitTest", "StringUtils::versionToInt");
     StringUtils::unitTesting();
 
@@ -2491,6 +2582,9 @@ void runUnitTests()
     Log::info("UnitTest", "RewindQueue");
     RewindQueue::unitTesting();
 
+    Log::info("UnitTest", "GameProtocol delta states");
+    GameProtocol::unitTesting();
+
     Log::info("UnitTest", "=====================");
     Log::info("UnitTest", "Testing successful   ");
     Log::info("UnitTest", "=====================");
@@ -45,6 +45,7 @@
 #include "tracks/track_sector.hpp"
 #include "tracks/track.hpp"
 #include "utils/constants.hpp"
+#include "utils/profiler.hpp"
 #include "utils/string_utils.hpp"
 #include "utils/translation.hpp"
 
@@ -183,7 +184,9 @@ void LinearWorld::update(int ticks)
 
     // Do stuff specific to this subtype of race.
     // ------------------------------------------
+    PROFILER_PUSH_CPU_MARKER("LinearWorld::update (track sectors)", 0x20, 0x7F, 0x40);
     updateTrackSectors();
+    PROFILER_POP_CPU_MARKER();
     // Run generic parent stuff that applies to all modes.
     // It especially updates the kart positions.
     // It MUST be done after the update of the distances
@@ -21,19 +21,29 @@
 #include "main_loop.hpp"
 #include "graphics/camera.hpp"
 #include "graphics/irr_driver.hpp"
+#include "items/item_manager.hpp"
+#include "items/powerup.hpp"
 #include "karts/kart_with_stats.hpp"
 #include "karts/controller/controller.hpp"
 #include "tracks/track.hpp"
+#include "utils/allocation_counter.hpp"
+#include "utils/profiler.hpp"
 
 #include <ISceneManager.h>
 
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <sstream>
 
 ProfileWorld::ProfileType ProfileWorld::m_profile_mode=PROFILE_NONE;
 int   ProfileWorld::m_num_laps    = 0;
 float ProfileWorld::m_time        = 0.0f;
+int   ProfileWorld::m_num_ticks   = 0;
 bool  ProfileWorld::m_no_graphics = false;
+std::vector<std::string> ProfileWorld::m_benchmark_tracks;
+std::string              ProfileWorld::m_benchmark_file = "benchmark.json";
+std::vector<std::string> ProfileWorld::m_benchmark_results;
 
 //-----------------------------------------------------------------------------
 /** The constructor sets the number of (local) players to 0, since only AI
@@ -56,6 +66,9 @@ ProfileWorld::ProfileWorld()
     m_num_transparent  = 0;
     m_num_trans_effect = 0;
     m_num_calls        = 0;
+    m_ticks_done       = 0;
+    m_benchmark_start_time        = 0;
+    m_benchmark_start_allocations = 0;
 }   // ProfileWorld
 
 //-----------------------------------------------------------------------------
@@ -65,7 +78,9 @@ ProfileWorld::ProfileWorld()
  */
 ProfileWorld::~ProfileWorld()
 {
-    m_profile_mode = PROFILE_NONE;
+    // The benchmark runs several tracks, each with a new world
+    if (m_profile_mode != PROFILE_TICKS)
+        m_profile_mode = PROFILE_NONE;
 }
 
 //-----------------------------------------------------------------------------
@@ -92,6 +107,19 @@ void ProfileWorld::setProfileModeLaps(int laps)
     m_num_laps     = laps;
 }   // setProfileModeLaps
 
+//-----------------------------------------------------------------------------
+/** Enables the benchmark mode, which simulates a fixed number of ticks on
+ *  each benchmark track and writes the results as json. Like time based
+ *  profiling, the number of laps is set high enough to not finish earlier.
+ *  \param ticks The number of ticks to simulate on each track.
+ */
+void ProfileWorld::setProfileModeTicks(int ticks)
+{
+    m_profile_mode = PROFILE_TICKS;
+    m_num_laps     = 99999;
+    m_num_ticks    = ticks;
+}   // setProfileModeTicks
+
 //-----------------------------------------------------------------------------
 /** Creates a kart, having a certain position, starting location, and local
  *  and global player id (if applicable).
@@ -129,13 +157,16 @@ std::shared_ptr<AbstractKart> ProfileWorld::createKart
 
 //-----------------------------------------------------------------------------
 /** The race is over if either the requested number of laps have been done
- *  or the requested time is over.
+ *  or the requested time or number of ticks is over.
  */
 bool ProfileWorld::isRaceOver()
 {
     if(m_profile_mode==PROFILE_TIME)
         return getTime()>m_time;
 
+    if(m_profile_mode==PROFILE_TICKS)
+        return m_ticks_done>=m_num_ticks;
+
     if(m_profile_mode == PROFILE_LAPS )
     {
         // Now it must be laps based profiling:
@@ -152,8 +183,17 @@ bool ProfileWorld::isRaceOver()
  */
 void ProfileWorld::update(int ticks)
 {
+    if (m_profile_mode == PROFILE_TICKS && m_ticks_done == 0)
+    {
+        profiler.getTotalTimes(&m_benchmark_start_times);
+        AllocationCounter::enable(true);
+        m_benchmark_start_allocations = AllocationCounter::getCount();
+        m_benchmark_start_time = getTimeMilliseconds();
+    }
+
     StandardRace::update(ticks);
 
+    m_ticks_done += ticks;
     m_frame_count++;
     video::IVideoDriver *driver = irr_driver->getVideoDriver();
     io::IAttributes   *attr = irr_driver->getSceneManager()->getParameters();
@@ -174,11 +214,14 @@ void ProfileWorld::update(int ticks)
  */
 void ProfileWorld::enterRaceOverState()
 {
+    if (m_profile_mode == PROFILE_TICKS)
+        writeBenchmarkResults();
+
     // If in timing mode, the number of laps is way too high (which avoids
     // aborting too early). So in this case determine the maximum number
     // of laps and set this +1 as the number of laps to get more meaningful
     // time estimations.
-    if(m_profile_mode==PROFILE_TIME)
+    if(m_profile_mode==PROFILE_TIME || m_profile_mode==PROFILE_TICKS)
     {
         int max_laps = -2;
         for(unsigned int i=0; i<race_manager->getNumberOfKarts(); i++)
@@ -345,6 +388,131 @@ void ProfileWorld::enterRaceOverState()
                off_track_count, energy);
         Log::verbose("profile", "");
     }   // for it !=all_groups.end
-    delete this;
+    // In benchmark mode the world is deleted by main() after the main
+    // loop is left, before the next track is started.
+    if (m_profile_mode != PROFILE_TICKS)
+        delete this;
     main_loop->abort();
 }   // enterRaceOverState
+
+//-----------------------------------------------------------------------------
+/** Returns a hash of the simulated state of all karts and items. Running the
+ *  same benchmark twice with the same binary must give the same hash, so it
+ *  can be used to detect non-deterministic behaviour or changes of the
+ *  simulation results.
+ */
+uint64_t ProfileWorld::getStateHash() const
+{
+    // 64 bit FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto add = [&hash](const void* data, size_t size)
+    {
+        const uint8_t* p = (const uint8_t*)data;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= p[i];
+            hash *= 0x100000001b3ULL;
+        }
+    };
+    auto add_vec = [&add](const btVector3& v)
+    {
+        float f[3] = { v.getX(), v.getY(), v.getZ() };
+        add(f, sizeof(f));
+    };
+
+    add(&m_ticks_done, sizeof(m_ticks_done));
+    for (unsigned int i = 0; i < m_karts.size(); i++)
+    {
+        const AbstractKart* kart = m_karts[i].get();
+        const btTransform& t = kart->getTrans();
+        add_vec(t.getOrigin());
+        btQuaternion q = t.getRotation();
+        float rotation[4] = { q.getX(), q.getY(), q.getZ(), q.getW() };
+        add(rotation, sizeof(rotation));
+        add_vec(kart->getBody()->getLinearVelocity());
+        add_vec(kart->getBody()->getAngularVelocity());
+        float energy = kart->getEnergy();
+        add(&energy, sizeof(energy));
+        int powerup[2] = { (int)kart->getPowerup()->getType(),
+                           kart->getPowerup()->getNum() };
+        add(powerup, sizeof(powerup));
+        float distance = getOverallDistance(i);
+        add(&distance, sizeof(distance));
+    }
+
+    ItemManager* im = ItemManager::get();
+    for (unsigned int i = 0; i < im->getNumberOfItems(); i++)
+    {
+        const ItemState* item = im->getItem(i);
+        if (!item)
+            continue;
+        int state[2] = { (int)item->getType(), item->getTicksTillReturn() };
+        add(state, sizeof(state));
+        add_vec(item->getXYZ());
+    }
+    return hash;
+}   // getStateHash
+
+//-----------------------------------------------------------------------------
+/** Adds the results of the benchmark on this track to the results of all
+ *  previous tracks, and writes all of them to the benchmark file. The file
+ *  is rewritten after each track, so results are kept if a later track
+ *  fails to load.
+ */
+void ProfileWorld::writeBenchmarkResults()
+{
+    double time = (getTimeMilliseconds() - m_benchmark_start_time) * 0.001;
+    AllocationCounter::enable(false);
+    uint64_t allocations = AllocationCounter::getCount()
+                         - m_benchmark_start_allocations;
+    std::map<std::string, double> times;
+    profiler.getTotalTimes(&times);
+
+    std::ostringstream json;
+    json.setf(std::ios::fixed, std::ios::floatfield);
+    json.precision(3);
+    json << "{\"track\":\"" << Track::getCurrentTrack()->getIdent()
+         << "\",\"karts\":" << getNumKarts()
+         << ",\"ticks\":" << m_ticks_done
+         << ",\"time\":" << time
+         << ",\"ticks_per_second\":" << (time > 0 ? m_ticks_done / time : 0);
+    // Allocations are only counted with the cmake option COUNT_ALLOCATIONS
+    if (AllocationCounter::isAvailable())
+    {
+        json << ",\"allocations\":" << allocations
+             << ",\"allocations_per_tick\":"
+             << (m_ticks_done > 0 ? (double)allocations / m_ticks_done : 0);
+    }
+    json
+         << ",\"state_hash\":\"" << std::hex << std::setfill('0')
+         << std::setw(16) << getStateHash() << std::dec
+         << "\",\"subsystems_ms\":{";
+    bool first = true;
+    for (std::map<std::string, double>::iterator i = times.begin();
+         i != times.end(); i++)
+    {
+        double start = m_benchmark_start_times.count(i->first) > 0
+                     ? m_benchmark_start_times[i->first] : 0.0;
+        json << (first ? "" : ",") << "\"" << i->first << "\":"
+             << i->second - start;
+        first = false;
+    }
+    json << "}}";
+    Log::info("profile", "Benchmark: %s", json.str().c_str());
+    m_benchmark_results.push_back(json.str());
+
+    std::ofstream f(m_benchmark_file.c_str());
+    if (!f.is_open())
+    {
+        Log::error("profile", "Can't write benchmark results to '%s'.",
+                   m_benchmark_file.c_str());
+        return;
+    }
+    f << "{\"results\":[\n";
+    for (unsigned int i = 0; i < m_benchmark_results.size(); i++)
+    {
+        f << "  " << m_benchmark_results[i]
+          << (i + 1 < m_benchmark_results.size() ? ",\n" : "\n");
+    }
+    f << "]}\n";
+}   // writeBenchmarkResults
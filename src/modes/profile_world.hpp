@@ -20,6 +20,11 @@
 #define HEADER_PROFILE_WORLD_HPP
 
 #include "modes/standard_race.hpp"
+#include "utils/types.hpp"
+
+#include <map>
+#include <string>
+#include <vector>
 
 class Kart;
 
@@ -31,7 +36,8 @@ class ProfileWorld : public StandardRace
 {
 private:
     /** Profiling modes. */
-    enum        ProfileType {PROFILE_NONE, PROFILE_TIME, PROFILE_LAPS};
+    enum        ProfileType {PROFILE_NONE, PROFILE_TIME, PROFILE_LAPS,
+                             PROFILE_TICKS};
 
     /** If profiling is done, and if so, which mode. */
     static ProfileType m_profile_mode;
@@ -43,6 +49,27 @@ private:
     /** In time based profiling only: time to run. */
     static float m_time;
 
+    /** In ticks based profiling (benchmark mode) only: ticks to run. */
+    static int   m_num_ticks;
+
+    /** In benchmark mode: the tracks to run one after another. */
+    static std::vector<std::string> m_benchmark_tracks;
+
+    /** In benchmark mode: name of the json file the results are written to. */
+    static std::string m_benchmark_file;
+
+    /** In benchmark mode: the json results of all tracks run so far. */
+    static std::vector<std::string> m_benchmark_results;
+
+    /** Number of ticks simulated so far. */
+    int          m_ticks_done;
+
+    /** In benchmark mode: time, allocation count and profiler times at
+     *  the first update, so that loading the track is not included. */
+    double       m_benchmark_start_time;
+    uint64_t     m_benchmark_start_allocations;
+    std::map<std::string, double> m_benchmark_start_times;
+
     /** Return value of real time at start of race. */
     unsigned int m_start_time;
 
@@ -77,6 +104,9 @@ protected:
         int global_player_id, RaceManager::KartType type,
         PerPlayerDifficulty difficulty);
 
+    uint64_t             getStateHash() const;
+    void                 writeBenchmarkResults();
+
 public:
                           ProfileWorld();
     virtual              ~ProfileWorld();
@@ -88,6 +118,34 @@ public:
 
     static   void setProfileModeTime(float time);
     static   void setProfileModeLaps(int laps);
+    static   void setProfileModeTicks(int ticks);
+    // ------------------------------------------------------------------------
+    /** Sets the tracks to use in benchmark mode. */
+    static   void setBenchmarkTracks(const std::vector<std::string> &tracks)
+    {
+        m_benchmark_tracks = tracks;
+    }   // setBenchmarkTracks
+    // ------------------------------------------------------------------------
+    /** Returns the tracks to use in benchmark mode. */
+    static   const std::vector<std::string>& getBenchmarkTracks()
+    {
+        return m_benchmark_tracks;
+    }   // getBenchmarkTracks
+    // ------------------------------------------------------------------------
+    /** Sets the file the benchmark results are written to. */
+    static   void setBenchmarkFile(const std::string &file)
+    {
+        m_benchmark_file = file;
+    }   // setBenchmarkFile
+    // ------------------------------------------------------------------------
+    /** Returns the number of tracks for which the benchmark has finished. */
+    static   unsigned int getNumBenchmarkResults()
+    {
+        return (unsigned int)m_benchmark_results.size();
+    }   // getNumBenchmarkResults
+    // ------------------------------------------------------------------------
+    /** Returns true if a fixed number of ticks is run for benchmarking. */
+    static   bool isBenchmarkMode() { return m_profile_mode == PROFILE_TICKS; }
     // ------------------------------------------------------------------------
     /** Returns true if profile mode was selected. */
     static   bool isProfileMode() {return m_profile_mode!=PROFILE_NONE; }
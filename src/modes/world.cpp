@@ -35,6 +35,7 @@
 #include "io/file_manager.hpp"
 #include "input/device_manager.hpp"
 #include "input/keyboard_device.hpp"
+#include "items/item_manager.hpp"
 #include "items/projectile_manager.hpp"
 #include "karts/controller/battle_ai.hpp"
 #include "karts/ghost_kart.hpp"
@@ -76,6 +77,7 @@
 #include "tracks/track_manager.hpp"
 #include "tracks/track_object.hpp"
 #include "tracks/track_object_manager.hpp"
+#include "utils/benchmark.hpp"
 #include "utils/constants.hpp"
 #include "utils/profiler.hpp"
 #include "utils/translation.hpp"
@@ -272,6 +274,9 @@ void World::init()
     for (unsigned int i = 0; i < kart_amount; i++)
         initTeamArrows(m_karts[i].get());
 
+    if (Benchmark::isEnabled("item"))
+        ItemManager::get()->benchmarkItemHit();
+
     main_loop->renderGUI(7300);
 }   // init
 
@@ -1150,7 +1155,9 @@ void World::update(int ticks)
  */
 void World::updateTrack(int ticks)
 {
+    PROFILER_PUSH_CPU_MARKER("World::updateTrack", 0x20, 0x7F, 0x40);
     Track::getCurrentTrack()->update(ticks);
+    PROFILER_POP_CPU_MARKER();
 }   // update Track
 
 // ----------------------------------------------------------------------------
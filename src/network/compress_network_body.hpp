@@ -79,27 +79,26 @@ namespace CompressNetworkBody
         if (!bns)
             return;
 
-        bns->addFloat(x).addFloat(y).addFloat(z).addUInt32(compressed_q);
-        bns->addUInt16(lvx).addUInt16(lvy).addUInt16(lvz)
-            .addUInt16(avx).addUInt16(avy).addUInt16(avz);
+        const float xyz[3] = { x, y, z };
+        const uint16_t velocities[6] = { (uint16_t)lvx, (uint16_t)lvy,
+            (uint16_t)lvz, (uint16_t)avx, (uint16_t)avy, (uint16_t)avz };
+        bns->reserve(28);
+        bns->addFloats(xyz, 3).addUInt32(compressed_q)
+            .addUInt16s(velocities, 6);
     }   // compress
     // ------------------------------------------------------------------------
     /* Called during rewind when restoring data from game state. */
     inline void decompress(const BareNetworkString* bns,
                            btRigidBody* body, btMotionState* ms)
     {
-        float x = bns->getFloat();
-        float y = bns->getFloat();
-        float z = bns->getFloat();
+        float xyz[3];
+        bns->getFloats(xyz, 3);
         uint32_t compressed_q = bns->getUInt32();
-        short lvx = bns->getUInt16();
-        short lvy = bns->getUInt16();
-        short lvz = bns->getUInt16();
-        short avx = bns->getUInt16();
-        short avy = bns->getUInt16();
-        short avz = bns->getUInt16();
-        setCompressedValues(x, y, z, compressed_q, lvx, lvy, lvz, avx, avy,
-            avz, body, ms);
+        uint16_t v[6];
+        bns->getUInt16s(v, 6);
+        setCompressedValues(xyz[0], xyz[1], xyz[2], compressed_q,
+            (short)v[0], (short)v[1], (short)v[2],
+            (short)v[3], (short)v[4], (short)v[5], body, ms);
     }   // decompress
 };
 
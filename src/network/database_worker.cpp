@@ -0,0 +1,278 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifdef ENABLE_SQLITE3
+
+#include "network/database_worker.hpp"
+#include "network/protocol_manager.hpp"
+#include "utils/log.hpp"
+#include "utils/vs.hpp"
+
+// ----------------------------------------------------------------------------
+/** Opens a separate connection to the database for the worker thread. It
+ *  does not use the shared cache of the lobby connection, otherwise a write
+ *  transaction of the worker would make lobby queries fail with
+ *  SQLITE_LOCKED instead of waiting in the busy handler. If the database
+ *  can not be opened, all queries fail.
+ *  \param database_file The sqlite database file.
+ */
+DatabaseWorker::DatabaseWorker(const std::string& database_file)
+{
+    m_db = NULL;
+    int ret = sqlite3_open_v2(database_file.c_str(), &m_db,
+        SQLITE_OPEN_FULLMUTEX | SQLITE_OPEN_READWRITE, NULL);
+    if (ret != SQLITE_OK)
+    {
+        Log::error("DatabaseWorker", "Cannot open database: %s.",
+            sqlite3_errmsg(m_db));
+        sqlite3_close(m_db);
+        m_db = NULL;
+    }
+    else
+        sqlite3_busy_handler(m_db, busyHandler, NULL);
+    m_exit = false;
+    m_thread = std::thread(std::bind(&DatabaseWorker::mainLoop, this));
+}   // DatabaseWorker
+
+// ----------------------------------------------------------------------------
+/** Executes all remaining queries before the thread exits, callbacks which
+ *  have not been handled yet are discarded.
+ */
+DatabaseWorker::~DatabaseWorker()
+{
+    std::unique_lock<std::mutex> ul(m_queries_mutex);
+    m_exit = true;
+    ul.unlock();
+    m_queries_cv.notify_one();
+    if (m_thread.joinable())
+        m_thread.join();
+
+    for (auto& p : m_statements)
+        sqlite3_finalize(p.second);
+    m_statements.clear();
+    if (m_db)
+        sqlite3_close(m_db);
+}   // ~DatabaseWorker
+
+// ----------------------------------------------------------------------------
+/** Busy handler for the connections of the lobby and the worker, it lets
+ *  sqlite retry for at most 1 second if the database is locked.
+ */
+int DatabaseWorker::busyHandler(void* data, int retry)
+{
+    // Maximum 1 second total retry time
+    if (retry < 10)
+    {
+        sqlite3_sleep(100);
+        // Return non-zero to let caller retry again
+        return 1;
+    }
+    // Return zero to let caller return SQLITE_BUSY immediately
+    return 0;
+}   // busyHandler
+
+// ----------------------------------------------------------------------------
+/** Queues a query to be executed in the worker thread.
+ *  \param query The sql query, use ? parameters with bind_function if the
+ *         same query is used with different values, so that the prepared
+ *         statement can be reused.
+ *  \param bind_function Called in the worker thread to bind parameters.
+ *  \param row_function Called in the worker thread for each result row.
+ *  \param callback Called in handleCallbacks with true if the query was
+ *         executed without error.
+ */
+void DatabaseWorker::addQuery(const std::string& query,
+                              StatementFunction bind_function,
+                              StatementFunction row_function,
+                              std::function<void(bool)> callback)
+{
+    Query q;
+    q.m_query = query;
+    q.m_bind_function = bind_function;
+    q.m_row_function = row_function;
+    q.m_callback = callback;
+    std::unique_lock<std::mutex> ul(m_queries_mutex);
+    m_queries.push_back(std::move(q));
+    ul.unlock();
+    m_queries_cv.notify_one();
+}   // addQuery
+
+// ----------------------------------------------------------------------------
+/** Calls the callbacks of all executed queries, in the order the queries
+ *  were added.
+ */
+void DatabaseWorker::handleCallbacks()
+{
+    std::vector<std::function<void()> > callbacks;
+    std::unique_lock<std::mutex> ul(m_callbacks_mutex);
+    std::swap(callbacks, m_callbacks);
+    ul.unlock();
+    for (auto& callback : callbacks)
+        callback();
+}   // handleCallbacks
+
+// ----------------------------------------------------------------------------
+void DatabaseWorker::mainLoop()
+{
+    VS::setThreadName("DatabaseWorker");
+    std::vector<Query> queries;
+    while (true)
+    {
+        std::unique_lock<std::mutex> ul(m_queries_mutex);
+        m_queries_cv.wait(ul, [this]()
+            {
+                return m_exit || !m_queries.empty();
+            });
+        if (m_queries.empty())
+            break;
+        std::swap(queries, m_queries);
+        ul.unlock();
+
+        if (!m_db)
+        {
+            std::unique_lock<std::mutex> lock(m_callbacks_mutex);
+            bool has_callbacks = false;
+            for (Query& q : queries)
+            {
+                if (!q.m_callback)
+                    continue;
+                m_callbacks.push_back(std::bind(q.m_callback, false));
+                has_callbacks = true;
+            }
+            lock.unlock();
+            queries.clear();
+            if (has_callbacks)
+                wakeUpProtocolManager();
+            continue;
+        }
+
+        // Write all queued queries in one transaction, so only one journal
+        // sync is needed for all of them
+        bool transaction = queries.size() > 1 &&
+            sqlite3_exec(m_db, "BEGIN;", NULL, NULL, NULL) == SQLITE_OK;
+        std::vector<std::pair<std::function<void(bool)>, bool> > results;
+        for (Query& q : queries)
+        {
+            bool success = executeQuery(q);
+            if (q.m_callback)
+                results.emplace_back(q.m_callback, success);
+        }
+        if (transaction &&
+            sqlite3_exec(m_db, "COMMIT;", NULL, NULL, NULL) != SQLITE_OK)
+        {
+            Log::error("DatabaseWorker", "Error committing transaction: %s",
+                sqlite3_errmsg(m_db));
+            sqlite3_exec(m_db, "ROLLBACK;", NULL, NULL, NULL);
+            for (auto& r : results)
+                r.second = false;
+        }
+        queries.clear();
+
+        if (!results.empty())
+        {
+            std::unique_lock<std::mutex> lock(m_callbacks_mutex);
+            for (auto& r : results)
+                m_callbacks.push_back(std::bind(r.first, r.second));
+            lock.unlock();
+            wakeUpProtocolManager();
+        }
+    }
+}   // mainLoop
+
+// ----------------------------------------------------------------------------
+/** The callbacks are handled in the asynchronous update of the server lobby,
+ *  so wake up the protocol manager instead of waiting for its next periodic
+ *  update.
+ */
+void DatabaseWorker::wakeUpProtocolManager()
+{
+    if (auto pm = ProtocolManager::lock())
+        pm->wakeUp();
+}   // wakeUpProtocolManager
+
+// ----------------------------------------------------------------------------
+/** Returns a prepared statement for the query, either from the cache or
+ *  newly prepared (and cached if there is space). Returns NULL on error.
+ */
+sqlite3_stmt* DatabaseWorker::getStatement(const std::string& query,
+                                           bool* cached)
+{
+    auto it = m_statements.find(query);
+    if (it != m_statements.end())
+    {
+        *cached = true;
+        return it->second;
+    }
+
+    sqlite3_stmt* stmt = NULL;
+    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
+    if (ret != SQLITE_OK)
+    {
+        Log::error("DatabaseWorker",
+            "Error preparing database for query %s: %s",
+            query.c_str(), sqlite3_errmsg(m_db));
+        sqlite3_finalize(stmt);
+        *cached = false;
+        return NULL;
+    }
+    // Only queries with parameters are reused, others have their values
+    // written in the query string
+    *cached = query.find('?') != std::string::npos &&
+        m_statements.size() < MAX_CACHED_STATEMENTS;
+    if (*cached)
+        m_statements[query] = stmt;
+    return stmt;
+}   // getStatement
+
+// ----------------------------------------------------------------------------
+/** Executes a query in the worker thread, returns true if no error occurs.
+ */
+bool DatabaseWorker::executeQuery(const Query& query)
+{
+    bool cached = false;
+    sqlite3_stmt* stmt = getStatement(query.m_query, &cached);
+    if (!stmt)
+        return false;
+
+    if (query.m_bind_function)
+        query.m_bind_function(stmt);
+    int ret = sqlite3_step(stmt);
+    while (ret == SQLITE_ROW)
+    {
+        if (query.m_row_function)
+            query.m_row_function(stmt);
+        ret = sqlite3_step(stmt);
+    }
+    bool success = ret == SQLITE_DONE;
+    if (!success)
+    {
+        Log::error("DatabaseWorker", "Error executing query %s: %s",
+            query.m_query.c_str(), sqlite3_errmsg(m_db));
+    }
+
+    if (cached)
+    {
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+    }
+    else
+        sqlite3_finalize(stmt);
+    return success;
+}   // executeQuery
+
+#endif // ENABLE_SQLITE3
@@ -0,0 +1,120 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifdef ENABLE_SQLITE3
+
+#ifndef HEADER_DATABASE_WORKER_HPP
+#define HEADER_DATABASE_WORKER_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sqlite3.h>
+
+/** \ingroup network
+ *  Executes sqlite queries for the server lobby in a separate thread, so
+ *  that the lobby never waits for disk I/O or the busy handler. The worker
+ *  uses its own connection to the database, so its transactions never
+ *  include queries of the lobby thread. All queries
+ *  queued while the worker was busy are executed in a single transaction,
+ *  and prepared statements are cached by their query string. Results are
+ *  returned with callbacks, which are called in the thread which calls
+ *  handleCallbacks(). The protocol manager is woken up when callbacks are
+ *  queued, so the server lobby handles them in its next asynchronous
+ *  update.
+ */
+class DatabaseWorker : public NoCopy
+{
+public:
+    typedef std::function<void(sqlite3_stmt* stmt)> StatementFunction;
+
+private:
+    /** Maximum number of cached prepared statements, queries without
+     *  parameters are finalized after use. */
+    static const unsigned MAX_CACHED_STATEMENTS = 64;
+
+    struct Query
+    {
+        std::string m_query;
+        /** Called before the statement is executed to bind parameters. */
+        StatementFunction m_bind_function;
+        /** Called in the worker thread for each result row. */
+        StatementFunction m_row_function;
+        /** Called in handleCallbacks with true if no error occurred. */
+        std::function<void(bool)> m_callback;
+    };
+
+    /** Connection only used by the worker thread (after the constructor). */
+    sqlite3* m_db;
+
+    /** Queries waiting to be executed, guarded by m_queries_mutex. */
+    std::vector<Query> m_queries;
+
+    std::mutex m_queries_mutex;
+
+    std::condition_variable m_queries_cv;
+
+    /** Set in destructor to let the thread exit after all queries are
+     *  executed, guarded by m_queries_mutex. */
+    bool m_exit;
+
+    /** Callbacks of executed queries, guarded by m_callbacks_mutex. */
+    std::vector<std::function<void()> > m_callbacks;
+
+    std::mutex m_callbacks_mutex;
+
+    /** Cached prepared statements, only used by the worker thread. */
+    std::map<std::string, sqlite3_stmt*> m_statements;
+
+    std::thread m_thread;
+
+    // ------------------------------------------------------------------------
+    void mainLoop();
+    // ------------------------------------------------------------------------
+    bool executeQuery(const Query& query);
+    // ------------------------------------------------------------------------
+    sqlite3_stmt* getStatement(const std::string& query, bool* cached);
+    // ------------------------------------------------------------------------
+    void wakeUpProtocolManager();
+
+public:
+    DatabaseWorker(const std::string& database_file);
+    // ------------------------------------------------------------------------
+    ~DatabaseWorker();
+    // ------------------------------------------------------------------------
+    void addQuery(const std::string& query,
+                  StatementFunction bind_function = nullptr,
+                  StatementFunction row_function = nullptr,
+                  std::function<void(bool)> callback = nullptr);
+    // ------------------------------------------------------------------------
+    void handleCallbacks();
+    // ------------------------------------------------------------------------
+    static int busyHandler(void* data, int retry);
+
+};   // class DatabaseWorker
+
+#endif // HEADER_DATABASE_WORKER_HPP
+
+#endif // ENABLE_SQLITE3
@@ -0,0 +1,204 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/ip_ban_index.hpp"
+
+#include <algorithm>
+#include <assert.h>
+
+// ----------------------------------------------------------------------------
+/** Replaces all ban ranges, used when the table is (re)loaded. */
+void IPBanIndex::set(std::vector<Entry>&& entries)
+{
+    m_entries = std::move(entries);
+    std::stable_sort(m_entries.begin(), m_entries.end(),
+        [](const Entry& a, const Entry& b)
+        {
+            return a.m_ip_start < b.m_ip_start;
+        });
+    buildSegments();
+}   // set
+
+// ----------------------------------------------------------------------------
+/** Adds a single ban range, used when the server itself bans an IP. */
+void IPBanIndex::add(const Entry& entry)
+{
+    auto it = std::upper_bound(m_entries.begin(), m_entries.end(),
+        entry.m_ip_start, [](uint32_t ip, const Entry& e)
+        {
+            return ip < e.m_ip_start;
+        });
+    m_entries.insert(it, entry);
+    buildSegments();
+}   // add
+
+// ----------------------------------------------------------------------------
+/** Splits the IP space at the start and after the end of each range, and
+ *  stores for each resulting segment the ranges containing it.
+ */
+void IPBanIndex::buildSegments()
+{
+    m_segments.clear();
+    m_segment_entries.clear();
+
+    // 64 bit, since the end of a range ending at 255.255.255.255 is 2^32
+    std::vector<uint64_t> bounds;
+    bounds.reserve(m_entries.size() * 2);
+    for (const Entry& e : m_entries)
+    {
+        bounds.push_back(e.m_ip_start);
+        bounds.push_back((uint64_t)e.m_ip_end + 1);
+    }
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+    if (bounds.size() < 2)
+        return;
+
+    // Ranges containing segment [bounds[i], bounds[i + 1])
+    std::vector<std::vector<unsigned> > containing(bounds.size() - 1);
+    for (unsigned i = 0; i < m_entries.size(); i++)
+    {
+        const Entry& e = m_entries[i];
+        if (e.m_ip_end < e.m_ip_start)
+            continue;
+        size_t first = std::lower_bound(bounds.begin(), bounds.end(),
+            (uint64_t)e.m_ip_start) - bounds.begin();
+        size_t last = std::lower_bound(bounds.begin(), bounds.end(),
+            (uint64_t)e.m_ip_end + 1) - bounds.begin();
+        for (size_t j = first; j < last; j++)
+            containing[j].push_back(i);
+    }
+
+    for (unsigned i = 0; i < containing.size(); i++)
+    {
+        if (containing[i].empty())
+            continue;
+        Segment segment;
+        segment.m_ip_start = (uint32_t)bounds[i];
+        segment.m_ip_end = (uint32_t)(bounds[i + 1] - 1);
+        segment.m_first = (unsigned)m_segment_entries.size();
+        segment.m_count = (unsigned)containing[i].size();
+        m_segments.push_back(segment);
+        m_segment_entries.insert(m_segment_entries.end(),
+            containing[i].begin(), containing[i].end());
+    }
+}   // buildSegments
+
+// ----------------------------------------------------------------------------
+/** Returns an active ban range containing the IP, or NULL if it is not
+ *  banned. If several active ranges contain it, the one with the highest
+ *  start IP is returned.
+ *  \param ip The IP to test.
+ *  \param now Current time since epoch in seconds.
+ */
+const IPBanIndex::Entry* IPBanIndex::find(uint32_t ip, int64_t now) const
+{
+    // The segment before it is the only one which can contain ip
+    auto it = std::upper_bound(m_segments.begin(), m_segments.end(), ip,
+        [](uint32_t ip, const Segment& s)
+        {
+            return ip < s.m_ip_start;
+        });
+    if (it == m_segments.begin())
+        return NULL;
+    const Segment& segment = *(it - 1);
+    if (segment.m_ip_end < ip)
+        return NULL;
+    for (unsigned i = segment.m_count; i > 0; i--)
+    {
+        const Entry& e = m_entries[m_segment_entries[segment.m_first + i - 1]];
+        if (e.isActive(now))
+            return &e;
+    }
+    return NULL;
+}   // find
+
+// ----------------------------------------------------------------------------
+void IPBanIndex::unitTesting()
+{
+    auto entry = [](uint32_t ip_start, uint32_t ip_end, int64_t start,
+                    int64_t expired)
+        {
+            Entry e;
+            e.m_row_id = 0;
+            e.m_ip_start = ip_start;
+            e.m_ip_end = ip_end;
+            e.m_starting_time = start;
+            e.m_expired_time = expired;
+            return e;
+        };
+
+    IPBanIndex index;
+    assert(index.find(100, 1000) == NULL);
+
+    std::vector<Entry> entries;
+    entries.push_back(entry(200, 300, 0, -1));
+    entries.push_back(entry(10, 1000, 0, 500));
+    entries.push_back(entry(50, 50, 0, -1));
+    index.set(std::move(entries));
+    assert(index.size() == 3);
+
+    // Single IP range
+    assert(index.find(50, 1000) != NULL);
+    assert(index.find(50, 1000)->m_ip_end == 50);
+    assert(index.find(49, 1000) == NULL);
+    assert(index.find(51, 1000) == NULL);
+
+    // Range covered by an expired range
+    assert(index.find(200, 1000)->m_ip_start == 200);
+    assert(index.find(300, 1000)->m_ip_start == 200);
+    assert(index.find(301, 1000) == NULL);
+    assert(index.find(199, 1000) == NULL);
+
+    // Large range still active, found behind later ranges
+    assert(index.find(999, 400) != NULL);
+    assert(index.find(999, 400)->m_ip_start == 10);
+    assert(index.find(1001, 400) == NULL);
+    assert(index.find(9, 400) == NULL);
+
+    // Not started yet
+    index.add(entry(2000, 2000, 1500, -1));
+    assert(index.find(2000, 1000) == NULL);
+    assert(index.find(2000, 1501) != NULL);
+
+    // Add in the middle
+    index.add(entry(5, 5, 0, -1));
+    assert(index.size() == 5);
+    assert(index.find(5, 1000) != NULL);
+    assert(index.find(999, 400)->m_ip_start == 10);
+    assert(index.find(50, 1000)->m_ip_end == 50);
+    assert(index.find(0xffffffff, 1000) == NULL);
+
+    // Ranges up to the last IP, and a wide expired range in front of many
+    // small ranges
+    entries.clear();
+    entries.push_back(entry(0, 0xffffffff, 0, 500));
+    for (uint32_t ip = 1000; ip < 2000; ip += 10)
+        entries.push_back(entry(ip, ip + 4, 0, -1));
+    entries.push_back(entry(0xfffffff0, 0xffffffff, 0, -1));
+    index.set(std::move(entries));
+    assert(index.find(1000, 1000)->m_ip_start == 1000);
+    assert(index.find(1004, 1000)->m_ip_start == 1000);
+    assert(index.find(1005, 1000) == NULL);
+    assert(index.find(1005, 400)->m_ip_start == 0);
+    assert(index.find(1994, 1000)->m_ip_start == 1990);
+    assert(index.find(0xffffffff, 1000)->m_ip_start == 0xfffffff0);
+    assert(index.find(0xffffffef, 1000) == NULL);
+    assert(index.find(0, 1000) == NULL);
+    assert(index.find(0, 400)->m_ip_end == 0xffffffff);
+}   // unitTesting
@@ -0,0 +1,92 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_IP_BAN_INDEX_HPP
+#define HEADER_IP_BAN_INDEX_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/** \ingroup network
+ *  An in-memory copy of the IP ban table, so that a connecting peer can be
+ *  tested without a database query. The IP space is split at the start and
+ *  end of all ban ranges into disjoint segments, each of them storing the
+ *  ranges which contain it. A lookup is a binary search for the segment,
+ *  followed by a test of the (usually one) ranges of the segment, so it
+ *  does not depend on the number of ranges or how wide they are.
+ */
+class IPBanIndex
+{
+public:
+    struct Entry
+    {
+        int m_row_id;
+        uint32_t m_ip_start;
+        uint32_t m_ip_end;
+        /** Time since epoch in seconds when the ban starts. */
+        int64_t m_starting_time;
+        /** Time since epoch in seconds when the ban expires, -1 if never. */
+        int64_t m_expired_time;
+        std::string m_reason;
+        std::string m_description;
+        // --------------------------------------------------------------------
+        bool isActive(int64_t now) const
+        {
+            return now > m_starting_time &&
+                (m_expired_time == -1 || m_expired_time > now);
+        }
+    };
+
+private:
+    /** A part of the IP space in which all IPs are in the same ranges. */
+    struct Segment
+    {
+        uint32_t m_ip_start;
+        uint32_t m_ip_end;
+        /** The ranges containing this segment are m_segment_entries[m_first]
+         *  to m_segment_entries[m_first + m_count - 1], sorted by start IP. */
+        unsigned m_first;
+        unsigned m_count;
+    };
+
+    /** All ban ranges, sorted by m_ip_start. */
+    std::vector<Entry> m_entries;
+
+    /** All segments which are in at least one range, sorted by IP. */
+    std::vector<Segment> m_segments;
+
+    /** Indices into m_entries of the ranges containing each segment. */
+    std::vector<unsigned> m_segment_entries;
+
+    void buildSegments();
+
+public:
+    void set(std::vector<Entry>&& entries);
+    // ------------------------------------------------------------------------
+    void add(const Entry& entry);
+    // ------------------------------------------------------------------------
+    const Entry* find(uint32_t ip, int64_t now) const;
+    // ------------------------------------------------------------------------
+    unsigned size() const                   { return (unsigned)m_entries.size(); }
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+
+};   // class IPBanIndex
+
+#endif // HEADER_IP_BAN_INDEX_HPP
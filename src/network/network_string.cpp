@@ -17,6 +17,8 @@
 
 #include "network/network_string.hpp"
 
+#include "utils/benchmark.hpp"
+#include "utils/log.hpp"
 #include "utils/string_utils.hpp"
 
 #include <algorithm>   // for std::min
@@ -57,8 +59,286 @@ void NetworkString::unitTesting()
     std::string log = slog.getLogMessage();
     assert(log=="0x000 | 00 01 02 03 04 05 06 07  08 09 0a 0b 0c 0d 0e 0f   | ................\n"
                 "0x010 | 10 11 12 13 14 15 16 17  18 19 1a 1b               | ............\n");
+
+    // Values are sent in big endian byte order
+    BareNetworkString sbe;
+    sbe.addUInt16(0x1234).addUInt32(0x56789abc)
+       .addUInt64(0x0102030405060708ULL).addFloat(1.0f).addInt24(-2);
+    assert(sbe.getLogMessage() ==
+        "0x000 | 12 34 56 78 9a bc 01 02  03 04 05 06 07 08 3f 80   | .4Vx..........?.\n"
+        "0x010 | 00 00 ff ff fe                                     | .....\n");
+    assert(sbe.getUInt16() == 0x1234);
+    assert(sbe.getUInt32() == 0x56789abc);
+    assert(sbe.getUInt64() == 0x0102030405060708ULL);
+    assert(sbe.getFloat() == 1.0f);
+    assert(sbe.getInt24() == -2);
+    assert(sbe.size() == 0);
+
+    // Reading past the end throws
+    try
+    {
+        sbe.getUInt16();
+        assert(false);
+    }
+    catch (std::out_of_range&)
+    {
+    }
+
+    // Batch functions give the same bytes as adding single values
+    const float f[3] = { 1.5f, -2.25f, 1000.0f };
+    const uint16_t h[3] = { 0x3c00, 0xc000, 0x7bff };
+    BareNetworkString single, batch;
+    single.addFloat(f[0]).addFloat(f[1]).addFloat(f[2])
+          .addUInt16(h[0]).addUInt16(h[1]).addUInt16(h[2])
+          .addFloat(1.0f).addFloat(2.0f).addFloat(3.0f)
+          .addFloat(0.0f).addFloat(0.5f).addFloat(-0.5f).addFloat(1.0f);
+    batch.reserve(50).addFloats(f, 3).addUInt16s(h, 3)
+         .add(Vec3(1.0f, 2.0f, 3.0f))
+         .add(btQuaternion(0.0f, 0.5f, -0.5f, 1.0f));
+    assert(single.getTotalSize() == batch.getTotalSize());
+    assert(memcmp(single.getData(), batch.getData(),
+                  single.getTotalSize()) == 0);
+    float f_out[3];
+    uint16_t h_out[3];
+    batch.getFloats(f_out, 3);
+    batch.getUInt16s(h_out, 3);
+    assert(memcmp(f, f_out, sizeof(f)) == 0);
+    assert(memcmp(h, h_out, sizeof(h)) == 0);
+    assert(batch.getVec3() == Vec3(1.0f, 2.0f, 3.0f));
+    assert(batch.getQuat() == btQuaternion(0.0f, 0.5f, -0.5f, 1.0f));
+    assert(batch.size() == 0);
 }   // unitTesting
 
+// ----------------------------------------------------------------------------
+namespace
+{
+    /** The previous implementation of the BareNetworkString functions, which
+     *  adds and reads one byte at a time. Used to show the difference in
+     *  NetworkString::benchmark(). */
+    class PerByteString
+    {
+    public:
+        std::vector<uint8_t> m_buffer;
+        mutable int m_current_offset;
+        PerByteString() : m_current_offset(0) { m_buffer.reserve(16); }
+        // --------------------------------------------------------------------
+        void addUInt8(uint8_t v) { m_buffer.push_back(v); }
+        // --------------------------------------------------------------------
+        void addUInt16(uint16_t v)
+        {
+            m_buffer.push_back((v >> 8) & 0xff);
+            m_buffer.push_back(v & 0xff);
+        }   // addUInt16
+        // --------------------------------------------------------------------
+        void addUInt32(uint32_t v)
+        {
+            m_buffer.push_back((v >> 24) & 0xff);
+            m_buffer.push_back((v >> 16) & 0xff);
+            m_buffer.push_back((v >>  8) & 0xff);
+            m_buffer.push_back( v        & 0xff);
+        }   // addUInt32
+        // --------------------------------------------------------------------
+        void addFloat(float f)
+        {
+            uint32_t u;
+            memcpy(&u, &f, 4);
+            addUInt32(u);
+        }   // addFloat
+        // --------------------------------------------------------------------
+        template<typename T, size_t n>
+        T get() const
+        {
+            int a = n;
+            T result = 0;
+            m_current_offset += n;
+            int offset = m_current_offset -1;
+            while (a--)
+            {
+                result <<= 8;
+                result += m_buffer.at(offset - a);
+            }
+            return result;
+        }   // get
+        // --------------------------------------------------------------------
+        uint8_t getUInt8() const { return m_buffer.at(m_current_offset++); }
+        uint16_t getUInt16() const { return get<uint16_t, 2>(); }
+        uint32_t getUInt32() const { return get<uint32_t, 4>(); }
+        // --------------------------------------------------------------------
+        float getFloat() const
+        {
+            uint32_t u = getUInt32();
+            float f;
+            memcpy(&f, &u, 4);
+            return f;
+        }   // getFloat
+    };   // PerByteString
+
+    // ------------------------------------------------------------------------
+    /** The values of a kart state, similar to what KartRewinder::saveState
+     *  sends for a kart which drives without animation. */
+    struct KartState
+    {
+        uint16_t m_controls[2];
+        uint8_t  m_flags[3];
+        uint16_t m_ticks[3];
+        float    m_energy;
+        float    m_xyz[3];
+        uint32_t m_rotation;
+        uint16_t m_velocities[6];
+        float    m_impulse[3];
+        uint16_t m_max_speed[6];
+        float    m_skid_factor;
+    };   // KartState
+
+    // ------------------------------------------------------------------------
+    void encodePerByte(const KartState& k, PerByteString* s)
+    {
+        s->addUInt16(k.m_controls[0]);
+        s->addUInt16(k.m_controls[1]);
+        for (unsigned i = 0; i < 3; i++)
+            s->addUInt8(k.m_flags[i]);
+        for (unsigned i = 0; i < 3; i++)
+            s->addUInt16(k.m_ticks[i]);
+        s->addFloat(k.m_energy);
+        for (unsigned i = 0; i < 3; i++)
+            s->addFloat(k.m_xyz[i]);
+        s->addUInt32(k.m_rotation);
+        for (unsigned i = 0; i < 6; i++)
+            s->addUInt16(k.m_velocities[i]);
+        for (unsigned i = 0; i < 3; i++)
+            s->addFloat(k.m_impulse[i]);
+        for (unsigned i = 0; i < 6; i++)
+            s->addUInt16(k.m_max_speed[i]);
+        s->addFloat(k.m_skid_factor);
+    }   // encodePerByte
+
+    // ------------------------------------------------------------------------
+    void decodePerByte(const PerByteString& s, KartState* k)
+    {
+        k->m_controls[0] = s.getUInt16();
+        k->m_controls[1] = s.getUInt16();
+        for (unsigned i = 0; i < 3; i++)
+            k->m_flags[i] = s.getUInt8();
+        for (unsigned i = 0; i < 3; i++)
+            k->m_ticks[i] = s.getUInt16();
+        k->m_energy = s.getFloat();
+        for (unsigned i = 0; i < 3; i++)
+            k->m_xyz[i] = s.getFloat();
+        k->m_rotation = s.getUInt32();
+        for (unsigned i = 0; i < 6; i++)
+            k->m_velocities[i] = s.getUInt16();
+        for (unsigned i = 0; i < 3; i++)
+            k->m_impulse[i] = s.getFloat();
+        for (unsigned i = 0; i < 6; i++)
+            k->m_max_speed[i] = s.getUInt16();
+        k->m_skid_factor = s.getFloat();
+    }   // decodePerByte
+
+    // ------------------------------------------------------------------------
+    void encode(const KartState& k, BareNetworkString* s)
+    {
+        s->addUInt16s(k.m_controls, 2);
+        for (unsigned i = 0; i < 3; i++)
+            s->addUInt8(k.m_flags[i]);
+        s->addUInt16s(k.m_ticks, 3).addFloat(k.m_energy)
+          .addFloats(k.m_xyz, 3).addUInt32(k.m_rotation)
+          .addUInt16s(k.m_velocities, 6).addFloats(k.m_impulse, 3)
+          .addUInt16s(k.m_max_speed, 6).addFloat(k.m_skid_factor);
+    }   // encode
+
+    // ------------------------------------------------------------------------
+    void decode(const BareNetworkString& s, KartState* k)
+    {
+        s.getUInt16s(k->m_controls, 2);
+        for (unsigned i = 0; i < 3; i++)
+            k->m_flags[i] = s.getUInt8();
+        s.getUInt16s(k->m_ticks, 3);
+        k->m_energy = s.getFloat();
+        s.getFloats(k->m_xyz, 3);
+        k->m_rotation = s.getUInt32();
+        s.getUInt16s(k->m_velocities, 6);
+        s.getFloats(k->m_impulse, 3);
+        s.getUInt16s(k->m_max_speed, 6);
+        k->m_skid_factor = s.getFloat();
+    }   // decode
+}   // namespace
+
+// ----------------------------------------------------------------------------
+/** Compares encoding and decoding the state of 8 karts one byte at a time
+ *  (as done before) with the current functions, and prints the time needed.
+ *  Both must give the same bytes. Enabled with
+ *  --micro-benchmark=network-string.
+ */
+void NetworkString::benchmark()
+{
+    const unsigned int num_karts = 8;
+    const unsigned int count = 200000;
+    // Clear the padding bytes, so that decoded states can be compared
+    // with memcmp
+    KartState karts[num_karts], decoded[num_karts];
+    memset(karts, 0, sizeof(karts));
+    memset(decoded, 0, sizeof(decoded));
+    for (unsigned int i = 0; i < num_karts; i++)
+    {
+        KartState& k = karts[i];
+        k.m_controls[0] = (uint16_t)(1000 * i);
+        k.m_controls[1] = (uint16_t)(7 * i);
+        for (unsigned j = 0; j < 3; j++)
+        {
+            k.m_flags[j] = (uint8_t)(i + j);
+            k.m_ticks[j] = (uint16_t)(100 * i + j);
+            k.m_xyz[j] = 10.5f * i - 3.25f * j;
+            k.m_impulse[j] = 0.5f * j;
+        }
+        k.m_energy = 2.5f * i;
+        k.m_rotation = 0x12345678 + i;
+        for (unsigned j = 0; j < 6; j++)
+        {
+            k.m_velocities[j] = (uint16_t)(0x3c00 + i * 16 + j);
+            k.m_max_speed[j] = (uint16_t)(i * 6 + j);
+        }
+        k.m_skid_factor = 1.0f + 0.1f * i;
+    }
+
+    PerByteString per_byte;
+    BareNetworkString batch;
+    Benchmark::Timer per_byte_time;
+    for (unsigned int n = 0; n < count; n++)
+    {
+        per_byte.m_buffer.clear();
+        per_byte.m_current_offset = 0;
+        for (unsigned int i = 0; i < num_karts; i++)
+            encodePerByte(karts[i], &per_byte);
+        for (unsigned int i = 0; i < num_karts; i++)
+            decodePerByte(per_byte, &decoded[i]);
+    }
+    per_byte_time.stop();
+    bool same = memcmp(decoded, karts, sizeof(karts)) == 0;
+
+    memset(decoded, 0, sizeof(decoded));
+    Benchmark::Timer batch_time;
+    for (unsigned int n = 0; n < count; n++)
+    {
+        batch.getBuffer().clear();
+        batch.reset();
+        batch.reserve(num_karts * sizeof(KartState));
+        for (unsigned int i = 0; i < num_karts; i++)
+            encode(karts[i], &batch);
+        for (unsigned int i = 0; i < num_karts; i++)
+            decode(batch, &decoded[i]);
+    }
+    batch_time.stop();
+    same = same && memcmp(decoded, karts, sizeof(karts)) == 0 &&
+        per_byte.m_buffer == batch.getBuffer();
+
+    Log::info("NetworkString", "Benchmark of %u states with %u karts "
+        "(%u bytes): %s.", count, num_karts, batch.getTotalSize(),
+        same ? "same result" : "DIFFERENT RESULT");
+    Log::info("NetworkString", "Encode and decode: one byte at a time "
+        "%f ms, batch %f ms.", per_byte_time.getTotal(),
+        batch_time.getTotal());
+}   // benchmark
+
 // ============================================================================
 
 // ----------------------------------------------------------------------------
@@ -91,7 +371,7 @@ BareNetworkString& BareNetworkString::encodeString(const irr::core::stringw &val
  */
 int BareNetworkString::decodeString(std::string *out) const
 {
-    uint8_t len = get<uint8_t>();
+    uint8_t len = getUInt8();
     *out = getString(len);
     return len+1;
 }    // decodeString
@@ -32,9 +32,11 @@
 
 #include "irrString.h"
 
+#include <algorithm>
 #include <assert.h>
 #include <stdarg.h>
 #include <stdexcept>
+#include <stdlib.h>
 #include <string>
 #include <string.h>
 #include <vector>
@@ -88,35 +90,131 @@ protected:
     /** Adds a std::string. Internal use only. */
     BareNetworkString& addString(const std::string& value)
     {
-        for (unsigned int i = 0; i < value.size(); i++)
-            m_buffer.push_back((uint8_t)(value[i]));
+        m_buffer.insert(m_buffer.end(), value.begin(), value.end());
         return *this;
     }   // addString
 
     // ------------------------------------------------------------------------
-    /** Template to get n bytes from a buffer into a single data type. */
-    template<typename T, size_t n>
-    T get() const
+    /** Appends n bytes to the buffer and returns a pointer to them, so that
+     *  several values can be written with a single size check. */
+    uint8_t* grow(unsigned int n)
     {
-        int a = n;
-        T result = 0;
-        m_current_offset += n;
-        int offset = m_current_offset -1;
-        while (a--)
-        {
-            result <<= 8; // offset one byte
-                          // add the data to result
-            result += m_buffer.at(offset - a);
-        }
-        return result;
-    }   // get(int pos)
+        const size_t size = m_buffer.size();
+        m_buffer.resize(size + n);
+        return m_buffer.data() + size;
+    }   // grow
+
     // ------------------------------------------------------------------------
-    /** Another function for n == 1 to surpress warnings in clang. */
-    template<typename T>
-    T get() const
+    /** Returns a pointer to the next n unread bytes and marks them as read.
+     *  Throws std::out_of_range (like std::vector::at) if less than n bytes
+     *  are left. */
+    const uint8_t* consume(unsigned int n) const
     {
-        return m_buffer.at(m_current_offset++);
-    }   // get
+        if (m_current_offset < 0 ||
+            m_current_offset + (int)n > (int)m_buffer.size())
+            throw std::out_of_range("BareNetworkString read out of range.");
+        const uint8_t* p = m_buffer.data() + m_current_offset;
+        m_current_offset += n;
+        return p;
+    }   // consume
+
+    // ------------------------------------------------------------------------
+    // Conversion between host and network (big endian) byte order. On little
+    // endian systems a value is stored with one byte swap and one (unaligned)
+    // memcpy instead of one byte at a time.
+    static uint16_t toNetwork16(uint16_t v)
+    {
+#if defined(_MSC_VER)
+        return _byteswap_ushort(v);
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return v;
+#else
+        return (uint16_t)((v << 8) | (v >> 8));
+#endif
+    }   // toNetwork16
+    // ------------------------------------------------------------------------
+    static uint32_t toNetwork32(uint32_t v)
+    {
+#if defined(_MSC_VER)
+        return _byteswap_ulong(v);
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return v;
+#elif defined(__GNUC__)
+        return __builtin_bswap32(v);
+#else
+        return  (v >> 24)               | ((v >>  8) & 0x0000ff00) |
+               ((v <<  8) & 0x00ff0000) |  (v << 24);
+#endif
+    }   // toNetwork32
+    // ------------------------------------------------------------------------
+    static uint64_t toNetwork64(uint64_t v)
+    {
+#if defined(_MSC_VER)
+        return _byteswap_uint64(v);
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return v;
+#elif defined(__GNUC__)
+        return __builtin_bswap64(v);
+#else
+        return ((uint64_t)toNetwork32((uint32_t)v) << 32) |
+                toNetwork32((uint32_t)(v >> 32));
+#endif
+    }   // toNetwork64
+    // ------------------------------------------------------------------------
+    static void store16(uint8_t* p, uint16_t v)
+    {
+        v = toNetwork16(v);
+        memcpy(p, &v, 2);
+    }   // store16
+    // ------------------------------------------------------------------------
+    static void store32(uint8_t* p, uint32_t v)
+    {
+        v = toNetwork32(v);
+        memcpy(p, &v, 4);
+    }   // store32
+    // ------------------------------------------------------------------------
+    static void store64(uint8_t* p, uint64_t v)
+    {
+        v = toNetwork64(v);
+        memcpy(p, &v, 8);
+    }   // store64
+    // ------------------------------------------------------------------------
+    static void storeFloat(uint8_t* p, float f)
+    {
+        uint32_t u;
+        memcpy(&u, &f, 4);
+        store32(p, u);
+    }   // storeFloat
+    // ------------------------------------------------------------------------
+    static uint16_t load16(const uint8_t* p)
+    {
+        uint16_t v;
+        memcpy(&v, p, 2);
+        return toNetwork16(v);
+    }   // load16
+    // ------------------------------------------------------------------------
+    static uint32_t load32(const uint8_t* p)
+    {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return toNetwork32(v);
+    }   // load32
+    // ------------------------------------------------------------------------
+    static uint64_t load64(const uint8_t* p)
+    {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        return toNetwork64(v);
+    }   // load64
+    // ------------------------------------------------------------------------
+    /** Converts 4 bytes to a float, see getFloat for why memcpy is used. */
+    static float loadFloat(const uint8_t* p)
+    {
+        uint32_t u = load32(p);
+        float f;
+        memcpy(&f, &u, 4);
+        return f;
+    }   // loadFloat
 
 public:
 
@@ -146,6 +244,13 @@ public:
     /** Allows to read a buffer from the beginning again. */
     void reset() { m_current_offset = 0; }
     // ------------------------------------------------------------------------
+    /** Removes all data, but keeps the allocated memory for reuse. */
+    void clear()
+    {
+        m_buffer.clear();
+        m_current_offset = 0;
+    }   // clear
+    // ------------------------------------------------------------------------
     /** Encode string with max length of 16bit and utf32, used in motd or
      *  chat. */
     BareNetworkString& encodeString16(const irr::core::stringw& value)
@@ -153,18 +258,21 @@ public:
         uint16_t str_len = (uint16_t)value.size();
         if (value.size() > 65535)
             str_len = 65535;
-        addUInt16(str_len);
+        uint8_t* p = grow(2 + str_len * 4);
+        store16(p, str_len);
         for (unsigned i = 0; i < str_len; i++)
-            addUInt32(value[i]);
+            store32(p + 2 + i * 4, value[i]);
         return *this;
     }
     // ------------------------------------------------------------------------
     int decodeString16(irr::core::stringw* out) const
     {
         uint16_t str_len = getUInt16();
+        const uint8_t* p = consume(str_len * 4);
+        out->reserve(out->size() + str_len);
         for (unsigned i = 0; i < str_len; i++)
         {
-            uint32_t c = getUInt32();
+            uint32_t c = load32(p + i * 4);
             // In the future convert for windows
             if (c > 65535)
                 c = 20; // whitespace
@@ -226,6 +334,18 @@ public:
      *  string must be sent. */
     unsigned int getTotalSize() const { return (unsigned int)m_buffer.size(); }
     // ------------------------------------------------------------------------
+    /** Makes sure that n more bytes can be added without reallocating the
+     *  buffer. Use it before adding many values of known size. The capacity
+     *  is at least doubled, so that calling this for each part of a message
+     *  does not cause a reallocation each time. */
+    BareNetworkString& reserve(unsigned int n)
+    {
+        const size_t needed = m_buffer.size() + n;
+        if (needed > m_buffer.capacity())
+            m_buffer.reserve(std::max(needed, m_buffer.capacity() * 2));
+        return *this;
+    }   // reserve
+    // ------------------------------------------------------------------------
     // All functions related to adding data to a network string
     /** Add 8 bit unsigned int. */
     BareNetworkString& addUInt8(const uint8_t value)
@@ -245,8 +365,7 @@ public:
     /** Adds 16 bit unsigned int. */
     BareNetworkString& addUInt16(const uint16_t value)
     {
-        m_buffer.push_back((value >> 8) & 0xff);
-        m_buffer.push_back(value & 0xff);
+        store16(grow(2), value);
         return *this;
     }   // addUInt16
 
@@ -255,9 +374,9 @@ public:
     BareNetworkString& addInt24(const int value)
     {
         uint32_t combined = (uint32_t)value & 0xffffff;
-        m_buffer.push_back((combined >> 16) & 0xff);
-        m_buffer.push_back((combined >> 8) & 0xff);
-        m_buffer.push_back(combined & 0xff);
+        uint8_t* p = grow(3);
+        p[0] = (combined >> 16) & 0xff;
+        store16(p + 1, (uint16_t)combined);
         return *this;
     }   // addInt24
 
@@ -265,10 +384,7 @@ public:
     /** Adds unsigned 32 bit integer. */
     BareNetworkString& addUInt32(const uint32_t& value)
     {
-        m_buffer.push_back((value >> 24) & 0xff);
-        m_buffer.push_back((value >> 16) & 0xff);
-        m_buffer.push_back((value >>  8) & 0xff);
-        m_buffer.push_back( value        & 0xff);
+        store32(grow(4), value);
         return *this;
     }   // addUInt32
 
@@ -276,14 +392,7 @@ public:
     /** Adds unsigned 64 bit integer. */
     BareNetworkString& addUInt64(const uint64_t& value)
     {
-        m_buffer.push_back((value >> 56) & 0xff);
-        m_buffer.push_back((value >> 48) & 0xff);
-        m_buffer.push_back((value >> 40) & 0xff);
-        m_buffer.push_back((value >> 32) & 0xff);
-        m_buffer.push_back((value >> 24) & 0xff);
-        m_buffer.push_back((value >> 16) & 0xff);
-        m_buffer.push_back((value >>  8) & 0xff);
-        m_buffer.push_back( value        & 0xff);
+        store64(grow(8), value);
         return *this;
     }   // addUInt64
 
@@ -291,10 +400,32 @@ public:
     /** Adds a 4 byte floating point value. */
     BareNetworkString& addFloat(const float value)
     {
-        uint32_t *p = (uint32_t*)&value;
-        return addUInt32(*p);
+        storeFloat(grow(4), value);
+        return *this;
     }   // addFloat
 
+    // ------------------------------------------------------------------------
+    /** Adds n floating point values, with the same encoding as n calls of
+     *  addFloat. */
+    BareNetworkString& addFloats(const float* values, unsigned int n)
+    {
+        uint8_t* p = grow(n * 4);
+        for (unsigned int i = 0; i < n; i++)
+            storeFloat(p + i * 4, values[i]);
+        return *this;
+    }   // addFloats
+
+    // ------------------------------------------------------------------------
+    /** Adds n 16 bit values (e.g. half floats), with the same encoding as n
+     *  calls of addUInt16. */
+    BareNetworkString& addUInt16s(const uint16_t* values, unsigned int n)
+    {
+        uint8_t* p = grow(n * 2);
+        for (unsigned int i = 0; i < n; i++)
+            store16(p + i * 2, values[i]);
+        return *this;
+    }   // addUInt16s
+
     // ------------------------------------------------------------------------
     /** Adds the content of another network string. It only copies data which
      *  has not been 'removed' (i.e. skipped). */
@@ -316,15 +447,23 @@ public:
     /** Adds the xyz components of a Vec3 to the string. */
     BareNetworkString& add(const Vec3 &xyz)
     {
-        return addFloat(xyz.getX()).addFloat(xyz.getY()).addFloat(xyz.getZ());
+        uint8_t* p = grow(12);
+        storeFloat(p,     xyz.getX());
+        storeFloat(p + 4, xyz.getY());
+        storeFloat(p + 8, xyz.getZ());
+        return *this;
     }   // add
 
     // ------------------------------------------------------------------------
     /** Adds the four components of a quaternion. */
     BareNetworkString& add(const btQuaternion &quat)
     {
-        return addFloat(quat.getX()).addFloat(quat.getY())
-              .addFloat(quat.getZ()).addFloat(quat.getW());
+        uint8_t* p = grow(16);
+        storeFloat(p,      quat.getX());
+        storeFloat(p + 4,  quat.getY());
+        storeFloat(p + 8,  quat.getZ());
+        storeFloat(p + 12, quat.getW());
+        return *this;
     }   // add
     // ------------------------------------------------------------------------
     /** Adds a function to add a time ticks value. Use this function instead
@@ -339,15 +478,16 @@ public:
     // Functions related to getting data from a network string
     // ------------------------------------------------------------------------
     /** Returns a unsigned 64 bit integer. */
-    inline uint64_t getUInt64() const { return get<uint64_t, 8>(); }
+    inline uint64_t getUInt64() const { return load64(consume(8)); }
     // ------------------------------------------------------------------------
     /** Returns a unsigned 32 bit integer. */
-    inline uint32_t getUInt32() const { return get<uint32_t, 4>(); }
+    inline uint32_t getUInt32() const { return load32(consume(4)); }
     // ------------------------------------------------------------------------
     /** Returns a signed 24 bit integer. */
     inline int getInt24() const
     {
-        uint32_t combined = get<uint32_t, 3>();
+        const uint8_t* p = consume(3);
+        uint32_t combined = ((uint32_t)p[0] << 16) | load16(p + 1);
         if (combined & 0x800000)
             return (0x1000000 - (int)combined) * -1;
         else
@@ -355,13 +495,13 @@ public:
     }
     // ------------------------------------------------------------------------
     /** Returns a unsigned 32 bit integer. */
-    inline uint32_t getTime() const { return get<uint32_t, 4>(); }
+    inline uint32_t getTime() const { return load32(consume(4)); }
     // ------------------------------------------------------------------------
     /** Returns an unsigned 16 bit integer. */
-    inline uint16_t getUInt16() const { return get<uint16_t, 2>(); }
+    inline uint16_t getUInt16() const { return load16(consume(2)); }
     // ------------------------------------------------------------------------
     /** Returns an unsigned 16 bit integer. */
-    inline int16_t getInt16() const { return get<int16_t, 2>(); }
+    inline int16_t getInt16() const { return (int16_t)load16(consume(2)); }
     // ------------------------------------------------------------------------
     /** Returns an unsigned 8-bit integer. */
     inline uint8_t getUInt8() const
@@ -378,7 +518,7 @@ public:
     /** Gets a 4 byte floating point value. */
     float getFloat() const
     {
-        uint32_t u = getUInt32();
+        uint32_t u = load32(consume(4));
         float f;
         // Doig a "return *(float*)&u;" appears to be more efficient,
         // but it can create incorrect code on higher optimisation: c++
@@ -400,25 +540,35 @@ public:
     /** Gets a Vec3. */
     Vec3 getVec3() const
     {
-        Vec3 r;
-        r.setX(getFloat());
-        r.setY(getFloat());
-        r.setZ(getFloat());
-        return r;
+        const uint8_t* p = consume(12);
+        return Vec3(loadFloat(p), loadFloat(p + 4), loadFloat(p + 8));
     }   // getVec3
 
     // ------------------------------------------------------------------------
     /** Gets a bullet quaternion. */
     btQuaternion getQuat() const
     {
-        btQuaternion q;
-        q.setX(getFloat());
-        q.setY(getFloat());
-        q.setZ(getFloat());
-        q.setW(getFloat());
-        return q;
+        const uint8_t* p = consume(16);
+        return btQuaternion(loadFloat(p),     loadFloat(p + 4),
+                            loadFloat(p + 8), loadFloat(p + 12));
     }   // getQuat
     // ------------------------------------------------------------------------
+    /** Gets n floating point values added with addFloats. */
+    void getFloats(float* values, unsigned int n) const
+    {
+        const uint8_t* p = consume(n * 4);
+        for (unsigned int i = 0; i < n; i++)
+            values[i] = loadFloat(p + i * 4);
+    }   // getFloats
+    // ------------------------------------------------------------------------
+    /** Gets n 16 bit values added with addUInt16s. */
+    void getUInt16s(uint16_t* values, unsigned int n) const
+    {
+        const uint8_t* p = consume(n * 2);
+        for (unsigned int i = 0; i < n; i++)
+            values[i] = load16(p + i * 2);
+    }   // getUInt16s
+    // ------------------------------------------------------------------------
 
 };   // class BareNetworkString
 
@@ -443,6 +593,7 @@ class NetworkString : public BareNetworkString
 {
 public:
     static void unitTesting();
+    static void benchmark();
         
     /** Constructor for a message to be sent. It sets the 
      *  protocol type of this message. It adds 1 byte to the capacity:
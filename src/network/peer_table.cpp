@@ -0,0 +1,209 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/peer_table.hpp"
+
+#include "network/network_string.hpp"
+#include "network/protocols/lobby_protocol.hpp"
+#include "network/stk_peer.hpp"
+#include "utils/benchmark.hpp"
+#include "utils/log.hpp"
+#include "utils/time.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <string.h>
+#include <thread>
+
+// ----------------------------------------------------------------------------
+PeerTable::PeerTable()
+{
+    m_snapshot = std::make_shared<const PeerList>();
+}   // PeerTable
+
+// ----------------------------------------------------------------------------
+/** Adds a newly connected peer. */
+void PeerTable::add(std::shared_ptr<STKPeer> peer)
+{
+    std::lock_guard<std::mutex> lock(m_peers_mutex);
+    m_peers[peer->getENetPeer()] = peer;
+    updateSnapshot();
+}   // add
+
+// ----------------------------------------------------------------------------
+/** Removes the stk peers of the given enet peers. */
+void PeerTable::remove(const std::vector<ENetPeer*>& enet_peers)
+{
+    std::lock_guard<std::mutex> lock(m_peers_mutex);
+    for (ENetPeer* enet_peer : enet_peers)
+        m_peers.erase(enet_peer);
+    updateSnapshot();
+}   // remove
+
+// ----------------------------------------------------------------------------
+/** Removes all peers and returns them. */
+PeerTable::PeerList PeerTable::removeAll()
+{
+    std::lock_guard<std::mutex> lock(m_peers_mutex);
+    PeerList peers = *m_snapshot;
+    m_peers.clear();
+    updateSnapshot();
+    return peers;
+}   // removeAll
+
+// ----------------------------------------------------------------------------
+/** Returns the stk peer of an enet peer, or NULL if it is not in the table.
+ */
+std::shared_ptr<STKPeer> PeerTable::find(ENetPeer* enet_peer) const
+{
+    std::lock_guard<std::mutex> lock(m_peers_mutex);
+    auto it = m_peers.find(enet_peer);
+    return it == m_peers.end() ? nullptr : it->second;
+}   // find
+
+// ----------------------------------------------------------------------------
+/** Replaces the snapshot after m_peers was changed, m_peers_mutex must be
+ *  locked. Readers which still use the previous snapshot keep it alive
+ *  until they are done.
+ */
+void PeerTable::updateSnapshot()
+{
+    auto peers = std::make_shared<PeerList>();
+    peers->reserve(m_peers.size());
+    for (auto& p : m_peers)
+        peers->push_back(p.second);
+    std::atomic_store(&m_snapshot, std::shared_ptr<const PeerList>(peers));
+}   // updateSnapshot
+
+// ----------------------------------------------------------------------------
+/** Stress test of the peer table without a host: a thread like the
+ *  listening thread sweeps over 64 peers (as when sending pings) and
+ *  constantly removes and re-adds a peer, while several threads select the
+ *  receivers of a broadcast and create its packet, as
+ *  STKHost::sendPacketToAllPeers does. The enet peers are only used as keys
+ *  and are never given to enet. Logs how long each change of the table
+ *  and each broadcast takes.
+ */
+void PeerTable::benchmark()
+{
+    const int NUM_PEERS = 64;
+    const int NUM_SENDERS = 4;
+    const int RUN_TIME = 3000;
+
+    PeerTable table;
+    std::vector<ENetPeer> enet_peers(NUM_PEERS);
+    for (int i = 0; i < NUM_PEERS; i++)
+    {
+        ENetPeer& enet_peer = enet_peers[i];
+        memset(&enet_peer, 0, sizeof(ENetPeer));
+        enet_peer.state = ENET_PEER_STATE_CONNECTED;
+        enet_peer.address.host = 0x0100007f;
+        enet_peer.address.port = (uint16_t)(10000 + i);
+    }
+    auto create_peer = [](ENetPeer* enet_peer, uint32_t host_id)
+        {
+            auto peer = std::make_shared<STKPeer>(enet_peer,
+                /*host*/nullptr, host_id);
+            peer->setValidated();
+            peer->setWaitingForGame(false);
+            return peer;
+        };
+    for (int i = 0; i < NUM_PEERS; i++)
+        table.add(create_peer(&enet_peers[i], i));
+
+    std::atomic_bool stop(false);
+    Benchmark::Timer sweeps, changes;
+    std::thread listening([&]()
+        {
+            unsigned next = 0;
+            std::vector<ENetPeer*> timed_out;
+            while (!stop.load())
+            {
+                // Like the sweep which collects the peers to be removed
+                sweeps.start();
+                auto peers = table.getSnapshot();
+                for (auto& peer : *peers)
+                {
+                    if (!peer->isValidated())
+                        timed_out.push_back(peer->getENetPeer());
+                }
+                sweeps.stop();
+
+                // A peer disconnects and another one connects
+                ENetPeer* enet_peer = &enet_peers[next++ % NUM_PEERS];
+                auto peer = create_peer(enet_peer, NUM_PEERS + next);
+                changes.start();
+                table.remove({ enet_peer });
+                table.add(peer);
+                changes.stop();
+                StkTime::sleep(1);
+            }
+        });
+
+    std::vector<Benchmark::Timer> broadcasts(NUM_SENDERS);
+    std::vector<std::thread> senders;
+    for (int i = 0; i < NUM_SENDERS; i++)
+    {
+        senders.emplace_back([&, i]()
+            {
+                NetworkString msg(PROTOCOL_LOBBY_ROOM);
+                msg.addUInt8(LobbyProtocol::LE_CHAT).encodeString16(
+                    L"A message sent to every peer in the server");
+                while (!stop.load())
+                {
+                    broadcasts[i].start();
+                    auto peers = table.getSnapshot();
+                    std::vector<STKPeer*> receivers;
+                    for (auto& p : *peers)
+                    {
+                        if (p->isValidated() && !p->isWaitingForGame() &&
+                            p->canSendPacket())
+                            receivers.push_back(p.get());
+                    }
+                    ENetPacket* packet = enet_packet_create(msg.getData(),
+                        msg.getTotalSize(), ENET_PACKET_FLAG_RELIABLE);
+                    enet_packet_destroy(packet);
+                    broadcasts[i].stop();
+                    StkTime::sleep(1);
+                }
+            });
+    }
+
+    StkTime::sleep(RUN_TIME);
+    stop.store(true);
+    listening.join();
+    double total = 0.0, max_time = 0.0;
+    unsigned int count = 0;
+    for (int i = 0; i < NUM_SENDERS; i++)
+    {
+        senders[i].join();
+        total += broadcasts[i].getTotal();
+        max_time = std::max(max_time, broadcasts[i].getMax());
+        count += broadcasts[i].getCount();
+    }
+
+    Log::info("PeerTable", "Peer table with %d peers, %d senders for %d ms.",
+        NUM_PEERS, NUM_SENDERS, RUN_TIME);
+    Log::info("PeerTable", "Sweeps: %u, average %.4f ms.", sweeps.getCount(),
+        sweeps.getAverage());
+    Log::info("PeerTable", "Peer table changes: %u, average %.4f ms, "
+        "max %.4f ms.", changes.getCount(), changes.getAverage(),
+        changes.getMax());
+    Log::info("PeerTable", "Broadcasts: %u, average %.4f ms, max %.4f ms.",
+        count, count > 0 ? total / count : 0.0, max_time);
+}   // benchmark
@@ -0,0 +1,78 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef PEER_TABLE_HPP
+#define PEER_TABLE_HPP
+
+#include "utils/no_copy.hpp"
+
+// enet.h includes win32.h, which without lean_and_mean includes
+// winspool.h, which defines MAX_PRIORITY as a macro, which then
+// results in request_manager.hpp not being compilable.
+#define WIN32_LEAN_AND_MEAN
+#include <enet/enet.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class STKPeer;
+
+/** \ingroup network
+ *  The peers connected to a host. The table is only locked while a peer is
+ *  added or removed. Each change publishes a new list of the peers which
+ *  is never changed afterwards, so readers (e.g. when sending packets to
+ *  all peers) use it without locking and never wait for the listening
+ *  thread.
+ */
+class PeerTable : public NoCopy
+{
+public:
+    typedef std::vector<std::shared_ptr<STKPeer> > PeerList;
+
+private:
+    /** Locked while m_peers is changed. */
+    mutable std::mutex m_peers_mutex;
+
+    /** The peers, indexed by their enet peer. */
+    std::map<ENetPeer*, std::shared_ptr<STKPeer> > m_peers;
+
+    /** Copy of the peers in m_peers (in the same order), which is replaced
+     *  whenever a peer is added or removed. Readers take a reference to it
+     *  with std::atomic_load. */
+    std::shared_ptr<const PeerList> m_snapshot;
+
+    void updateSnapshot();
+
+public:
+    PeerTable();
+    void add(std::shared_ptr<STKPeer> peer);
+    void remove(const std::vector<ENetPeer*>& enet_peers);
+    PeerList removeAll();
+    std::shared_ptr<STKPeer> find(ENetPeer* enet_peer) const;
+    static void benchmark();
+    // ------------------------------------------------------------------------
+    /** Returns the current list of peers without locking. */
+    std::shared_ptr<const PeerList> getSnapshot() const
+    {
+        return std::atomic_load(&m_snapshot);
+    }   // getSnapshot
+};   // PeerTable
+
+#endif
@@ -116,6 +116,12 @@ public:
      *  Must be re-defined. */
     virtual void asynchronousUpdate() = 0;
 
+    /** \brief Returns in how many milliseconds asynchronousUpdate() should
+     *  be called again. By default it is only called after the protocol
+     *  manager thread was woken up by an event or a request, protocols that
+     *  poll a state have to return a non-negative interval. */
+    virtual int getAsynchronousUpdateInterval() const { return -1; }
+
     /// functions to check incoming data easily
     NetworkString* getNetworkString(size_t capacity = 16) const;
     bool checkDataSize(Event* event, unsigned int minimum_size);
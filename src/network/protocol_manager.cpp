@@ -23,6 +23,7 @@
 #include "network/protocols/game_protocol.hpp"
 #include "network/protocols/server_lobby.hpp"
 #include "network/stk_peer.hpp"
+#include "utils/benchmark.hpp"
 #include "utils/log.hpp"
 #include "utils/profiler.hpp"
 #include "utils/time.hpp"
@@ -30,7 +31,10 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <errno.h>
 #include <functional>
 #include <typeinfo>
@@ -54,7 +58,7 @@ std::shared_ptr<ProtocolManager> ProtocolManager::createInstance()
             {
                 pm->asynchronousUpdate();
                 PROFILER_PUSH_CPU_MARKER("sleep", 0, 255, 255);
-                StkTime::sleep(2);
+                pm->waitForAsynchronousUpdate();
                 PROFILER_POP_CPU_MARKER();
             }
         });
@@ -101,6 +105,7 @@ std::shared_ptr<ProtocolManager> ProtocolManager::createInstance()
 ProtocolManager::ProtocolManager()
 {
     m_exit.store(false);
+    m_async_wake_up = false;
 }   // ProtocolManager
 
 // ----------------------------------------------------------------------------
@@ -149,6 +154,7 @@ void ProtocolManager::OneProtocolType::abort()
 void ProtocolManager::abort()
 {
     m_exit.store(true);
+    wakeUp();
     if (NetworkConfig::get()->isServer())
     {
         std::unique_lock<std::mutex> ul(m_game_protocol_mutex);
@@ -189,9 +195,61 @@ void ProtocolManager::propagateEvent(Event* event)
         m_async_events_to_process.lock();
         m_async_events_to_process.getData().push_back(event);
         m_async_events_to_process.unlock();
+        wakeUp();
     }
 }   // propagateEvent
 
+// ----------------------------------------------------------------------------
+/** Wakes up the asynchronous update thread, used when new events or
+ *  requests are queued, or when a protocol has new work for its
+ *  asynchronous update (e.g. results of database queries).
+ */
+void ProtocolManager::wakeUp()
+{
+    std::lock_guard<std::mutex> lock(m_async_mutex);
+    m_async_wake_up = true;
+    m_async_cv.notify_one();
+}   // wakeUp
+
+// ----------------------------------------------------------------------------
+/** Called from the asynchronous update thread after each update. Sleeps
+ *  until either new events or requests are queued, or until the shortest
+ *  update interval requested by any running protocol has passed.
+ */
+void ProtocolManager::waitForAsynchronousUpdate()
+{
+    int interval = -1;
+    for (unsigned int i = 0; i < m_all_protocols.size(); i++)
+    {
+        int n = m_all_protocols[i].getAsynchronousUpdateInterval();
+        if (n >= 0 && (interval < 0 || n < interval))
+            interval = n;
+    }
+
+    // Events that could not be delivered yet (e.g. because the protocol is
+    // about to be started) are kept for a while, so retry them regularly.
+    const int RETRY_INTERVAL = 10;
+    m_async_events_to_process.lock();
+    if (!m_async_events_to_process.getData().empty() &&
+        (interval < 0 || interval > RETRY_INTERVAL))
+        interval = RETRY_INTERVAL;
+    m_async_events_to_process.unlock();
+
+    std::unique_lock<std::mutex> ul(m_async_mutex);
+    auto has_work = [this]()
+        {
+            return m_async_wake_up || m_exit.load();
+        };
+    if (interval < 0)
+        m_async_cv.wait(ul, has_work);
+    else
+    {
+        m_async_cv.wait_for(ul, std::chrono::milliseconds(interval),
+            has_work);
+    }
+    m_async_wake_up = false;
+}   // waitForAsynchronousUpdate
+
 // ----------------------------------------------------------------------------
 /** \brief Asks the manager to start a protocol.
  * This function will store the request, and process it at a time when it is
@@ -207,6 +265,7 @@ void ProtocolManager::requestStart(std::shared_ptr<Protocol> protocol)
     m_requests.lock();
     m_requests.getData().push_back(req);
     m_requests.unlock();
+    wakeUp();
 }   // requestStart
 
 // ----------------------------------------------------------------------------
@@ -234,6 +293,7 @@ void ProtocolManager::requestTerminate(std::shared_ptr<Protocol> protocol)
     }
     m_requests.getData().push_back(req);
     m_requests.unlock();
+    wakeUp();
 }   // requestTerminate
 
 // ----------------------------------------------------------------------------
@@ -409,6 +469,23 @@ void ProtocolManager::OneProtocolType::update(int ticks, bool async)
     }
 }   // update
 
+// ----------------------------------------------------------------------------
+/** Returns the shortest interval in milliseconds in which any protocol of
+ *  this type wants to be updated asynchronously, or -1 if none of them
+ *  needs periodic updates.
+ */
+int ProtocolManager::OneProtocolType::getAsynchronousUpdateInterval() const
+{
+    int interval = -1;
+    for (unsigned int i = 0; i < m_protocols.size(); i++)
+    {
+        int n = m_protocols[i]->getAsynchronousUpdateInterval();
+        if (n >= 0 && (interval < 0 || n < interval))
+            interval = n;
+    }
+    return interval;
+}   // getAsynchronousUpdateInterval
+
 // ----------------------------------------------------------------------------
 /** \brief Updates the manager.
  *
@@ -545,8 +622,8 @@ void ProtocolManager::asynchronousUpdate()
     m_requests.lock();
     while(m_requests.getData().size()>0)
     {
-        ProtocolRequest request = m_requests.getData()[0];
-        m_requests.getData().erase(m_requests.getData().begin());
+        ProtocolRequest request = m_requests.getData().front();
+        m_requests.getData().pop_front();
         // Make sure new requests can be queued up while handling requests.
         m_requests.unlock();
         // This is often used that terminating a protocol unpauses another,
@@ -581,3 +658,86 @@ std::shared_ptr<Protocol> ProtocolManager::getProtocol(ProtocolType type)
 
     return opt.getFirstProtocol();
 }   // getProtocol
+
+// ============================================================================
+namespace
+{
+    /** A protocol that only records when it receives an event, used to
+     *  measure the latency of the asynchronous update thread. */
+    class BenchmarkProtocol : public Protocol
+    {
+    public:
+        std::atomic<int> m_events, m_updates;
+        std::atomic<bool> m_started;
+        BenchmarkProtocol() : Protocol(PROTOCOL_SILENT)
+        {
+            m_events.store(0);
+            m_updates.store(0);
+            m_started.store(false);
+            setHandleConnections(true);
+        }   // BenchmarkProtocol
+        virtual void setup() OVERRIDE             { m_started.store(true); }
+        virtual void update(int ticks) OVERRIDE   {}
+        virtual void asynchronousUpdate() OVERRIDE { m_updates++;          }
+        virtual bool notifyEventAsynchronous(Event* event) OVERRIDE
+        {
+            m_events++;
+            return true;
+        }   // notifyEventAsynchronous
+    };   // BenchmarkProtocol
+}   // namespace
+
+// ----------------------------------------------------------------------------
+/** Measures the wakeups and CPU time of an idle protocol manager thread and
+ *  the latency from queueing an event or request until a protocol handles
+ *  it. Called with --micro-benchmark=protocol-manager.
+ */
+void ProtocolManager::benchmark()
+{
+    NetworkConfig::get()->setIsServer(false);
+    auto pm = createInstance();
+    auto protocol = std::make_shared<BenchmarkProtocol>();
+
+    Benchmark::Timer request_latency;
+    pm->requestStart(protocol);
+    while (!protocol->m_started.load())
+        std::this_thread::yield();
+    request_latency.stop();
+
+    // Idle: no events and no protocol that needs periodic updates
+    const int IDLE_TIME = 2000;
+    int updates = protocol->m_updates.load();
+    std::clock_t cpu = std::clock();
+    StkTime::sleep(IDLE_TIME);
+    double idle_cpu = double(std::clock() - cpu) / CLOCKS_PER_SEC;
+    updates = protocol->m_updates.load() - updates;
+
+    // Connect events need no peer and no packet
+    ENetEvent enet_event;
+    memset(&enet_event, 0, sizeof(enet_event));
+    enet_event.type = ENET_EVENT_TYPE_CONNECT;
+    const int NUM_EVENTS = 500;
+    Benchmark::Timer latency;
+    for (int i = 0; i < NUM_EVENTS; i++)
+    {
+        // Don't send in phase with the update thread
+        StkTime::sleep(1 + i % 3);
+        int events = protocol->m_events.load();
+        latency.start();
+        pm->propagateEvent(new Event(&enet_event, nullptr));
+        while (protocol->m_events.load() == events)
+            std::this_thread::yield();
+        latency.stop();
+    }
+
+    pm->requestTerminate(protocol);
+    pm->abort();
+
+    Log::info("ProtocolManager", "Idle for %d ms: %d updates, %.1f ms cpu.",
+        IDLE_TIME, updates, idle_cpu * 1000.0);
+    Log::info("ProtocolManager", "Event latency: average %.3f ms, "
+        "max %.3f ms (%u events).", latency.getAverage(), latency.getMax(),
+        latency.getCount());
+    Log::info("ProtocolManager", "Start request latency: %.3f ms.",
+        request_latency.getTotal());
+}   // benchmark
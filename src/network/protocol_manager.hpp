@@ -33,6 +33,7 @@
 #include <array>
 #include <atomic>
 #include <condition_variable>
+#include <deque>
 #include <list>
 #include <memory>
 #include <mutex>
@@ -95,7 +96,9 @@ public:
  *     A separate threads runs that delivers asynchronous events 
  *     (i.e. messages), updates each protocol, and handles new requests
  *     (start/stop protocol etc). Protocols are updated using the
- *     Protocol::asynchronousUpdate() function.
+ *     Protocol::asynchronousUpdate() function. The thread sleeps until
+ *     an event or request is queued, or until the shortest interval
+ *     returned by Protocol::getAsynchronousUpdateInterval() has passed.
  
  *  2) Synchronous updates:
  *     This is called from the main game thread, and will deliver synchronous
@@ -149,6 +152,7 @@ private:
         void requestTerminateAll();
         bool notifyEvent(Event *event);
         void update(int ticks, bool async);
+        int  getAsynchronousUpdateInterval() const;
         void abort();
         // --------------------------------------------------------------------
         /** Returns the first protocol of a given type. It is assumed that
@@ -199,7 +203,7 @@ private:
     Synchronised<EventList> m_async_events_to_process;
 
     /** Contains the requests to start/pause etc... protocols. */
-    Synchronised< std::vector<ProtocolRequest> > m_requests;
+    Synchronised< std::deque<ProtocolRequest> > m_requests;
 
     /** When set to true, the main thread will exit. */
     std::atomic_bool m_exit;
@@ -217,6 +221,17 @@ private:
 
     EventList m_controller_events_list;
 
+    /** Wakes up the asynchronous update thread when an event or a request
+     *  is queued, otherwise it only wakes up when a protocol requested a
+     *  periodic update. */
+    std::condition_variable m_async_cv;
+
+    std::mutex m_async_mutex;
+
+    /** Set (with m_async_mutex locked) when there is new work for the
+     *  asynchronous update thread. */
+    bool m_async_wake_up;
+
     /*! Single instance of protocol manager.*/
     static std::weak_ptr<ProtocolManager> m_protocol_manager;
 
@@ -226,6 +241,7 @@ private:
     virtual void startProtocol(std::shared_ptr<Protocol> protocol);
     virtual void terminateProtocol(std::shared_ptr<Protocol> protocol);
     virtual void asynchronousUpdate();
+    void waitForAsynchronousUpdate();
 
 public:
     // ===========================================
@@ -239,6 +255,8 @@ public:
     void      requestTerminate(std::shared_ptr<Protocol> protocol);
     void      findAndTerminate(ProtocolType type);
     void      update(int ticks);
+    void      wakeUp();
+    static void benchmark();
     // ------------------------------------------------------------------------
     bool isExiting() const                            { return m_exit.load(); }
     // ------------------------------------------------------------------------
@@ -45,6 +45,7 @@
 #include "network/protocols/game_protocol.hpp"
 #include "network/protocols/game_events_protocol.hpp"
 #include "network/race_event_manager.hpp"
+#include "network/rewind_manager.hpp"
 #include "network/server.hpp"
 #include "network/server_config.hpp"
 #include "network/stk_host.hpp"
@@ -915,6 +916,7 @@ void ClientLobby::startGame(Event* event)
     LinearWorld* lw = dynamic_cast<LinearWorld*>(World::getWorld());
     if (lw)
         lw->handleServerCheckStructureCount(check_structure_count);
+    RewindManager::get()->restoreRewinderIDs(event->data());
 
     NetworkItemManager* nim =
     dynamic_cast<NetworkItemManager*>(ItemManager::get());
@@ -1161,6 +1163,7 @@ void ClientLobby::liveJoinAcknowledged(Event* event)
 
     m_start_live_game_time = data.getUInt64();
     m_last_live_join_util_ticks = data.getUInt32();
+    RewindManager::get()->restoreRewinderIDs(data);
     for (unsigned i = 0; i < w->getNumKarts(); i++)
     {
         AbstractKart* k = w->getKart(i);
@@ -51,6 +51,12 @@ public:
     virtual void setup() OVERRIDE {}
     virtual void update(int ticks) OVERRIDE {}
     virtual void asynchronousUpdate() OVERRIDE;
+    // ------------------------------------------------------------------------
+    /** Polls for the connection of the peer until done. */
+    virtual int getAsynchronousUpdateInterval() const OVERRIDE
+    {
+        return m_state == EXITING ? -1 : 10;
+    }   // getAsynchronousUpdateInterval
 };   // class ConnectToPeer
 
 #endif // CONNECT_TO_SERVER_HPP
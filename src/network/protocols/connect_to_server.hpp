@@ -59,6 +59,12 @@ public:
     virtual void setup() OVERRIDE;
     virtual void asynchronousUpdate() OVERRIDE;
     virtual void update(int ticks) OVERRIDE;
+    // ------------------------------------------------------------------------
+    /** The connection states are only advanced in asynchronousUpdate(). */
+    virtual int getAsynchronousUpdateInterval() const OVERRIDE
+    {
+        return m_state.load() >= DONE ? -1 : 2;
+    }   // getAsynchronousUpdateInterval
 
 };   // class ConnectToServer
 
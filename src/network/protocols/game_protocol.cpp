@@ -30,12 +30,16 @@
 #include "network/protocol_manager.hpp"
 #include "network/rewind_info.hpp"
 #include "network/rewind_manager.hpp"
+#include "network/rewinder.hpp"
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
 #include "utils/log.hpp"
 #include "utils/time.hpp"
 #include "main_loop.hpp"
 
+#include <algorithm>
+#include <stdexcept>
+
 // ============================================================================
 std::weak_ptr<GameProtocol> GameProtocol::m_game_protocol;
 // ============================================================================
@@ -57,13 +61,24 @@ GameProtocol::GameProtocol()
             : Protocol( PROTOCOL_CONTROLLER_EVENTS)
 {
     m_data_to_send = getNetworkString();
-
+    m_delta_to_send = getNetworkString();
+    // The client keeps more states than the server, so that any state
+    // the server uses as base for a delta state is still available
+    m_state_history.resize(NetworkConfig::get()->isServer() ? 16 : 32);
+    for (StateHistory& sh : m_state_history)
+        sh.m_ticks = -1;
+    m_state_history_index = 0;
+    m_state_ticks = 0;
+    m_state_rewinder_count = 0;
+    m_states_sent = 0;
+    m_state_statistics_time = StkTime::getMonoTimeMs();
 }   // GameProtocol
 
 //-----------------------------------------------------------------------------
 GameProtocol::~GameProtocol()
 {
     delete m_data_to_send;
+    delete m_delta_to_send;
 }   // ~GameProtocol
 
 //-----------------------------------------------------------------------------
@@ -126,6 +141,8 @@ bool GameProtocol::notifyEventAsynchronous(Event* event)
     {
     case GP_CONTROLLER_ACTION: handleControllerAction(event); break;
     case GP_STATE:             handleState(event);            break;
+    case GP_DELTA_STATE:       handleDeltaState(event);       break;
+    case GP_STATE_ACK:         handleStateAck(event);         break;
     case GP_ITEM_CONFIRMATION: handleItemEventConfirmation(event); break;
     case GP_ADJUST_TIME:
     case GP_ITEM_UPDATE:
@@ -161,13 +178,13 @@ void GameProtocol::controllerAction(int kart_id, PlayerAction action,
 
     m_all_actions.push_back(a);
     const auto& c = compressAction(a);
-    // Store the event in the rewind manager, which is responsible
-    // for freeing the allocated memory
-    BareNetworkString *s = new BareNetworkString(4);
-    s->addUInt8(kart_id).addUInt8(std::get<0>(c)).addUInt16(std::get<1>(c))
+    // Store the event in the rewind manager, which moves the data of s
+    // into the event
+    BareNetworkString s(8);
+    s.addUInt8(kart_id).addUInt8(std::get<0>(c)).addUInt16(std::get<1>(c))
         .addUInt16(std::get<2>(c)).addUInt16(std::get<3>(c));
 
-    RewindManager::get()->addEvent(this, s, /*confirmed*/true,
+    RewindManager::get()->addEvent(this, &s, /*confirmed*/true,
                                    World::getWorld()->getTicksSinceStart());
 }   // controllerAction
 
@@ -222,10 +239,10 @@ void GameProtocol::handleControllerAction(Event *event)
                 cur_ticks, kart_id, std::get<0>(a), std::get<1>(a),
                 std::get<2>(a), std::get<3>(a));
         }
-        BareNetworkString *s = new BareNetworkString(3);
-        s->addUInt8(kart_id).addUInt8(w).addUInt16(x).addUInt16(y)
+        BareNetworkString s(8);
+        s.addUInt8(kart_id).addUInt8(w).addUInt16(x).addUInt16(y)
             .addUInt16(z);
-        RewindManager::get()->addNetworkEvent(this, s, cur_ticks);
+        RewindManager::get()->addNetworkEvent(this, &s, cur_ticks);
     }
 
     if (data.size() > 0)
@@ -276,50 +293,70 @@ void GameProtocol::handleItemEventConfirmation(Event *event)
 
 // ----------------------------------------------------------------------------
 /** Called by the server before assembling a new message containing the full
- *  state of the race to be sent to a client.
+ *  state of the race to be sent to a client. The number of rewinders in the
+ *  state is filled in by finalizeState.
  */
 void GameProtocol::startNewState()
 {
     assert(NetworkConfig::get()->isServer());
     m_data_to_send->clear();
-    m_data_to_send->addUInt8(GP_STATE)
-        .addUInt32(World::getWorld()->getTicksSinceStart());
+    m_state_ticks = World::getWorld()->getTicksSinceStart();
+    m_state_rewinder_count = 0;
+    m_data_to_send->addUInt8(GP_STATE).addUInt32(m_state_ticks)
+        .addUInt8((uint8_t)RewindManager::get()->getStaticRewinderCount())
+        .addUInt8(0);
 }   // startNewState
 
 // ----------------------------------------------------------------------------
-/** Called by a server to add data to the current state. The data in buffer
- *  is copied, so the data can be freed after this call/.
- *  \param buffer Adds the data in the buffer to the current state.
+/** Called by a server to add the state of a rewinder to the current state.
+ *  The rewinder is identified by its rewinder id, which is followed by its
+ *  unique identity only if the id was not sent to the clients when the race
+ *  started. The rewinder writes directly into the state buffer after the 16
+ *  bit size field, which is filled in afterwards. Since the state buffer is
+ *  reused for every state, no memory is allocated once it is large enough.
+ *  \param rewinder The rewinder to save the state for.
+ *  \return Size of the state written, 0 if the rewinder saved no state.
  */
-void GameProtocol::addState(BareNetworkString *buffer)
+unsigned GameProtocol::addState(Rewinder* rewinder)
 {
     assert(NetworkConfig::get()->isServer());
-    m_data_to_send->addUInt16(buffer->size());
-    (*m_data_to_send) += *buffer;
+    const int id = rewinder->getRewinderID();
+    if (id < 0)
+        return 0;
+    std::vector<uint8_t>& buffer = m_data_to_send->getBuffer();
+    const size_t entry_offset = buffer.size();
+    m_data_to_send->addUInt8((uint8_t)id);
+    if ((unsigned)id >= RewindManager::get()->getStaticRewinderCount())
+        m_data_to_send->encodeString(rewinder->getUniqueIdentity());
+    const size_t size_offset = buffer.size();
+    m_data_to_send->addUInt16(0);
+    if (!rewinder->saveState(m_data_to_send))
+    {
+        buffer.resize(entry_offset);
+        return 0;
+    }
+    const size_t size = buffer.size() - size_offset - 2;
+    buffer[size_offset]     = (size >> 8) & 0xff;
+    buffer[size_offset + 1] =  size       & 0xff;
+    m_state_rewinder_count++;
+    return (unsigned)size;
 }   // addState
 
 // ----------------------------------------------------------------------------
-/** Called by a server to finalize the current state, which add updated
- *  names of rewinder using to the beginning of state buffer
- *  \param cur_rewinder List of current rewinder using.
+/** Called by a server to finalize the current state, which fills in the
+ *  number of rewinders in the state.
  */
-void GameProtocol::finalizeState(std::vector<std::string>& cur_rewinder)
+void GameProtocol::finalizeState()
 {
     assert(NetworkConfig::get()->isServer());
     auto& buffer = m_data_to_send->getBuffer();
-    auto pos = buffer.begin() + 1/*protocol type*/ + 1 /*gp event type*/+
+    const unsigned state_offset = 1/*protocol type*/ + 1 /*gp event type*/+
         4/*time*/;
-
+    buffer[state_offset + 1] = (uint8_t)m_state_rewinder_count;
+    // Keep a copy of the state as base for delta compressed states
+    addStateHistory(m_state_ticks, buffer.data() + state_offset,
+        (unsigned)buffer.size() - state_offset);
     m_data_to_send->reset();
-    std::vector<uint8_t> names;
-    names.push_back((uint8_t)cur_rewinder.size());
-    for (std::string& name : cur_rewinder)
-    {
-        names.push_back((uint8_t)name.size());
-        std::vector<uint8_t> rewinder(name.begin(), name.end());
-        names.insert(names.end(), rewinder.begin(), rewinder.end());
-    }
-    buffer.insert(pos, names.begin(), names.end());
 }   // finalizeState
 
 // ----------------------------------------------------------------------------
@@ -329,9 +366,310 @@ void GameProtocol::finalizeState(std::vector<std::string>& cur_rewinder)
 void GameProtocol::sendState()
 {
     assert(NetworkConfig::get()->isServer());
-    sendMessageToPeers(m_data_to_send, /*reliable*/false);
+    const StateHistory* state = findStateHistory(m_state_ticks);
+
+    // Each peer which has acknowledged a state that is still in the
+    // history gets the state delta compressed against that state, all
+    // other peers get the full state (sent together at the end). The peers
+    // are grouped by their acknowledged state, so that each delta state is
+    // only computed once.
+    auto peers = STKHost::get()->getPeers();
+    std::vector<STKPeer*> full_state_peers;
+    std::map<int, std::vector<std::pair<STKPeer*, PeerStateInfo*> > >
+        delta_state_peers;
+    std::unique_lock<std::mutex> ul(m_peer_state_info_mutex);
+    for (auto& peer : peers)
+    {
+        if (!peer->isValidated() || peer->isWaitingForGame())
+            continue;
+        PeerStateInfo& info = m_peer_state_info[peer];
+        if (state && info.m_ack_ticks >= 0 &&
+            info.m_ack_ticks < m_state_ticks &&
+            findStateHistory(info.m_ack_ticks))
+        {
+            delta_state_peers[info.m_ack_ticks].emplace_back(peer.get(),
+                &info);
+            continue;
+        }
+        full_state_peers.push_back(peer.get());
+        info.m_bytes_sent += m_data_to_send->getTotalSize();
+        info.m_full_bytes += m_data_to_send->getTotalSize();
+    }
+
+    std::vector<STKPeer*> receivers;
+    for (auto& dsp : delta_state_peers)
+    {
+        writeDeltaState(*state, *findStateHistory(dsp.first));
+        // Only use the delta state if it is actually smaller
+        const bool use_delta = m_delta_to_send->getTotalSize() <
+            m_data_to_send->getTotalSize();
+        NetworkString* ns = use_delta ? m_delta_to_send : m_data_to_send;
+        receivers.clear();
+        for (auto& p : dsp.second)
+        {
+            if (use_delta)
+                receivers.push_back(p.first);
+            else
+                full_state_peers.push_back(p.first);
+            p.second->m_bytes_sent += ns->getTotalSize();
+            p.second->m_full_bytes += m_data_to_send->getTotalSize();
+        }
+        if (use_delta)
+        {
+            STKHost::get()->sendPacketToPeers(receivers, m_delta_to_send,
+                /*reliable*/false);
+        }
+    }
+    STKHost::get()->sendPacketToPeers(full_state_peers, m_data_to_send,
+        /*reliable*/false);
+
+    m_states_sent++;
+    if (m_states_sent >= NetworkConfig::get()->getStateFrequency())
+        printStateStatistics();
 }   // sendState
 
+// ----------------------------------------------------------------------------
+/** Prints the state bandwidth in bytes per second used for each peer and
+ *  for all peers, with and without delta compression, if connection
+ *  debugging is enabled. It also removes the information of disconnected
+ *  peers. Must be called with m_peer_state_info_mutex locked.
+ */
+void GameProtocol::printStateStatistics()
+{
+    const uint64_t now = StkTime::getMonoTimeMs();
+    const float seconds =
+        std::max(now - m_state_statistics_time, (uint64_t)1) / 1000.0f;
+    uint64_t total_sent = 0;
+    uint64_t total_full = 0;
+    for (auto it = m_peer_state_info.begin(); it != m_peer_state_info.end();)
+    {
+        auto peer = it->first.lock();
+        if (!peer)
+        {
+            it = m_peer_state_info.erase(it);
+            continue;
+        }
+        if (Network::m_connection_debug)
+        {
+            Log::info("GameProtocol", "State bandwidth to %s in %d states: "
+                "%.0f bytes/s sent, %.0f bytes/s without delta compression.",
+                peer->getAddress().toString().c_str(), m_states_sent,
+                it->second.m_bytes_sent / seconds,
+                it->second.m_full_bytes / seconds);
+        }
+        total_sent += it->second.m_bytes_sent;
+        total_full += it->second.m_full_bytes;
+        it->second.m_bytes_sent = 0;
+        it->second.m_full_bytes = 0;
+        it++;
+    }
+    if (Network::m_connection_debug && total_full > 0)
+    {
+        Log::info("GameProtocol", "State bandwidth to all peers: %.0f bytes/s "
+            "sent, %.0f bytes/s without delta compression (%.1f%%).",
+            total_sent / seconds, total_full / seconds,
+            100.0f * total_sent / total_full);
+    }
+    m_states_sent = 0;
+    m_state_statistics_time = now;
+}   // printStateStatistics
+
+// ----------------------------------------------------------------------------
+/** Stores a state (without message header) in the state history ring
+ *  buffer, to be used as base for delta compressed states.
+ *  \param ticks Time of the state.
+ *  \param data The number of static rewinder ids and of rewinders,
+ *         followed by the entry and the state (preceded by its 16 bit size)
+ *         of each rewinder.
+ *  \param size Number of bytes in data.
+ *  \return The history entry, its ticks are -1 if the data is invalid.
+ */
+GameProtocol::StateHistory&
+    GameProtocol::addStateHistory(int ticks, const uint8_t* data,
+                                  unsigned size)
+{
+    StateHistory& sh = m_state_history[m_state_history_index];
+    m_state_history_index =
+        (m_state_history_index + 1) % m_state_history.size();
+
+    sh.m_ticks = ticks;
+    sh.m_buffer.assign(data, data + size);
+    sh.m_entry_offsets.clear();
+    sh.m_offsets.clear();
+    sh.m_sizes.clear();
+    if (size < 2)
+    {
+        sh.m_ticks = -1;
+        return sh;
+    }
+    const unsigned static_count = data[0];
+    const unsigned count = data[1];
+    unsigned offset = 2;
+    for (unsigned i = 0; i < count; i++)
+    {
+        if (offset + 1 > size)
+        {
+            sh.m_ticks = -1;
+            return sh;
+        }
+        sh.m_entry_offsets.push_back(offset);
+        const unsigned id = data[offset++];
+        // Skip the unique identity of a rewinder without static id
+        if (id >= static_count)
+        {
+            if (offset + 1 > size)
+            {
+                sh.m_ticks = -1;
+                return sh;
+            }
+            offset += 1 + data[offset];
+        }
+        if (offset + 2 > size)
+        {
+            sh.m_ticks = -1;
+            return sh;
+        }
+        unsigned state_size = (data[offset] << 8) | data[offset + 1];
+        offset += 2;
+        if (offset + state_size > size)
+        {
+            sh.m_ticks = -1;
+            return sh;
+        }
+        sh.m_offsets.push_back(offset);
+        sh.m_sizes.push_back(state_size);
+        offset += state_size;
+    }
+    return sh;
+}   // addStateHistory
+
+// ----------------------------------------------------------------------------
+/** Returns the state at the given time from the history, or NULL if it is
+ *  not available anymore.
+ */
+const GameProtocol::StateHistory* GameProtocol::findStateHistory(int ticks)
+                                                                      const
+{
+    for (const StateHistory& sh : m_state_history)
+    {
+        if (sh.m_ticks == ticks)
+            return &sh;
+    }
+    return NULL;
+}   // findStateHistory
+
+// ----------------------------------------------------------------------------
+/** Writes a state delta compressed against a base state (which the peer has
+ *  acknowledged) into m_delta_to_send. The state of each rewinder which also
+ *  exists in the base state (with the same rewinder id) is sent as the xor
+ *  with its base state, with runs of unchanged bytes compressed, see
+ *  encodeDelta.
+ *  \param state The state to send.
+ *  \param base The base state known to the peer.
+ */
+void GameProtocol::writeDeltaState(const StateHistory& state,
+                                   const StateHistory& base)
+{
+    m_delta_to_send->clear();
+    m_delta_to_send->addUInt8(GP_DELTA_STATE).addUInt32(state.m_ticks)
+        .addUInt32(base.m_ticks);
+    // Number of static rewinder ids and of rewinders
+    std::vector<uint8_t>& out = m_delta_to_send->getBuffer();
+    out.insert(out.end(), state.m_buffer.begin(), state.m_buffer.begin() + 2);
+
+    for (unsigned i = 0; i < state.m_offsets.size(); i++)
+    {
+        // Copy the rewinder id and (if any) the unique identity
+        out.insert(out.end(),
+            state.m_buffer.begin() + state.m_entry_offsets[i],
+            state.m_buffer.begin() + state.m_offsets[i] - 2);
+        const uint8_t* data = state.m_buffer.data() + state.m_offsets[i];
+        const unsigned size = state.m_sizes[i];
+        m_delta_to_send->addUInt16(size);
+        const uint8_t id = state.getRewinderID(i);
+        unsigned j = 0;
+        while (j < base.m_offsets.size() && base.getRewinderID(j) != id)
+            j++;
+        if (j == base.m_offsets.size())
+        {
+            // New rewinder, send its full state
+            m_delta_to_send->addUInt8(0);
+            out.insert(out.end(), data, data + size);
+            continue;
+        }
+        m_delta_to_send->addUInt8(1);
+        encodeDelta(data, size, base.m_buffer.data() + base.m_offsets[j],
+            base.m_sizes[j], m_delta_to_send);
+    }
+    m_delta_to_send->reset();
+}   // writeDeltaState
+
+// ----------------------------------------------------------------------------
+/** Appends the xor of data and base to the string, where base is treated
+ *  as zero beyond base_size. The result is written as pairs of the number
+ *  of zero bytes (i.e. unchanged data) and the number of literal bytes
+ *  following, which makes unchanged fields in a state almost free.
+ *  \param data The new data.
+ *  \param size Number of bytes in data.
+ *  \param base The base data.
+ *  \param base_size Number of bytes in base.
+ *  \param out The string to append the encoded data to.
+ */
+void GameProtocol::encodeDelta(const uint8_t* data, unsigned size,
+                               const uint8_t* base, unsigned base_size,
+                               BareNetworkString* out)
+{
+    auto delta = [data, base, base_size](unsigned n)
+        {
+            return uint8_t(data[n] ^ (n < base_size ? base[n] : 0));
+        };
+    unsigned i = 0;
+    while (i < size)
+    {
+        unsigned zeros = 0;
+        while (i + zeros < size && zeros < 255 && delta(i + zeros) == 0)
+            zeros++;
+        const unsigned start = i + zeros;
+        unsigned literals = 0;
+        // A single unchanged byte is cheaper as literal than as a new pair
+        while (start + literals < size && literals < 255 &&
+               (delta(start + literals) != 0 ||
+                (start + literals + 1 < size &&
+                 delta(start + literals + 1) != 0)))
+            literals++;
+        out->addUInt8(zeros).addUInt8(literals);
+        for (unsigned n = start; n < start + literals; n++)
+            out->addUInt8(delta(n));
+        i = start + literals;
+    }
+}   // encodeDelta
+
+// ----------------------------------------------------------------------------
+/** Decodes data written by encodeDelta and appends the decoded data to out.
+ *  \param in The string to read the encoded data from.
+ *  \param size Number of decoded bytes.
+ *  \param base The base data.
+ *  \param base_size Number of bytes in base.
+ *  \param out The vector to append the decoded data to.
+ */
+void GameProtocol::decodeDelta(const BareNetworkString& in, unsigned size,
+                               const uint8_t* base, unsigned base_size,
+                               std::vector<uint8_t>* out)
+{
+    unsigned i = 0;
+    while (i < size)
+    {
+        unsigned zeros = in.getUInt8();
+        unsigned literals = in.getUInt8();
+        if (zeros + literals == 0 || i + zeros + literals > size)
+            throw std::out_of_range("Invalid delta state.");
+        for (; zeros > 0; zeros--, i++)
+            out->push_back(i < base_size ? base[i] : 0);
+        for (; literals > 0; literals--, i++)
+            out->push_back(in.getUInt8() ^ (i < base_size ? base[i] : 0));
+    }
+}   // decodeDelta
+
 // ----------------------------------------------------------------------------
 /** Called when a new full state is received form the server.
  */
@@ -342,22 +680,165 @@ void GameProtocol::handleState(Event *event)
     NetworkString &data = event->data();
     int ticks          = data.getUInt32();
 
-    // Check for updated rewinder using
-    unsigned rewinder_size = data.getUInt8();
-    std::vector<std::string> rewinder_using;
-    for (unsigned i = 0; i < rewinder_size; i++)
+    // Keep the state as base for delta states, and tell the server
+    const StateHistory& sh = addStateHistory(ticks,
+        (const uint8_t*)data.getCurrentData(), data.size());
+    if (sh.m_ticks == -1)
     {
-        std::string name;
-        data.decodeString(&name);
-        rewinder_using.push_back(name);
+        Log::error("GameProtocol", "Invalid state %d.", ticks);
+        return;
     }
+    sendStateAck(ticks);
 
     // The memory for bns will be handled in the RewindInfoState object
     RewindInfoState* ris = new RewindInfoState(ticks, data.getCurrentOffset(),
-        rewinder_using, data.getBuffer());
+        data.getBuffer());
     RewindManager::get()->addNetworkRewindInfo(ris);
 }   // handleState
 
+// ----------------------------------------------------------------------------
+/** Called when a delta compressed state is received from the server. It
+ *  restores the full state using the base state from the state history.
+ */
+void GameProtocol::handleDeltaState(Event *event)
+{
+    if (!NetworkConfig::get()->isClient())
+        return;
+    NetworkString &data = event->data();
+    int ticks = data.getUInt32();
+    int base_ticks = data.getUInt32();
+
+    const StateHistory* base = findStateHistory(base_ticks);
+    if (!base)
+    {
+        Log::warn("GameProtocol", "Missing base state %d for state %d.",
+            base_ticks, ticks);
+        return;
+    }
+
+    std::vector<uint8_t> buffer;
+    try
+    {
+        const uint8_t static_count = data.getUInt8();
+        const uint8_t count = data.getUInt8();
+        buffer.push_back(static_count);
+        buffer.push_back(count);
+        for (unsigned i = 0; i < count; i++)
+        {
+            const uint8_t id = data.getUInt8();
+            buffer.push_back(id);
+            if (id >= static_count)
+            {
+                const uint8_t length = data.getUInt8();
+                if (data.size() < length)
+                    throw std::out_of_range("Invalid delta state.");
+                const uint8_t* p = (const uint8_t*)data.getCurrentData();
+                buffer.push_back(length);
+                buffer.insert(buffer.end(), p, p + length);
+                data.skip(length);
+            }
+            const unsigned size = data.getUInt16();
+            const uint8_t mode = data.getUInt8();
+            buffer.push_back((size >> 8) & 0xff);
+            buffer.push_back(size & 0xff);
+            if (mode == 0)
+            {
+                if (data.size() < size)
+                    throw std::out_of_range("Invalid delta state.");
+                const uint8_t* p = (const uint8_t*)data.getCurrentData();
+                buffer.insert(buffer.end(), p, p + size);
+                data.skip(size);
+                continue;
+            }
+            unsigned j = 0;
+            while (j < base->m_offsets.size() && base->getRewinderID(j) != id)
+                j++;
+            if (j == base->m_offsets.size())
+                throw std::out_of_range("Rewinder not in base state.");
+            decodeDelta(data, size, base->m_buffer.data() + base->m_offsets[j],
+                base->m_sizes[j], &buffer);
+        }
+    }
+    catch (std::exception& e)
+    {
+        Log::error("GameProtocol", "Delta state %d error: %s", ticks,
+            e.what());
+        return;
+    }
+
+    const StateHistory& sh = addStateHistory(ticks, buffer.data(),
+        (unsigned)buffer.size());
+    if (sh.m_ticks == -1)
+    {
+        Log::error("GameProtocol", "Invalid delta state %d.", ticks);
+        return;
+    }
+    sendStateAck(ticks);
+
+    RewindInfoState* ris = new RewindInfoState(ticks, 0, buffer);
+    RewindManager::get()->addNetworkRewindInfo(ris);
+}   // handleDeltaState
+
+// ----------------------------------------------------------------------------
+/** Tells the server that the state at the given time was received, so it
+ *  can be used as base for delta compressed states.
+ *  \param ticks Time of the state received.
+ */
+void GameProtocol::sendStateAck(int ticks)
+{
+    NetworkString *ns = getNetworkString(5);
+    ns->addUInt8(GP_STATE_ACK).addUInt32(ticks);
+    // A lost ack only means that an older base state is used
+    sendToServer(ns, /*reliable*/false);
+    delete ns;
+}   // sendStateAck
+
+// ----------------------------------------------------------------------------
+/** Handles a state acknowledgement from a client.
+ */
+void GameProtocol::handleStateAck(Event *event)
+{
+    if (!NetworkConfig::get()->isServer())
+        return;
+    int ticks = event->data().getUInt32();
+    std::lock_guard<std::mutex> lock(m_peer_state_info_mutex);
+    PeerStateInfo& info = m_peer_state_info[event->getPeerSP()];
+    if (ticks > info.m_ack_ticks)
+        info.m_ack_ticks = ticks;
+}   // handleStateAck
+
+// ----------------------------------------------------------------------------
+/** Unit tests for the delta compression of states.
+ */
+void GameProtocol::unitTesting()
+{
+    std::vector<uint8_t> base, data;
+    for (unsigned i = 0; i < 600; i++)
+    {
+        base.push_back(uint8_t(i * 7));
+        data.push_back(uint8_t(i % 5 == 0 || (i > 300 && i < 310)
+                               ? i * 3 : i * 7));
+    }
+    for (unsigned base_size : { 0u, 1u, 100u, 600u })
+    {
+        for (unsigned size : { 0u, 1u, 2u, 300u, 600u })
+        {
+            BareNetworkString s;
+            encodeDelta(data.data(), size, base.data(), base_size, &s);
+            std::vector<uint8_t> out;
+            decodeDelta(s, size, base.data(), base_size, &out);
+            assert(out.size() == size);
+            assert(std::equal(out.begin(), out.end(), data.begin()));
+            assert(s.size() == 0);
+        }
+    }
+
+    // Unchanged data only needs 2 bytes for every 255 bytes
+    BareNetworkString s;
+    encodeDelta(base.data(), 600, base.data(), 600, &s);
+    assert(s.size() == 6);
+}   // unitTesting
+
 // ----------------------------------------------------------------------------
 /** Called from the RewindManager when rolling back.
  *  \param buffer Pointer to the saved state information.
@@ -27,12 +27,16 @@
 #include "utils/singleton.hpp"
 
 #include <cstdlib>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <vector>
 #include <tuple>
 
 class BareNetworkString;
 class NetworkString;
+class Rewinder;
 class STKPeer;
 
 class GameProtocol : public Protocol
@@ -48,13 +52,78 @@ private:
            GP_STATE,
            GP_ITEM_UPDATE,
            GP_ITEM_CONFIRMATION,
-           GP_ADJUST_TIME
+           GP_ADJUST_TIME,
+           GP_DELTA_STATE,
+           GP_STATE_ACK
     };
 
     /** A network string that collects all information from the server to be sent
      *  next. */
     NetworkString *m_data_to_send;
 
+    /** A network string used on the server to assemble the delta compressed
+     *  state for each peer. */
+    NetworkString *m_delta_to_send;
+
+    /** A state without message header, used as the base for delta
+     *  compressed states. */
+    struct StateHistory
+    {
+        int m_ticks;
+        /** Offset of the entry of each rewinder in m_buffer, which is its
+         *  rewinder id followed by its unique identity if the id is not
+         *  static (see RewindManager::getStaticRewinderCount). */
+        std::vector<unsigned> m_entry_offsets;
+        /** Offset of the state of each rewinder in m_buffer. */
+        std::vector<unsigned> m_offsets;
+        /** Size of the state of each rewinder. */
+        std::vector<unsigned> m_sizes;
+        /** The number of static rewinder ids and of rewinders, followed by
+         *  the entry, 16 bit size and state of each rewinder. */
+        std::vector<uint8_t> m_buffer;
+        // --------------------------------------------------------------------
+        /** Returns the rewinder id of the n-th rewinder in this state. */
+        uint8_t getRewinderID(unsigned n) const
+                                      { return m_buffer[m_entry_offsets[n]]; }
+    };
+
+    /** Ring buffer of the latest states sent (server) or received (client).
+     */
+    std::vector<StateHistory> m_state_history;
+
+    /** Index of the next entry to use in m_state_history. */
+    unsigned m_state_history_index;
+
+    /** Ticks of the state currently being assembled on the server. */
+    int m_state_ticks;
+
+    /** Number of rewinders in the state currently being assembled. */
+    unsigned m_state_rewinder_count;
+
+    /** Per peer information on the server for delta compressed states. */
+    struct PeerStateInfo
+    {
+        /** The latest state ticks acknowledged by the client, -1 if none. */
+        int m_ack_ticks;
+        /** Bytes of states sent since the last statistics output. */
+        unsigned m_bytes_sent;
+        /** Bytes that would have been sent without delta compression. */
+        unsigned m_full_bytes;
+        PeerStateInfo() : m_ack_ticks(-1), m_bytes_sent(0), m_full_bytes(0) {}
+    };
+    std::map<std::weak_ptr<STKPeer>, PeerStateInfo,
+        std::owner_less<std::weak_ptr<STKPeer> > > m_peer_state_info;
+
+    /** Protects m_peer_state_info, acks are handled in the network thread. */
+    std::mutex m_peer_state_info_mutex;
+
+    /** Number of states sent since the last statistics output. */
+    int m_states_sent;
+
+    /** Time of the last statistics output in milliseconds, used to print
+     *  the state bandwidth in bytes per second. */
+    uint64_t m_state_statistics_time;
+
     /** The server might request that the world clock of a client is adjusted
      *  to reduce number of rollbacks. */
     std::vector<int8_t> m_adjust_time;
@@ -75,6 +144,14 @@ private:
 
     void handleControllerAction(Event *event);
     void handleState(Event *event);
+    void handleDeltaState(Event *event);
+    void handleStateAck(Event *event);
+    StateHistory& addStateHistory(int ticks, const uint8_t* data,
+                                  unsigned size);
+    const StateHistory* findStateHistory(int ticks) const;
+    void sendStateAck(int ticks);
+    void writeDeltaState(const StateHistory& state, const StateHistory& base);
+    void printStateStatistics();
     void handleAdjustTime(Event *event);
     void handleItemEventConfirmation(Event *event);
     static std::weak_ptr<GameProtocol> m_game_protocol;
@@ -101,6 +178,14 @@ private:
         return std::make_tuple(a, b, c, d);
     }
 public:
+    static void unitTesting();
+    static void encodeDelta(const uint8_t* data, unsigned size,
+                            const uint8_t* base, unsigned base_size,
+                            BareNetworkString* out);
+    static void decodeDelta(const BareNetworkString& in, unsigned size,
+                            const uint8_t* base, unsigned base_size,
+                            std::vector<uint8_t>* out);
+
              GameProtocol();
     virtual ~GameProtocol();
 
@@ -110,9 +195,9 @@ public:
     void controllerAction(int kart_id, PlayerAction action,
                           int value, int val_l, int val_r);
     void startNewState();
-    void addState(BareNetworkString *buffer);
+    unsigned addState(Rewinder* rewinder);
     void sendState();
-    void finalizeState(std::vector<std::string>& cur_rewinder);
+    void finalizeState();
     void sendItemEventConfirmation(int ticks);
 
     virtual void undo(BareNetworkString *buffer) OVERRIDE;
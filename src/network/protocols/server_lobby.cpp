@@ -28,6 +28,7 @@
 #include "modes/capture_the_flag.hpp"
 #include "modes/linear_world.hpp"
 #include "network/crypto.hpp"
+#include "network/database_worker.hpp"
 #include "network/event.hpp"
 #include "network/game_setup.hpp"
 #include "network/network_config.hpp"
@@ -38,6 +39,7 @@
 #include "network/protocols/game_protocol.hpp"
 #include "network/protocols/game_events_protocol.hpp"
 #include "network/race_event_manager.hpp"
+#include "network/rewind_manager.hpp"
 #include "network/server_config.hpp"
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
@@ -166,12 +168,66 @@ ServerLobby::~ServerLobby()
     destroyDatabase();
 }   // ~ServerLobby
 
+#ifdef ENABLE_SQLITE3
+namespace
+{
+    /** An online id ban table row read in the database worker thread. */
+    struct BanInfo
+    {
+        int m_row_id = -1;
+        std::string m_reason;
+        std::string m_description;
+    };
+    // ------------------------------------------------------------------------
+    std::string getColumnText(sqlite3_stmt* stmt, int column)
+    {
+        const char* text = (const char*)sqlite3_column_text(stmt, column);
+        return text ? text : "";
+    }   // getColumnText
+    // ------------------------------------------------------------------------
+    std::string getIPBanTableQuery()
+    {
+        // Times are converted to seconds since epoch for IPBanIndex
+        std::ostringstream oss;
+        oss << "SELECT rowid, ip_start, ip_end, reason, description, "
+            << "CAST(STRFTIME(\"%s\", starting_time) AS INTEGER), "
+            << "CAST(STRFTIME(\"%s\", starting_time, "
+            << "'+'||expired_days||' days') AS INTEGER) "
+            << "FROM " << ServerConfig::m_ip_ban_table.c_str() << ";";
+        return oss.str();
+    }   // getIPBanTableQuery
+    // ------------------------------------------------------------------------
+    void readIPBanEntry(sqlite3_stmt* stmt,
+                        std::vector<IPBanIndex::Entry>* entries)
+    {
+        // Entry without valid starting time will never be effective
+        if (sqlite3_column_type(stmt, 5) == SQLITE_NULL)
+            return;
+        IPBanIndex::Entry e;
+        e.m_row_id = sqlite3_column_int(stmt, 0);
+        e.m_ip_start = (uint32_t)sqlite3_column_int64(stmt, 1);
+        e.m_ip_end = (uint32_t)sqlite3_column_int64(stmt, 2);
+        e.m_reason = getColumnText(stmt, 3);
+        e.m_description = getColumnText(stmt, 4);
+        e.m_starting_time = sqlite3_column_int64(stmt, 5);
+        e.m_expired_time = sqlite3_column_type(stmt, 6) == SQLITE_NULL ?
+            -1 : sqlite3_column_int64(stmt, 6);
+        entries->push_back(e);
+    }   // readIPBanEntry
+}   // namespace
+#endif
+
 //-----------------------------------------------------------------------------
 void ServerLobby::initDatabase()
 {
 #ifdef ENABLE_SQLITE3
     m_last_cleanup_db_time = StkTime::getMonoTimeMs();
     m_db = NULL;
+    m_db_worker = NULL;
+    m_ip_ban_data_version = -1;
+    m_ip_ban_saves = 0;
+    m_ip_ban_updating = false;
+    m_last_ip_ban_update_time = StkTime::getMonoTimeMs();
     m_ip_ban_table_exists = false;
     m_online_id_ban_table_exists = false;
     m_ip_geolocation_table_exists = false;
@@ -188,18 +244,7 @@ void ServerLobby::initDatabase()
         m_db = NULL;
         return;
     }
-    sqlite3_busy_handler(m_db, [](void* data, int retry)
-        {
-            // Maximum 1 second total retry time
-            if (retry < 10)
-            {
-                sqlite3_sleep(100);
-                // Return non-zero to let caller retry again
-                return 1;
-            }
-            // Return zero to let caller return SQLITE_BUSY immediately
-            return 0;
-        }, NULL);
+    sqlite3_busy_handler(m_db, DatabaseWorker::busyHandler, NULL);
 
     checkTableExists(ServerConfig::m_ip_ban_table, m_ip_ban_table_exists);
     checkTableExists(ServerConfig::m_online_id_ban_table,
@@ -208,6 +253,9 @@ void ServerLobby::initDatabase()
         m_player_reports_table_exists);
     checkTableExists(ServerConfig::m_ip_geolocation_table,
         m_ip_geolocation_table_exists);
+    if (m_ip_ban_table_exists)
+        loadIPBanTable();
+    m_db_worker = new DatabaseWorker(ServerConfig::m_database_file);
 #endif
 }   // initDatabase
 
@@ -416,6 +464,10 @@ void ServerLobby::destroyDatabase()
     auto peers = STKHost::get()->getPeers();
     for (auto& peer : peers)
         writeDisconnectInfoTable(peer.get());
+    flushIPBanTriggers();
+    // Waits for all queued queries to be written
+    delete m_db_worker;
+    m_db_worker = NULL;
     if (m_db != NULL)
         sqlite3_close(m_db);
 #endif
@@ -425,13 +477,18 @@ void ServerLobby::destroyDatabase()
 void ServerLobby::writeDisconnectInfoTable(STKPeer* peer)
 {
 #ifdef ENABLE_SQLITE3
-    if (m_server_stats_table.empty())
+    if (m_server_stats_table.empty() || !m_db_worker)
         return;
     std::string query = StringUtils::insertValues(
-        "UPDATE %s SET disconnected_time = datetime('now'), ping = %d "
-        "WHERE host_id = %u;", m_server_stats_table.c_str(),
-        peer->getAveragePing(), peer->getHostId());
-    easySQLQuery(query);
+        "UPDATE %s SET disconnected_time = datetime('now'), ping = ? "
+        "WHERE host_id = ?;", m_server_stats_table.c_str());
+    const int ping = peer->getAveragePing();
+    const uint32_t host_id = peer->getHostId();
+    m_db_worker->addQuery(query, [ping, host_id](sqlite3_stmt* stmt)
+        {
+            sqlite3_bind_int(stmt, 1, ping);
+            sqlite3_bind_int64(stmt, 2, host_id);
+        });
 #endif
 }   // writeDisconnectInfoTable
 
@@ -718,7 +775,7 @@ void ServerLobby::createServerIdFile()
  */
 void ServerLobby::cleanupDatabase()
 {
-    if (!ServerConfig::m_sql_management || !m_db)
+    if (!ServerConfig::m_sql_management || !m_db_worker)
         return;
 
     if (StkTime::getMonoTimeMs() < m_last_cleanup_db_time + 60000)
@@ -735,7 +792,7 @@ void ServerLobby::cleanupDatabase()
             "(reported_time, '+%f days') < datetime('now');",
             ServerConfig::m_player_reports_table.c_str(),
             ServerConfig::m_player_reports_expired_days);
-        easySQLQuery(query);
+        m_db_worker->addQuery(query);
     }
     if (m_server_stats_table.empty())
         return;
@@ -775,9 +832,148 @@ void ServerLobby::cleanupDatabase()
         oss << ");";
         query = oss.str();
     }
-    easySQLQuery(query);
+    m_db_worker->addQuery(query);
 }   // cleanupDatabase
 
+//-----------------------------------------------------------------------------
+/** Loads the IP ban table into m_ip_ban_index when starting the server, so
+ *  that bans are effective before any peer connects.
+ */
+void ServerLobby::loadIPBanTable()
+{
+    std::vector<IPBanIndex::Entry> entries;
+    std::string query = getIPBanTableQuery();
+    sqlite3_stmt* stmt = NULL;
+    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
+    if (ret == SQLITE_OK)
+    {
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+            readIPBanEntry(stmt, &entries);
+        ret = sqlite3_finalize(stmt);
+        if (ret != SQLITE_OK)
+        {
+            Log::error("ServerLobby",
+                "Error finalize database for query %s: %s",
+                query.c_str(), sqlite3_errmsg(m_db));
+        }
+    }
+    else
+    {
+        Log::error("ServerLobby", "Error preparing database for query %s: %s",
+            query.c_str(), sqlite3_errmsg(m_db));
+        return;
+    }
+    m_ip_ban_index.set(std::move(entries));
+    Log::info("ServerLobby", "%u IP ban ranges loaded.",
+        m_ip_ban_index.size());
+
+    ret = sqlite3_prepare_v2(m_db, "PRAGMA data_version;", -1, &stmt, 0);
+    if (ret == SQLITE_OK)
+    {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            m_ip_ban_data_version = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+}   // loadIPBanTable
+
+//-----------------------------------------------------------------------------
+/* Every 10 seconds write the trigger counts of IP bans and check if the
+ * database was changed by another connection (for example the server owner
+ * editing the ban table), if so reload the IP ban table in the database
+ * worker.
+ */
+void ServerLobby::updateIPBanTable()
+{
+    if (!m_db_worker || !m_ip_ban_table_exists || m_ip_ban_updating)
+        return;
+
+    if (StkTime::getMonoTimeMs() < m_last_ip_ban_update_time + 10000)
+        return;
+
+    m_last_ip_ban_update_time = StkTime::getMonoTimeMs();
+    flushIPBanTriggers();
+
+    m_ip_ban_updating = true;
+    auto version = std::make_shared<int64_t>(-1);
+    m_db_worker->addQuery("PRAGMA data_version;", nullptr,
+        [version](sqlite3_stmt* stmt)
+        {
+            *version = sqlite3_column_int64(stmt, 0);
+        },
+        [this, version](bool success)
+        {
+            m_ip_ban_updating = false;
+            if (success && *version != m_ip_ban_data_version)
+                reloadIPBanTable(*version);
+        });
+}   // updateIPBanTable
+
+//-----------------------------------------------------------------------------
+/** Reloads the IP ban table in the database worker and replaces
+ *  m_ip_ban_index with it.
+ *  \param version PRAGMA data_version of the table to be loaded, or -1 if
+ *         it is reloaded after this server changed the table itself.
+ */
+void ServerLobby::reloadIPBanTable(int64_t version)
+{
+    unsigned saves;
+    {
+        std::lock_guard<std::mutex> lock(m_ip_ban_mutex);
+        saves = m_ip_ban_saves;
+    }
+    auto entries = std::make_shared<std::vector<IPBanIndex::Entry> >();
+    m_db_worker->addQuery(getIPBanTableQuery(), nullptr,
+        [entries](sqlite3_stmt* stmt)
+        {
+            readIPBanEntry(stmt, entries.get());
+        },
+        [this, version, entries, saves](bool success)
+        {
+            if (!success)
+                return;
+            std::lock_guard<std::mutex> lock(m_ip_ban_mutex);
+            // A ban saved since the query was queued might be missing
+            if (saves != m_ip_ban_saves)
+                return;
+            m_ip_ban_index.set(std::move(*entries));
+            if (version != -1)
+                m_ip_ban_data_version = version;
+            Log::debug("ServerLobby", "%u IP ban ranges reloaded.",
+                m_ip_ban_index.size());
+        });
+}   // reloadIPBanTable
+
+//-----------------------------------------------------------------------------
+/** Writes the trigger counts of IP bans since last flush, they are executed
+ *  in one transaction by the database worker.
+ */
+void ServerLobby::flushIPBanTriggers()
+{
+    if (!m_db_worker || m_ip_ban_triggers.empty())
+        return;
+
+    std::string query = StringUtils::insertValues(
+        "UPDATE %s SET trigger_count = trigger_count + ?, "
+        "last_trigger = datetime('now') "
+        "WHERE ip_start = ? AND ip_end = ?;",
+        ServerConfig::m_ip_ban_table.c_str());
+    std::lock_guard<std::mutex> lock(m_ip_ban_mutex);
+    for (auto& p : m_ip_ban_triggers)
+    {
+        const unsigned count = p.second;
+        const uint32_t ip_start = p.first.first;
+        const uint32_t ip_end = p.first.second;
+        m_db_worker->addQuery(query,
+            [count, ip_start, ip_end](sqlite3_stmt* stmt)
+            {
+                sqlite3_bind_int(stmt, 1, count);
+                sqlite3_bind_int64(stmt, 2, ip_start);
+                sqlite3_bind_int64(stmt, 3, ip_end);
+            });
+    }
+    m_ip_ban_triggers.clear();
+}   // flushIPBanTriggers
+
 //-----------------------------------------------------------------------------
 /** Run simple query with write lock waiting and optional function, this
  *  function has no callback for the return (if any) by the query.
@@ -904,9 +1100,9 @@ std::string ServerLobby::ip2Country(const TransportAddress& addr) const
 void ServerLobby::writePlayerReport(Event* event)
 {
 #ifdef ENABLE_SQLITE3
-    if (!m_db || !m_player_reports_table_exists)
+    if (!m_db_worker || !m_player_reports_table_exists)
         return;
-    STKPeer* reporter = event->getPeer();
+    std::shared_ptr<STKPeer> reporter = event->getPeerSP();
     if (!reporter->hasPlayerProfiles())
         return;
     auto reporter_npp = reporter->getPlayerProfiles()[0];
@@ -926,51 +1122,65 @@ void ServerLobby::writePlayerReport(Event* event)
         "INSERT INTO %s "
         "(server_uid, reporter_ip, reporter_online_id, reporter_username, "
         "info, reporting_ip, reporting_online_id, reporting_username) "
-        "VALUES (?, %u, %u, ?, ?, %u, %u, ?);",
-        ServerConfig::m_player_reports_table.c_str(),
-        reporter->getAddress().getIP(), reporter_npp->getOnlineId(),
-        reporting_peer->getAddress().getIP(), reporting_npp->getOnlineId());
-    bool written = easySQLQuery(query,
-        [reporter_npp, reporting_npp, info](sqlite3_stmt* stmt)
+        "VALUES (?, ?, ?, ?, ?, ?, ?, ?);",
+        ServerConfig::m_player_reports_table.c_str());
+    const uint32_t reporter_ip = reporter->getAddress().getIP();
+    const uint32_t reporter_online_id = reporter_npp->getOnlineId();
+    const std::string reporter_name =
+        StringUtils::wideToUtf8(reporter_npp->getName());
+    const std::string info_utf8 = StringUtils::wideToUtf8(info);
+    const uint32_t reporting_ip = reporting_peer->getAddress().getIP();
+    const uint32_t reporting_online_id = reporting_npp->getOnlineId();
+    const core::stringw reporting_name = reporting_npp->getName();
+    const std::string reporting_name_utf8 =
+        StringUtils::wideToUtf8(reporting_name);
+    const std::string server_uid = ServerConfig::m_server_uid;
+    m_db_worker->addQuery(query,
+        [server_uid, reporter_ip, reporter_online_id, reporter_name,
+        info_utf8, reporting_ip, reporting_online_id, reporting_name_utf8]
+        (sqlite3_stmt* stmt)
         {
             // SQLITE_TRANSIENT to copy string
-            if (sqlite3_bind_text(stmt, 1, ServerConfig::m_server_uid.c_str(),
+            if (sqlite3_bind_text(stmt, 1, server_uid.c_str(),
                 -1, SQLITE_TRANSIENT) != SQLITE_OK)
             {
                 Log::error("easySQLQuery", "Failed to bind %s.",
-                    ServerConfig::m_server_uid.c_str());
+                    server_uid.c_str());
             }
-            if (sqlite3_bind_text(stmt, 2,
-                StringUtils::wideToUtf8(reporter_npp->getName()).c_str(),
+            sqlite3_bind_int64(stmt, 2, reporter_ip);
+            sqlite3_bind_int64(stmt, 3, reporter_online_id);
+            if (sqlite3_bind_text(stmt, 4, reporter_name.c_str(),
                 -1, SQLITE_TRANSIENT) != SQLITE_OK)
             {
                 Log::error("easySQLQuery", "Failed to bind %s.",
-                    StringUtils::wideToUtf8(reporter_npp->getName()).c_str());
+                    reporter_name.c_str());
             }
-            if (sqlite3_bind_text(stmt, 3,
-                StringUtils::wideToUtf8(info).c_str(),
+            if (sqlite3_bind_text(stmt, 5, info_utf8.c_str(),
                 -1, SQLITE_TRANSIENT) != SQLITE_OK)
             {
                 Log::error("easySQLQuery", "Failed to bind %s.",
-                    StringUtils::wideToUtf8(info).c_str());
+                    info_utf8.c_str());
             }
-            if (sqlite3_bind_text(stmt, 4,
-                StringUtils::wideToUtf8(reporting_npp->getName()).c_str(),
+            sqlite3_bind_int64(stmt, 6, reporting_ip);
+            sqlite3_bind_int64(stmt, 7, reporting_online_id);
+            if (sqlite3_bind_text(stmt, 8, reporting_name_utf8.c_str(),
                 -1, SQLITE_TRANSIENT) != SQLITE_OK)
             {
                 Log::error("easySQLQuery", "Failed to bind %s.",
-                    StringUtils::wideToUtf8(reporting_npp->getName()).c_str());
+                    reporting_name_utf8.c_str());
             }
+        }, nullptr,
+        [this, reporter, reporting_name](bool written)
+        {
+            if (!written || reporter->isDisconnected())
+                return;
+            NetworkString* success = getNetworkString();
+            success->setSynchronous(true);
+            success->addUInt8(LE_REPORT_PLAYER).addUInt8(1)
+                .encodeString(reporting_name);
+            reporter->sendPacket(success, true/*reliable*/);
+            delete success;
         });
-    if (written)
-    {
-        NetworkString* success = getNetworkString();
-        success->setSynchronous(true);
-        success->addUInt8(LE_REPORT_PLAYER).addUInt8(1)
-            .encodeString(reporting_npp->getName());
-        event->getPeer()->sendPacket(success, true/*reliable*/);
-        delete success;
-    }
 #endif
 }   // writePlayerReport
 
@@ -986,7 +1196,10 @@ void ServerLobby::asynchronousUpdate()
     }
 
 #ifdef ENABLE_SQLITE3
+    if (m_db_worker)
+        m_db_worker->handleCallbacks();
     cleanupDatabase();
+    updateIPBanTable();
 #endif
 
     // Check if server owner has left
@@ -1219,6 +1432,25 @@ void ServerLobby::asynchronousUpdate()
 
 }   // asynchronousUpdate
 
+//-----------------------------------------------------------------------------
+/** The lobby polls the voting and world loading state of all peers (which
+ *  are changed by the main thread too) and some timeouts, so it has to be
+ *  updated regularly. Use a short interval when a race is about to start,
+ *  so that the start time is configured as soon as everyone is ready.
+ */
+int ServerLobby::getAsynchronousUpdateInterval() const
+{
+    switch (m_state.load())
+    {
+    case SELECTING:
+    case LOAD_WORLD:
+    case WAIT_FOR_WORLD_LOADED:
+        return 2;
+    default:
+        return 20;
+    }
+}   // getAsynchronousUpdateInterval
+
 //-----------------------------------------------------------------------------
 void ServerLobby::encodePlayers(BareNetworkString* bns,
         std::vector<std::shared_ptr<NetworkPlayerProfile> >& players) const
@@ -1567,6 +1799,7 @@ void ServerLobby::finishedLoadingLiveJoinClient(Event* event)
     ns->addUInt8(LE_LIVE_JOIN_ACK).addUInt64(m_client_starting_time)
         .addUInt8(cc).addUInt64(live_join_start_time)
         .addUInt32(m_last_live_join_util_ticks);
+    RewindManager::get()->saveRewinderIDs(ns);
 
     NetworkItemManager* nim =
         dynamic_cast<NetworkItemManager*>(ItemManager::get());
@@ -2635,14 +2868,35 @@ void ServerLobby::kickPlayerWithReason(STKPeer* peer, const char* reason) const
 void ServerLobby::saveIPBanTable(const TransportAddress& addr)
 {
 #ifdef ENABLE_SQLITE3
-    if (!m_db || !m_ip_ban_table_exists)
+    if (!m_db_worker || !m_ip_ban_table_exists)
         return;
 
     std::string query = StringUtils::insertValues(
         "INSERT INTO %s (ip_start, ip_end) "
-        "VALUES (%u, %u);",
-        ServerConfig::m_ip_ban_table.c_str(), addr.getIP(), addr.getIP());
-    easySQLQuery(query);
+        "VALUES (?1, ?1);", ServerConfig::m_ip_ban_table.c_str());
+    const uint32_t ip = addr.getIP();
+    m_db_worker->addQuery(query, [ip](sqlite3_stmt* stmt)
+        {
+            sqlite3_bind_int64(stmt, 1, ip);
+        }, nullptr,
+        [this](bool success)
+        {
+            // Replace the temporary entry with the actual database row
+            if (success)
+                reloadIPBanTable(-1);
+        });
+
+    // Effective immediately, until the table is reloaded after the row
+    // is written
+    IPBanIndex::Entry e;
+    e.m_row_id = -1;
+    e.m_ip_start = ip;
+    e.m_ip_end = ip;
+    e.m_starting_time = StkTime::getTimeSinceEpoch() - 1;
+    e.m_expired_time = -1;
+    std::lock_guard<std::mutex> lock(m_ip_ban_mutex);
+    m_ip_ban_index.add(e);
+    m_ip_ban_saves++;
 #endif
 }   // saveIPBanTable
 
@@ -2783,9 +3037,28 @@ void ServerLobby::connectionRequested(Event* event)
     if (peer->isDisconnected())
         return;
 
-    if (online_id != 0)
-        testBannedForOnlineId(peer.get(), online_id);
+    // The online id ban test is done by the database worker, so keep the
+    // remaining data for continuing the connection when it is finished
+    auto remaining = std::make_shared<BareNetworkString>(
+        data.getCurrentData(), data.size());
     // Will be disconnected if banned by online id
+    testBannedForOnlineId(peer, online_id, [this, peer, remaining,
+        player_count, online_id, encrypted_size]()
+        {
+            handleConnectionRequest(peer, *remaining, player_count,
+                online_id, encrypted_size);
+        });
+}   // connectionRequested
+
+//-----------------------------------------------------------------------------
+/** Continues a connection request of a peer which is not banned.
+ */
+void ServerLobby::handleConnectionRequest(std::shared_ptr<STKPeer> peer,
+                                          BareNetworkString& data,
+                                          unsigned player_count,
+                                          uint32_t online_id,
+                                          uint32_t encrypted_size)
+{
     if (peer->isDisconnected())
         return;
 
@@ -2843,7 +3116,7 @@ void ServerLobby::connectionRequested(Event* event)
         handleUnencryptedConnection(peer, data, online_id, online_name,
             false/*is_pending_connection*/);
     }
-}   // connectionRequested
+}   // handleConnectionRequest
 
 //-----------------------------------------------------------------------------
 void ServerLobby::handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
@@ -3017,29 +3290,39 @@ void ServerLobby::handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
         }
     }
 #ifdef ENABLE_SQLITE3
-    if (m_server_stats_table.empty())
+    if (m_server_stats_table.empty() || !m_db_worker)
         return;
     std::string query = StringUtils::insertValues(
         "INSERT INTO %s "
         "(host_id, ip, port, online_id, username, player_num, "
         "country_code, version, ping) "
-        "VALUES (%u, %u, %u, %u, ?, %u, ?, ?, %u);",
-        m_server_stats_table.c_str(), peer->getHostId(),
-        peer->getAddress().getIP(), peer->getAddress().getPort(), online_id,
-        player_count, peer->getAveragePing());
-    easySQLQuery(query, [peer, country_code](sqlite3_stmt* stmt)
+        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?);", m_server_stats_table.c_str());
+    // The query is executed in the database worker thread, so copy all
+    // values instead of accessing the peer there
+    const uint32_t host_id = peer->getHostId();
+    const uint32_t ip = peer->getAddress().getIP();
+    const uint16_t port = peer->getAddress().getPort();
+    const int ping = peer->getAveragePing();
+    const std::string username =
+        StringUtils::wideToUtf8(peer->getPlayerProfiles()[0]->getName());
+    const std::string version = peer->getUserVersion();
+    m_db_worker->addQuery(query, [host_id, ip, port, online_id, username,
+        player_count, country_code, version, ping](sqlite3_stmt* stmt)
         {
-            if (sqlite3_bind_text(stmt, 1, StringUtils::wideToUtf8(
-                peer->getPlayerProfiles()[0]->getName()).c_str(),
+            sqlite3_bind_int64(stmt, 1, host_id);
+            sqlite3_bind_int64(stmt, 2, ip);
+            sqlite3_bind_int(stmt, 3, port);
+            sqlite3_bind_int64(stmt, 4, online_id);
+            if (sqlite3_bind_text(stmt, 5, username.c_str(),
                 -1, SQLITE_TRANSIENT) != SQLITE_OK)
             {
                 Log::error("easySQLQuery", "Failed to bind %s.",
-                    StringUtils::wideToUtf8(
-                    peer->getPlayerProfiles()[0]->getName()).c_str());
+                    username.c_str());
             }
+            sqlite3_bind_int(stmt, 6, player_count);
             if (country_code.empty())
             {
-                if (sqlite3_bind_null(stmt, 2) != SQLITE_OK)
+                if (sqlite3_bind_null(stmt, 7) != SQLITE_OK)
                 {
                     Log::error("easySQLQuery",
                         "Failed to bind NULL for country code.");
@@ -3047,21 +3330,21 @@ void ServerLobby::handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
             }
             else
             {
-                if (sqlite3_bind_text(stmt, 2, country_code.c_str(),
+                if (sqlite3_bind_text(stmt, 7, country_code.c_str(),
                     -1, SQLITE_TRANSIENT) != SQLITE_OK)
                 {
                     Log::error("easySQLQuery", "Failed to bind country: %s.",
                         country_code.c_str());
                 }
             }
-            if (sqlite3_bind_text(stmt, 3, peer->getUserVersion().c_str(),
+            if (sqlite3_bind_text(stmt, 8, version.c_str(),
                 -1, SQLITE_TRANSIENT) != SQLITE_OK)
             {
                 Log::error("easySQLQuery", "Failed to bind %s.",
-                    peer->getUserVersion().c_str());
+                    version.c_str());
             }
-        }
-    );
+            sqlite3_bind_int(stmt, 9, ping);
+        });
 #endif
 }   // handleUnencryptedConnection
 
@@ -3740,6 +4023,7 @@ void ServerLobby::configPeersStartTime()
     ns->addUInt8(LE_START_RACE).addUInt64(start_time);
     const uint8_t cc = (uint8_t)CheckManager::get()->getCheckStructureCount();
     ns->addUInt8(cc);
+    RewindManager::get()->saveRewinderIDs(ns);
     *ns += *m_items_complete_state;
     m_client_starting_time = start_time;
     sendMessageToPeers(ns, /*reliable*/true);
@@ -3828,124 +4112,95 @@ void ServerLobby::resetServer()
 }   // resetServer
 
 //-----------------------------------------------------------------------------
-void ServerLobby::testBannedForIP(STKPeer* peer) const
+/** Tests if the peer is banned by IP using the in-memory copy of the IP ban
+ *  table, the peer will be kicked if so.
+ */
+void ServerLobby::testBannedForIP(STKPeer* peer)
 {
 #ifdef ENABLE_SQLITE3
-    if (!m_db || !m_ip_ban_table_exists)
+    if (!m_ip_ban_table_exists)
         return;
 
-    int row_id = -1;
-    unsigned ip_start = 0;
-    unsigned ip_end = 0;
-    std::string query = StringUtils::insertValues(
-        "SELECT rowid, ip_start, ip_end, reason, description FROM %s "
-        "WHERE ip_start <= %u AND ip_end >= %u "
-        "AND datetime('now') > datetime(starting_time) AND "
-        "(expired_days is NULL OR datetime"
-        "(starting_time, '+'||expired_days||' days') > datetime('now')) "
-        "LIMIT 1;",
-        ServerConfig::m_ip_ban_table.c_str(),
-        peer->getAddress().getIP(), peer->getAddress().getIP());
-
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
-    {
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW)
-        {
-            row_id = sqlite3_column_int(stmt, 0);
-            ip_start = (unsigned)sqlite3_column_int64(stmt, 1);
-            ip_end = (unsigned)sqlite3_column_int64(stmt, 2);
-            const char* reason = (char*)sqlite3_column_text(stmt, 3);
-            const char* desc = (char*)sqlite3_column_text(stmt, 4);
-            Log::info("ServerLobby", "%s banned by IP: %s "
-                "(rowid: %d, description: %s).",
-                peer->getAddress().toString().c_str(), reason, row_id, desc);
-            kickPlayerWithReason(peer, reason);
-        }
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
-        {
-            Log::error("ServerLobby",
-                "Error finalize database for query %s: %s",
-                query.c_str(), sqlite3_errmsg(m_db));
-        }
-    }
-    else
-    {
-        Log::error("ServerLobby", "Error preparing database for query %s: %s",
-            query.c_str(), sqlite3_errmsg(m_db));
+    std::unique_lock<std::mutex> ul(m_ip_ban_mutex);
+    const IPBanIndex::Entry* ban = m_ip_ban_index.find(
+        peer->getAddress().getIP(), StkTime::getTimeSinceEpoch());
+    if (!ban)
         return;
-    }
-    if (row_id != -1)
-    {
-        query = StringUtils::insertValues(
-            "UPDATE %s SET trigger_count = trigger_count + 1, "
-            "last_trigger = datetime('now') "
-            "WHERE ip_start = %u AND ip_end = %u;",
-            ServerConfig::m_ip_ban_table.c_str(), ip_start, ip_end);
-        easySQLQuery(query);
-    }
+    const std::string reason = ban->m_reason;
+
+    Log::info("ServerLobby", "%s banned by IP: %s "
+        "(rowid: %d, description: %s).",
+        peer->getAddress().toString().c_str(), ban->m_reason.c_str(),
+        ban->m_row_id, ban->m_description.c_str());
+    // Written to database in updateIPBanTable
+    m_ip_ban_triggers[std::make_pair(ban->m_ip_start, ban->m_ip_end)]++;
+    ul.unlock();
+    kickPlayerWithReason(peer, reason.c_str());
 #endif
 }   // testBannedForIP
 
 //-----------------------------------------------------------------------------
-void ServerLobby::testBannedForOnlineId(STKPeer* peer,
-                                        uint32_t online_id) const
+/** Tests if the online id is banned in the database worker, the peer will
+ *  be kicked if so, otherwise not_banned will be called.
+ */
+void ServerLobby::testBannedForOnlineId(std::shared_ptr<STKPeer> peer,
+                                        uint32_t online_id,
+                                        std::function<void()> not_banned)
 {
 #ifdef ENABLE_SQLITE3
-    if (!m_db || !m_online_id_ban_table_exists)
+    if (!m_db_worker || !m_online_id_ban_table_exists || online_id == 0)
+    {
+        not_banned();
         return;
+    }
 
-    int row_id = -1;
     std::string query = StringUtils::insertValues(
         "SELECT rowid, reason, description FROM %s "
-        "WHERE online_id = %u "
+        "WHERE online_id = ? "
         "AND datetime('now') > datetime(starting_time) AND "
         "(expired_days is NULL OR datetime"
         "(starting_time, '+'||expired_days||' days') > datetime('now')) "
-        "LIMIT 1;",
-        ServerConfig::m_online_id_ban_table.c_str(), online_id);
+        "LIMIT 1;", ServerConfig::m_online_id_ban_table.c_str());
 
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
-    {
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW)
+    auto ban = std::make_shared<BanInfo>();
+    m_db_worker->addQuery(query,
+        [online_id](sqlite3_stmt* stmt)
+        {
+            sqlite3_bind_int64(stmt, 1, online_id);
+        },
+        [ban](sqlite3_stmt* stmt)
         {
-            row_id = sqlite3_column_int(stmt, 0);
-            const char* reason = (char*)sqlite3_column_text(stmt, 1);
-            const char* desc = (char*)sqlite3_column_text(stmt, 2);
+            ban->m_row_id = sqlite3_column_int(stmt, 0);
+            ban->m_reason = getColumnText(stmt, 1);
+            ban->m_description = getColumnText(stmt, 2);
+        },
+        [this, peer, online_id, ban, not_banned](bool success)
+        {
+            if (peer->isDisconnected())
+                return;
+            if (ban->m_row_id == -1)
+            {
+                not_banned();
+                return;
+            }
             Log::info("ServerLobby", "%s banned by online id: %s "
                 "(online id: %u rowid: %d, description: %s).",
-                peer->getAddress().toString().c_str(), reason, online_id,
-                row_id, desc);
-            kickPlayerWithReason(peer, reason);
-        }
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
-        {
-            Log::error("ServerLobby", "Error finalize database: %s",
-                sqlite3_errmsg(m_db));
-        }
-    }
-    else
-    {
-        Log::error("ServerLobby", "Error preparing database: %s",
-            sqlite3_errmsg(m_db));
-        return;
-    }
-    if (row_id != -1)
-    {
-        query = StringUtils::insertValues(
-            "UPDATE %s SET trigger_count = trigger_count + 1, "
-            "last_trigger = datetime('now') "
-            "WHERE online_id = %u;",
-            ServerConfig::m_online_id_ban_table.c_str(), online_id);
-        easySQLQuery(query);
-    }
+                peer->getAddress().toString().c_str(), ban->m_reason.c_str(),
+                online_id, ban->m_row_id, ban->m_description.c_str());
+            kickPlayerWithReason(peer.get(), ban->m_reason.c_str());
+
+            std::string query = StringUtils::insertValues(
+                "UPDATE %s SET trigger_count = trigger_count + 1, "
+                "last_trigger = datetime('now') "
+                "WHERE online_id = ?;",
+                ServerConfig::m_online_id_ban_table.c_str());
+            m_db_worker->addQuery(query, [online_id](sqlite3_stmt* stmt)
+                {
+                    sqlite3_bind_int64(stmt, 1, online_id);
+                });
+        });
+#else
+    not_banned();
 #endif
 }   // testBannedForOnlineId
 
@@ -19,6 +19,7 @@
 #ifndef SERVER_LOBBY_HPP
 #define SERVER_LOBBY_HPP
 
+#include "network/ip_ban_index.hpp"
 #include "network/protocols/lobby_protocol.hpp"
 #include "network/transport_address.hpp"
 #include "utils/cpp2011.hpp"
@@ -39,6 +40,7 @@
 #endif
 
 class BareNetworkString;
+class DatabaseWorker;
 class NetworkString;
 class NetworkPlayerProfile;
 class STKPeer;
@@ -76,6 +78,10 @@ private:
 #ifdef ENABLE_SQLITE3
     sqlite3* m_db;
 
+    /** Executes all queries which are not needed for server startup, so the
+     *  lobby never blocks on the database. */
+    DatabaseWorker* m_db_worker;
+
     std::string m_server_stats_table;
 
     bool m_ip_ban_table_exists;
@@ -86,8 +92,41 @@ private:
 
     uint64_t m_last_cleanup_db_time;
 
+    /** In-memory copy of the IP ban table, so connecting peers are tested
+     *  without a database query. */
+    IPBanIndex m_ip_ban_index;
+
+    /** Number of times each IP ban range (start and end) was triggered since
+     *  the last write to database. */
+    std::map<std::pair<uint32_t, uint32_t>, unsigned> m_ip_ban_triggers;
+
+    /** Protects m_ip_ban_index, m_ip_ban_triggers and m_ip_ban_saves, as
+     *  the network console can ban an IP too. */
+    std::mutex m_ip_ban_mutex;
+
+    /** PRAGMA data_version when m_ip_ban_index was loaded, it changes if
+     *  another connection writes to the database. */
+    int64_t m_ip_ban_data_version;
+
+    /** Number of IP bans saved by this server. A reload of the table is
+     *  only used if no ban was saved after its query was queued, otherwise
+     *  the reload queued after saving that ban is used. */
+    unsigned m_ip_ban_saves;
+
+    /** True while a reload of m_ip_ban_index is queued. */
+    bool m_ip_ban_updating;
+
+    uint64_t m_last_ip_ban_update_time;
+
     void cleanupDatabase();
 
+    void loadIPBanTable();
+
+    void updateIPBanTable();
+    void reloadIPBanTable(int64_t version);
+
+    void flushIPBanTriggers();
+
     bool easySQLQuery(const std::string& query,
         std::function<void(sqlite3_stmt* stmt)> bind_function = nullptr) const;
 
@@ -277,6 +316,10 @@ private:
         std::lock_guard<std::mutex> lock(m_keys_mutex);
         std::swap(m_keys, new_keys);
     }
+    void handleConnectionRequest(std::shared_ptr<STKPeer> peer,
+                                 BareNetworkString& data,
+                                 unsigned player_count, uint32_t online_id,
+                                 uint32_t encrypted_size);
     void handlePendingConnection();
     void handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
                                      BareNetworkString& data,
@@ -329,8 +372,10 @@ private:
     void clientInGameWantsToBackLobby(Event* event);
     void clientSelectingAssetsWantsToBackLobby(Event* event);
     void kickPlayerWithReason(STKPeer* peer, const char* reason) const;
-    void testBannedForIP(STKPeer* peer) const;
-    void testBannedForOnlineId(STKPeer* peer, uint32_t online_id) const;
+    void testBannedForIP(STKPeer* peer);
+    void testBannedForOnlineId(std::shared_ptr<STKPeer> peer,
+                               uint32_t online_id,
+                               std::function<void()> not_banned);
     void writeDisconnectInfoTable(STKPeer* peer);
     void writePlayerReport(Event* event);
 public:
@@ -342,6 +387,7 @@ public:
     virtual void setup() OVERRIDE;
     virtual void update(int ticks) OVERRIDE;
     virtual void asynchronousUpdate() OVERRIDE;
+    virtual int getAsynchronousUpdateInterval() const OVERRIDE;
 
     void startSelection(const Event *event=NULL);
     void checkIncomingConnectionRequests();
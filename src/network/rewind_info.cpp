@@ -23,6 +23,30 @@
 #include "network/rewind_manager.hpp"
 #include "items/projectile_manager.hpp"
 
+#include <mutex>
+
+namespace
+{
+    // RewindInfos are created and freed at a high rate on a client (several
+    // events per tick and a state every few ticks), so they are taken from
+    // a free list of blocks big enough for all subclasses. The blocks are
+    // allocated in chunks, which are kept till the end of the program.
+    constexpr size_t maxSize(size_t a, size_t b) { return a > b ? a : b; }
+    const size_t BLOCK_SIZE =
+        (maxSize(sizeof(RewindInfoEventFunction),
+                 maxSize(sizeof(RewindInfoEvent), sizeof(RewindInfoState)))
+         + 15) / 16 * 16;
+    const size_t BLOCKS_PER_CHUNK = 256;
+
+    struct FreeBlock
+    {
+        FreeBlock *m_next;
+    };
+    FreeBlock *g_free_blocks = NULL;
+    // New RewindInfos are created by the network thread, too
+    std::mutex g_free_blocks_mutex;
+}   // namespace
+
 /** Constructor for a state: it only takes the size, and allocates a buffer
  *  for all state info.
  *  \param size Necessary buffer size for a state.
@@ -33,6 +57,51 @@ RewindInfo::RewindInfo(int ticks, bool is_confirmed)
     m_is_confirmed = is_confirmed;
 }   // RewindInfo
 
+// ----------------------------------------------------------------------------
+/** Takes the memory of a RewindInfo from the free list of blocks, which is
+ *  refilled with a new chunk when it is empty.
+ */
+void* RewindInfo::operator new(size_t size)
+{
+    // Allow for subclasses which are bigger than a block
+    if (size > BLOCK_SIZE)
+        return ::operator new(size);
+
+    std::lock_guard<std::mutex> lock(g_free_blocks_mutex);
+    if (!g_free_blocks)
+    {
+        char *chunk = (char*)::operator new(BLOCK_SIZE * BLOCKS_PER_CHUNK);
+        for (size_t i = 0; i < BLOCKS_PER_CHUNK; i++)
+        {
+            FreeBlock *block = (FreeBlock*)(chunk + i * BLOCK_SIZE);
+            block->m_next = g_free_blocks;
+            g_free_blocks = block;
+        }
+    }
+    FreeBlock *block = g_free_blocks;
+    g_free_blocks = block->m_next;
+    return block;
+}   // operator new
+
+// ----------------------------------------------------------------------------
+/** Returns the memory of a RewindInfo to the free list of blocks.
+ */
+void RewindInfo::operator delete(void *p, size_t size)
+{
+    if (!p)
+        return;
+    if (size > BLOCK_SIZE)
+    {
+        ::operator delete(p);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(g_free_blocks_mutex);
+    FreeBlock *block = (FreeBlock*)p;
+    block->m_next = g_free_blocks;
+    g_free_blocks = block;
+}   // operator delete
+
 // ----------------------------------------------------------------------------
 /** Adjusts the time of this RewindInfo. This is only called on the server
  *  in case that an event is received in the past - in this case the server
@@ -47,25 +116,25 @@ void RewindInfo::setTicks(int ticks)
 
 // ============================================================================
 RewindInfoState::RewindInfoState(int ticks, int start_offset,
-                                 std::vector<std::string>& rewinder_using,
                                  std::vector<uint8_t>& buffer)
-               : RewindInfo(ticks, true/*is_confirmed*/)
+               : RewindInfo(ticks, true/*is_confirmed*/), m_buffer(0)
 {
-    std::swap(m_rewinder_using, rewinder_using);
     m_start_offset = start_offset;
-    m_buffer = new BareNetworkString();
-    std::swap(m_buffer->getBuffer(), buffer);
+    std::swap(m_buffer.getBuffer(), buffer);
 }   // RewindInfoState
 
 // ------------------------------------------------------------------------
-/** Constructor used only in unit testing (without list of rewinder using).
+/** Constructor used only in unit testing (without rewinders in the state).
+ *  The data of buffer (which can be NULL) is moved into this state, the
+ *  caller keeps ownership of buffer.
  */
 RewindInfoState::RewindInfoState(int ticks, BareNetworkString* buffer,
                                  bool is_confirmed)
-               : RewindInfo(ticks, is_confirmed)
+               : RewindInfo(ticks, is_confirmed), m_buffer(0)
 {
     m_start_offset = 0;
-    m_buffer = buffer;
+    if (buffer)
+        std::swap(m_buffer.getBuffer(), buffer->getBuffer());
 }   // RewindInfoState
 
 // ------------------------------------------------------------------------
@@ -75,57 +144,71 @@ RewindInfoState::RewindInfoState(int ticks, BareNetworkString* buffer,
  */
 void RewindInfoState::restore()
 {
-    m_buffer->reset();
-    m_buffer->skip(m_start_offset);
-    for (const std::string& name : m_rewinder_using)
+    m_buffer.reset();
+    m_buffer.skip(m_start_offset);
+    // The structure of the state was checked when it was received
+    const unsigned static_count = m_buffer.getUInt8();
+    const unsigned count = m_buffer.getUInt8();
+    for (unsigned i = 0; i < count; i++)
     {
-        const uint16_t data_size = m_buffer->getUInt16();
-        const unsigned current_offset_now = m_buffer->getCurrentOffset();
-        std::shared_ptr<Rewinder> r =
-            RewindManager::get()->getRewinder(name);
-
-        if (!r)
+        const unsigned id = m_buffer.getUInt8();
+        std::shared_ptr<Rewinder> r;
+        std::string name;
+        if (id < static_count)
+            r = RewindManager::get()->getRewinder(id);
+        else
         {
-            // For now we only need to get missing rewinder from
-            // projectile_manager
-            r = projectile_manager->addRewinderFromNetworkState(name);
+            m_buffer.decodeString(&name);
+            r = RewindManager::get()->getRewinder(name);
+            if (!r)
+            {
+                // For now we only need to get missing rewinder from
+                // projectile_manager
+                r = projectile_manager->addRewinderFromNetworkState(name);
+            }
         }
+        const uint16_t data_size = m_buffer.getUInt16();
+        const unsigned current_offset_now = m_buffer.getCurrentOffset();
         if (!r)
         {
-            Log::error("RewindInfoState", "Missing rewinder %s",
-                name.c_str());
-            m_buffer->skip(data_size);
+            Log::error("RewindInfoState", "Missing rewinder %d", id);
+            m_buffer.skip(data_size);
             continue;
         }
         try
         {
-            r->restoreState(m_buffer, data_size);
+            r->restoreState(&m_buffer, data_size);
         }
         catch (std::exception& e)
         {
             Log::error("RewindInfoState", "Restore state error: %s",
                 e.what());
-            m_buffer->reset();
-            m_buffer->skip(current_offset_now + data_size);
+            m_buffer.reset();
+            m_buffer.skip(current_offset_now + data_size);
             continue;
         }
 
-        if (m_buffer->getCurrentOffset() - current_offset_now != data_size)
+        if (m_buffer.getCurrentOffset() - current_offset_now != data_size)
         {
             Log::error("RewindInfoState", "Wrong size read when restore "
                 "state, incompatible binary?");
-            m_buffer->reset();
-            m_buffer->skip(current_offset_now + data_size);
+            m_buffer.reset();
+            m_buffer.skip(current_offset_now + data_size);
         }
     }   // for all rewinder
 }   // restore
 
 // ============================================================================
+/** Creates an event. The data of buffer (which can be NULL) is moved into
+ *  this event, the caller keeps ownership of buffer, which can therefore
+ *  be a local variable.
+ */
 RewindInfoEvent::RewindInfoEvent(int ticks, EventRewinder *event_rewinder,
                                  BareNetworkString *buffer, bool is_confirmed)
-               : RewindInfo(ticks, is_confirmed)
+               : RewindInfo(ticks, is_confirmed), m_buffer(0)
 {
     m_event_rewinder = event_rewinder;
-    m_buffer         = buffer;
+    if (buffer)
+        std::swap(m_buffer.getBuffer(), buffer->getBuffer());
 }   // RewindInfoEvent
 
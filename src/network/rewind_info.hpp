@@ -26,6 +26,7 @@
 #include "utils/ptr_vector.hpp"
 
 #include <assert.h>
+#include <cstddef>
 #include <functional>
 #include <string>
 #include <vector>
@@ -59,6 +60,9 @@ public:
 
     void setTicks(int ticks);
 
+    static void* operator new(size_t size);
+    static void  operator delete(void *p, size_t size);
+
     /** Called when going back in time to undo any rewind information. */
     virtual void undo() = 0;
     /** This is called to restore a state before replaying the events. */
@@ -92,27 +96,24 @@ public:
 class RewindInfoState: public RewindInfo
 {
 private:
-    std::vector<std::string> m_rewinder_using;
-
+    /** Offset of the state in m_buffer, which starts with the number of
+     *  static rewinder ids and of rewinders (see GameProtocol::addState). */
     int m_start_offset;
 
-    /** Pointer to the buffer which stores all states. */
-    BareNetworkString *m_buffer;
+    /** The buffer which stores all states. */
+    BareNetworkString m_buffer;
 
 public:
     // ------------------------------------------------------------------------
     RewindInfoState(int ticks, int start_offset,
-                    std::vector<std::string>& rewinder_using,
                     std::vector<uint8_t>& buffer);
     // ------------------------------------------------------------------------
     RewindInfoState(int ticks, BareNetworkString *buffer, bool is_confirmed);
     // ------------------------------------------------------------------------
-    virtual ~RewindInfoState()                             { delete m_buffer; }
-    // ------------------------------------------------------------------------
     virtual void restore();
     // ------------------------------------------------------------------------
     /** Returns a pointer to the state buffer. */
-    BareNetworkString *getBuffer() const { return m_buffer; }
+    BareNetworkString *getBuffer() { return &m_buffer; }
     // ------------------------------------------------------------------------
     virtual bool isState() const { return true; }
     // ------------------------------------------------------------------------
@@ -139,14 +140,10 @@ private:
     EventRewinder *m_event_rewinder;
 
     /** Buffer with the event data. */
-    BareNetworkString *m_buffer;
+    BareNetworkString m_buffer;
 public:
              RewindInfoEvent(int ticks, EventRewinder *event_rewinder,
                              BareNetworkString *buffer, bool is_confirmed);
-    virtual ~RewindInfoEvent()
-    {
-        delete m_buffer;
-    }   // ~RewindInfoEvent
 
     // ------------------------------------------------------------------------
     /** An event is never 'restored', it is only rewound. */
@@ -158,8 +155,8 @@ public:
      *  It calls undoEvent in the rewinder. */
     virtual void undo()
     {
-        m_buffer->reset();
-        m_event_rewinder->undo(m_buffer);
+        m_buffer.reset();
+        m_event_rewinder->undo(&m_buffer);
     }   // undo
     // ------------------------------------------------------------------------
     /** This is called while going forwards in time again to reach current
@@ -168,12 +165,12 @@ public:
     virtual void replay()
     {
         // Make sure to reset the buffer so we read from the beginning
-        m_buffer->reset();
-        m_event_rewinder->rewind(m_buffer);
+        m_buffer.reset();
+        m_event_rewinder->rewind(&m_buffer);
     }   // rewind
     // ------------------------------------------------------------------------
     /** Returns the buffer with the event information in it. */
-    BareNetworkString *getBuffer() { return m_buffer; }
+    BareNetworkString *getBuffer() { return &m_buffer; }
 };   // class RewindIndoEvent
 
 
@@ -20,6 +20,7 @@
 
 #include "graphics/irr_driver.hpp"
 #include "modes/world.hpp"
+#include "network/network.hpp"
 #include "network/network_config.hpp"
 #include "network/network_string.hpp"
 #include "network/protocols/game_protocol.hpp"
@@ -31,6 +32,7 @@
 #include "tracks/check_manager.hpp"
 #include "tracks/track.hpp"
 #include "tracks/track_object_manager.hpp"
+#include "utils/allocation_counter.hpp"
 #include "utils/log.hpp"
 #include "utils/profiler.hpp"
 
@@ -61,6 +63,7 @@ void RewindManager::destroy()
  */
 RewindManager::RewindManager()
 {
+    m_static_rewinder_count = 0;
     reset();
 }   // RewindManager
 
@@ -85,6 +88,22 @@ void RewindManager::reset()
     m_overall_state_size = 0;
     m_state_frequency = stk_config->getPhysicsFPS() /
         NetworkConfig::get()->getStateFrequency();
+    m_rewind_count = 0;
+    m_resimulated_ticks = 0;
+    m_stats_ticks = 0;
+    m_saved_states = 0;
+    m_state_allocations = 0;
+
+    // Keep local states for the last 5 seconds, which is more than any
+    // confirmed state can be behind the client time
+    m_local_state.resize(
+        stk_config->time2Ticks(5.0f) / m_state_frequency + 1);
+    for (LocalState& ls : m_local_state)
+    {
+        ls.m_ticks = -1;
+        ls.m_rewinders.clear();
+        ls.m_buffer.clear();
+    }
 
     if (!m_enable_rewind_manager) return;
 
@@ -93,8 +112,8 @@ void RewindManager::reset()
 }   // reset
 
 // ----------------------------------------------------------------------------    
-/** Adds an event to the rewind data. The data to be stored must be allocated
- *  and not freed by the caller!
+/** Adds an event to the rewind data. The data of buffer is moved into the
+ *  rewind data, the caller keeps ownership of buffer.
  *  \param time Time at which the event was recorded. If time is not specified
  *          (or set to -1), the current world time is used.
  *  \param buffer Pointer to the event data.
@@ -105,7 +124,6 @@ void RewindManager::addEvent(EventRewinder *event_rewinder,
 {
     if (m_is_rewinding)
     {
-        delete buffer;
         Log::error("RewindManager", "Adding event when rewinding");
         return;
     }
@@ -118,8 +136,8 @@ void RewindManager::addEvent(EventRewinder *event_rewinder,
 // ----------------------------------------------------------------------------
 /** Adds an event to the list of network rewind data. This function is
  *  threadsafe so can be called by the network thread. The data is synched
- *  to m_rewind_info by the main thread. The data to be stored must be
- *  allocated and not freed by the caller!
+ *  to m_rewind_info by the main thread. The data of buffer is moved into
+ *  the rewind data, the caller keeps ownership of buffer.
  *  \param time Time at which the event was recorded.
  *  \param buffer Pointer to the event data.
  */
@@ -132,8 +150,8 @@ void RewindManager::addNetworkEvent(EventRewinder *event_rewinder,
 // ----------------------------------------------------------------------------
 /** Adds a state to the list of network rewind data. This function is
  *  threadsafe so can be called by the network thread. The data is synched
- *  to m_rewind_info by the main thread. The data to be stored must be
- *  allocated and not freed by the caller!
+ *  to m_rewind_info by the main thread. The data of buffer is moved into
+ *  the rewind data, the caller keeps ownership of buffer.
  *  \param time Time at which the event was recorded.
  *  \param buffer Pointer to the event data.
  */
@@ -153,26 +171,27 @@ void RewindManager::saveState()
     auto gp = GameProtocol::lock();
     if (!gp)
         return;
+    // Counts the allocations done while saving the state, and keeps
+    // counting afterwards if a benchmark counts all allocations
+    const bool counting = AllocationCounter::isEnabled();
+    AllocationCounter::enable(true);
+    const uint64_t allocations = AllocationCounter::getCount();
     gp->startNewState();
 
     m_overall_state_size = 0;
-    std::vector<std::string> rewinder_using;
 
     for (auto& p : m_all_rewinder)
     {
-        // TODO: check if it's worth passing in a sufficiently large buffer from
-        // GameProtocol - this would save the copy operation.
-        BareNetworkString* buffer = NULL;
-        if (auto r = p.second.lock())
-            buffer = r->saveState(&rewinder_using);
-        if (buffer != NULL)
-        {
-            m_overall_state_size += buffer->size();
-            gp->addState(buffer);
-        }
-        delete buffer;    // buffer can be freed
+        // Each rewinder writes directly into the state buffer of
+        // GameProtocol, which is reused for all states
+        if (auto r = p.lock())
+            m_overall_state_size += gp->addState(r.get());
     }
-    gp->finalizeState(rewinder_using);
+    gp->finalizeState();
+
+    m_state_allocations += AllocationCounter::getCount() - allocations;
+    m_saved_states++;
+    AllocationCounter::enable(counting);
     PROFILER_POP_CPU_MARKER();
 }   // saveState
 
@@ -191,6 +210,7 @@ void RewindManager::update(int ticks_not_used)
     int ticks = World::getWorld()->getTicksSinceStart();
 
     m_not_rewound_ticks.store(ticks, std::memory_order_relaxed);
+    updateRewindStatistics(ticks);
 
     if (!shouldSaveState(ticks))
         return;
@@ -199,11 +219,16 @@ void RewindManager::update(int ticks_not_used)
     clearExpiredRewinder();
     if (NetworkConfig::get()->isClient())
     {
-        auto& ret = m_local_state[ticks];
+        LocalState& ls = getLocalState(ticks);
+        ls.m_ticks = ticks;
+        ls.m_rewinders.clear();
+        ls.m_buffer.clear();
         for (auto& p : m_all_rewinder)
         {
-            if (auto r = p.second.lock())
-                ret.push_back(r->getLocalStateRestoreFunction());
+            auto r = p.lock();
+            const int offset = (int)ls.m_buffer.size();
+            if (r && r->saveLocalState(&ls.m_buffer))
+                ls.m_rewinders.emplace_back(p, offset);
         }
     }
     else
@@ -268,13 +293,116 @@ void RewindManager::playEventsTill(int world_ticks, bool fast_forward)
 bool RewindManager::addRewinder(std::shared_ptr<Rewinder> rewinder)
 {
     if (!m_enable_rewind_manager) return false;
-    // Maximum 1 bit to store no of rewinder used
-    if (m_all_rewinder.size() == 255)
-        return false;
-    m_all_rewinder[rewinder->getUniqueIdentity()] = rewinder;
+    // All rewinders are alive after this, so they can be compared
+    clearExpiredRewinder();
+
+    // Find the id first, so that a rewinder is either added with an id or
+    // not at all. Use the first free id, but never reuse an id already sent
+    // to clients.
+    const bool is_server = NetworkConfig::get()->isServer();
+    unsigned id = m_static_rewinder_count;
+    if (is_server)
+    {
+        while (id < m_rewinder_by_id.size() &&
+               !m_rewinder_by_id[id].expired())
+            id++;
+        // Ids are sent in 1 byte, a rewinder without id can't be in states
+        if (id >= 255)
+            return false;
+    }
+
+    const std::string& uid = rewinder->getUniqueIdentity();
+    auto it = std::lower_bound(m_all_rewinder.begin(), m_all_rewinder.end(),
+        uid, [](const std::weak_ptr<Rewinder>& a, const std::string& b)
+        {
+            return a.lock()->getUniqueIdentity() < b;
+        });
+    if (it != m_all_rewinder.end() &&
+        it->lock()->getUniqueIdentity() == uid)
+    {
+        // Replaces the rewinder with the same identity
+        *it = rewinder;
+    }
+    else
+    {
+        // Maximum 1 byte to store no of rewinder used
+        if (m_all_rewinder.size() == 255)
+            return false;
+        m_all_rewinder.insert(it, rewinder);
+    }
+
+    if (!is_server)
+        return true;
+    if (id == m_rewinder_by_id.size())
+        m_rewinder_by_id.emplace_back();
+    m_rewinder_by_id[id] = rewinder;
+    rewinder->setRewinderID(id);
     return true;
 }   // addRewinder
 
+// ----------------------------------------------------------------------------
+/** Returns the rewinder with the given unique identity, or nullptr.
+ */
+std::shared_ptr<Rewinder> RewindManager::getRewinder(const std::string& name)
+{
+    for (auto& p : m_all_rewinder)
+    {
+        std::shared_ptr<Rewinder> r = p.lock();
+        if (r && r->getUniqueIdentity() == name)
+            return r;
+    }
+    return nullptr;
+}   // getRewinder
+
+// ----------------------------------------------------------------------------
+/** Called by the server when the race starts (or a client live joins) to
+ *  send the rewinder ids to the clients. The ids are sent only once, so
+ *  that states only need to contain the ids instead of the unique
+ *  identities of the rewinders.
+ *  \param buffer The buffer to write the unique identity of each id to.
+ */
+void RewindManager::saveRewinderIDs(BareNetworkString* buffer)
+{
+    assert(NetworkConfig::get()->isServer());
+    // The ids sent first are fixed, later rewinders get ids after them
+    if (m_static_rewinder_count == 0)
+        m_static_rewinder_count = (unsigned)m_rewinder_by_id.size();
+    buffer->addUInt8((uint8_t)m_static_rewinder_count);
+    for (unsigned i = 0; i < m_static_rewinder_count; i++)
+    {
+        std::shared_ptr<Rewinder> r = m_rewinder_by_id[i].lock();
+        buffer->encodeString(r ? r->getUniqueIdentity() : "");
+    }
+}   // saveRewinderIDs
+
+// ----------------------------------------------------------------------------
+/** Called on a client to assign the rewinder ids sent by the server (see
+ *  saveRewinderIDs) to the rewinders of the client.
+ *  \param buffer The buffer with the unique identity of each id.
+ */
+void RewindManager::restoreRewinderIDs(const BareNetworkString& buffer)
+{
+    assert(NetworkConfig::get()->isClient());
+    m_static_rewinder_count = buffer.getUInt8();
+    m_rewinder_by_id.clear();
+    m_rewinder_by_id.resize(m_static_rewinder_count);
+    for (unsigned i = 0; i < m_static_rewinder_count; i++)
+    {
+        std::string name;
+        buffer.decodeString(&name);
+        if (name.empty())
+            continue;
+        std::shared_ptr<Rewinder> r = getRewinder(name);
+        if (!r)
+        {
+            Log::warn("RewindManager", "Missing rewinder for id %d.", i);
+            continue;
+        }
+        r->setRewinderID(i);
+        m_rewinder_by_id[i] = r;
+    }
+}   // restoreRewinderIDs
+
 // ----------------------------------------------------------------------------
 /** Rewinds to the specified time, then goes forward till the current
  *  World::getTime() is reached again: it will replay everything before
@@ -298,7 +426,7 @@ void RewindManager::rewindTo(int rewind_ticks, int now_ticks,
     // the rewind.
     for (auto& p : m_all_rewinder)
     {
-        if (auto r = p.second.lock())
+        if (auto r = p.lock())
             r->saveTransform();
     }
 
@@ -326,20 +454,17 @@ void RewindManager::rewindTo(int rewind_ticks, int now_ticks,
 
     // Restore states from the exact rewind time
     // -----------------------------------------
-    auto it = m_local_state.find(exact_rewind_ticks);
-    if (it != m_local_state.end())
+    LocalState& ls = getLocalState(exact_rewind_ticks);
+    if (ls.m_ticks == exact_rewind_ticks)
     {
-        for (auto& restore_local_state : it->second)
+        for (auto& p : ls.m_rewinders)
         {
-            if (restore_local_state)
-                restore_local_state();
-        }
-        for (auto it = m_local_state.begin(); it != m_local_state.end();)
-        {
-            if (it->first <= exact_rewind_ticks)
-                it = m_local_state.erase(it);
-            else
-                break;
+            if (auto r = p.first.lock())
+            {
+                ls.m_buffer.reset();
+                ls.m_buffer.skip(p.second);
+                r->restoreLocalState(&ls.m_buffer);
+            }
         }
     }
     else if (!fast_forward)
@@ -369,6 +494,10 @@ void RewindManager::rewindTo(int rewind_ticks, int now_ticks,
         world->setTicksForRewind(exact_rewind_ticks);
     }
 
+    m_rewind_count++;
+    if (!fast_forward)
+        m_resimulated_ticks += now_ticks - exact_rewind_ticks;
+
     // Now go forward through the list of rewind infos till we reach 'now':
     while (world->getTicksSinceStart() < now_ticks)
     { 
@@ -388,7 +517,7 @@ void RewindManager::rewindTo(int rewind_ticks, int now_ticks,
     // Now compute the errors which need to be visually smoothed
     for (auto& p : m_all_rewinder)
     {
-        if (auto r = p.second.lock())
+        if (auto r = p.lock())
             r->computeError();
     }
 
@@ -397,6 +526,42 @@ void RewindManager::rewindTo(int rewind_ticks, int now_ticks,
     mergeRewindInfoEventFunction();
 }   // rewindTo
 
+// ----------------------------------------------------------------------------
+/** Prints the number of rewinds and resimulated physics ticks once per
+ *  second if connection debugging is enabled, which is the main cost of
+ *  rollback on a client with high latency. It also prints the allocations
+ *  per saved state if they are counted.
+ *  \param ticks Current world ticks.
+ */
+void RewindManager::updateRewindStatistics(int ticks)
+{
+    if (ticks < m_stats_ticks)
+        m_stats_ticks = ticks;
+    if (ticks - m_stats_ticks < stk_config->getPhysicsFPS())
+        return;
+
+    if (Network::m_connection_debug && m_rewind_count > 0)
+    {
+        Log::info("RewindManager", "%d rewinds with %d ticks resimulated "
+            "in %d ticks.", m_rewind_count, m_resimulated_ticks,
+            ticks - m_stats_ticks);
+    }
+    // Allocations are only counted with the cmake option COUNT_ALLOCATIONS
+    if (Network::m_connection_debug && m_saved_states > 0 &&
+        AllocationCounter::isAvailable())
+    {
+        Log::info("RewindManager", "%d states saved with %.1f allocations "
+            "per state in %d ticks.", m_saved_states,
+            (float)m_state_allocations / m_saved_states,
+            ticks - m_stats_ticks);
+    }
+    m_rewind_count = 0;
+    m_resimulated_ticks = 0;
+    m_saved_states = 0;
+    m_state_allocations = 0;
+    m_stats_ticks = ticks;
+}   // updateRewindStatistics
+
 // ----------------------------------------------------------------------------
 bool RewindManager::useLocalEvent() const
 {
@@ -420,7 +585,7 @@ void RewindManager::resetSmoothNetworkBody()
 {
     for (auto& p : m_all_rewinder)
     {
-        if (auto r = p.second.lock())
+        if (auto r = p.lock())
         {
             auto snb = std::dynamic_pointer_cast<SmoothNetworkBody>(r);
             if (snb)
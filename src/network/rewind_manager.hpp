@@ -19,6 +19,7 @@
 #ifndef HEADER_REWIND_MANAGER_HPP
 #define HEADER_REWIND_MANAGER_HPP
 
+#include "network/network_string.hpp"
 #include "network/rewind_queue.hpp"
 #include "utils/ptr_vector.hpp"
 #include "utils/synchronised.hpp"
@@ -92,10 +93,37 @@ private:
      *  rewind data in case of local races only. */
     static bool           m_enable_rewind_manager;
 
-    std::map<int, std::vector<std::function<void()> > > m_local_state;
+    /** Client only: the local states (see Rewinder::saveLocalState) saved
+     *  at a state tick. */
+    struct LocalState
+    {
+        int m_ticks;
+        /** Each rewinder which saved a local state, and the offset of its
+         *  local state in m_buffer. */
+        std::vector<std::pair<std::weak_ptr<Rewinder>, int> > m_rewinders;
+        BareNetworkString m_buffer;
+    };
+
+    /** Ring buffer of local states, indexed by the state number (i.e. ticks
+     *  divided by m_state_frequency). Old entries are overwritten, and their
+     *  memory is reused, so saving a local state doesn't allocate. */
+    std::vector<LocalState> m_local_state;
+
+    /** A list of all objects that can be rewound, sorted by their unique
+     *  identity, which is the order in which states are saved and
+     *  restored. */
+    std::vector<std::weak_ptr<Rewinder> > m_all_rewinder;
+
+    /** The rewinders indexed by their rewinder id. On the server all
+     *  rewinders get an id, on a client only the rewinders which existed
+     *  when the race started (see restoreRewinderIDs). */
+    std::vector<std::weak_ptr<Rewinder> > m_rewinder_by_id;
 
-    /** A list of all objects that can be rewound. */
-    std::map<std::string, std::weak_ptr<Rewinder> > m_all_rewinder;
+    /** Number of rewinder ids sent to the clients when the race started.
+     *  These ids are never reused, and states only contain the ids of these
+     *  rewinders. All other rewinders (e.g. flyables) are sent with their
+     *  unique identity. */
+    unsigned m_static_rewinder_count;
 
     /** The queue that stores all rewind infos. */
     RewindQueue m_rewind_queue;
@@ -103,6 +131,7 @@ private:
     /** Overall amount of memory allocated by states. */
     unsigned int m_overall_state_size;
 
+
     /** Indicates if currently a rewind is happening. */
     bool m_is_rewinding;
 
@@ -114,6 +143,18 @@ private:
      *  rewinds. */
     std::atomic<int> m_not_rewound_ticks;
 
+    /** Number of rewinds and resimulated ticks since m_stats_ticks, used
+     *  to print rewind statistics with --connection-debug. */
+    int m_rewind_count;
+    int m_resimulated_ticks;
+    int m_stats_ticks;
+
+    /** Number of states saved and the allocations done while saving them
+     *  since m_stats_ticks. Allocations are only counted with the cmake
+     *  option COUNT_ALLOCATIONS, see AllocationCounter. */
+    int m_saved_states;
+    uint64_t m_state_allocations;
+
     std::vector<RewindInfoEventFunction*> m_pending_rief;
 
     RewindManager();
@@ -123,7 +164,7 @@ private:
     {
         for (auto it = m_all_rewinder.begin(); it != m_all_rewinder.end();)
         {
-            if (it->second.expired())
+            if (it->expired())
             {
                 it = m_all_rewinder.erase(it);
                 continue;
@@ -133,6 +174,15 @@ private:
     }
     // ------------------------------------------------------------------------
     void mergeRewindInfoEventFunction();
+    // ------------------------------------------------------------------------
+    LocalState& getLocalState(int ticks)
+    {
+        assert(!m_local_state.empty());
+        return m_local_state[(ticks / m_state_frequency) %
+                             m_local_state.size()];
+    }   // getLocalState
+    // ------------------------------------------------------------------------
+    void updateRewindStatistics(int ticks);
 
 public:
     // First static functions to manage rewinding.
@@ -167,19 +217,27 @@ public:
     void addNetworkState(BareNetworkString *buffer, int ticks);
     void saveState();
     // ------------------------------------------------------------------------
-    std::shared_ptr<Rewinder> getRewinder(const std::string& name)
+    std::shared_ptr<Rewinder> getRewinder(const std::string& name);
+    // ------------------------------------------------------------------------
+    /** Returns the rewinder with the given rewinder id, or nullptr. */
+    std::shared_ptr<Rewinder> getRewinder(unsigned id)
     {
-        auto it = m_all_rewinder.find(name);
-        if (it != m_all_rewinder.end())
-        {
-            if (auto r = it->second.lock())
-                return r;
-        }
+        if (id < m_rewinder_by_id.size())
+            return m_rewinder_by_id[id].lock();
         return nullptr;
     }
     // ------------------------------------------------------------------------
+    /** Returns the number of rewinder ids sent to the clients at race start,
+     *  see m_static_rewinder_count. */
+    unsigned getStaticRewinderCount() const
+                                             { return m_static_rewinder_count; }
+    // ------------------------------------------------------------------------
     bool addRewinder(std::shared_ptr<Rewinder> rewinder);
     // ------------------------------------------------------------------------
+    void saveRewinderIDs(BareNetworkString* buffer);
+    // ------------------------------------------------------------------------
+    void restoreRewinderIDs(const BareNetworkString& buffer);
+    // ------------------------------------------------------------------------
     /** Returns true if currently a rewind is happening. */
     bool isRewinding() const { return m_is_rewinding; }
 
@@ -26,6 +26,8 @@
 #include "network/rewinder.hpp"
 #include "network/rewind_info.hpp"
 #include "network/rewind_manager.hpp"
+#include "utils/allocation_counter.hpp"
+#include "utils/benchmark.hpp"
 
 #include <algorithm>
 
@@ -74,12 +76,11 @@ void RewindQueue::reset()
     m_network_events.getData().clear();
     m_network_events.unlock();
 
-    AllRewindInfo::const_iterator i;
-    for (i = m_all_rewind_info.begin(); i != m_all_rewind_info.end(); ++i)
-        delete *i;
+    for (RewindInfo *ri : m_all_rewind_info)
+        delete ri;
 
     m_all_rewind_info.clear();
-    m_current = m_all_rewind_info.end();
+    m_current = 0;
     m_latest_confirmed_state_time = -1;
 }   // reset
 
@@ -94,28 +95,29 @@ void RewindQueue::reset()
  */
 void RewindQueue::insertRewindInfo(RewindInfo *ri)
 {
-    AllRewindInfo::iterator i = m_all_rewind_info.end();
+    size_t i = m_all_rewind_info.size();
 
-    while (i != m_all_rewind_info.begin())
+    while (i > 0)
     {
-        AllRewindInfo::iterator i_prev = i;
-        i_prev--;
+        const RewindInfo *prev = m_all_rewind_info[i - 1];
         // Now test if 'ri' needs to be inserted after the
         // previous element, i.e. before the current element:
-        if ((*i_prev)->getTicks() < ri->getTicks()) break;
-        if ((*i_prev)->getTicks() == ri->getTicks() &&
-            ri->isEvent()                              ) break;
-        i = i_prev;
+        if (prev->getTicks() < ri->getTicks()) break;
+        if (prev->getTicks() == ri->getTicks() && ri->isEvent()) break;
+        i--;
     }
-    if(m_current == m_all_rewind_info.end())
-        m_current = m_all_rewind_info.insert(i, ri);
-    else
-        m_all_rewind_info.insert(i, ri);  
+    // If there was no current element, the new one becomes current.
+    // Otherwise current must keep pointing to the same element.
+    if (m_current == m_all_rewind_info.size())
+        m_current = i;
+    else if (i <= m_current)
+        m_current++;
+    m_all_rewind_info.insert(m_all_rewind_info.begin() + i, ri);
 }   // insertRewindInfo
 
 // ----------------------------------------------------------------------------
-/** Adds an event to the rewind data. The data to be stored must be allocated
- *  and not freed by the caller!
+/** Adds an event to the rewind data. The data of buffer is moved into the
+ *  event, the caller keeps ownership of buffer.
  *  \param buffer Pointer to the event data. 
  *  \param ticks Time at which the event happened.
  */
@@ -154,8 +156,8 @@ void RewindQueue::addLocalState(BareNetworkString *buffer,
 // ----------------------------------------------------------------------------
 /** Adds an event to the list of network rewind data. This function is
  *  threadsafe so can be called by the network thread. The data is synched
- *  to m_tRewindInformation list by the main thread. The data to be stored
- *  must be allocated and not freed by the caller!
+ *  to m_tRewindInformation list by the main thread. The data of buffer is
+ *  moved into the event, the caller keeps ownership of buffer.
  *  \param buffer Pointer to the event data.
  *  \param ticks Time at which the event happened.
  */
@@ -173,8 +175,8 @@ void RewindQueue::addNetworkEvent(EventRewinder *event_rewinder,
 // ----------------------------------------------------------------------------
 /** Adds a state to the list of network rewind data. This function is
  *  threadsafe so can be called by the network thread. The data is synched
- *  to RewindInfo list by the main thread. The data to be stored must be
- *  allocated and not freed by the caller!
+ *  to RewindInfo list by the main thread. The data of buffer is moved into
+ *  the state, the caller keeps ownership of buffer.
  *  \param buffer Pointer to the event data.
  *  \param ticks Time at which the event happened.
  */
@@ -327,25 +329,27 @@ void RewindQueue::mergeNetworkData(int world_ticks, bool *needs_rewind,
  */
 void RewindQueue::cleanupOldRewindInfo(int ticks)
 {
-    auto i = m_all_rewind_info.begin();
-
-    while (!m_all_rewind_info.empty() &&
-        (*i)->getTicks() < ticks)
+    size_t count = 0;
+    while (count < m_all_rewind_info.size() &&
+           m_all_rewind_info[count]->getTicks() < ticks)
     {
-        if (m_current == i) next();
-        delete *i;
-        i = m_all_rewind_info.erase(i);
+        delete m_all_rewind_info[count];
+        count++;
     }
+    if (count == 0)
+        return;
 
-    if (m_all_rewind_info.empty())
-        m_current = m_all_rewind_info.end();
+    m_all_rewind_info.erase(m_all_rewind_info.begin(),
+                            m_all_rewind_info.begin() + count);
+    // If current was deleted, it now points to the first remaining element
+    m_current = m_current < count ? 0 : m_current - count;
 
 }   // cleanupOldRewindInfo
 
 // ----------------------------------------------------------------------------
 bool RewindQueue::isEmpty() const
 {
-    return m_current == m_all_rewind_info.end();
+    return m_current == m_all_rewind_info.size();
 }   // isEmpty
 
 // ----------------------------------------------------------------------------
@@ -353,7 +357,7 @@ bool RewindQueue::isEmpty() const
  */
 bool RewindQueue::hasMoreRewindInfo() const
 {
-    return m_current != m_all_rewind_info.end();
+    return m_current < m_all_rewind_info.size();
 }   // hasMoreRewindInfo
 
 // ----------------------------------------------------------------------------
@@ -367,27 +371,27 @@ int RewindQueue::undoUntil(int undo_ticks)
 {
     // A rewind is done after a state in the past is inserted. This function
     // makes sure that m_current is not end()
-    //assert(m_current != m_all_rewind_info.end());
     assert(!m_all_rewind_info.empty());
-    m_current = m_all_rewind_info.end();
-    m_current--;
-    while((*m_current)->getTicks() > undo_ticks ||
-        (*m_current)->isEvent() || !(*m_current)->isConfirmed())
+    m_current = m_all_rewind_info.size() - 1;
+    RewindInfo *ri = m_all_rewind_info[m_current];
+    while(ri->getTicks() > undo_ticks || ri->isEvent() || !ri->isConfirmed())
     {
         // Undo all events and states from the current time
-        (*m_current)->undo();
-        if(m_current == m_all_rewind_info.begin())
+        ri->undo();
+        if(m_current == 0)
         {
             // This shouldn't happen, but add some debug info just in case
             Log::error("undoUntil",
                        "At %d rewinding to %d current = %d = begin",
                        World::getWorld()->getTicksSinceStart(), undo_ticks, 
-                       (*m_current)->getTicks());
+                       ri->getTicks());
+            break;
         }
         m_current--;
+        ri = m_all_rewind_info[m_current];
     }
 
-    return (*m_current)->getTicks();
+    return ri->getTicks();
 }   // undoUntil
 
 // ----------------------------------------------------------------------------
@@ -397,10 +401,11 @@ int RewindQueue::undoUntil(int undo_ticks)
 void RewindQueue::replayAllEvents(int ticks)
 {
     // Replay all events that happened at the current time step
-    while ( hasMoreRewindInfo() && (*m_current)->getTicks() == ticks )
+    while ( hasMoreRewindInfo() &&
+            m_all_rewind_info[m_current]->getTicks() == ticks )
     {
-        if ((*m_current)->isEvent())
-            (*m_current)->replay();
+        if (m_all_rewind_info[m_current]->isEvent())
+            m_all_rewind_info[m_current]->replay();
         m_current++;
     }   // while current->getTIcks == ticks
 
@@ -442,42 +447,42 @@ void RewindQueue::unitTesting()
     q0.mergeNetworkData(world_ticks, &needs_rewind, &rewind_ticks);
     assert(q0.hasMoreRewindInfo());
     assert(q0.m_all_rewind_info.size() == 2);
-    AllRewindInfo::iterator rii = q0.m_all_rewind_info.begin();
-    assert((*rii)->isState());
+    size_t rii = 0;
+    assert(q0.m_all_rewind_info[rii]->isState());
     rii++;
-    assert((*rii)->isEvent());
+    assert(q0.m_all_rewind_info[rii]->isEvent());
 
     // Another state must be sorted before the event:
     q0.addNetworkState(NULL, 0);
     assert(q0.hasMoreRewindInfo());
     q0.mergeNetworkData(world_ticks, &needs_rewind, &rewind_ticks);
     assert(q0.m_all_rewind_info.size() == 3);
-    rii = q0.m_all_rewind_info.begin();
-    assert((*rii)->isState());
+    rii = 0;
+    assert(q0.m_all_rewind_info[rii]->isState());
     rii++;
-    assert((*rii)->isState());
+    assert(q0.m_all_rewind_info[rii]->isState());
     rii++;
-    assert((*rii)->isEvent());
+    assert(q0.m_all_rewind_info[rii]->isEvent());
 
     // Test time base comparisons: adding an event to the end
     q0.addLocalEvent(dummy_rewinder.get(), NULL, true, 4);
     // Then adding an earlier event
     q0.addLocalEvent(dummy_rewinder.get(), NULL, false, 1);
-    // rii points to the 3rd element, the ones added just now
+    // rii is the index of the 3rd element, the ones added just now
     // should be elements4 and 5:
     rii++;
-    assert((*rii)->getTicks()==1);
+    assert(q0.m_all_rewind_info[rii]->getTicks()==1);
     rii++;
-    assert((*rii)->getTicks()==4);
+    assert(q0.m_all_rewind_info[rii]->getTicks()==4);
 
     // Now test inserting an event first, then the state
     RewindQueue q1;
     q1.addLocalEvent(NULL, NULL, true, 5);
     q1.addLocalState(NULL, true, 5);
-    rii = q1.m_all_rewind_info.begin();
-    assert((*rii)->isState());
+    rii = 0;
+    assert(q1.m_all_rewind_info[rii]->isState());
     rii++;
-    assert((*rii)->isEvent());
+    assert(q1.m_all_rewind_info[rii]->isEvent());
 
     // Bugs seen before
     // ----------------
@@ -496,7 +501,7 @@ void RewindQueue::unitTesting()
     //    event, that m_current pooints to the first event, otherwise
     //    events with same time stamp will not be handled correctly.
     //    At this stage current points to the event at time 2 from above
-    AllRewindInfo::iterator current_old = b1.m_current;
+    size_t current_old = b1.m_current;
     b1.addLocalEvent(NULL, NULL, true, 2);
     // Make sure that current was not modified, i.e. the new event at time
     // 2 was added at the end of the list:
@@ -509,7 +514,7 @@ void RewindQueue::unitTesting()
     assert(ri->getTicks() == 2);
     assert(ri->isEvent());
     b1.next();
-    assert(b1.m_current == b1.m_all_rewind_info.end());
+    assert(b1.m_current == b1.m_all_rewind_info.size());
 
     // 3) Test that if cleanupOldRewindInfo is called, it will if necessary
     //    adjust m_current to point to the latest confirmed state.
@@ -518,7 +523,88 @@ void RewindQueue::unitTesting()
     b2.addNetworkState(NULL, 2);
     b2.addNetworkState(NULL, 3);
     b2.mergeNetworkData(4, &needs_rewind, &rewind_ticks);
-    assert((*b2.m_current)->getTicks() == 3);
+    assert(b2.getCurrent()->getTicks() == 3);
 
 
 }   // unitTesting
+
+// ----------------------------------------------------------------------------
+/** Simulates the rewind queue of a client: a local event every second tick,
+ *  network events from other players with a delay of 5 ticks and a server
+ *  state every 6 ticks, each state triggering a rewind. Prints the time and
+ *  the number of allocations per tick. Called with
+ *  --micro-benchmark=rewind-queue.
+ */
+void RewindQueue::benchmark()
+{
+    RewindManager::create();
+    auto dummy_rewinder = std::make_shared<DummyRewinder>();
+
+    const int NUM_TICKS = 200000;
+    for (int round = 0; round < 3; round++)
+    {
+        RewindQueue q;
+        int rewinds = 0;
+        size_t max_size = 0;
+        uint64_t allocations = AllocationCounter::getCount();
+        AllocationCounter::enable(true);
+        Benchmark::Timer timer;
+        for (int ticks = 10; ticks < NUM_TICKS; ticks++)
+        {
+            if (ticks % 2 == 0)
+            {
+                BareNetworkString s(8);
+                s.addUInt8(0).addUInt8(1).addUInt16(2).addUInt16(3)
+                    .addUInt16(4);
+                q.addLocalEvent(dummy_rewinder.get(), &s, true, ticks);
+            }
+            for (int kart = 1; kart <= 3; kart++)
+            {
+                if ((ticks + kart) % 4 != 0)
+                    continue;
+                BareNetworkString s(8);
+                s.addUInt8(kart).addUInt8(1).addUInt16(2).addUInt16(3)
+                    .addUInt16(4);
+                q.addNetworkEvent(dummy_rewinder.get(), &s, ticks - 5);
+            }
+            if (ticks % 6 == 0)
+            {
+                std::vector<uint8_t> state(700, (uint8_t)ticks);
+                q.addNetworkRewindInfo(new RewindInfoState(ticks - 8, 0,
+                                                           state));
+            }
+
+            bool needs_rewind;
+            int rewind_ticks;
+            q.mergeNetworkData(ticks, &needs_rewind, &rewind_ticks);
+            if (needs_rewind)
+            {
+                // Same as RewindManager::rewindTo, but without restoring
+                // the states (there are no rewinders).
+                rewinds++;
+                int exact_rewind_ticks = q.undoUntil(rewind_ticks);
+                while (q.getCurrent() &&
+                       q.getCurrent()->getTicks() == exact_rewind_ticks &&
+                       q.getCurrent()->isState())
+                    q.next();
+                for (int t = exact_rewind_ticks; t < ticks; t++)
+                    q.replayAllEvents(t);
+            }
+            q.replayAllEvents(ticks);
+            max_size = std::max(max_size, q.m_all_rewind_info.size());
+        }
+        const double ns = timer.stop() * 1000000.0;
+        AllocationCounter::enable(false);
+        allocations = AllocationCounter::getCount() - allocations;
+        Log::info("RewindQueue", "%d ticks: %.1f ns per tick, %d rewinds, "
+            "at most %d rewind infos.", NUM_TICKS, ns / NUM_TICKS, rewinds,
+            (int)max_size);
+        // Only counted with the cmake option COUNT_ALLOCATIONS
+        if (AllocationCounter::isAvailable())
+        {
+            Log::info("RewindQueue", "%.2f allocations per tick.",
+                      double(allocations) / NUM_TICKS);
+        }
+    }
+    RewindManager::destroy();
+}   // benchmark
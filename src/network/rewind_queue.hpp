@@ -22,7 +22,6 @@
 #include "utils/synchronised.hpp"
 
 #include <assert.h>
-#include <list>
 #include <vector>
 
 class BareNetworkString;
@@ -37,7 +36,12 @@ class RewindQueue
 {
 private:
 
-    typedef std::list<RewindInfo*> AllRewindInfo;
+    /** All rewind infos sorted by ticks, with states before events at the
+     *  same tick. New infos are nearly always appended close to the end,
+     *  and old ones are removed from the front in one go, so a vector
+     *  is cheaper than a list (no allocation per entry, and undoUntil and
+     *  replayAllEvents walk contiguous memory). */
+    typedef std::vector<RewindInfo*> AllRewindInfo;
 
     AllRewindInfo m_all_rewind_info;
 
@@ -49,8 +53,9 @@ private:
     typedef std::vector<RewindInfo*> AllNetworkRewindInfo;
     Synchronised<AllNetworkRewindInfo> m_network_events;
 
-    /** Iterator to the curren time step info to be handled. */
-    AllRewindInfo::iterator m_current;
+    /** Index of the current rewind info to be handled, equal to the size
+     *  of m_all_rewind_info if there is none. */
+    size_t m_current;
 
     /** Time at which the latest confirmed state is at. */
     int m_latest_confirmed_state_time;
@@ -60,6 +65,7 @@ private:
 
 public:
         static void unitTesting();
+        static void benchmark();
 
          RewindQueue();
         ~RewindQueue();
@@ -95,7 +101,7 @@ public:
      *  RewindInfo element. */
     void next()
     {
-        assert(m_current != m_all_rewind_info.end());
+        assert(m_current < m_all_rewind_info.size());
         m_current++;
         return;
     }   // operator++
@@ -105,7 +111,8 @@ public:
      *  least one more RewindInfo (see hasMoreRewindInfo()). */
     RewindInfo* getCurrent()
     {
-        return (m_current != m_all_rewind_info.end() ) ? *m_current : NULL;
+        return m_current < m_all_rewind_info.size()
+             ? m_all_rewind_info[m_current] : NULL;
     }   // getNext
 
 };   // RewindQueue
@@ -45,19 +45,30 @@ class Rewinder : public std::enable_shared_from_this<Rewinder>
 protected:
     void setUniqueIdentity(const std::string& uid)  { m_unique_identity = uid; }
 private:
-    /** Currently it has 2 usages:
+    /** Currently it has 3 usages:
      *  1. Create the required flyable if the firing event missed using this
      *     uid. (see RewindInfoState::restore)
-     *  2. Determine the order of restoring state for each rewinder, this is
-     *     used as a key in std::string, Rewinder map, which is less than.
+     *  2. Determine the order of restoring state for each rewinder, the
+     *     rewinders in RewindManager are sorted by it (less than).
      *     So uid of "0x01" (item manager) is restored before "0x02, x" (which
      *     kart id x) and 0x03 / 0x04 (the red / blue flag) is restored after
      *     karts, because the restoreState in CTFFlag read kart transformation.
+     *  3. Map the rewinder ids of the server to the rewinders of a client
+     *     (see RewindManager::restoreRewinderIDs).
     */
     std::string m_unique_identity;
 
+    /** The id of this rewinder in states, assigned by the server. -1 if no
+     *  id is assigned (yet), which is the case for all rewinders created
+     *  on a client after the race started. */
+    int m_rewinder_id;
+
 public:
-    Rewinder(const std::string& ui = "")             { m_unique_identity = ui; }
+    Rewinder(const std::string& ui = "")
+    {
+        m_unique_identity = ui;
+        m_rewinder_id = -1;
+    }
 
     virtual ~Rewinder() {}
 
@@ -70,12 +81,14 @@ public:
      *  caused by the rewind (which is then visually smoothed over time). */
     virtual void computeError() = 0;
 
-    /** Provides a copy of the state of the object in one memory buffer.
-     *  The memory is managed by the RewindManager.
-     *  \param[out] ru The unique identity of rewinder writing to.
-     *  \return The address of the memory buffer with the state.
+    /** Writes the state of the object to the given buffer, which is the
+     *  state message that is being assembled by GameProtocol. The rewinder
+     *  must only append to the buffer.
+     *  \param buffer The buffer to append the state to.
+     *  \return True if a state was saved, if false the buffer will be
+     *          reverted to the size before this call.
      */
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru) = 0;
+    virtual bool saveState(BareNetworkString* buffer) = 0;
 
     /** Called when an event needs to be undone. This is called while going
      *  backwards for rewinding - all stored events will get an 'undo' call.
@@ -103,8 +116,15 @@ public:
     /** Nothing to do here. */
     virtual void reset() {}
     // -------------------------------------------------------------------------
-    virtual std::function<void()> getLocalStateRestoreFunction()
-                                                             { return nullptr; }
+    /** Called on a client when a state is saved, to save the local state
+     *  which is not part of the server state (e.g. the steering of the
+     *  local player). Returns false if there is no local state to save.
+     *  The buffer is reused, so saving doesn't allocate memory. */
+    virtual bool saveLocalState(BareNetworkString *buffer)    { return false; }
+    // -------------------------------------------------------------------------
+    /** Restores the local state saved by saveLocalState when rewinding to
+     *  the ticks at which it was saved. */
+    virtual void restoreLocalState(BareNetworkString *buffer) {}
     // -------------------------------------------------------------------------
     const std::string& getUniqueIdentity() const
     {
@@ -112,6 +132,11 @@ public:
         return m_unique_identity;
     }
     // -------------------------------------------------------------------------
+    /** Returns the id of this rewinder in states, or -1 if none. */
+    int getRewinderID() const                          { return m_rewinder_id; }
+    // -------------------------------------------------------------------------
+    void setRewinderID(int id)                           { m_rewinder_id = id; }
+    // -------------------------------------------------------------------------
     bool rewinderAdd();
     // -------------------------------------------------------------------------
     template<typename T> std::shared_ptr<T> getShared()
@@ -319,6 +319,13 @@ namespace ServerConfig
         "more rewind, which clients with slow device may have problem playing "
         "this server, use the default value is recommended."));
 
+    SERVER_CFG_PREFIX IntServerConfigParam m_track_cache_size
+        SERVER_CFG_DEFAULT(IntServerConfigParam(0,
+        "track-cache-size",
+        "Number of recently played tracks whose models are kept in memory "
+        "after a race, so that voting for the same track again loads "
+        "faster. Each cached track needs more memory, 0 to disable."));
+
     SERVER_CFG_PREFIX BoolServerConfigParam m_sql_management
         SERVER_CFG_DEFAULT(BoolServerConfigParam(false,
         "sql-management",
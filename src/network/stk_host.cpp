@@ -342,7 +342,8 @@ STKHost::~STKHost()
     // Drop all unsent packets
     for (auto& p : m_enet_cmd)
     {
-        if (std::get<3>(p) == ECT_SEND_PACKET)
+        if (std::get<3>(p) == ECT_SEND_PACKET ||
+            std::get<3>(p) == ECT_RELEASE_PACKET)
         {
             ENetPacket* packet = std::get<1>(p);
             enet_packet_destroy(packet);
@@ -617,17 +618,30 @@ void STKHost::setPrivatePort()
 */
 void STKHost::disconnectAllPeers(bool timeout_waiting)
 {
-    std::lock_guard<std::mutex> lock(m_peers_mutex);
-    if (!m_peers.empty() && timeout_waiting)
+    PeerList peers = m_peer_table.removeAll();
+    if (!peers.empty() && timeout_waiting)
     {
-        for (auto peer : m_peers)
-            peer.second->disconnect();
+        for (auto peer : peers)
+            peer->disconnect();
         // Wait for at most 2 seconds for disconnect event to be generated
         m_exit_timeout.store(StkTime::getMonoTimeMs() + 2000);
     }
-    m_peers.clear();
 }   // disconnectAllPeers
 
+//-----------------------------------------------------------------------------
+/** Adds a newly connected peer. */
+void STKHost::addPeer(std::shared_ptr<STKPeer> peer)
+{
+    m_peer_table.add(peer);
+}   // addPeer
+
+//-----------------------------------------------------------------------------
+/** Removes the stk peers of the given enet peers. */
+void STKHost::removePeers(const std::vector<ENetPeer*>& enet_peers)
+{
+    m_peer_table.remove(enet_peers);
+}   // removePeers
+
 //-----------------------------------------------------------------------------
 /** Sets an error message for the gui.
  */
@@ -759,7 +773,9 @@ void STKHost::mainLoop()
 
         if (is_server)
         {
-            std::unique_lock<std::mutex> peer_lock(m_peers_mutex);
+            // Use the snapshot so that other threads (e.g. sending to all
+            // peers) are not blocked during the whole sweep
+            auto peers = getPeersSnapshot();
             const float timeout = ServerConfig::m_validation_timeout;
             bool need_ping = false;
             if (sl && (!sl->isRacing() || sl->allowJoinedPlayersWaiting()) &&
@@ -776,49 +792,49 @@ void STKHost::mainLoop()
             if (need_ping)
             {
                 m_peer_pings.getData().clear();
-                for (auto& p : m_peers)
+                for (auto& peer : *peers)
                 {
-                    m_peer_pings.getData()[p.second->getHostId()] =
-                        p.second->getPing();
-                    const unsigned ap = p.second->getAveragePing();
+                    m_peer_pings.getData()[peer->getHostId()] =
+                        peer->getPing();
+                    const unsigned ap = peer->getAveragePing();
                     const unsigned max_ping = ServerConfig::m_max_ping;
-                    if (p.second->isValidated() &&
-                        p.second->getConnectedTime() > 5.0f && ap > max_ping)
+                    if (peer->isValidated() &&
+                        peer->getConnectedTime() > 5.0f && ap > max_ping)
                     {
                         std::string player_name;
-                        if (!p.second->getPlayerProfiles().empty())
+                        if (!peer->getPlayerProfiles().empty())
                         {
                             player_name = StringUtils::wideToUtf8
-                                (p.second->getPlayerProfiles()[0]->getName());
+                                (peer->getPlayerProfiles()[0]->getName());
                         }
                         const bool peer_not_in_game =
                             sl->getCurrentState() <= ServerLobby::SELECTING
-                            || p.second->isWaitingForGame();
+                            || peer->isWaitingForGame();
                         if (ServerConfig::m_kick_high_ping_players &&
-                            !p.second->isDisconnected() && peer_not_in_game)
+                            !peer->isDisconnected() && peer_not_in_game)
                         {
                             Log::info("STKHost", "%s %s with ping %d is higher"
                                 " than %d ms when not in game, kick.",
-                                p.second->getAddress().toString().c_str(),
+                                peer->getAddress().toString().c_str(),
                                 player_name.c_str(), ap, max_ping);
-                            p.second->setWarnedForHighPing(true);
-                            p.second->setDisconnected(true);
+                            peer->setWarnedForHighPing(true);
+                            peer->setDisconnected(true);
                             std::lock_guard<std::mutex> lock(m_enet_cmd_mutex);
-                            m_enet_cmd.emplace_back(p.second->getENetPeer(),
+                            m_enet_cmd.emplace_back(peer->getENetPeer(),
                                 (ENetPacket*)NULL, PDI_KICK_HIGH_PING,
                                 ECT_DISCONNECT);
                         }
-                        else if (!p.second->hasWarnedForHighPing())
+                        else if (!peer->hasWarnedForHighPing())
                         {
                             Log::info("STKHost", "%s %s with ping %d is higher"
                                 " than %d ms.",
-                                p.second->getAddress().toString().c_str(),
+                                peer->getAddress().toString().c_str(),
                                 player_name.c_str(), ap, max_ping);
-                            p.second->setWarnedForHighPing(true);
+                            peer->setWarnedForHighPing(true);
                             NetworkString msg(PROTOCOL_LOBBY_ROOM);
                             msg.setSynchronous(true);
                             msg.addUInt8(LobbyProtocol::LE_BAD_CONNECTION);
-                            p.second->sendPacket(&msg, /*reliable*/true);
+                            peer->sendPacket(&msg, /*reliable*/true);
                         }
                     }
                 }
@@ -849,11 +865,12 @@ void STKHost::mainLoop()
                     g_ping_packet.end());
             }
 
-            for (auto it = m_peers.begin(); it != m_peers.end();)
+            std::vector<ENetPeer*> timed_out_peers;
+            for (auto& peer : *peers)
             {
                 if (!ping_packet.getBuffer().empty() &&
                     (!sl->allowJoinedPlayersWaiting() ||
-                    !sl->isRacing() || it->second->isWaitingForGame()))
+                    !sl->isRacing() || peer->isWaitingForGame()))
                 {
                     ENetPacket* packet = enet_packet_create(ping_packet.getData(),
                         ping_packet.getTotalSize(), ENET_PACKET_FLAG_RELIABLE);
@@ -862,8 +879,8 @@ void STKHost::mainLoop()
                         // If enet_peer_send failed, destroy the packet to
                         // prevent leaking, this can only be done if the packet
                         // is copied instead of shared sending to all peers
-                        if (enet_peer_send(
-                            it->first, EVENT_CHANNEL_UNENCRYPTED, packet) < 0)
+                        if (enet_peer_send(peer->getENetPeer(),
+                            EVENT_CHANNEL_UNENCRYPTED, packet) < 0)
                         {
                             enet_packet_destroy(packet);
                         }
@@ -872,23 +889,20 @@ void STKHost::mainLoop()
 
                 // Remove peer which has not been validated after a specific time
                 // It is validated when the first connection request has finished
-                if (!it->second->isValidated() &&
-                    it->second->getConnectedTime() > timeout)
+                if (!peer->isValidated() &&
+                    peer->getConnectedTime() > timeout)
                 {
                     Log::info("STKHost", "%s has not been validated for more"
                         " than %f seconds, disconnect it by force.",
-                        it->second->getAddress().toString().c_str(),
+                        peer->getAddress().toString().c_str(),
                         timeout);
                     enet_host_flush(host);
-                    enet_peer_reset(it->first);
-                    it = m_peers.erase(it);
-                }
-                else
-                {
-                    it++;
+                    enet_peer_reset(peer->getENetPeer());
+                    timed_out_peers.push_back(peer->getENetPeer());
                 }
             }
-            peer_lock.unlock();
+            if (!timed_out_peers.empty())
+                removePeers(timed_out_peers);
         }
 
         std::list<std::tuple<ENetPeer*, ENetPacket*, uint32_t,
@@ -913,6 +927,19 @@ void STKHost::mainLoop()
                 }
                 break;
             }
+            case ECT_SEND_SHARED_PACKET:
+                // The packet is destroyed by the ECT_RELEASE_PACKET command
+                // if no peer could take it
+                enet_peer_send(std::get<0>(p), (uint8_t)std::get<2>(p),
+                    std::get<1>(p));
+                break;
+            case ECT_RELEASE_PACKET:
+            {
+                ENetPacket* packet = std::get<1>(p);
+                if (packet->referenceCount == 0)
+                    enet_packet_destroy(packet);
+                break;
+            }
             case ECT_DISCONNECT:
                 enet_peer_disconnect(std::get<0>(p), std::get<2>(p));
                 break;
@@ -921,8 +948,7 @@ void STKHost::mainLoop()
                 enet_host_flush(host);
                 enet_peer_reset(std::get<0>(p));
                 // Remove the stk peer of it
-                std::lock_guard<std::mutex> lock(m_peers_mutex);
-                m_peers.erase(std::get<0>(p));
+                removePeers({ std::get<0>(p) });
                 break;
             }
         }
@@ -958,9 +984,7 @@ void STKHost::mainLoop()
                 // ++m_next_unique_host_id for unique host id for database
                 auto stk_peer = std::make_shared<STKPeer>
                     (event.peer, this, ++m_next_unique_host_id);
-                std::unique_lock<std::mutex> lock(m_peers_mutex);
-                m_peers[event.peer] = stk_peer;
-                lock.unlock();
+                addPeer(stk_peer);
                 stk_event = new Event(&event, stk_peer);
                 TransportAddress addr(event.peer->address);
                 Log::info("STKHost", "%s has just connected. There are "
@@ -982,20 +1006,23 @@ void STKHost::mainLoop()
                 }
                 // Use the previous stk peer so protocol can see the network
                 // profile and handle it for disconnection
-                if (m_peers.find(event.peer) != m_peers.end())
+                std::shared_ptr<STKPeer> stk_peer =
+                    m_peer_table.find(event.peer);
+                if (stk_peer)
                 {
-                    stk_event = new Event(&event, m_peers.at(event.peer));
-                    std::lock_guard<std::mutex> lock(m_peers_mutex);
-                    m_peers.erase(event.peer);
+                    stk_event = new Event(&event, stk_peer);
+                    removePeers({ event.peer });
                 }
                 TransportAddress addr(event.peer->address);
                 Log::info("STKHost", "%s has just disconnected. There are "
                     "now %u peers.", addr.toString().c_str(), getPeerCount());
             }   // ENET_EVENT_TYPE_DISCONNECT
 
-            if (!stk_event && m_peers.find(event.peer) != m_peers.end())
+            std::shared_ptr<STKPeer> peer;
+            if (!stk_event)
+                peer = m_peer_table.find(event.peer);
+            if (peer)
             {
-                auto& peer = m_peers.at(event.peer);
                 if (isPingPacket(event.packet->data, event.packet->dataLength))
                 {
                     if (!is_server)
@@ -1185,10 +1212,9 @@ void STKHost::handleDirectSocketRequest(Network* direct_socket,
  */
 bool STKHost::peerExists(const TransportAddress& peer)
 {
-    std::lock_guard<std::mutex> lock(m_peers_mutex);
-    for (auto p : m_peers)
+    auto peers = getPeersSnapshot();
+    for (auto& stk_peer : *peers)
     {
-        auto stk_peer = p.second;
         if (stk_peer->getAddress() == peer ||
             ((stk_peer->getAddress().isPublicAddressLocalhost() ||
             peer.isPublicAddressLocalhost()) &&
@@ -1205,9 +1231,10 @@ bool STKHost::peerExists(const TransportAddress& peer)
 std::shared_ptr<STKPeer> STKHost::getServerPeerForClient() const
 {
     assert(NetworkConfig::get()->isClient());
-    if (m_peers.size() != 1)
+    auto peers = getPeersSnapshot();
+    if (peers->size() != 1)
         return nullptr;
-    return m_peers.begin()->second;
+    return (*peers)[0];
 }   // getServerPeerForClient
 
 // ----------------------------------------------------------------------------
@@ -1235,12 +1262,14 @@ bool STKHost::isConnectedTo(const TransportAddress& peer)
  */
 void STKHost::sendPacketToAllPeersInServer(NetworkString *data, bool reliable)
 {
-    std::lock_guard<std::mutex> lock(m_peers_mutex);
-    for (auto p : m_peers)
+    auto peers = getPeersSnapshot();
+    std::vector<STKPeer*> receivers;
+    for (auto& p : *peers)
     {
-        if (p.second->isValidated())
-            p.second->sendPacket(data, reliable);
+        if (p->isValidated())
+            receivers.push_back(p.get());
     }
+    sendPacketToPeers(receivers, data, reliable);
 }   // sendPacketToAllPeersInServer
 
 //-----------------------------------------------------------------------------
@@ -1250,12 +1279,14 @@ void STKHost::sendPacketToAllPeersInServer(NetworkString *data, bool reliable)
  */
 void STKHost::sendPacketToAllPeers(NetworkString *data, bool reliable)
 {
-    std::lock_guard<std::mutex> lock(m_peers_mutex);
-    for (auto p : m_peers)
+    auto peers = getPeersSnapshot();
+    std::vector<STKPeer*> receivers;
+    for (auto& p : *peers)
     {
-        if (p.second->isValidated() && !p.second->isWaitingForGame())
-            p.second->sendPacket(data, reliable);
+        if (p->isValidated() && !p->isWaitingForGame())
+            receivers.push_back(p.get());
     }
+    sendPacketToPeers(receivers, data, reliable);
 }   // sendPacketToAllPeers
 
 //-----------------------------------------------------------------------------
@@ -1267,16 +1298,18 @@ void STKHost::sendPacketToAllPeers(NetworkString *data, bool reliable)
 void STKHost::sendPacketExcept(STKPeer* peer, NetworkString *data,
                                bool reliable)
 {
-    std::lock_guard<std::mutex> lock(m_peers_mutex);
-    for (auto p : m_peers)
+    auto peers = getPeersSnapshot();
+    std::vector<STKPeer*> receivers;
+    for (auto& p : *peers)
     {
-        STKPeer* stk_peer = p.second.get();
-        if (!stk_peer->isSamePeer(peer) && p.second->isValidated() &&
-            !p.second->isWaitingForGame())
+        STKPeer* stk_peer = p.get();
+        if (!stk_peer->isSamePeer(peer) && p->isValidated() &&
+            !p->isWaitingForGame())
         {
-            stk_peer->sendPacket(data, reliable);
+            receivers.push_back(stk_peer);
         }
     }
+    sendPacketToPeers(receivers, data, reliable);
 }   // sendPacketExcept
 
 //-----------------------------------------------------------------------------
@@ -1288,26 +1321,80 @@ void STKHost::sendPacketExcept(STKPeer* peer, NetworkString *data,
 void STKHost::sendPacketToAllPeersWith(std::function<bool(STKPeer*)> predicate,
                                        NetworkString* data, bool reliable)
 {
-    std::lock_guard<std::mutex> lock(m_peers_mutex);
-    for (auto p : m_peers)
+    auto peers = getPeersSnapshot();
+    std::vector<STKPeer*> receivers;
+    for (auto& p : *peers)
     {
-        STKPeer* stk_peer = p.second.get();
+        STKPeer* stk_peer = p.get();
         if (!stk_peer->isValidated())
             continue;
         if (predicate(stk_peer))
-            stk_peer->sendPacket(data, reliable);
+            receivers.push_back(stk_peer);
     }
+    sendPacketToPeers(receivers, data, reliable);
 }   // sendPacketToAllPeersWith
 
+//-----------------------------------------------------------------------------
+/** Sends the same data to several peers. Peers without encryption share one
+ *  enet packet (which is destroyed by enet after it was sent to all of
+ *  them), and all send commands are queued with a single lock of
+ *  m_enet_cmd_mutex.
+ *  \param peers The peers to send the data to.
+ *  \param data Data to sent.
+ *  \param reliable If the data should be sent reliable or now.
+ */
+void STKHost::sendPacketToPeers(const std::vector<STKPeer*>& peers,
+                                NetworkString* data, bool reliable)
+{
+    std::list<std::tuple<ENetPeer*, ENetPacket*, uint32_t,
+        ENetCommandType> > commands;
+    ENetPacket* shared_packet = NULL;
+    for (STKPeer* peer : peers)
+    {
+        if (!peer->canSendPacket())
+            continue;
+        if (peer->getCrypto())
+        {
+            ENetPacket* packet = peer->createPacket(data, reliable,
+                /*encrypted*/true);
+            if (packet)
+            {
+                commands.emplace_back(peer->getENetPeer(), packet,
+                    EVENT_CHANNEL_NORMAL, ECT_SEND_PACKET);
+            }
+            continue;
+        }
+        if (!shared_packet)
+        {
+            shared_packet = peer->createPacket(data, reliable,
+                /*encrypted*/true);
+            if (!shared_packet)
+                continue;
+        }
+        commands.emplace_back(peer->getENetPeer(), shared_packet,
+            EVENT_CHANNEL_NORMAL, ECT_SEND_SHARED_PACKET);
+    }
+    if (shared_packet)
+    {
+        commands.emplace_back((ENetPeer*)NULL, shared_packet, 0,
+            ECT_RELEASE_PACKET);
+    }
+    if (commands.empty())
+        return;
+
+    std::lock_guard<std::mutex> lock(m_enet_cmd_mutex);
+    m_enet_cmd.splice(m_enet_cmd.end(), commands);
+}   // sendPacketToPeers
+
 //-----------------------------------------------------------------------------
 /** Sends a message from a client to the server. */
 void STKHost::sendToServer(NetworkString *data, bool reliable)
 {
-    std::lock_guard<std::mutex> lock(m_peers_mutex);
-    if (m_peers.empty())
+    auto peers = getPeersSnapshot();
+    if (peers->empty())
         return;
     assert(NetworkConfig::get()->isClient());
-    m_peers.begin()->second->sendPacket(data, reliable);
+    (*peers)[0]->sendPacket(data, reliable);
 }   // sendToServer
 
 //-----------------------------------------------------------------------------
@@ -1315,15 +1402,14 @@ std::vector<std::shared_ptr<NetworkPlayerProfile> >
     STKHost::getAllPlayerProfiles() const
 {
     std::vector<std::shared_ptr<NetworkPlayerProfile> > p;
-    std::unique_lock<std::mutex> lock(m_peers_mutex);
-    for (auto& peer : m_peers)
+    auto peers = getPeersSnapshot();
+    for (auto& peer : *peers)
     {
-        if (peer.second->isDisconnected() || !peer.second->isValidated())
+        if (peer->isDisconnected() || !peer->isValidated())
             continue;
-        auto peer_profile = peer.second->getPlayerProfiles();
+        auto peer_profile = peer->getPlayerProfiles();
         p.insert(p.end(), peer_profile.begin(), peer_profile.end());
     }
-    lock.unlock();
     return p;
 }   // getAllPlayerProfiles
 
@@ -1331,31 +1417,30 @@ std::vector<std::shared_ptr<NetworkPlayerProfile> >
 std::set<uint32_t> STKHost::getAllPlayerOnlineIds() const
 {
     std::set<uint32_t> online_ids;
-    std::unique_lock<std::mutex> lock(m_peers_mutex);
-    for (auto& peer : m_peers)
+    auto peers = getPeersSnapshot();
+    for (auto& peer : *peers)
     {
-        if (peer.second->isDisconnected() || !peer.second->isValidated())
+        if (peer->isDisconnected() || !peer->isValidated())
             continue;
-        if (!peer.second->getPlayerProfiles().empty())
+        if (!peer->getPlayerProfiles().empty())
         {
             online_ids.insert(
-                peer.second->getPlayerProfiles()[0]->getOnlineId());
+                peer->getPlayerProfiles()[0]->getOnlineId());
         }
     }
-    lock.unlock();
     return online_ids;
 }   // getAllPlayerOnlineIds
 
 //-----------------------------------------------------------------------------
 std::shared_ptr<STKPeer> STKHost::findPeerByHostId(uint32_t id) const
 {
-    std::lock_guard<std::mutex> lock(m_peers_mutex);
-    auto ret = std::find_if(m_peers.begin(), m_peers.end(),
-        [id](const std::pair<ENetPeer*, std::shared_ptr<STKPeer> >& p)
+    auto peers = getPeersSnapshot();
+    auto ret = std::find_if(peers->begin(), peers->end(),
+        [id](const std::shared_ptr<STKPeer>& p)
         {
-            return p.second->getHostId() == id;
+            return p->getHostId() == id;
         });
-    return ret != m_peers.end() ? ret->second : nullptr;
+    return ret != peers->end() ? *ret : nullptr;
 }   // findPeerByHostId
 
 //-----------------------------------------------------------------------------
@@ -1372,7 +1457,7 @@ void STKHost::initClientNetwork(ENetEvent& event, Network* new_network)
     auto stk_peer = std::make_shared<STKPeer>(event.peer, this,
         m_next_unique_host_id++);
     stk_peer->setValidated();
-    m_peers[event.peer] = stk_peer;
+    addPeer(stk_peer);
     setPrivatePort();
     auto pm = ProtocolManager::lock();
     if (pm && !pm->isExiting())
@@ -1403,10 +1488,9 @@ std::vector<std::shared_ptr<NetworkPlayerProfile> >
     STKHost::getPlayersForNewGame() const
 {
     std::vector<std::shared_ptr<NetworkPlayerProfile> > players;
-    std::lock_guard<std::mutex> lock(m_peers_mutex);
-    for (auto& p : m_peers)
+    auto peers = getPeersSnapshot();
+    for (auto& stk_peer : *peers)
     {
-        auto& stk_peer = p.second;
         if (stk_peer->isWaitingForGame())
             continue;
         for (auto& q : stk_peer->getPlayerProfiles())
@@ -1427,10 +1511,9 @@ void STKHost::updatePlayers(unsigned* ingame, unsigned* waiting,
     uint32_t ingame_players = 0;
     uint32_t waiting_players = 0;
     uint32_t total_players = 0;
-    std::lock_guard<std::mutex> lock(m_peers_mutex);
-    for (auto& p : m_peers)
+    auto peers = getPeersSnapshot();
+    for (auto& stk_peer : *peers)
     {
-        auto& stk_peer = p.second;
         if (!stk_peer->isValidated())
             continue;
         if (stk_peer->isWaitingForGame())
@@ -24,6 +24,7 @@
 
 #include "network/network.hpp"
 #include "network/network_string.hpp"
+#include "network/peer_table.hpp"
 #include "network/transport_address.hpp"
 #include "utils/synchronised.hpp"
 #include "utils/time.hpp"
@@ -45,6 +46,7 @@
 #include <set>
 #include <thread>
 #include <tuple>
+#include <vector>
 
 class GameSetup;
 class LobbyProtocol;
@@ -58,7 +60,12 @@ enum ENetCommandType : unsigned int
 {
     ECT_SEND_PACKET = 0,
     ECT_DISCONNECT = 1,
-    ECT_RESET = 2
+    ECT_RESET = 2,
+    /** Sends a packet which is shared by several peers. */
+    ECT_SEND_SHARED_PACKET = 3,
+    /** Destroys a shared packet if no peer uses it, queued after the last
+     *  ECT_SEND_SHARED_PACKET of that packet. */
+    ECT_RELEASE_PACKET = 4
 };
 
 class STKHost
@@ -87,9 +94,6 @@ private:
     /** Network console thread */
     std::thread m_network_console;
 
-    /** Make sure the removing or adding a peer is thread-safe. */
-    mutable std::mutex m_peers_mutex;
-
     /** Let (atm enet_peer_send and enet_peer_disconnect) run in the listening
      *  thread. */
     std::list<std::tuple</*peer receive*/ENetPeer*,
@@ -99,8 +103,12 @@ private:
     /** Protect \ref m_enet_cmd from multiple threads usage. */
     std::mutex m_enet_cmd_mutex;
 
-    /** The list of peers connected to this instance. */
-    std::map<ENetPeer*, std::shared_ptr<STKPeer> > m_peers;
+    /** The list of peers connected to this instance. Readers (e.g. when
+     *  sending packets to all peers) use its snapshot without locking, so
+     *  they never wait for the listening thread. */
+    PeerTable m_peer_table;
+
+    typedef PeerTable::PeerList PeerList;
 
     /** Next unique host id. It is increased whenever a new peer is added (see
      *  getPeer()), but not decreased whena host (=peer) disconnects. This
@@ -167,6 +175,16 @@ private:
                                    std::map<std::string, uint64_t>& ctp);
     // ------------------------------------------------------------------------
     void mainLoop();
+    // ------------------------------------------------------------------------
+    void addPeer(std::shared_ptr<STKPeer> peer);
+    // ------------------------------------------------------------------------
+    void removePeers(const std::vector<ENetPeer*>& enet_peers);
+    // ------------------------------------------------------------------------
+    /** Returns the current list of peers without locking. */
+    std::shared_ptr<const PeerList> getPeersSnapshot() const
+    {
+        return m_peer_table.getSnapshot();
+    }   // getPeersSnapshot
 
 public:
     /** If a network console should be started. */
@@ -231,6 +249,9 @@ public:
     void sendPacketToAllPeersWith(std::function<bool(STKPeer*)> predicate,
                                   NetworkString* data, bool reliable = true);
     // ------------------------------------------------------------------------
+    void sendPacketToPeers(const std::vector<STKPeer*>& peers,
+                           NetworkString* data, bool reliable = true);
+    // ------------------------------------------------------------------------
     /** Returns true if this client instance is allowed to control the server.
      *  It will auto transfer ownership if previous server owner disconnected.
      */
@@ -299,13 +320,7 @@ public:
     /** Returns a copied list of peers. */
     std::vector<std::shared_ptr<STKPeer> > getPeers() const
     {
-        std::lock_guard<std::mutex> lock(m_peers_mutex);
-        std::vector<std::shared_ptr<STKPeer> > peers;
-        for (auto p : m_peers)
-        {
-            peers.push_back(p.second);
-        }
-        return peers;
+        return *getPeersSnapshot();
     }
     // ------------------------------------------------------------------------
     /** Returns the next (unique) host id. */
@@ -320,8 +335,7 @@ public:
     /** Returns the number of currently connected peers. */
     unsigned int getPeerCount() const
     {
-        std::lock_guard<std::mutex> lock(m_peers_mutex);
-        return (unsigned)m_peers.size();
+        return (unsigned)getPeersSnapshot()->size();
     }
     // ------------------------------------------------------------------------
     /** Sets the global host id of this host (client use). */
@@ -103,15 +103,43 @@ void STKPeer::reset()
  */
 void STKPeer::sendPacket(NetworkString *data, bool reliable, bool encrypted)
 {
-    if (m_disconnected.load())
+    if (!canSendPacket())
         return;
+
+    ENetPacket* packet = createPacket(data, reliable, encrypted);
+    if (packet)
+    {
+        m_host->addEnetCommand(m_enet_peer, packet,
+                encrypted ? EVENT_CHANNEL_NORMAL : EVENT_CHANNEL_UNENCRYPTED,
+                ECT_SEND_PACKET);
+    }
+}   // sendPacket
+
+//-----------------------------------------------------------------------------
+/** Returns if packets can be sent to this peer, i.e. it is not disconnected
+ *  and its enet peer has not been reused for another connection.
+ */
+bool STKPeer::canSendPacket() const
+{
+    if (m_disconnected.load())
+        return false;
     TransportAddress a(m_enet_peer->address);
     // Enet will reuse a disconnected peer so we check here to avoid sending
     // to wrong peer
-    if (m_enet_peer->state != ENET_PEER_STATE_CONNECTED ||
-        a != m_peer_address)
-        return;
+    return m_enet_peer->state == ENET_PEER_STATE_CONNECTED &&
+        a == m_peer_address;
+}   // canSendPacket
 
+//-----------------------------------------------------------------------------
+/** Creates the enet packet to send the data to this peer, encrypted with the
+ *  key of this peer if needed. Returns NULL if it failed.
+ *  \param data The data to send.
+ *  \param reliable If the data should be sent reliable or not.
+ *  \param encrypted If the data should be encrypted (if this peer has a key).
+ */
+ENetPacket* STKPeer::createPacket(NetworkString *data, bool reliable,
+                                  bool encrypted)
+{
     ENetPacket* packet = NULL;
     if (m_crypto && encrypted)
     {
@@ -126,19 +154,14 @@ void STKPeer::sendPacket(NetworkString *data, bool reliable, bool encrypted)
             ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT)));
     }
 
-    if (packet)
+    if (packet && Network::m_connection_debug)
     {
-        if (Network::m_connection_debug)
-        {
-            Log::verbose("STKPeer", "sending packet of size %d to %s at %lf",
-                packet->dataLength, a.toString().c_str(),
-                StkTime::getRealTime());
-        }
-        m_host->addEnetCommand(m_enet_peer, packet,
-                encrypted ? EVENT_CHANNEL_NORMAL : EVENT_CHANNEL_UNENCRYPTED,
-                ECT_SEND_PACKET);
+        Log::verbose("STKPeer", "sending packet of size %d to %s at %lf",
+            packet->dataLength, m_peer_address.toString().c_str(),
+            StkTime::getRealTime());
     }
-}   // sendPacket
+    return packet;
+}   // createPacket
 
 //-----------------------------------------------------------------------------
 /** Returns if the peer is connected or not.
@@ -112,6 +112,11 @@ public:
     void sendPacket(NetworkString *data, bool reliable = true,
                     bool encrypted = true);
     // ------------------------------------------------------------------------
+    bool canSendPacket() const;
+    // ------------------------------------------------------------------------
+    ENetPacket* createPacket(NetworkString *data, bool reliable,
+                             bool encrypted);
+    // ------------------------------------------------------------------------
     void disconnect();
     // ------------------------------------------------------------------------
     void kick();
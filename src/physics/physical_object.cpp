@@ -32,6 +32,7 @@
 #include "network/compress_network_body.hpp"
 #include "network/network_config.hpp"
 #include "network/protocols/lobby_protocol.hpp"
+#include "scriptengine/script_engine.hpp"
 #include "tracks/track.hpp"
 #include "tracks/track_object.hpp"
 #include "utils/constants.hpp"
@@ -167,6 +168,9 @@ PhysicalObject::PhysicalObject(bool is_dynamic,
     m_reset_height       = settings.m_reset_height;
     m_on_kart_collision  = settings.m_on_kart_collision;
     m_on_item_collision  = settings.m_on_item_collision;
+    m_on_kart_collision_function = NULL;
+    m_on_item_collision_function = NULL;
+    m_collision_functions_found  = false;
     m_current_transform.setOrigin(Vec3());
     m_current_transform.setRotation(
         btQuaternion(0.0f, 0.0f, 0.0f, 1.0f));
@@ -743,6 +747,27 @@ void PhysicalObject::setInteraction(std::string interaction){
     }
 }   // set interaction
 
+// ----------------------------------------------------------------------------
+/** Looks up the script functions called on collisions, so that the
+ *  declarations of the functions do not need to be built for each collision.
+ */
+void PhysicalObject::findCollisionFunctions()
+{
+    Scripting::ScriptEngine* script_engine =
+        Scripting::ScriptEngine::getInstance();
+    if (!m_on_kart_collision.empty())
+    {
+        m_on_kart_collision_function = script_engine->getFunction(true,
+            "void " + m_on_kart_collision + "(int, const string, const string)");
+    }
+    if (!m_on_item_collision.empty())
+    {
+        m_on_item_collision_function = script_engine->getFunction(true,
+            "void " + m_on_item_collision + "(int, int, const string)");
+    }
+    m_collision_functions_found = true;
+}   // findCollisionFunctions
+
 // ----------------------------------------------------------------------------
 /** Remove body from physics dynamic world interaction type for object*/
 void PhysicalObject::removeBody()
@@ -812,14 +837,13 @@ void PhysicalObject::computeError()
 }   // computeError
 
 // ----------------------------------------------------------------------------
-BareNetworkString* PhysicalObject::saveState(std::vector<std::string>* ru)
+bool PhysicalObject::saveState(BareNetworkString* buffer)
 {
     bool has_live_join = false;
 
     if (auto sl = LobbyProtocol::get<LobbyProtocol>())
         has_live_join = sl->hasLiveJoiningRecently();
 
-    BareNetworkString* buffer = new BareNetworkString();
     // This will compress and round down values of body, use the rounded
     // down value to test if sending state is needed
     // If any client live-joined always send new state for this object
@@ -833,15 +857,14 @@ BareNetworkString* PhysicalObject::saveState(std::vector<std::string>* ru)
         (current_lv - m_last_lv).length() < 0.01f &&
         (current_av - m_last_av).length() < 0.01f && !has_live_join)
     {
-        delete buffer;
-        return nullptr;
+        // The compressed data written is discarded by the caller
+        return false;
     }
 
-    ru->push_back(getUniqueIdentity());
     m_last_transform = cur_transform;
     m_last_lv = current_lv;
     m_last_av = current_av;
-    return buffer;
+    return true;
 }   // saveState
 
 // ----------------------------------------------------------------------------
@@ -856,35 +879,41 @@ void PhysicalObject::restoreState(BareNetworkString *buffer, int count)
 }   // restoreState
 
 // ----------------------------------------------------------------------------
-std::function<void()> PhysicalObject::getLocalStateRestoreFunction()
+bool PhysicalObject::saveLocalState(BareNetworkString *buffer)
 {
-    btTransform t = m_body->getWorldTransform();
-    Vec3 lv = m_body->getLinearVelocity();
-    Vec3 av = m_body->getAngularVelocity();
-    return [t, lv, av, this]()
+    // The rows of the basis are saved instead of a quaternion, so that the
+    // transform is restored exactly
+    const btTransform& t = m_body->getWorldTransform();
+    buffer->add(t.getBasis()[0]).add(t.getBasis()[1]).add(t.getBasis()[2])
+        .add(t.getOrigin());
+    buffer->add(m_body->getLinearVelocity())
+        .add(m_body->getAngularVelocity());
+    return true;
+}   // saveLocalState
+
+// ----------------------------------------------------------------------------
+void PhysicalObject::restoreLocalState(BareNetworkString *buffer)
+{
+    btTransform t;
+    for (unsigned i = 0; i < 3; i++)
+        t.getBasis()[i] = buffer->getVec3();
+    t.setOrigin(buffer->getVec3());
+    Vec3 lv = buffer->getVec3();
+    Vec3 av = buffer->getVec3();
+    if (m_no_server_state)
     {
-        if (m_no_server_state)
-        {
-            m_body->setWorldTransform(m_last_transform);
-            m_motion_state->setWorldTransform(m_last_transform);
-            m_body->setInterpolationWorldTransform(m_last_transform);
-            m_body->setLinearVelocity(m_last_lv);
-            m_body->setAngularVelocity(m_last_av);
-            m_body->setInterpolationLinearVelocity(m_last_lv);
-            m_body->setInterpolationAngularVelocity(m_last_av);
-        }
-        else
-        {
-            m_body->setWorldTransform(t);
-            m_motion_state->setWorldTransform(t);
-            m_body->setInterpolationWorldTransform(t);
-            m_body->setLinearVelocity(lv);
-            m_body->setAngularVelocity(av);
-            m_body->setInterpolationLinearVelocity(lv);
-            m_body->setInterpolationAngularVelocity(av);
-        }
-    };
-}   // getLocalStateRestoreFunction
+        t = m_last_transform;
+        lv = m_last_lv;
+        av = m_last_av;
+    }
+    m_body->setWorldTransform(t);
+    m_motion_state->setWorldTransform(t);
+    m_body->setInterpolationWorldTransform(t);
+    m_body->setLinearVelocity(lv);
+    m_body->setAngularVelocity(av);
+    m_body->setInterpolationLinearVelocity(lv);
+    m_body->setInterpolationAngularVelocity(av);
+}   // restoreLocalState
 
 // ----------------------------------------------------------------------------
 void PhysicalObject::joinToMainTrack()
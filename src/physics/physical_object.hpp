@@ -30,6 +30,7 @@
 #include "utils/leak_check.hpp"
 
 
+class asIScriptFunction;
 class Material;
 class TrackObject;
 class XMLNode;
@@ -180,6 +181,12 @@ private:
     * when a (flyable) item collides with this object
     */
     std::string           m_on_item_collision;
+    /** The script functions called on collisions (NULL if there is none).
+     *  They are looked up on the first collision, since the scripts are
+     *  compiled after the physical objects are created. */
+    asIScriptFunction    *m_on_kart_collision_function;
+    asIScriptFunction    *m_on_item_collision_function;
+    bool                  m_collision_functions_found;
     /** If this body is a bullet dynamic body, i.e. affected by physics
      *  or not (static (not moving) or kinematic (animated outside
      *  of physics). */
@@ -239,6 +246,7 @@ public:
     // ------------------------------------------------------------------------
     /** Sets the interaction type */
     void setInteraction(std::string interaction);
+    void findCollisionFunctions();
     // ------------------------------------------------------------------------
     /** Remove body from dynamic world */
     void removeBody();
@@ -252,6 +260,24 @@ public:
     // ------------------------------------------------------------------------
     const std::string& getOnItemCollisionFunction() const { return m_on_item_collision; }
     // ------------------------------------------------------------------------
+    /** Returns the script function to call when a kart collides with this
+     *  object, or NULL. */
+    asIScriptFunction* getOnKartCollisionScriptFunction()
+    {
+        if (!m_collision_functions_found)
+            findCollisionFunctions();
+        return m_on_kart_collision_function;
+    }   // getOnKartCollisionScriptFunction
+    // ------------------------------------------------------------------------
+    /** Returns the script function to call when an item collides with this
+     *  object, or NULL. */
+    asIScriptFunction* getOnItemCollisionScriptFunction()
+    {
+        if (!m_collision_functions_found)
+            findCollisionFunctions();
+        return m_on_item_collision_function;
+    }   // getOnItemCollisionScriptFunction
+    // ------------------------------------------------------------------------
     TrackObject* getTrackObject() { return m_object; }
 
     // Methods usable by scripts
@@ -285,12 +311,13 @@ public:
     void addForRewind();
     virtual void saveTransform();
     virtual void computeError();
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru);
+    virtual bool saveState(BareNetworkString* buffer);
     virtual void undoEvent(BareNetworkString *buffer) {}
     virtual void rewindToEvent(BareNetworkString *buffer) {}
     virtual void restoreState(BareNetworkString *buffer, int count);
     virtual void undoState(BareNetworkString *buffer) {}
-    virtual std::function<void()> getLocalStateRestoreFunction();
+    virtual bool saveLocalState(BareNetworkString *buffer);
+    virtual void restoreLocalState(BareNetworkString *buffer);
     bool hasTriangleMesh() const { return m_triangle_mesh != NULL; }
     void joinToMainTrack();
     LEAK_CHECK()
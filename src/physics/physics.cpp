@@ -62,6 +62,8 @@ Physics::Physics() : btSequentialImpulseConstraintSolver()
 void Physics::init(const Vec3 &world_min, const Vec3 &world_max)
 {
     m_physics_loop_active = false;
+    m_kart_kart_collision_function       = NULL;
+    m_kart_kart_collision_function_found = false;
     m_axis_sweep          = new btAxisSweep3(world_min, world_max);
     m_dynamics_world      = new STKDynamicsWorld(m_dispatcher,
                                                  m_axis_sweep,
@@ -194,13 +196,22 @@ void Physics::update(int ticks)
                               p->getContactPointCS(1)                );
             Scripting::ScriptEngine* script_engine =
                                             Scripting::ScriptEngine::getInstance();
-            int kartid1 = p->getUserPointer(0)->getPointerKart()->getWorldKartId();
-            int kartid2 = p->getUserPointer(1)->getPointerKart()->getWorldKartId();
-            script_engine->runFunction(false, "void onKartKartCollision(int, int)",
-                [=](asIScriptContext* ctx) {
-                    ctx->SetArgDWord(0, kartid1);
-                    ctx->SetArgDWord(1, kartid2);
-                });
+            if (!m_kart_kart_collision_function_found)
+            {
+                m_kart_kart_collision_function = script_engine->getFunction(
+                    false, "void onKartKartCollision(int, int)");
+                m_kart_kart_collision_function_found = true;
+            }
+            if (m_kart_kart_collision_function)
+            {
+                int kartid1 = p->getUserPointer(0)->getPointerKart()->getWorldKartId();
+                int kartid2 = p->getUserPointer(1)->getPointerKart()->getWorldKartId();
+                script_engine->runFunction(m_kart_kart_collision_function,
+                    [=](asIScriptContext* ctx) {
+                        ctx->SetArgDWord(0, kartid1);
+                        ctx->SetArgDWord(1, kartid2);
+                    });
+            }
             continue;
         }  // if kart-kart collision
 
@@ -212,20 +223,21 @@ void Physics::update(int ticks)
             AbstractKart *kart = p->getUserPointer(1)->getPointerKart();
             int kartId = kart->getWorldKartId();
             PhysicalObject* obj = p->getUserPointer(0)->getPointerPhysicalObject();
-            std::string obj_id = obj->getID();
-            std::string scripting_function = obj->getOnKartCollisionFunction();
-
-            TrackObject* to = obj->getTrackObject();
-            TrackObject* library = to->getParentLibrary();
-            std::string lib_id;
-            std::string* lib_id_ptr = NULL;
-            if (library != NULL)
-                lib_id = library->getID();
-            lib_id_ptr = &lib_id;
-
-            if (scripting_function.size() > 0)
+            asIScriptFunction* scripting_function =
+                obj->getOnKartCollisionScriptFunction();
+
+            if (scripting_function)
             {
-                script_engine->runFunction(true, "void " + scripting_function + "(int, const string, const string)",
+                std::string obj_id = obj->getID();
+                TrackObject* to = obj->getTrackObject();
+                TrackObject* library = to->getParentLibrary();
+                std::string lib_id;
+                std::string* lib_id_ptr = NULL;
+                if (library != NULL)
+                    lib_id = library->getID();
+                lib_id_ptr = &lib_id;
+
+                script_engine->runFunction(scripting_function,
                     [&](asIScriptContext* ctx) {
                         ctx->SetArgDWord(0, kartId);
                         ctx->SetArgObject(1, lib_id_ptr);
@@ -314,11 +326,12 @@ void Physics::update(int ticks)
             Scripting::ScriptEngine* script_engine = Scripting::ScriptEngine::getInstance();
             Flyable* flyable = p->getUserPointer(0)->getPointerFlyable();
             PhysicalObject* obj = p->getUserPointer(1)->getPointerPhysicalObject();
-            std::string obj_id = obj->getID();
-            std::string scripting_function = obj->getOnItemCollisionFunction();
-            if (scripting_function.size() > 0)
+            asIScriptFunction* scripting_function =
+                obj->getOnItemCollisionScriptFunction();
+            if (scripting_function)
             {
-                script_engine->runFunction(true, "void " + scripting_function + "(int, int, const string)",
+                std::string obj_id = obj->getID();
+                script_engine->runFunction(scripting_function,
                         [&](asIScriptContext* ctx) {
                         ctx->SetArgDWord(0, (int)flyable->getType());
                         ctx->SetArgDWord(1, flyable->getOwnerId());
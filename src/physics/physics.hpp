@@ -35,6 +35,7 @@
 #include "utils/singleton.hpp"
 
 class AbstractKart;
+class asIScriptFunction;
 class STKDynamicsWorld;
 class Vec3;
 
@@ -149,6 +150,12 @@ private:
     btDefaultCollisionConfiguration *m_collision_conf;
     CollisionList                    m_all_collisions;
 
+    /** The script function called on kart-kart collisions, or NULL. It is
+     *  looked up on the first collision, since the track scripts are
+     *  compiled after init() is called. */
+    asIScriptFunction               *m_kart_kart_collision_function;
+    bool                             m_kart_kart_collision_function_found;
+
     /** Singleton. */
     static Physics                  *m_physics;
 
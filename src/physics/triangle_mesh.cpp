@@ -19,14 +19,23 @@
 #include "physics/triangle_mesh.hpp"
 
 #include "config/stk_config.hpp"
+#include "io/file_manager.hpp"
 #include "main_loop.hpp"
 #include "physics/physics.hpp"
 #include "utils/constants.hpp"
+#include "utils/log.hpp"
 #include "utils/time.hpp"
 
 #include "btBulletDynamicsCommon.h"
 
-#include <fstream>
+#include <IReadFile.h>
+#include <IWriteFile.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/** Version of the BVH cache files, increase it if the content changes. */
+static const uint8_t BVH_CACHE_VERSION = 1;
 
 // -----------------------------------------------------------------------------
 /** Constructor: Initialises all data structures with zero.
@@ -44,6 +53,7 @@ TriangleMesh::TriangleMesh(bool can_be_transformed) : m_mesh()
     // (and m_mesh->m_weldingThreshold at m_normals
     m_collision_shape  = NULL;
     m_collision_object = NULL;
+    m_cached_bvh       = NULL;
     m_user_pointer.set(this);
 }   // TriangleMesh
 
@@ -89,10 +99,12 @@ void TriangleMesh::addTriangle(const btVector3 &t1, const btVector3 &t2,
 // -----------------------------------------------------------------------------
 /** Creates a collision body only, which can be used for raycasting, but
  *  has no physical properties.
- *  @param serialized_bhv if non-null, load the serialized bhv from file instead
- *                        of builing it on the fly
+ *  \param use_bvh_cache If true, the BVH of the collision shape is loaded
+ *         from the cache if it was saved before for the same triangles, and
+ *         saved otherwise. Used for tracks, which have big meshes.
  */
-void TriangleMesh::createCollisionShape(bool create_collision_object, const char* serialized_bhv)
+void TriangleMesh::createCollisionShape(bool create_collision_object,
+                                        bool use_bvh_cache)
 {
     if(m_triangleIndex2Material.size()==0)
     {
@@ -105,53 +117,18 @@ void TriangleMesh::createCollisionShape(bool create_collision_object, const char
     // Now convert the triangle mesh into a static rigid body
     btBvhTriangleMeshShape* bhv_triangle_mesh;
 
-    if (serialized_bhv != NULL)
+    const uint64_t hash = use_bvh_cache ? getBvhHash() : 0;
+    btOptimizedBvh* bvh = loadBvh(hash);
+    if (bvh)
     {
-        FILE *f = fopen(serialized_bhv, "rb");
-        fseek(f, 0, SEEK_END);
-        long pos = ftell(f);
-        assert(pos != -1L);
-        fseek(f, 0, SEEK_SET);
-
-        void* bytes = btAlignedAlloc(pos, 16);
-        fread(bytes, pos, 1, f);
-        fclose(f);
-
-        btOptimizedBvh* bhv = btOptimizedBvh::deSerializeInPlace(bytes, pos, !IS_LITTLE_ENDIAN);
-        if (bhv == NULL)
-        {
-            Log::warn("TriangleMesh", "Failed to load serialized BHV");
-            bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */);
-        }
-        else
-        {
-            bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */,
-                                                           false /* buildBvh */);
-            bhv_triangle_mesh->setOptimizedBvh( bhv );
-        }
-        // Do *NOT* free the bytes, 'deSerializeInPlace' makes the btOptimizedBvh object
-        // directly at this memory location
-        //free(bytes);
-
+        bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */,
+                                                       false /* buildBvh */);
+        bhv_triangle_mesh->setOptimizedBvh(bvh);
     }
     else
     {
         bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */);
-
-        /*
-         // code to serialize triangle mesh
-        btOptimizedBvh* bvh = bhv_triangle_mesh->getOptimizedBvh();
-        unsigned int ssize = bvh->calculateSerializeBufferSize();
-        char* buffer = (char*)btAlignedAlloc(ssize, 16);
-        bool success = bvh->serialize(buffer, ssize, !IS_LITTLE_ENDIAN);
-        printf("serialization success = %i\n", success);
-
-        std::ofstream fileout("/tmp/btOptimizedBvh");
-        fileout.write(buffer, ssize);
-        fileout.close();
-
-        btAlignedFree(buffer);
-         */
+        saveBvh(hash, bhv_triangle_mesh->getOptimizedBvh());
     }
 
     m_collision_shape = bhv_triangle_mesh;
@@ -178,16 +155,16 @@ void TriangleMesh::createCollisionShape(bool create_collision_object, const char
  *  for height of terrain detection).
  *  \param friction Friction to be used for this TriangleMesh.
  *  \param flags Additional collision flags (default 0).
- *  \param serializedBhv if non-NULL, the bhv is deserialized instead of
- *                       being calculated on the fly
+ *  \param use_bvh_cache If true, the BVH is loaded from or saved to the
+ *         cache, see createCollisionShape.
  */
 void TriangleMesh::createPhysicalBody(float friction,
                                       btCollisionObject::CollisionFlags flags,
-                                      const char* serializedBhv)
+                                      bool use_bvh_cache)
 {
     // We need the collision shape, but not the collision object (since
     // this will be created when the dynamics body is anyway).
-    createCollisionShape(/*create_collision_object*/false, serializedBhv);
+    createCollisionShape(/*create_collision_object*/false, use_bvh_cache);
     main_loop->renderGUI(5583);
 
     btTransform startTransform;
@@ -232,8 +209,150 @@ void TriangleMesh::removeAll()
     }
     delete m_collision_shape;
     m_collision_shape = NULL;
+    // A BVH loaded from the cache is not owned by the collision shape
+    if (m_cached_bvh)
+    {
+        ((btOptimizedBvh*)m_cached_bvh)->~btOptimizedBvh();
+        btAlignedFree(m_cached_bvh);
+        m_cached_bvh = NULL;
+    }
 }   // removeAll
 
+// ----------------------------------------------------------------------------
+/** Returns a hash of the triangles of this mesh, which is used to find the
+ *  cached BVH of it. The sizes of pointers and btScalar are included, since
+ *  the saved BVH depends on them.
+ */
+uint64_t TriangleMesh::getBvhHash() const
+{
+    // 64 bit FNV-1a, but applied to 32 bit words instead of single bytes,
+    // since track meshes have several MB of data. All sizes added are
+    // multiples of 4.
+    uint64_t hash = 14695981039346656037ULL;
+    auto add = [&hash](const void *data, size_t size)
+    {
+        const uint8_t *p = (const uint8_t*)data;
+        for (size_t i = 0; i + 4 <= size; i += 4)
+        {
+            uint32_t word;
+            memcpy(&word, p + i, 4);
+            hash ^= word;
+            hash *= 1099511628211ULL;
+        }
+    };
+    const uint32_t sizes[2] = { (uint32_t)sizeof(void*),
+                                (uint32_t)sizeof(btScalar) };
+    add(sizes, sizeof(sizes));
+
+    const IndexedMeshArray &m = m_mesh.getIndexedMeshArray();
+    const btVector3 *vertices = (const btVector3*)(m[0].m_vertexBase);
+    for (int i = 0; i < m[0].m_numVertices; i++)
+        add(vertices[i].m_floats, 3 * sizeof(btScalar));
+    add(m[0].m_triangleIndexBase,
+        m[0].m_numTriangles * m[0].m_triangleIndexStride);
+    return hash == 0 ? 1 : hash;
+}   // getBvhHash
+
+// ----------------------------------------------------------------------------
+/** Returns the file in which the BVH of a mesh is cached.
+ *  \param hash Hash of the triangles of the mesh.
+ */
+std::string TriangleMesh::getBvhCacheFile(uint64_t hash) const
+{
+    std::string dir = file_manager->getCachedDataDir() + "physics/";
+    file_manager->checkAndCreateDirectoryP(dir);
+    char name[32];
+    sprintf(name, "%016llx.stkbvh", (unsigned long long)hash);
+    return dir + name;
+}   // getBvhCacheFile
+
+// ----------------------------------------------------------------------------
+/** Loads the cached BVH for this mesh, returns NULL if there is none. The
+ *  file contains the cache version and the hash, followed by the BVH
+ *  serialized by bullet. The BVH is deserialized in place, so the memory it
+ *  was loaded into is kept in m_cached_bvh until the shape is removed.
+ *  \param hash Hash of the triangles of this mesh, 0 to not use the cache.
+ */
+btOptimizedBvh* TriangleMesh::loadBvh(uint64_t hash)
+{
+    if (hash == 0)
+        return NULL;
+    const std::string path = getBvhCacheFile(hash);
+    if (!file_manager->fileExists(path))
+        return NULL;
+    irr::io::IReadFile* file = irr::io::createReadFile(path.c_str());
+    if (!file)
+        return NULL;
+
+    uint8_t version = 0;
+    uint64_t file_hash = 0;
+    const long size = file->getSize() - 9;
+    bool success = size > 0 &&
+        file->read(&version, 1) == 1 && version == BVH_CACHE_VERSION &&
+        file->read(&file_hash, 8) == 8 && file_hash == hash;
+
+    void* bytes = NULL;
+    btOptimizedBvh* bvh = NULL;
+    if (success)
+    {
+        bytes = btAlignedAlloc(size, 16);
+        if (file->read(bytes, size) == size)
+        {
+            bvh = btOptimizedBvh::deSerializeInPlace(bytes, size,
+                                                     !IS_LITTLE_ENDIAN);
+        }
+    }
+    file->drop();
+
+    if (!bvh)
+    {
+        Log::warn("TriangleMesh", "Invalid BVH cache '%s' ignored.",
+            path.c_str());
+        if (bytes)
+            btAlignedFree(bytes);
+        return NULL;
+    }
+    // Keeps recently used files when the cache directory is limited
+    file_manager->touchFile(path);
+    m_cached_bvh = bytes;
+    return bvh;
+}   // loadBvh
+
+// ----------------------------------------------------------------------------
+/** Saves the BVH of this mesh, so that it doesn't need to be built when the
+ *  same mesh is loaded again.
+ *  \param hash Hash of the triangles of this mesh, 0 to not use the cache.
+ */
+void TriangleMesh::saveBvh(uint64_t hash, const btOptimizedBvh *bvh) const
+{
+    if (hash == 0 || !bvh)
+        return;
+    const unsigned int size = bvh->calculateSerializeBufferSize();
+    void* buffer = btAlignedAlloc(size, 16);
+    if (!bvh->serialize(buffer, size, !IS_LITTLE_ENDIAN))
+    {
+        btAlignedFree(buffer);
+        return;
+    }
+
+    const std::string path = getBvhCacheFile(hash);
+    irr::io::IWriteFile* file = irr::io::createWriteFile(path.c_str(),
+        false/*append*/);
+    if (!file)
+    {
+        Log::warn("TriangleMesh", "Can't write BVH cache '%s'.",
+            path.c_str());
+        btAlignedFree(buffer);
+        return;
+    }
+    const uint8_t version = BVH_CACHE_VERSION;
+    file->write(&version, 1);
+    file->write(&hash, 8);
+    file->write(buffer, size);
+    file->drop();
+    btAlignedFree(buffer);
+}   // saveBvh
+
 // -----------------------------------------------------------------------------
 /** Interpolates the normal at the given position for the triangle with
  *  a given index. The position must be inside of the given triangle.
@@ -19,6 +19,7 @@
 #ifndef HEADER_TRIANGLE_MESH_HPP
 #define HEADER_TRIANGLE_MESH_HPP
 
+#include <string>
 #include <vector>
 #include "btBulletDynamicsCommon.h"
 
@@ -57,6 +58,15 @@ private:
      *  to the current transform of the body. */
     bool m_can_be_transformed;
 
+    /** If the BVH of the collision shape was loaded from the cache, the
+     *  memory it was loaded into (the BVH object is at its start). */
+    void                        *m_cached_bvh;
+
+    uint64_t        getBvhHash() const;
+    std::string     getBvhCacheFile(uint64_t hash) const;
+    btOptimizedBvh *loadBvh(uint64_t hash);
+    void            saveBvh(uint64_t hash, const btOptimizedBvh *bvh) const;
+
 public:
     class RigidBodyTriangleMesh : public btRigidBody
     {
@@ -76,11 +86,12 @@ public:
                      const btVector3 &t3, const btVector3 &n1,
                      const btVector3 &n2, const btVector3 &n3,
                      const Material* m);
-    void createCollisionShape(bool create_collision_object=true, const char* serialized_bhv=NULL);
+    void createCollisionShape(bool create_collision_object=true,
+                              bool use_bvh_cache=false);
     void createPhysicalBody(float friction,
                             btCollisionObject::CollisionFlags flags=
                                (btCollisionObject::CollisionFlags)0,
-                            const char* serializedBhv = NULL);
+                            bool use_bvh_cache=false);
     void removeAll();
     void removeCollisionObject();
     btVector3 getInterpolatedNormal(unsigned int index,
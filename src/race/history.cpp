@@ -18,13 +18,17 @@
 
 #include "race/history.hpp"
 
+#include <algorithm>
 #include <stdio.h>
+#include <string.h>
 
+#include "config/stk_config.hpp"
 #include "io/file_manager.hpp"
 #include "modes/world.hpp"
 #include "karts/abstract_kart.hpp"
 #include "karts/controller/controller.hpp"
 #include "network/network_config.hpp"
+#include "network/network_string.hpp"
 #include "network/rewind_manager.hpp"
 #include "physics/physics.hpp"
 #include "race/race_manager.hpp"
@@ -33,12 +37,24 @@
 
 History* history = 0;
 bool History::m_online_history_replay = false;
+
+namespace
+{
+    /** The first 4 bytes of a binary history file. A text history starts
+     *  with 'STK-version:'. */
+    const char* BINARY_HISTORY_MAGIC = "STKH";
+    /** Version of the binary format, text histories are version 1. */
+    const unsigned int BINARY_HISTORY_VERSION = 2;
+}   // namespace
 //-----------------------------------------------------------------------------
 /** Initialises the history object and sets the mode to none.
  */
 History::History()
 {
-    m_replay_history = false;
+    m_replay_history       = false;
+    m_event_index          = 0;
+    m_ticks_per_seek_point = 0;
+    m_last_replay_ticks    = 0;
 }   // History
 
 //-----------------------------------------------------------------------------
@@ -50,6 +66,7 @@ void History::initRecording()
     allocateMemory();
     m_event_index = 0;
     m_all_input_events.clear();
+    m_seek_points.clear();
 }   // initRecording
 
 //-----------------------------------------------------------------------------
@@ -95,6 +112,12 @@ void History::updateReplay(int world_ticks)
 {
     World *world = World::getWorld();
 
+    // If the world time went back (e.g. the race was restarted), continue
+    // with the events at that time
+    if (world_ticks < m_last_replay_ticks)
+        seekReplay(world_ticks);
+    m_last_replay_ticks = world_ticks;
+
     while (m_event_index < m_all_input_events.size() &&
         m_all_input_events[m_event_index].m_world_ticks <= world_ticks)
     {
@@ -125,19 +148,67 @@ void History::updateReplay(int world_ticks)
 
 }   // updateReplay
 
+//-----------------------------------------------------------------------------
+/** Continues the replay with the first event at or after the given time.
+ *  The seek points are used so that only the events of one second need to
+ *  be searched, even for very long histories.
+ *  \param world_ticks World time in ticks.
+ */
+void History::seekReplay(int world_ticks)
+{
+    m_event_index = 0;
+    if (m_ticks_per_seek_point > 0 && world_ticks > 0)
+    {
+        unsigned int n = world_ticks / m_ticks_per_seek_point;
+        if (n >= m_seek_points.size())
+        {
+            m_event_index = (unsigned int)m_all_input_events.size();
+            m_last_replay_ticks = world_ticks;
+            return;
+        }
+        m_event_index = m_seek_points[n];
+    }
+    while (m_event_index < m_all_input_events.size() &&
+           m_all_input_events[m_event_index].m_world_ticks < world_ticks)
+        m_event_index++;
+    m_last_replay_ticks = world_ticks;
+}   // seekReplay
+
+//-----------------------------------------------------------------------------
+/** Computes the index of the first event of each second. The events are
+ *  sorted by time, since they are recorded in order.
+ */
+void History::computeSeekPoints()
+{
+    m_ticks_per_seek_point = stk_config->time2Ticks(1.0f);
+    m_seek_points.clear();
+    if (m_all_input_events.empty())
+        return;
+    const int last_ticks = m_all_input_events.back().m_world_ticks;
+    m_seek_points.reserve(last_ticks / m_ticks_per_seek_point + 1);
+    unsigned int index = 0;
+    for (int ticks = 0; ticks <= last_ticks; ticks += m_ticks_per_seek_point)
+    {
+        while (index < m_all_input_events.size() &&
+               m_all_input_events[index].m_world_ticks < ticks)
+            index++;
+        m_seek_points.push_back(index);
+    }
+}   // computeSeekPoints
+
 //-----------------------------------------------------------------------------
 /** Saves the history stored in the internal data structures into a file called
  *  history.dat.
  */
 void History::Save()
 {
-    FILE *fd = fopen("history.dat","w");
+    FILE *fd = fopen("history.dat","wb");
     if(fd)
         Log::info("History", "Saved in ./history.dat.");
     else
     {
         std::string fn = file_manager->getUserConfigFile("history.dat");
-        fd = fopen(fn.c_str(), "w");
+        fd = fopen(fn.c_str(), "wb");
         if(fd)
             Log::info("History", "Saved in '%s'.", fn.c_str());
     }
@@ -151,58 +222,163 @@ void History::Save()
 
     World *world   = World::getWorld();
     const int num_karts = world->getNumKarts();
-    fprintf(fd, "STK-version:      %s\n",   STK_VERSION);
-    fprintf(fd, "History-version:  %d\n",   1);
-    fprintf(fd, "numkarts:         %d\n",   num_karts);
-    fprintf(fd, "numplayers:       %d\n", race_manager->getNumPlayers());
-    fprintf(fd, "difficulty:       %d\n", race_manager->getDifficulty());
-    fprintf(fd, "reverse: %c\n", race_manager->getReverseTrack() ? 'y' : 'n');
-
-    fprintf(fd, "track: %s\n", Track::getCurrentTrack()->getIdent().c_str());
-
     assert(num_karts > 0);
 
-    int k;
-    for(k=0; k<num_karts; k++)
-    {
-        fprintf(fd, "model %d: %s\n",k, world->getKart(k)->getIdent().c_str());
-    }
-    fprintf(fd, "count:     %zu\n", m_all_input_events.size());
+    // Each event takes 10 bytes: ticks, kart index, action and value.
+    BareNetworkString data(256 + (int)m_all_input_events.size() * 10);
+    data.addUInt32(BINARY_HISTORY_VERSION)
+        .encodeString(std::string(STK_VERSION))
+        .addUInt8(num_karts)
+        .addUInt8(race_manager->getNumPlayers())
+        .addUInt8(race_manager->getDifficulty())
+        .addUInt8(race_manager->getReverseTrack() ? 1 : 0)
+        .encodeString(Track::getCurrentTrack()->getIdent());
+    for (int k = 0; k < num_karts; k++)
+        data.encodeString(world->getKart(k)->getIdent());
+
+    computeSeekPoints();
+    data.addUInt32(m_ticks_per_seek_point)
+        .addUInt32((uint32_t)m_seek_points.size())
+        .addUInt32((uint32_t)m_all_input_events.size());
+    for (unsigned int i = 0; i < m_seek_points.size(); i++)
+        data.addUInt32(m_seek_points[i]);
 
     for (unsigned int i = 0; i < m_all_input_events.size(); i++)
     {
-        fprintf(fd, "%d %d %d %d\n",
-                m_all_input_events[i].m_world_ticks,
-                m_all_input_events[i].m_kart_index,
-                m_all_input_events[i].m_action,
-                m_all_input_events[i].m_value      );
+        const InputEvent &ie = m_all_input_events[i];
+        data.addUInt32(ie.m_world_ticks).addUInt8(ie.m_kart_index)
+            .addUInt8(ie.m_action).addUInt32(ie.m_value);
     }   // for i
 
-    fprintf(fd, "History file end.\n");
+    if (fwrite(BINARY_HISTORY_MAGIC, 4, 1, fd) != 1 ||
+        fwrite(data.getData(), data.getTotalSize(), 1, fd) != 1)
+        Log::error("History", "Could not write history.dat.");
     fclose(fd);
 }   // Save
 
 //-----------------------------------------------------------------------------
-/** Loads a history from history.dat in the current directory.
+/** Loads a history from history.dat in the current directory. Binary and
+ *  (older) text history files are supported.
  */
 void History::Load()
 {
-    char s[1024], s1[1024];
-    int  n;
-
-    FILE *fd = fopen("history.dat","r");
+    FILE *fd = fopen("history.dat","rb");
     if(fd)
         Log::info("History", "Reading ./history.dat");
     else
     {
         std::string fn = file_manager->getUserConfigFile("history.dat");
-        fd = fopen(fn.c_str(), "r");
+        fd = fopen(fn.c_str(), "rb");
         if(fd)
             Log::info("History", "Reading '%s'.", fn.c_str());
     }
     if(!fd)
         Log::fatal("History", "Could not open history.dat");
 
+    char magic[4];
+    if (fread(magic, 4, 1, fd) == 1 &&
+        memcmp(magic, BINARY_HISTORY_MAGIC, 4) == 0)
+    {
+        loadBinary(fd);
+    }
+    else
+    {
+        rewind(fd);
+        loadText(fd);
+        computeSeekPoints();
+    }
+    m_event_index       = 0;
+    m_last_replay_ticks = 0;
+    fclose(fd);
+}   // Load
+
+//-----------------------------------------------------------------------------
+/** Loads a binary history file. The magic at the start of the file was
+ *  already read.
+ *  \param fd The history file.
+ */
+void History::loadBinary(FILE *fd)
+{
+    const long start = ftell(fd);
+    fseek(fd, 0, SEEK_END);
+    const long size = ftell(fd) - start;
+    fseek(fd, start, SEEK_SET);
+
+    BareNetworkString data;
+    data.getBuffer().resize(size);
+    if (size <= 0 || fread(data.getData(), size, 1, fd) != 1)
+        Log::fatal("History", "Could not read history.dat.");
+
+    try
+    {
+        unsigned int version = data.getUInt32();
+        if (version != BINARY_HISTORY_VERSION)
+        {
+            Log::fatal("History", "History version %d is not supported.",
+                       version);
+        }
+        std::string s;
+        data.decodeString(&s);
+        if (s != STK_VERSION)
+        {
+            Log::warn("History", "History is version '%s', STK version is "
+                      "'%s'.", s.c_str(), STK_VERSION);
+        }
+
+        const unsigned int num_karts = data.getUInt8();
+        race_manager->setNumKarts(num_karts);
+        race_manager->setNumPlayers(data.getUInt8());
+        race_manager->setDifficulty((RaceManager::Difficulty)data.getUInt8());
+        race_manager->setReverseTrack(data.getUInt8() != 0);
+        data.decodeString(&s);
+        race_manager->setTrack(s);
+        // This value doesn't really matter, but should be defined, otherwise
+        // the racing phase can switch to 'ending'
+        race_manager->setNumLaps(100);
+
+        for (unsigned int i = 0; i < num_karts; i++)
+        {
+            data.decodeString(&s);
+            m_kart_ident.push_back(s);
+            if (i < race_manager->getNumPlayers() && !m_online_history_replay)
+                race_manager->setPlayerKart(i, s);
+        }   // for i<nKarts
+
+        m_ticks_per_seek_point = data.getUInt32();
+        const unsigned int num_seek_points = data.getUInt32();
+        const unsigned int count = data.getUInt32();
+        if (num_seek_points * 4 + count * 10 != data.size())
+            Log::fatal("History", "Invalid size of history.dat.");
+
+        m_seek_points.resize(num_seek_points);
+        for (unsigned int i = 0; i < num_seek_points; i++)
+            m_seek_points[i] = std::min(data.getUInt32(), count);
+
+        allocateMemory(count);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            InputEvent &ie = m_all_input_events[i];
+            ie.m_world_ticks = data.getUInt32();
+            ie.m_kart_index  = data.getUInt8();
+            ie.m_action      = (PlayerAction)data.getUInt8();
+            ie.m_value       = (int)data.getUInt32();
+        }   // for i
+    }
+    catch (std::exception &e)
+    {
+        Log::fatal("History", "Could not read history.dat: %s.", e.what());
+    }
+}   // loadBinary
+
+//-----------------------------------------------------------------------------
+/** Loads a text history file, as written by older versions of STK.
+ *  \param fd The history file.
+ */
+void History::loadText(FILE *fd)
+{
+    char s[1024], s1[1024];
+    int  n;
+
     if (fgets(s, 1023, fd) == NULL)
         Log::fatal("History", "Could not read history.dat.");
 
@@ -284,7 +460,6 @@ void History::Load()
         Log::fatal("History", "Number of records not found in history file.");
 
     allocateMemory(count);
-    m_event_index = 0;
 
     // We need to disable the rewind manager here (otherwise setting the
     // KartControl data would access the rewind manager).
@@ -304,7 +479,5 @@ void History::Load()
         ie.m_action = (PlayerAction)action;
     }   // for i
     RewindManager::setEnable(rewind_manager_was_enabled);
-
-    fclose(fd);
-}   // Load
+}   // loadText
 
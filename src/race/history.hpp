@@ -23,6 +23,7 @@
 #include "input/input.hpp"
 #include "karts/controller/kart_control.hpp"
 
+#include <stdio.h>
 #include <string>
 #include <vector>
 
@@ -60,7 +61,22 @@ private:
     /** All input events. */
     std::vector<InputEvent> m_all_input_events;
 
+    /** Index of the first input event at or after each full second (i.e.
+     *  at n * m_ticks_per_seek_point), used to jump to a time in the
+     *  history without searching all events before it. */
+    std::vector<unsigned int> m_seek_points;
+
+    /** Number of ticks between two seek points. */
+    int m_ticks_per_seek_point;
+
+    /** World ticks of the last call to updateReplay, to detect when the
+     *  world time goes back (e.g. a restarted race). */
+    int m_last_replay_ticks;
+
     void  allocateMemory(int size=-1);
+    void  computeSeekPoints();
+    void  loadText(FILE *fd);
+    void  loadBinary(FILE *fd);
 public:
     static bool m_online_history_replay;
           History        ();
@@ -68,6 +84,7 @@ public:
     void  Save           ();
     void  Load           ();
     void  updateReplay(int world_ticks);
+    void  seekReplay(int world_ticks);
     void  addEvent(int kart_id, PlayerAction pa, int value);
 
     // -------------------I-----------------------------------------------------
@@ -18,13 +18,15 @@
 #include "replay/replay_base.hpp"
 
 #include "io/file_manager.hpp"
+#include "network/network_string.hpp"
 
 // -----------------------------------------------------------------------------
 ReplayBase::ReplayBase()
 {
 }   // ReplayBaese
 // -----------------------------------------------------------------------------
-/** Opens a replay file which is determined by sub classes.
+/** Opens a replay file which is determined by sub classes. The file is
+ *  opened in binary mode, text replays can still be read from it.
  *  \param writeable True if the file should be opened for writing.
  *  \param full_path True if the file is full path.
  *  \return A FILE *, or NULL if the file could not be opened.
@@ -33,7 +35,7 @@ FILE* ReplayBase::openReplayFile(bool writeable, bool full_path, int replay_file
 {
     FILE *fd = fopen(full_path ? getReplayFilename(replay_file_number).c_str() :
         (file_manager->getReplayDir() + getReplayFilename(replay_file_number)).c_str(),
-        writeable ? "w" : "r");
+        writeable ? "wb" : "rb");
     if (!fd)
     {
         return NULL;
@@ -41,3 +43,73 @@ FILE* ReplayBase::openReplayFile(bool writeable, bool full_path, int replay_file
     return fd;
 
 }   // openReplayFile
+
+// -----------------------------------------------------------------------------
+/** Appends one event of a kart to a binary replay buffer. All events have
+ *  the same size (BINARY_EVENT_SIZE), so the events of a kart can be read
+ *  with a single read.
+ *  \param buffer The buffer to append the event to.
+ */
+void ReplayBase::encodeEvent(BareNetworkString *buffer,
+                             const TransformEvent &te, const PhysicInfo &pi,
+                             const BonusInfo &bi, const KartReplayEvent &kre)
+{
+    const btVector3 &xyz = te.m_transform.getOrigin();
+    const btQuaternion q = te.m_transform.getRotation();
+    const float f[16] = { te.m_time, xyz.getX(), xyz.getY(), xyz.getZ(),
+                          q.getX(), q.getY(), q.getZ(), q.getW(),
+                          pi.m_speed, pi.m_steer,
+                          pi.m_suspension_length[0],
+                          pi.m_suspension_length[1],
+                          pi.m_suspension_length[2],
+                          pi.m_suspension_length[3],
+                          bi.m_nitro_amount, kre.m_distance };
+    const uint16_t i[7] = { (uint16_t)pi.m_skidding_state,
+                            (uint16_t)bi.m_attachment,
+                            (uint16_t)bi.m_item_amount,
+                            (uint16_t)bi.m_item_type,
+                            (uint16_t)bi.m_special_value,
+                            (uint16_t)kre.m_nitro_usage,
+                            (uint16_t)kre.m_skidding_effect };
+    uint8_t flags = (kre.m_zipper_usage ? 1 : 0) |
+                    (kre.m_red_skidding ? 2 : 0) |
+                    (kre.m_jumping      ? 4 : 0);
+    buffer->addFloats(f, 16).addUInt16s(i, 7).addUInt8(flags);
+}   // encodeEvent
+
+// -----------------------------------------------------------------------------
+/** Reads one event written by encodeEvent. Throws std::out_of_range if the
+ *  buffer does not contain a full event.
+ */
+void ReplayBase::decodeEvent(const BareNetworkString &buffer,
+                             TransformEvent *te, PhysicInfo *pi,
+                             BonusInfo *bi, KartReplayEvent *kre)
+{
+    float f[16];
+    uint16_t i[7];
+    buffer.getFloats(f, 16);
+    buffer.getUInt16s(i, 7);
+    uint8_t flags = buffer.getUInt8();
+
+    te->m_time = f[0];
+    te->m_transform = btTransform(btQuaternion(f[4], f[5], f[6], f[7]),
+                                  btVector3(f[1], f[2], f[3]));
+    pi->m_speed                = f[8];
+    pi->m_steer                = f[9];
+    pi->m_suspension_length[0] = f[10];
+    pi->m_suspension_length[1] = f[11];
+    pi->m_suspension_length[2] = f[12];
+    pi->m_suspension_length[3] = f[13];
+    pi->m_skidding_state       = (int16_t)i[0];
+    bi->m_attachment           = (int16_t)i[1];
+    bi->m_nitro_amount         = f[14];
+    bi->m_item_amount          = (int16_t)i[2];
+    bi->m_item_type            = (int16_t)i[3];
+    bi->m_special_value        = (int16_t)i[4];
+    kre->m_distance            = f[15];
+    kre->m_nitro_usage         = (int16_t)i[5];
+    kre->m_skidding_effect     = (int16_t)i[6];
+    kre->m_zipper_usage        = (flags & 1) != 0;
+    kre->m_red_skidding        = (flags & 2) != 0;
+    kre->m_jumping             = (flags & 4) != 0;
+}   // decodeEvent
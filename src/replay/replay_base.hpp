@@ -26,6 +26,8 @@
 #include <string>
 #include <vector>
 
+class BareNetworkString;
+
 /**
   * \ingroup race
   */
@@ -80,23 +82,38 @@ protected:
 
 
     // ------------------------------------------------------------------------
-    /** Records all other events. */
+    /** Records all other events. The bools are kept together to avoid
+     *  padding, since a ghost kart stores one of these for each frame. */
     struct KartReplayEvent
     {
         /** distance on track for the kart recorded. */
         float  m_distance;
         /** Nitro usage for the kart recorded. */
         int    m_nitro_usage;
-        /** Zipper usage for the kart recorded. */
-        bool   m_zipper_usage;
         /** Skidding effect for the kart recorded. */
         int    m_skidding_effect;
+        /** Zipper usage for the kart recorded. */
+        bool   m_zipper_usage;
         /** Kart skidding showing red flame or not. */
         bool   m_red_skidding;
         /** True if the kart recorded is jumping. */
-        bool        m_jumping;
+        bool   m_jumping;
     };   // KartReplayEvent
 
+    // ------------------------------------------------------------------------
+    /** Size of one event in a binary replay file: 16 floats, 7 16-bit values
+     *  and one byte of flags. */
+    static const unsigned int BINARY_EVENT_SIZE = 16 * 4 + 7 * 2 + 1;
+
+    // ------------------------------------------------------------------------
+    static void encodeEvent(BareNetworkString *buffer,
+                            const TransformEvent &te, const PhysicInfo &pi,
+                            const BonusInfo &bi, const KartReplayEvent &kre);
+    // ------------------------------------------------------------------------
+    static void decodeEvent(const BareNetworkString &buffer,
+                            TransformEvent *te, PhysicInfo *pi,
+                            BonusInfo *bi, KartReplayEvent *kre);
+
     // ------------------------------------------------------------------------
     FILE *openReplayFile(bool writeable, bool full_path = false, int replay_file_number=1);
     // ------------------------------------------------------------------------
@@ -105,7 +122,17 @@ protected:
     // ------------------------------------------------------------------------
     /** Returns the version number of the replay file recorderd by this executable.
      *  This is also used as a maximum supported version by this exexcutable. */
-    unsigned int getCurrentReplayVersion() const { return 4; }
+    unsigned int getCurrentReplayVersion() const { return 5; }
+
+    // ------------------------------------------------------------------------
+    /** Replays starting with this version are stored in the binary format,
+     *  older versions are text files. */
+    unsigned int getFirstBinaryReplayVersion() const { return 5; }
+
+    // ------------------------------------------------------------------------
+    /** The first 4 bytes of a binary replay file. A text replay starts with
+     *  'version:', so both formats can be told apart. */
+    static const char* getBinaryReplayMagic() { return "STKR"; }
 
     // ------------------------------------------------------------------------
     /** This is used to check that a loaded replay file can still
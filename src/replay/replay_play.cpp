@@ -23,12 +23,16 @@
 #include "karts/ghost_kart.hpp"
 #include "karts/controller/ghost_controller.hpp"
 #include "modes/world.hpp"
+#include "network/network_string.hpp"
 #include "race/race_manager.hpp"
 #include "tracks/track.hpp"
 #include "tracks/track_manager.hpp"
+#include "utils/benchmark.hpp"
 
 #include <irrlicht.h>
+#include <cmath>
 #include <stdio.h>
+#include <string.h>
 #include <string>
 #include <cinttypes>
 
@@ -104,38 +108,103 @@ void ReplayPlay::loadAllReplayFile()
 //-----------------------------------------------------------------------------
 bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int call_index)
 {
-
-    char s[1024], s1[1024];
     if (StringUtils::getExtension(fn) != "replay") return false;
-    FILE *fd = fopen(custom_replay ? fn.c_str() :
-        (file_manager->getReplayDir() + fn).c_str(), "r");
-    if (fd == NULL) return false;
     ReplayData rd;
 
     // custom_replay is true when full path of filename is given
     rd.m_custom_replay_file = custom_replay;
     rd.m_filename = fn;
 
+    if (!readHeader(custom_replay ? fn : file_manager->getReplayDir() + fn,
+                    &rd, call_index))
+        return false;
+
+    Track* t = track_manager->getTrack(rd.m_track_name);
+    if (t == NULL)
+    {
+        Log::warn("Replay", "Track '%s' used in replay '%s' not found in STK!",
+        rd.m_track_name.c_str(), fn.c_str());
+        return false;
+    }
+
+    rd.m_track = t;
+    m_replay_file_list.push_back(rd);
+
+    assert(m_replay_file_list.size() > 0);
+    // Force to use custom replay file immediately
+    if (custom_replay)
+        m_current_replay_file = (unsigned int)m_replay_file_list.size() - 1;
+
+    return true;
+
+}   // addReplayFile
+
+//-----------------------------------------------------------------------------
+/** Reads the information needed to list a replay from a binary or text
+ *  replay file, without reading the events of the karts.
+ *  \param path Full path of the replay file.
+ *  \param rd The replay data to fill, m_filename must be set.
+ *  \param call_index Used as UID for version 3 replays, which have none.
+ *  \return False if the file could not be read.
+ */
+bool ReplayPlay::readHeader(const std::string& path, ReplayData *rd,
+                            int call_index)
+{
+    FILE *fd = fopen(path.c_str(), "rb");
+    if (fd == NULL) return false;
+
+    // Binary replays start with a magic, otherwise a text replay is
+    // imported. The text replay is read in text mode, so that windows
+    // line endings are handled.
+    char magic[4];
+    bool success;
+    if (fread(magic, 4, 1, fd) == 1 &&
+        memcmp(magic, getBinaryReplayMagic(), 4) == 0)
+    {
+        success = readBinaryHeader(fd, rd->m_filename, rd);
+    }
+    else
+    {
+        fclose(fd);
+        fd = fopen(path.c_str(), "r");
+        if (fd == NULL) return false;
+        success = readTextHeader(fd, rd->m_filename, rd, call_index);
+    }
+    fclose(fd);
+    return success;
+}   // readHeader
+
+//-----------------------------------------------------------------------------
+/** Reads the header of a text replay file (version 3 and 4), which contains
+ *  the information needed to list a replay.
+ *  \param fd The opened replay file.
+ *  \param fn Name of the replay file, used in warnings.
+ *  \param rd The replay data to fill.
+ *  \param call_index Used as UID for version 3 replays, which have none.
+ *  \return False if the header could not be read.
+ */
+bool ReplayPlay::readTextHeader(FILE *fd, const std::string& fn,
+                                ReplayData *rd, int call_index)
+{
+    char s[1024], s1[1024];
     fgets(s, 1023, fd);
     unsigned int version;
     if (sscanf(s,"version: %u", &version) != 1)
     {
         Log::warn("Replay", "No Version information "
                   "found in replay file (bogus replay file).");
-        fclose(fd);
         return false;
     }
-    if (version > getCurrentReplayVersion() ||
+    if (version >= getFirstBinaryReplayVersion() ||
         version < getMinSupportedReplayVersion() )
     {
         Log::warn("Replay", "Replay is version '%d'", version);
         Log::warn("Replay", "STK replay version is '%d'", getCurrentReplayVersion());
         Log::warn("Replay", "Minimum supported replay version is '%d'", getMinSupportedReplayVersion());
         Log::warn("Replay", "Skipped '%s'", fn.c_str());
-        fclose(fd);
         return false;
     }
-        rd.m_replay_version = version;
+    rd->m_replay_version = version;
 
     if (version >= 4)
     {
@@ -143,13 +212,12 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
         if(sscanf(s, "stk_version: %s", s1) != 1)
         {
             Log::warn("Replay", "No STK release version found in replay file, '%s'.", fn.c_str());
-            fclose(fd);
             return false;
         }
-        rd.m_stk_version = s1;
+        rd->m_stk_version = s1;
     }
     else
-        rd.m_stk_version = "";
+        rd->m_stk_version = "";
 
     while(true)
     {
@@ -167,21 +235,21 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
             break;
         }
 
-        rd.m_kart_list.push_back(std::string(s1));
+        rd->m_kart_list.push_back(std::string(s1));
         if (scanned == 2)
         {
             // If username of kart is present, use it
-            rd.m_name_list.push_back(StringUtils::xmlDecode(std::string(display_name_encoded)));
-            if (rd.m_name_list.size() == 1)
+            rd->m_name_list.push_back(StringUtils::xmlDecode(std::string(display_name_encoded)));
+            if (rd->m_name_list.size() == 1)
             {
                 // First user is the game master and the "owner" of this replay file
-                rd.m_user_name = rd.m_name_list[0];
+                rd->m_user_name = rd->m_name_list[0];
             }
         } else
         { // scanned == 1
             // If username is not present, kart display name will default to kart name
             // (see GhostController::getName)
-            rd.m_name_list.push_back("");
+            rd->m_name_list.push_back("");
         }
 
         // Read kart color data
@@ -192,13 +260,12 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
             if(sscanf(s, "kart_color: %f", &f) != 1)
             {
                 Log::warn("Replay", "Kart color missing in replay file, '%s'.", fn.c_str());
-                fclose(fd);
                 return false;
             }
-            rd.m_kart_color.push_back(f);
+            rd->m_kart_color.push_back(f);
         }
         else
-            rd.m_kart_color.push_back(0.0f); // Use default kart color
+            rd->m_kart_color.push_back(0.0f); // Use default kart color
     }
 
     int reverse = 0;
@@ -206,16 +273,14 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
     if(sscanf(s, "reverse: %d", &reverse) != 1)
     {
         Log::warn("Replay", "No reverse info found in replay file, '%s'.", fn.c_str());
-        fclose(fd);
         return false;
     }
-    rd.m_reverse = reverse != 0;
+    rd->m_reverse = reverse != 0;
 
     fgets(s, 1023, fd);
-    if (sscanf(s, "difficulty: %u", &rd.m_difficulty) != 1)
+    if (sscanf(s, "difficulty: %u", &rd->m_difficulty) != 1)
     {
         Log::warn("Replay", " No difficulty found in replay file, '%s'.", fn.c_str());
-        fclose(fd);
         return false;
     }
 
@@ -225,76 +290,141 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
         if (sscanf(s, "mode: %s", s1) != 1)
         {
             Log::warn("Replay", "Replay mode not found in replay file, '%s'.", fn.c_str());
-            fclose(fd);
             return false;
         }
-        rd.m_minor_mode = s1;
+        rd->m_minor_mode = s1;
     }
     // Assume time-trial mode for old replays
     else
-        rd.m_minor_mode = "time-trial";
+        rd->m_minor_mode = "time-trial";
 
 
     fgets(s, 1023, fd);
     if (sscanf(s, "track: %s", s1) != 1)
     {
         Log::warn("Replay", "Track info not found in replay file, '%s'.", fn.c_str());
-        fclose(fd);
-        return false;
-    }
-    rd.m_track_name = std::string(s1);
-    Track* t = track_manager->getTrack(rd.m_track_name);
-    if (t == NULL)
-    {
-        Log::warn("Replay", "Track '%s' used in replay '%s' not found in STK!",
-        rd.m_track_name.c_str(), fn.c_str());
-        fclose(fd);
         return false;
     }
-
-    rd.m_track = t;
+    rd->m_track_name = std::string(s1);
 
     fgets(s, 1023, fd);
-    if (sscanf(s, "laps: %u", &rd.m_laps) != 1)
+    if (sscanf(s, "laps: %u", &rd->m_laps) != 1)
     {
         Log::warn("Replay", "No number of laps found in replay file, '%s'.", fn.c_str());
-        fclose(fd);
         return false;
     }
 
     fgets(s, 1023, fd);
-    if (sscanf(s, "min_time: %f", &rd.m_min_time) != 1)
+    if (sscanf(s, "min_time: %f", &rd->m_min_time) != 1)
     {
         Log::warn("Replay", "Finish time not found in replay file, '%s'.", fn.c_str());
-        fclose(fd);
         return false;
     }
 
     if (version >= 4)
     {
         fgets(s, 1023, fd);
-        if (sscanf(s, "replay_uid: %" PRIu64, &rd.m_replay_uid) != 1)
+        if (sscanf(s, "replay_uid: %" PRIu64, &rd->m_replay_uid) != 1)
         {
             Log::warn("Replay", "Replay UID not found in replay file, '%s'.", fn.c_str());
-            fclose(fd);
             return false;
         }
     }
     // No UID in old replay format
     else
-        rd.m_replay_uid = call_index;
+        rd->m_replay_uid = call_index;
 
-    fclose(fd);
-    m_replay_file_list.push_back(rd);
+    return true;
+}   // readTextHeader
 
-    assert(m_replay_file_list.size() > 0);
-    // Force to use custom replay file immediately
-    if (custom_replay)
-        m_current_replay_file = (unsigned int)m_replay_file_list.size() - 1;
+//-----------------------------------------------------------------------------
+/** Reads the header of a binary replay file. The magic at the start of the
+ *  file was already read. Only the header is read, the events of the karts
+ *  are read by loadFile.
+ *  \param fd The opened replay file.
+ *  \param fn Name of the replay file, used in warnings.
+ *  \param rd The replay data to fill.
+ *  \return False if the header could not be read.
+ */
+bool ReplayPlay::readBinaryHeader(FILE *fd, const std::string& fn,
+                                  ReplayData *rd)
+{
+    BareNetworkString prefix;
+    prefix.getBuffer().resize(8);
+    if (fread(prefix.getData(), 8, 1, fd) != 1)
+    {
+        Log::warn("Replay", "No Version information "
+                  "found in replay file (bogus replay file).");
+        return false;
+    }
+    unsigned int version = prefix.getUInt32();
+    if (version > getCurrentReplayVersion() ||
+        version < getFirstBinaryReplayVersion())
+    {
+        Log::warn("Replay", "Replay is version '%d'", version);
+        Log::warn("Replay", "STK replay version is '%d'", getCurrentReplayVersion());
+        Log::warn("Replay", "Skipped '%s'", fn.c_str());
+        return false;
+    }
+    rd->m_replay_version = version;
 
-    return true;
+    // A header is less than 100 bytes plus the kart names, so a huge
+    // size can only be found in a broken file
+    const uint32_t header_size = prefix.getUInt32();
+    BareNetworkString header;
+    if (header_size > 65536)
+    {
+        Log::warn("Replay", "Invalid header size in replay file, '%s'.",
+                  fn.c_str());
+        return false;
+    }
+    header.getBuffer().resize(header_size);
+    if (header_size == 0 || fread(header.getData(), header_size, 1, fd) != 1)
+    {
+        Log::warn("Replay", "Header missing in replay file, '%s'.",
+                  fn.c_str());
+        return false;
+    }
 
-}   // addReplayFile
+    try
+    {
+        std::string str;
+        header.decodeString(&str);
+        rd->m_stk_version = str.c_str();
+
+        const unsigned int num_karts = header.getUInt8();
+        for (unsigned int i = 0; i < num_karts; i++)
+        {
+            core::stringw name;
+            header.decodeString(&str);
+            header.decodeStringW(&name);
+            rd->m_kart_list.push_back(str);
+            rd->m_name_list.push_back(name);
+            rd->m_kart_color.push_back(header.getFloat());
+        }
+        // First user is the game master and the "owner" of this replay file
+        if (num_karts > 0)
+            rd->m_user_name = rd->m_name_list[0];
+
+        rd->m_reverse    = header.getUInt8() != 0;
+        rd->m_difficulty = header.getUInt8();
+        header.decodeString(&rd->m_minor_mode);
+        header.decodeString(&rd->m_track_name);
+        rd->m_laps       = header.getUInt32();
+        rd->m_min_time   = header.getFloat();
+        rd->m_replay_uid = header.getUInt64();
+        for (unsigned int i = 0; i < num_karts; i++)
+            rd->m_num_events.push_back(header.getUInt32());
+    }
+    catch (std::exception& e)
+    {
+        Log::warn("Replay", "Invalid header in replay file, '%s': %s.",
+                  fn.c_str(), e.what());
+        return false;
+    }
+    rd->m_events_offset = 12 + header_size;
+    return true;
+}   // readBinaryHeader
 
 //-----------------------------------------------------------------------------
 void ReplayPlay::load()
@@ -332,6 +462,17 @@ void ReplayPlay::loadFile(bool second_replay)
                     getReplayFilename(replay_file_number).c_str());
 
     ReplayData &rd = m_replay_file_list[replay_index];
+    if (rd.m_replay_version >= getFirstBinaryReplayVersion())
+    {
+        if (fseek(fd, rd.m_events_offset, SEEK_SET) == 0)
+        {
+            for (unsigned int i = 0; i < rd.m_num_events.size(); i++)
+                readBinaryKartData(fd, rd.m_num_events[i], second_replay);
+        }
+        fclose(fd);
+        return;
+    }
+
     unsigned int num_kart = (unsigned int)m_replay_file_list.at(replay_index)
                                                             .m_kart_list.size();
     unsigned int lines_to_skip = (rd.m_replay_version == 3) ? 7 : 10;
@@ -353,13 +494,13 @@ void ReplayPlay::loadFile(bool second_replay)
 }   // loadFile
 
 //-----------------------------------------------------------------------------
-/** Reads all data from a replay file for a specific kart.
- *  \param fd The file descriptor from which to read.
+/** Creates the ghost kart and its controller for the next kart of a
+ *  replay file.
+ *  \param second_replay True if the kart is from the second replay file.
+ *  \return The index of the new ghost kart.
  */
-void ReplayPlay::readKartData(FILE *fd, char *next_line, bool second_replay)
+unsigned int ReplayPlay::createGhostKart(bool second_replay)
 {
-    char s[1024];
-
     int replay_index = second_replay ? m_second_replay_file
                                      : m_current_replay_file;
 
@@ -378,6 +519,57 @@ void ReplayPlay::readKartData(FILE *fd, char *next_line, bool second_replay)
     Controller* controller = new GhostController(getGhostKart(kart_num).get(),
                                                  rd.m_name_list[kart_num-first_loaded_f_num]);
     getGhostKart(kart_num)->setController(controller);
+    return kart_num;
+}   // createGhostKart
+
+//-----------------------------------------------------------------------------
+/** Reads all events of a kart from a binary replay file. All events of a
+ *  kart are stored together, so they are read with a single read and then
+ *  decoded.
+ *  \param fd The file descriptor from which to read.
+ *  \param num_events Number of events stored for this kart.
+ *  \param second_replay True if the kart is from the second replay file.
+ */
+void ReplayPlay::readBinaryKartData(FILE *fd, unsigned int num_events,
+                                    bool second_replay)
+{
+    const unsigned int kart_num = createGhostKart(second_replay);
+
+    BareNetworkString events;
+    events.getBuffer().resize(num_events * BINARY_EVENT_SIZE);
+    if (num_events > 0 &&
+        fread(events.getData(), events.getTotalSize(), 1, fd) != 1)
+    {
+        Log::warn("Replay", "Replay data of kart %d is incomplete, ignored.",
+                  kart_num);
+        return;
+    }
+
+    m_ghost_karts[kart_num]->reserveReplayEvents(num_events);
+    for (unsigned int i = 0; i < num_events; i++)
+    {
+        TransformEvent te;
+        PhysicInfo pi;
+        BonusInfo bi;
+        KartReplayEvent kre;
+        decodeEvent(events, &te, &pi, &bi, &kre);
+        m_ghost_karts[kart_num]->addReplayEvent(te.m_time, te.m_transform,
+                                                pi, bi, kre);
+    }
+}   // readBinaryKartData
+
+//-----------------------------------------------------------------------------
+/** Reads all data from a text replay file for a specific kart.
+ *  \param fd The file descriptor from which to read.
+ */
+void ReplayPlay::readKartData(FILE *fd, char *next_line, bool second_replay)
+{
+    char s[1024];
+
+    int replay_index = second_replay ? m_second_replay_file
+                                     : m_current_replay_file;
+    ReplayData &rd = m_replay_file_list[replay_index];
+    const unsigned int kart_num = createGhostKart(second_replay);
 
     unsigned int size;
     if(sscanf(next_line,"size: %u",&size)!=1)
@@ -387,113 +579,94 @@ void ReplayPlay::readKartData(FILE *fd, char *next_line, bool second_replay)
     for(unsigned int i=0; i<size; i++)
     {
         fgets(s, 1023, fd);
-        float x, y, z, rx, ry, rz, rw, time, speed, steer, w1, w2, w3, w4, nitro_amount, distance;
-        int skidding_state, attachment, item_amount, item_type, special_value,
-            nitro, zipper, skidding, red_skidding, jumping;
-
-        // Check for EV_TRANSFORM event:
-        // -----------------------------
-
-        // Up to STK 0.9.3 replays
-        if (rd.m_replay_version == 3)
+        TransformEvent te;
+        PhysicInfo pi;
+        BonusInfo bi;
+        KartReplayEvent kre;
+        if (parseTextEvent(s, rd.m_replay_version, &te, &pi, &bi, &kre))
         {
-            if(sscanf(s, "%f  %f %f %f  %f %f %f %f  %f  %f  %f %f %f %f  %d %d %d %d %d\n",
-                &time,
-                &x, &y, &z,
-                &rx, &ry, &rz, &rw,
-                &speed, &steer, &w1, &w2, &w3, &w4,
-                &nitro, &zipper, &skidding, &red_skidding, &jumping
-                )==19)
-            {
-                btQuaternion q(rx, ry, rz, rw);
-                btVector3 xyz(x, y, z);
-                PhysicInfo pi             = {0};
-                BonusInfo bi              = {0};
-                KartReplayEvent kre       = {0};
-
-                pi.m_speed                = speed;
-                pi.m_steer                = steer;
-                pi.m_suspension_length[0] = w1;
-                pi.m_suspension_length[1] = w2;
-                pi.m_suspension_length[2] = w3;
-                pi.m_suspension_length[3] = w4;
-                pi.m_skidding_state       = 0;    //not saved in version 3 replays
-                bi.m_attachment           = 0;    //not saved in version 3 replays
-                bi.m_nitro_amount         = 0;    //not saved in version 3 replays
-                bi.m_item_amount          = 0;    //not saved in version 3 replays
-                bi.m_item_type            = 0;    //not saved in version 3 replays
-                bi.m_special_value        = 0;    //not saved in version 3 replays
-                kre.m_distance            = 0.0f; //not saved in version 3 replays
-                kre.m_nitro_usage         = nitro;
-                kre.m_zipper_usage        = zipper!=0;
-                kre.m_skidding_effect     = skidding;
-                kre.m_red_skidding        = red_skidding!=0;
-                kre.m_jumping             = jumping != 0;
-                m_ghost_karts[kart_num]->addReplayEvent(time,
-                    btTransform(q, xyz), pi, bi, kre);
-            }
-            else
-            {
-                // Invalid record found
-                // ---------------------
-                Log::warn("Replay", "Can't read replay data line %d:", i);
-                Log::warn("Replay", "%s", s);
-                Log::warn("Replay", "Ignored.");
-            }
+            m_ghost_karts[kart_num]->addReplayEvent(te.m_time,
+                te.m_transform, pi, bi, kre);
         }
-
-        //version 4 replays (STK 0.9.4 and higher)
         else
         {
-            if(sscanf(s, "%f  %f %f %f  %f %f %f %f  %f  %f  %f %f %f %f %d  %d %f %d %d %d  %f %d %d %d %d %d\n",
-                &time,
-                &x, &y, &z,
-                &rx, &ry, &rz, &rw,
-                &speed, &steer, &w1, &w2, &w3, &w4, &skidding_state,
-                &attachment, &nitro_amount, &item_amount, &item_type, &special_value,
-                &distance, &nitro, &zipper, &skidding, &red_skidding, &jumping
-                )==26)
-            {
-                btQuaternion q(rx, ry, rz, rw);
-                btVector3 xyz(x, y, z);
-                PhysicInfo pi             = {0};
-                BonusInfo bi              = {0};
-                KartReplayEvent kre       = {0};
-
-                pi.m_speed                = speed;
-                pi.m_steer                = steer;
-                pi.m_suspension_length[0] = w1;
-                pi.m_suspension_length[1] = w2;
-                pi.m_suspension_length[2] = w3;
-                pi.m_suspension_length[3] = w4;
-                pi.m_skidding_state       = skidding_state;
-                bi.m_attachment           = attachment;
-                bi.m_nitro_amount         = nitro_amount;
-                bi.m_item_amount          = item_amount;
-                bi.m_item_type            = item_type;
-                bi.m_special_value        = special_value;
-                kre.m_distance            = distance;
-                kre.m_nitro_usage         = nitro;
-                kre.m_zipper_usage        = zipper!=0;
-                kre.m_skidding_effect     = skidding;
-                kre.m_red_skidding        = red_skidding!=0;
-                kre.m_jumping             = jumping != 0;
-                m_ghost_karts[kart_num]->addReplayEvent(time,
-                    btTransform(q, xyz), pi, bi, kre);
-            }
-            else
-            {
-                // Invalid record found
-                // ---------------------
-                Log::warn("Replay", "Can't read replay data line %d:", i);
-                Log::warn("Replay", "%s", s);
-                Log::warn("Replay", "Ignored.");
-            }
+            // Invalid record found
+            // ---------------------
+            Log::warn("Replay", "Can't read replay data line %d:", i);
+            Log::warn("Replay", "%s", s);
+            Log::warn("Replay", "Ignored.");
         }
     }   // for i
 
 }   // readKartData
 
+//-----------------------------------------------------------------------------
+/** Parses one event line of a text replay file.
+ *  \param s The line to parse.
+ *  \param version Version of the replay file.
+ *  \return False if the line could not be parsed.
+ */
+bool ReplayPlay::parseTextEvent(const char *s, unsigned int version,
+                                TransformEvent *te, PhysicInfo *pi,
+                                BonusInfo *bi, KartReplayEvent *kre)
+{
+    float x, y, z, rx, ry, rz, rw, time, speed, steer, w1, w2, w3, w4,
+          nitro_amount = 0.0f, distance = 0.0f;
+    int skidding_state = 0, attachment = 0, item_amount = 0, item_type = 0,
+        special_value = 0, nitro, zipper, skidding, red_skidding, jumping;
+
+    // Up to STK 0.9.3 replays
+    if (version == 3)
+    {
+        if(sscanf(s, "%f  %f %f %f  %f %f %f %f  %f  %f  %f %f %f %f  %d %d %d %d %d\n",
+            &time,
+            &x, &y, &z,
+            &rx, &ry, &rz, &rw,
+            &speed, &steer, &w1, &w2, &w3, &w4,
+            &nitro, &zipper, &skidding, &red_skidding, &jumping
+            )!=19)
+            return false;
+        // Skidding state, bonus info and distance are not saved in
+        // version 3 replays
+    }
+    //version 4 replays (STK 0.9.4 and higher)
+    else
+    {
+        if(sscanf(s, "%f  %f %f %f  %f %f %f %f  %f  %f  %f %f %f %f %d  %d %f %d %d %d  %f %d %d %d %d %d\n",
+            &time,
+            &x, &y, &z,
+            &rx, &ry, &rz, &rw,
+            &speed, &steer, &w1, &w2, &w3, &w4, &skidding_state,
+            &attachment, &nitro_amount, &item_amount, &item_type, &special_value,
+            &distance, &nitro, &zipper, &skidding, &red_skidding, &jumping
+            )!=26)
+            return false;
+    }
+
+    te->m_time                 = time;
+    te->m_transform            = btTransform(btQuaternion(rx, ry, rz, rw),
+                                             btVector3(x, y, z));
+    pi->m_speed                = speed;
+    pi->m_steer                = steer;
+    pi->m_suspension_length[0] = w1;
+    pi->m_suspension_length[1] = w2;
+    pi->m_suspension_length[2] = w3;
+    pi->m_suspension_length[3] = w4;
+    pi->m_skidding_state       = skidding_state;
+    bi->m_attachment           = attachment;
+    bi->m_nitro_amount         = nitro_amount;
+    bi->m_item_amount          = item_amount;
+    bi->m_item_type            = item_type;
+    bi->m_special_value        = special_value;
+    kre->m_distance            = distance;
+    kre->m_nitro_usage         = nitro;
+    kre->m_zipper_usage        = zipper!=0;
+    kre->m_skidding_effect     = skidding;
+    kre->m_red_skidding        = red_skidding!=0;
+    kre->m_jumping             = jumping != 0;
+    return true;
+}   // parseTextEvent
+
 //-----------------------------------------------------------------------------
 /** call getReplayIdByUID and set the current replay file to the first one
  *  with a matching UID.
@@ -521,3 +694,211 @@ unsigned int ReplayPlay::getReplayIdByUID(uint64_t uid)
     Log::error("Replay", "Replay with UID of " PRIu64 " not found.", uid);
     return 0;
 } //setReplayFileByUID
+
+//-----------------------------------------------------------------------------
+/** Compares the text and the binary replay format: the time to read the
+ *  headers of a few hundred replays (as done to list the replays), and the
+ *  file size, decoding time and memory of a 10 minute ghost. The files are
+ *  written to a temporary directory in the replay directory. Called with
+ *  --micro-benchmark=replay.
+ */
+void ReplayPlay::benchmark()
+{
+    ReplayPlay replay;
+    const std::string dir = file_manager->getReplayDir() + "benchmark/";
+    file_manager->checkAndCreateDirectory(dir);
+
+    // 10 events per second are recorded with the default replay delta-t
+    const unsigned int num_events = 6000;
+    std::vector<TransformEvent>  te(num_events);
+    std::vector<PhysicInfo>      pi(num_events);
+    std::vector<BonusInfo>       bi(num_events);
+    std::vector<KartReplayEvent> kre(num_events);
+    for (unsigned int i = 0; i < num_events; i++)
+    {
+        const float angle = 0.01f * i;
+        te[i].m_time = 0.1f * i;
+        te[i].m_transform = btTransform(btQuaternion(btVector3(0, 1, 0), angle),
+            btVector3(100.0f * sinf(angle), 0.5f, 100.0f * cosf(angle)));
+        pi[i].m_speed          = 20.0f + (i % 7);
+        pi[i].m_steer          = 0.1f * (i % 5);
+        for (unsigned int j = 0; j < 4; j++)
+            pi[i].m_suspension_length[j] = 0.1f + 0.01f * j;
+        pi[i].m_skidding_state = i % 3;
+        bi[i].m_attachment     = i % 6;
+        bi[i].m_nitro_amount   = 0.5f * (i % 20);
+        bi[i].m_item_amount    = i % 4;
+        bi[i].m_item_type      = i % 10;
+        bi[i].m_special_value  = 0;
+        kre[i].m_distance        = 2.0f * i;
+        kre[i].m_nitro_usage     = i % 2;
+        kre[i].m_skidding_effect = i % 4;
+        kre[i].m_zipper_usage    = i % 11 == 0;
+        kre[i].m_red_skidding    = i % 13 == 0;
+        kre[i].m_jumping         = i % 17 == 0;
+    }
+
+    // Writes a replay of one kart in the text format (version 4)
+    auto write_text = [&](const std::string &name, unsigned int n,
+                          uint64_t uid)
+    {
+        FILE *fd = fopen((dir + name).c_str(), "w");
+        fprintf(fd, "version: 4\nstk_version: %s\n", STK_VERSION);
+        fprintf(fd, "kart: tux Benchmark\nkart_color: 0\nkart_list_end\n");
+        fprintf(fd, "reverse: 0\ndifficulty: 2\nmode: time-trial\n");
+        fprintf(fd, "track: lighthouse\nlaps: 3\nmin_time: %f\n",
+                te[n - 1].m_time);
+        fprintf(fd, "replay_uid: %" PRIu64 "\nsize:     %d\n", uid, n);
+        for (unsigned int i = 0; i < n; i++)
+        {
+            const btVector3 &xyz = te[i].m_transform.getOrigin();
+            const btQuaternion q = te[i].m_transform.getRotation();
+            fprintf(fd, "%f  %f %f %f  %f %f %f %f  %f  %f  %f %f %f %f %d  %d %f %d %d %d  %f %d %d %d %d %d\n",
+                    te[i].m_time, xyz.getX(), xyz.getY(), xyz.getZ(),
+                    q.getX(), q.getY(), q.getZ(), q.getW(),
+                    pi[i].m_speed, pi[i].m_steer,
+                    pi[i].m_suspension_length[0],
+                    pi[i].m_suspension_length[1],
+                    pi[i].m_suspension_length[2],
+                    pi[i].m_suspension_length[3], pi[i].m_skidding_state,
+                    bi[i].m_attachment, bi[i].m_nitro_amount,
+                    bi[i].m_item_amount, bi[i].m_item_type,
+                    bi[i].m_special_value, kre[i].m_distance,
+                    kre[i].m_nitro_usage, (int)kre[i].m_zipper_usage,
+                    kre[i].m_skidding_effect, (int)kre[i].m_red_skidding,
+                    (int)kre[i].m_jumping);
+        }
+        fclose(fd);
+    };   // write_text
+
+    // Writes the same replay in the binary format, like ReplayRecorder::save
+    auto write_binary = [&](const std::string &name, unsigned int n,
+                            uint64_t uid)
+    {
+        BareNetworkString header;
+        header.encodeString(std::string(STK_VERSION)).addUInt8(1)
+              .encodeString(std::string("tux"))
+              .encodeString(std::string("Benchmark")).addFloat(0.0f)
+              .addUInt8(0).addUInt8(2)
+              .encodeString(std::string("time-trial"))
+              .encodeString(std::string("lighthouse"))
+              .addUInt32(3).addFloat(te[n - 1].m_time).addUInt64(uid)
+              .addUInt32(n);
+        BareNetworkString events(8 + header.getTotalSize() +
+                                 n * BINARY_EVENT_SIZE);
+        events.addUInt32(replay.getCurrentReplayVersion())
+              .addUInt32(header.getTotalSize());
+        events += header;
+        for (unsigned int i = 0; i < n; i++)
+            encodeEvent(&events, te[i], pi[i], bi[i], kre[i]);
+        FILE *fd = fopen((dir + name).c_str(), "wb");
+        fwrite(getBinaryReplayMagic(), 4, 1, fd);
+        fwrite(events.getData(), events.getTotalSize(), 1, fd);
+        fclose(fd);
+    };   // write_binary
+
+    // Reading the headers of a few hundred one minute replays
+    const unsigned int num_replays = 300;
+    bool same = true;
+    Benchmark::Timer read_header[2];
+    for (unsigned int binary = 0; binary < 2; binary++)
+    {
+        for (unsigned int i = 0; i < num_replays; i++)
+        {
+            const std::string name = StringUtils::toString(i) + ".replay";
+            if (binary)
+                write_binary(name, 600, i);
+            else
+                write_text(name, 600, i);
+        }
+        read_header[binary].start();
+        for (unsigned int i = 0; i < num_replays; i++)
+        {
+            ReplayData rd;
+            rd.m_filename = StringUtils::toString(i) + ".replay";
+            same = same && replay.readHeader(dir + rd.m_filename, &rd, 0) &&
+                rd.m_replay_uid == i && rd.m_track_name == "lighthouse" &&
+                rd.m_kart_list.size() == 1 && rd.m_name_list[0] == "Benchmark";
+        }
+        read_header[binary].stop();
+    }
+    Log::info("ReplayPlay", "Reading the headers of %u replays: text %f ms, "
+        "binary %f ms, %s.", num_replays, read_header[0].getTotal(),
+        read_header[1].getTotal(),
+        same ? "same result" : "DIFFERENT RESULT");
+
+    // A 10 minute ghost: size of the file, and time to decode all events
+    write_text("text.replay", num_events, 0);
+    write_binary("binary.replay", num_events, 0);
+    ReplayData text_rd, binary_rd;
+    replay.readHeader(dir + "text.replay", &text_rd, 0);
+    replay.readHeader(dir + "binary.replay", &binary_rd, 0);
+    const int count = 10;
+    TransformEvent t;
+    PhysicInfo p;
+    BonusInfo b;
+    KartReplayEvent k;
+
+    Benchmark::Timer decode[2];
+    long size[2];
+    decode[0].start();
+    for (int n = 0; n < count; n++)
+    {
+        char s[1024];
+        FILE *fd = fopen((dir + "text.replay").c_str(), "r");
+        // Skip the header and the size line of the kart
+        for (unsigned int i = 0; i < 13; i++)
+            fgets(s, 1023, fd);
+        for (unsigned int i = 0; i < num_events; i++)
+        {
+            fgets(s, 1023, fd);
+            same = parseTextEvent(s, text_rd.m_replay_version,
+                                  &t, &p, &b, &k) && same;
+        }
+        size[0] = ftell(fd);
+        fclose(fd);
+    }
+    decode[0].stop();
+    same = same && fabsf(t.m_time - te.back().m_time) < 0.001f &&
+           fabsf(k.m_distance - kre.back().m_distance) < 0.001f;
+
+    decode[1].start();
+    for (int n = 0; n < count; n++)
+    {
+        FILE *fd = fopen((dir + "binary.replay").c_str(), "rb");
+        fseek(fd, binary_rd.m_events_offset, SEEK_SET);
+        BareNetworkString events;
+        events.getBuffer().resize(binary_rd.m_num_events[0] *
+                                  BINARY_EVENT_SIZE);
+        same = fread(events.getData(), events.getTotalSize(), 1, fd) == 1 &&
+               same;
+        for (unsigned int i = 0; i < binary_rd.m_num_events[0]; i++)
+        {
+            decodeEvent(events, &t, &p, &b, &k);
+            same = same && t.m_time == te[i].m_time &&
+                   t.m_transform.getOrigin() == te[i].m_transform.getOrigin() &&
+                   p.m_speed == pi[i].m_speed &&
+                   b.m_item_type == bi[i].m_item_type &&
+                   k.m_jumping == kre[i].m_jumping;
+        }
+        size[1] = ftell(fd);
+        fclose(fd);
+    }
+    decode[1].stop();
+
+    // Memory used by a ghost kart for these events, see GhostKart and
+    // GhostController
+    const size_t ghost_memory = num_events * (sizeof(btVector3) +
+        sizeof(btQuaternion) + sizeof(PhysicInfo) + sizeof(BonusInfo) +
+        sizeof(KartReplayEvent) + sizeof(float));
+
+    Log::info("ReplayPlay", "10 minute ghost with %u events: text %ld bytes, "
+        "binary %ld bytes, %s.", num_events, size[0], size[1],
+        same ? "same result" : "DIFFERENT RESULT");
+    Log::info("ReplayPlay", "Decoding %d times: text %f ms, binary %f ms.",
+        count, decode[0].getTotal(), decode[1].getTotal());
+    Log::info("ReplayPlay", "Ghost kart memory: %u bytes (%u per event).",
+        (unsigned int)ghost_memory, (unsigned int)(ghost_memory / num_events));
+
+    file_manager->removeDirectory(dir);
+}   // benchmark
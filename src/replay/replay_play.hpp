@@ -72,6 +72,10 @@ public:
         unsigned int               m_replay_version; //no sorting for this
         uint64_t                   m_replay_uid; //no sorting for this
         float                      m_min_time;
+        /** Binary replays only: number of events of each kart, and the
+         *  position of the events in the file. */
+        std::vector<unsigned int>  m_num_events; //no sorting for this
+        long                       m_events_offset; //no sorting for this
 
         bool operator < (const ReplayData& r) const
         {
@@ -124,12 +128,23 @@ private:
 
           ReplayPlay();
          ~ReplayPlay();
+    bool  readHeader(const std::string& path, ReplayData *rd, int call_index);
+    bool  readTextHeader(FILE *fd, const std::string& fn, ReplayData *rd,
+                         int call_index);
+    bool  readBinaryHeader(FILE *fd, const std::string& fn, ReplayData *rd);
+    unsigned int createGhostKart(bool second_replay);
     void  readKartData(FILE *fd, char *next_line, bool second_replay);
+    void  readBinaryKartData(FILE *fd, unsigned int num_events,
+                             bool second_replay);
+    static bool parseTextEvent(const char *s, unsigned int version,
+                               TransformEvent *te, PhysicInfo *pi,
+                               BonusInfo *bi, KartReplayEvent *kre);
 public:
     void  reset();
     void  load();
     void  loadFile(bool second_replay);
     void  loadAllReplayFile();
+    static void benchmark();
     // ------------------------------------------------------------------------
     static void        setSortOrder(SortOrder so)       { m_sort_order = so; }
     // ------------------------------------------------------------------------
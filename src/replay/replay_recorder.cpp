@@ -31,6 +31,7 @@
 #include "modes/easter_egg_hunt.hpp"
 #include "modes/linear_world.hpp"
 #include "modes/world.hpp"
+#include "network/network_string.hpp"
 #include "physics/btKart.hpp"
 #include "race/race_manager.hpp"
 #include "tracks/track.hpp"
@@ -38,7 +39,6 @@
 #include <algorithm>
 #include <stdio.h>
 #include <string>
-#include <cinttypes>
 
 ReplayRecorder *ReplayRecorder::m_replay_recorder = NULL;
 
@@ -395,26 +395,36 @@ void ReplayRecorder::save()
         (file_manager->getReplayDir() + getReplayFilename()).c_str());
     MessageQueue::add(MessageQueue::MT_GENERIC, msg);
 
-    fprintf(fd, "version: %d\n", getCurrentReplayVersion());
-    fprintf(fd, "stk_version: %s\n", STK_VERSION);
+    // The header contains everything needed to list the replay, followed
+    // by the number of events of each kart. The events of each kart are
+    // stored one after the other, so they can be read with one read each.
+    BareNetworkString header(512);
+    header.encodeString(std::string(STK_VERSION));
 
     unsigned int player_count = 0;
+    std::vector<unsigned int> num_events;
+    for (unsigned int k = 0; k < num_karts; k++)
+    {
+        if (world->getKart(k)->isGhostKart()) continue;
+        num_events.push_back(std::min(m_max_frames, m_count_transforms[k]));
+    }
+    header.addUInt8((uint8_t)num_events.size());
     for (unsigned int real_karts = 0; real_karts < num_karts; real_karts++)
     {
         const AbstractKart *kart = world->getKart(real_karts);
         if (kart->isGhostKart()) continue;
 
-        // XML encode the username to handle Unicode
-        fprintf(fd, "kart: %s %s\n", kart->getIdent().c_str(),
-                StringUtils::xmlEncode(kart->getController()->getName()).c_str());
+        header.encodeString(kart->getIdent())
+              .encodeString(kart->getController()->getName());
 
         if (kart->getController()->isPlayerController())
         {
-            fprintf(fd, "kart_color: %f\n", StateManager::get()->getActivePlayer(player_count)->getConstProfile()->getDefaultKartColor());
+            header.addFloat(StateManager::get()->getActivePlayer(player_count)
+                            ->getConstProfile()->getDefaultKartColor());
             player_count++;
         }
         else
-            fprintf(fd, "kart_color: 0\n");
+            header.addFloat(0.0f);
     }
 
     m_last_uid = computeUID(min_time);
@@ -422,57 +432,42 @@ void ReplayRecorder::save()
     int num_laps = race_manager->getNumLaps();
     if (num_laps == 9999) num_laps = 0; // no lap in that race mode
 
-    fprintf(fd, "kart_list_end\n");
-    fprintf(fd, "reverse: %d\n",    (int)race_manager->getReverseTrack());
-    fprintf(fd, "difficulty: %d\n", race_manager->getDifficulty());
-    fprintf(fd, "mode: %s\n",       race_manager->getMinorModeName().c_str());
-    fprintf(fd, "track: %s\n",      Track::getCurrentTrack()->getIdent().c_str());
-    fprintf(fd, "laps: %d\n",       num_laps);
-    fprintf(fd, "min_time: %f\n",   min_time);
-    fprintf(fd, "replay_uid: %" PRIu64 "\n", m_last_uid);
-
-    for (unsigned int k = 0; k < num_karts; k++)
+    header.addUInt8(race_manager->getReverseTrack() ? 1 : 0)
+          .addUInt8((uint8_t)race_manager->getDifficulty())
+          .encodeString(race_manager->getMinorModeName())
+          .encodeString(Track::getCurrentTrack()->getIdent())
+          .addUInt32(num_laps).addFloat(min_time).addUInt64(m_last_uid);
+    for (unsigned int i = 0; i < num_events.size(); i++)
+        header.addUInt32(num_events[i]);
+
+    BareNetworkString prefix(8);
+    prefix.addUInt32(getCurrentReplayVersion())
+          .addUInt32(header.getTotalSize());
+    bool written =
+        fwrite(getBinaryReplayMagic(), 4, 1, fd) == 1 &&
+        fwrite(prefix.getData(), prefix.getTotalSize(), 1, fd) == 1 &&
+        fwrite(header.getData(), header.getTotalSize(), 1, fd) == 1;
+
+    unsigned int real_kart = 0;
+    for (unsigned int k = 0; k < num_karts && written; k++)
     {
         if (world->getKart(k)->isGhostKart()) continue;
-        fprintf(fd, "size:     %d\n", m_count_transforms[k]);
+        const unsigned int num_transforms = num_events[real_kart++];
+        if (num_transforms == 0) continue;
 
-        unsigned int num_transforms = std::min(m_max_frames,
-                                               m_count_transforms[k]);
+        BareNetworkString events(num_transforms * BINARY_EVENT_SIZE);
         for (unsigned int i = 0; i < num_transforms; i++)
         {
-            const TransformEvent *p  = &(m_transform_events[k][i]);
-            const PhysicInfo *q      = &(m_physic_info[k][i]);
-            const BonusInfo *b      = &(m_bonus_info[k][i]);
-            const KartReplayEvent *r = &(m_kart_replay_event[k][i]);
-            fprintf(fd, "%f  %f %f %f  %f %f %f %f  %f  %f  %f %f %f %f %d  %d %f %d %d %d  %f %d %d %d %d %d\n",
-                    p->m_time,
-                    p->m_transform.getOrigin().getX(),
-                    p->m_transform.getOrigin().getY(),
-                    p->m_transform.getOrigin().getZ(),
-                    p->m_transform.getRotation().getX(),
-                    p->m_transform.getRotation().getY(),
-                    p->m_transform.getRotation().getZ(),
-                    p->m_transform.getRotation().getW(),
-                    q->m_speed,
-                    q->m_steer,
-                    q->m_suspension_length[0],
-                    q->m_suspension_length[1],
-                    q->m_suspension_length[2],
-                    q->m_suspension_length[3],
-                    q->m_skidding_state,
-                    b->m_attachment,
-                    b->m_nitro_amount,
-                    b->m_item_amount,
-                    b->m_item_type,
-                    b->m_special_value,
-                    r->m_distance,
-                    r->m_nitro_usage,
-                    (int)r->m_zipper_usage,
-                    r->m_skidding_effect,
-                    (int)r->m_red_skidding,
-                    (int)r->m_jumping
-                );
+            encodeEvent(&events, m_transform_events[k][i],
+                        m_physic_info[k][i], m_bonus_info[k][i],
+                        m_kart_replay_event[k][i]);
         }   // for i
+        written = fwrite(events.getData(), events.getTotalSize(), 1, fd) == 1;
+    }
+    if (!written)
+    {
+        Log::error("ReplayRecorder", "Can't write replay data to '%s'.",
+            getReplayFilename().c_str());
     }
     fclose(fd);
 }   // save
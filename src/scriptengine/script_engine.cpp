@@ -37,6 +37,7 @@
 #include "states_screens/dialogs/tutorial_message_dialog.hpp"
 #include "tracks/track_object_manager.hpp"
 #include "tracks/track.hpp"
+#include "utils/constants.hpp"
 #include "utils/profiler.hpp"
 
 
@@ -46,6 +47,10 @@ namespace Scripting
 {
     const char* MODULE_ID_MAIN_SCRIPT_FILE = "main";
 
+    /** Version of the bytecode cache files, increase it if the content
+     *  changes. */
+    const uint8_t BYTECODE_CACHE_VERSION = 1;
+
     void AngelScript_ErrorCallback (const asSMessageInfo *msg, void *param)
     {
         const char *type = "ERR ";
@@ -80,6 +85,9 @@ namespace Scripting
     {
         // Release the engine
         m_pending_timeouts.clearAndDeleteAll();
+        for (asIScriptContext* ctx : m_free_contexts)
+            ctx->Release();
+        m_free_contexts.clear();
         m_engine->DiscardModule(MODULE_ID_MAIN_SCRIPT_FILE);
         m_engine->Release();
     }
@@ -119,6 +127,50 @@ namespace Scripting
         return script;
     }
 
+    //-----------------------------------------------------------------------------
+    /** A binary stream in memory, used to save the bytecode of the compiled
+     *  scripts to the cache, and to load it from there.
+     */
+    class ByteCodeStream : public asIBinaryStream
+    {
+    public:
+        std::string m_data;
+        size_t      m_offset;
+
+        ByteCodeStream() : m_offset(0) {}
+#if ANGELSCRIPT_VERSION < 23200
+        virtual void Read(void *ptr, asUINT size) { read(ptr, size); }
+        virtual void Write(const void *ptr, asUINT size)
+        {
+            m_data.append((const char*)ptr, size);
+        }
+#else
+        virtual int Read(void *ptr, asUINT size)
+        {
+            return read(ptr, size) ? 0 : asERROR;
+        }
+        virtual int Write(const void *ptr, asUINT size)
+        {
+            m_data.append((const char*)ptr, size);
+            return 0;
+        }
+#endif
+
+    private:
+        bool read(void *ptr, asUINT size)
+        {
+            if (size > m_data.size() - m_offset)
+            {
+                memset(ptr, 0, size);
+                m_offset = m_data.size();
+                return false;
+            }
+            memcpy(ptr, &m_data[m_offset], size);
+            m_offset += size;
+            return true;
+        }
+    };   // ByteCodeStream
+
     //-----------------------------------------------------------------------------
 
     void ScriptEngine::evalScript(std::string script_fragment)
@@ -297,8 +349,31 @@ namespace Scripting
         std::function<void(asIScriptContext*)> callback,
         std::function<void(asIScriptContext*)> get_return_value)
     {
-        int r; //int for error checking
+        asIScriptFunction *func = getFunction(warn_if_not_found, function_name);
+        if (func != NULL)
+            runFunction(func, callback, get_return_value);
+    }
+
+    //-----------------------------------------------------------------------------
+
+    void ScriptEngine::runFunction(asIScriptFunction* func,
+        std::function<void(asIScriptContext*)> callback)
+    {
+        std::function<void(asIScriptContext*)> get_return_value;
+        runFunction(func, callback, get_return_value);
+    }
 
+    //-----------------------------------------------------------------------------
+    /** Returns the function with the given declaration in the compiled
+    *  scripts, or NULL if there is no such function. The result is cached
+    *  until the scripts are unloaded, so callers which run a function often
+    *  (e.g. on collisions) can keep the returned function instead of building
+    *  its declaration each time.
+    *  \param string function_name = declaration of the function
+    */
+    asIScriptFunction* ScriptEngine::getFunction(bool warn_if_not_found,
+                                                 const std::string& function_name)
+    {
         asIScriptFunction *func;
 
         // TODO: allow splitting in multiple files
@@ -318,7 +393,7 @@ namespace Scripting
                 else
                     Log::debug("Scripting", "Scripting function was not found : %s (module not found)", function_name.c_str());
                 m_functions_cache[function_name] = NULL; // remember that this function is unavailable
-                return;
+                return NULL;
             }
 
             func = module->GetFunctionByDecl(function_name.c_str());
@@ -330,7 +405,7 @@ namespace Scripting
                 else
                     Log::debug("Scripting", "Scripting function was not found : %s", function_name.c_str());
                 m_functions_cache[function_name] = NULL; // remember that this function is unavailable
-                return;
+                return NULL;
             }
 
             m_functions_cache[function_name] = func;
@@ -346,16 +421,37 @@ namespace Scripting
         {
             if (warn_if_not_found)
                 Log::warn("Scripting", "Scripting function was not found : %s", function_name.c_str());
-            return; // function unavailable
         }
+        return func;
+    }   // getFunction
 
-        // Create a context that will execute the script.
-        asIScriptContext *ctx = m_engine->CreateContext();
-        if (ctx == NULL)
+    //-----------------------------------------------------------------------------
+    /** Runs the given script function, see getFunction.
+    */
+    void ScriptEngine::runFunction(asIScriptFunction* func,
+        std::function<void(asIScriptContext*)> callback,
+        std::function<void(asIScriptContext*)> get_return_value)
+    {
+        int r; //int for error checking
+
+        // Create a context that will execute the script, or reuse one. A
+        // script can call a function which runs another script function, so
+        // a context is only reused once the function using it has returned.
+        asIScriptContext *ctx;
+        if (m_free_contexts.empty())
         {
-            Log::error("Scripting", "Failed to create the context.");
-            //m_engine->Release();
-            return;
+            ctx = m_engine->CreateContext();
+            if (ctx == NULL)
+            {
+                Log::error("Scripting", "Failed to create the context.");
+                //m_engine->Release();
+                return;
+            }
+        }
+        else
+        {
+            ctx = m_free_contexts.back();
+            m_free_contexts.pop_back();
         }
 
         // Prepare the script context with the function we wish to execute. Prepare()
@@ -367,7 +463,7 @@ namespace Scripting
         if (r < 0)
         {
             Log::error("Scripting", "Failed to prepare the context.");
-            ctx->Release();
+            m_free_contexts.push_back(ctx);
             //m_engine->Release();
             return;
         }
@@ -415,8 +511,10 @@ namespace Scripting
                 get_return_value(ctx);
         }
 
-        // We must release the contexts when no longer using them
-        ctx->Release();
+        // Keep the context for the next function, it must not keep a
+        // reference to the function
+        ctx->Unprepare();
+        m_free_contexts.push_back(ctx);
     }
 
     //-----------------------------------------------------------------------------
@@ -429,6 +527,7 @@ namespace Scripting
                 curr.second->Release();
         }
         m_functions_cache.clear();
+        m_loaded_scripts.clear();
         m_engine->DiscardModule(MODULE_ID_MAIN_SCRIPT_FILE);
     }
 
@@ -465,8 +564,6 @@ namespace Scripting
 
     bool ScriptEngine::loadScript(std::string script_path, bool clear_previous)
     {
-        int r;
-
         std::string script = getScript(script_path);
         if (script.size() == 0)
         {
@@ -474,20 +571,12 @@ namespace Scripting
             return false;
         }
 
-        // Add the script sections that will be compiled into executable code.
-        // If we want to combine more than one file into the same script, then 
-        // we can call AddScriptSection() several times for the same module and
-        // the script engine will treat them all as if they were one. The script
-        // section name, will allow us to localize any errors in the script code.
-        asIScriptModule *mod = m_engine->GetModule(MODULE_ID_MAIN_SCRIPT_FILE,
-            clear_previous ? asGM_ALWAYS_CREATE : asGM_CREATE_IF_NOT_EXISTS);
-        r = mod->AddScriptSection("script", &script[0], script.size());
-        if (r < 0)
-        {
-            Log::error("Scripting", "AddScriptSection() failed");
-            return false;
-        }
-    
+        // The scripts are only added to the module by compileLoadedScripts,
+        // so that they do not need to be compiled if they are in the
+        // bytecode cache.
+        if (clear_previous)
+            m_loaded_scripts.clear();
+        m_loaded_scripts.push_back(script);
         return true;
     }
 
@@ -496,7 +585,32 @@ namespace Scripting
     bool ScriptEngine::compileLoadedScripts()
     {
         int r;
-        asIScriptModule *mod = m_engine->GetModule(MODULE_ID_MAIN_SCRIPT_FILE, asGM_CREATE_IF_NOT_EXISTS);
+        asIScriptModule *mod = m_engine->GetModule(MODULE_ID_MAIN_SCRIPT_FILE, asGM_ALWAYS_CREATE);
+
+        // Tracks without scripts have nothing to compile, so no cache is used
+        const uint64_t hash = m_loaded_scripts.empty() ? 0 : getScriptsHash();
+        if (hash != 0 && loadByteCode(mod, hash))
+        {
+            m_loaded_scripts.clear();
+            return true;
+        }
+
+        // Add the script sections that will be compiled into executable code.
+        // If we want to combine more than one file into the same script, then 
+        // we can call AddScriptSection() several times for the same module and
+        // the script engine will treat them all as if they were one. The script
+        // section name, will allow us to localize any errors in the script code.
+        for (const std::string& script : m_loaded_scripts)
+        {
+            r = mod->AddScriptSection("script", &script[0], script.size());
+            if (r < 0)
+            {
+                Log::error("Scripting", "AddScriptSection() failed");
+                m_loaded_scripts.clear();
+                return false;
+            }
+        }
+        m_loaded_scripts.clear();
 
         // Compile the script. If there are any compiler messages they will
         // be written to the message stream that we set right after creating the 
@@ -508,6 +622,8 @@ namespace Scripting
             Log::error("Scripting", "Build() failed");
             return false;
         }
+        if (hash != 0)
+            saveByteCode(mod, hash);
 
         // The engine doesn't keep a copy of the script sections after Build() has
         // returned. So if the script needs to be recompiled, then all the script
@@ -522,6 +638,121 @@ namespace Scripting
         return true;
     }
 
+    //-----------------------------------------------------------------------------
+    /** Returns a hash of all loaded scripts, used as key of the bytecode
+    *  cache. The versions of STK and AngelScript are included, since the
+    *  bytecode refers to the functions registered by STK.
+    */
+    uint64_t ScriptEngine::getScriptsHash() const
+    {
+        // 64 bit FNV-1a
+        uint64_t hash = 14695981039346656037ULL;
+        auto add = [&hash](const void *data, size_t size)
+        {
+            const uint8_t *p = (const uint8_t*)data;
+            for (size_t i = 0; i < size; i++)
+            {
+                hash ^= p[i];
+                hash *= 1099511628211ULL;
+            }
+        };
+        const uint32_t sizes[2] = { (uint32_t)sizeof(void*),
+                                    (uint32_t)ANGELSCRIPT_VERSION };
+        add(sizes, sizeof(sizes));
+        add(STK_VERSION, strlen(STK_VERSION));
+        for (const std::string& script : m_loaded_scripts)
+        {
+            const uint32_t size = (uint32_t)script.size();
+            add(&size, sizeof(size));
+            add(script.data(), script.size());
+        }
+        return hash == 0 ? 1 : hash;
+    }   // getScriptsHash
+
+    //-----------------------------------------------------------------------------
+    /** Returns the file in which the bytecode of the scripts is cached.
+    *  \param hash Hash of the loaded scripts.
+    */
+    std::string ScriptEngine::getByteCodeCacheFile(uint64_t hash) const
+    {
+        std::string dir = file_manager->getCachedDataDir() + "scripts/";
+        file_manager->checkAndCreateDirectoryP(dir);
+        char name[32];
+        sprintf(name, "%016llx.stkbc", (unsigned long long)hash);
+        return dir + name;
+    }   // getByteCodeCacheFile
+
+    //-----------------------------------------------------------------------------
+    /** Loads the cached bytecode of the loaded scripts into the module, and
+    *  returns false if it is not cached (or can not be loaded). The file
+    *  contains the cache version and the hash, followed by the bytecode.
+    *  \param hash Hash of the loaded scripts.
+    */
+    bool ScriptEngine::loadByteCode(asIScriptModule* mod, uint64_t hash)
+    {
+        const std::string path = getByteCodeCacheFile(hash);
+        if (!file_manager->fileExists(path))
+            return false;
+
+        ByteCodeStream stream;
+        stream.m_data = getScript(path);
+        uint64_t file_hash = 0;
+        if (stream.m_data.size() > 9)
+            memcpy(&file_hash, &stream.m_data[1], 8);
+        if (stream.m_data.size() <= 9 ||
+            stream.m_data[0] != (char)BYTECODE_CACHE_VERSION ||
+            file_hash != hash)
+        {
+            Log::warn("Scripting", "Invalid bytecode cache '%s' ignored.",
+                path.c_str());
+            return false;
+        }
+        stream.m_offset = 9;
+        if (mod->LoadByteCode(&stream) < 0)
+        {
+            Log::warn("Scripting", "Failed to load bytecode cache '%s'.",
+                path.c_str());
+            return false;
+        }
+        // Keeps recently used files when the cache directory is limited
+        file_manager->touchFile(path);
+        return true;
+    }   // loadByteCode
+
+    //-----------------------------------------------------------------------------
+    /** Saves the bytecode of the compiled scripts to the cache, including
+    *  debug information so that errors still show line numbers.
+    *  \param hash Hash of the loaded scripts.
+    */
+    void ScriptEngine::saveByteCode(asIScriptModule* mod, uint64_t hash)
+    {
+        ByteCodeStream stream;
+        stream.m_data.push_back((char)BYTECODE_CACHE_VERSION);
+        stream.m_data.append((const char*)&hash, 8);
+        if (mod->SaveByteCode(&stream) < 0)
+        {
+            Log::warn("Scripting", "Failed to save the bytecode.");
+            return;
+        }
+
+        const std::string path = getByteCodeCacheFile(hash);
+        FILE *f = fopen(path.c_str(), "wb");
+        if (f == NULL)
+        {
+            Log::warn("Scripting", "Can not write bytecode cache '%s'.",
+                path.c_str());
+            return;
+        }
+        size_t c = fwrite(stream.m_data.data(), stream.m_data.size(), 1, f);
+        fclose(f);
+        if (c != 1)
+        {
+            Log::warn("Scripting", "Can not write bytecode cache '%s'.",
+                path.c_str());
+            file_manager->removeFile(path);
+        }
+    }   // saveByteCode
+
     //-----------------------------------------------------------------------------
 
     PendingTimeout::PendingTimeout(double time, asIScriptFunction* callback_delegate) 
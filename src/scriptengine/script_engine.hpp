@@ -23,11 +23,13 @@
 #include "utils/no_copy.hpp"
 #include "utils/ptr_vector.hpp"
 #include "utils/singleton.hpp"
+#include "utils/types.hpp"
 
 #include <angelscript.h>
 #include <functional>
 #include <map>
 #include <string>
+#include <vector>
 
 class TrackObjectPresentation;
 
@@ -73,6 +75,13 @@ namespace Scripting
         void runFunction(bool warn_if_not_found, std::string function_name,
             std::function<void(asIScriptContext*)> callback,
             std::function<void(asIScriptContext*)> get_return_value);
+        void runFunction(asIScriptFunction* func,
+            std::function<void(asIScriptContext*)> callback);
+        void runFunction(asIScriptFunction* func,
+            std::function<void(asIScriptContext*)> callback,
+            std::function<void(asIScriptContext*)> get_return_value);
+        asIScriptFunction* getFunction(bool warn_if_not_found,
+                                       const std::string& function_name);
         void runDelegate(asIScriptFunction* delegate_fn);
         void evalScript(std::string script_fragment);
         void cleanupCache();
@@ -91,7 +100,19 @@ namespace Scripting
         std::map<std::string, asIScriptFunction*> m_functions_cache;
         PtrVector<PendingTimeout> m_pending_timeouts;
 
+        /** The scripts added by loadScript, they are only compiled (or
+         *  loaded from the bytecode cache) by compileLoadedScripts. */
+        std::vector<std::string> m_loaded_scripts;
+
+        /** Contexts which are not in use, so that calling a function does
+         *  not need to create a new context each time. */
+        std::vector<asIScriptContext*> m_free_contexts;
+
         void configureEngine(asIScriptEngine *engine);
+        uint64_t getScriptsHash() const;
+        std::string getByteCodeCacheFile(uint64_t hash) const;
+        bool loadByteCode(asIScriptModule* mod, uint64_t hash);
+        void saveByteCode(asIScriptModule* mod, uint64_t hash);
     };   // class ScriptEngine
 
 }
@@ -26,19 +26,38 @@
 #include "tracks/track.hpp"
 #include "tracks/track_manager.hpp"
 #include "utils/log.hpp"
+#include "utils/time.hpp"
+
+#include <IReadFile.h>
+#include <IWriteFile.h>
 
 #include <algorithm>
+#include <atomic>
 #include <queue>
+#include <thread>
 
 // -----------------------------------------------------------------------------
-ArenaGraph::ArenaGraph(const std::string &navmesh, const XMLNode *node)
+/** Creates the arena graph. The navmesh is read by readNavmesh() before,
+ *  since this can be called by a worker thread, and irrlicht's file system
+ *  is not thread-safe.
+ *  \param navmesh The navmesh file, NULL if it can't be read.
+ *  \param hash Hash of the navmesh file, 0 if the cache can't be used.
+ *  \param node The scene node of the track to load the goal nodes from.
+ */
+ArenaGraph::ArenaGraph(const XMLNode *navmesh, uint64_t hash,
+                       const XMLNode *node)
           : Graph()
 {
     loadNavmesh(navmesh);
     buildGraph();
-    // Compute shortest distance from all nodes
-    for (unsigned int i = 0; i < getNumNodes(); i++)
-        computeDijkstra(i);
+    createSectorGrid();
+    // Compute shortest distance from all nodes, unless they were cached
+    // for the same navmesh before
+    if (!loadShortestPaths(hash))
+    {
+        computeAllDijkstra();
+        saveShortestPaths(hash);
+    }
 
     setNearbyNodesOfAllNodes();
     if (node && race_manager->getMinorMode() == RaceManager::MINOR_MODE_SOCCER)
@@ -86,13 +105,31 @@ void ArenaGraph::differentNodeColor(int n, video::SColor* c) const
 }   // differentNodeColor
 
 // -----------------------------------------------------------------------------
-void ArenaGraph::loadNavmesh(const std::string &navmesh)
+/** Reads the navmesh file and computes its hash for the shortest path cache.
+ *  This uses irrlicht's file system, so it must be called by the main thread.
+ *  \param navmesh Name of the navmesh file.
+ *  \param hash On return the hash of the navmesh file, 0 if the cache can't
+ *         be used.
+ *  \return The navmesh file, NULL if it can't be read.
+ */
+XMLNode* ArenaGraph::readNavmesh(const std::string &navmesh, uint64_t *hash)
 {
-    XMLNode *xml = file_manager->createXMLTree(navmesh);
-    if (xml->getName() != "navmesh")
+    *hash = getNavmeshHash(navmesh);
+    if (*hash != 0 &&
+        !file_manager->checkAndCreateDirectoryP(file_manager
+                                             ->getCachedDataDir()+"navmesh/"))
+    {
+        *hash = 0;
+    }
+    return file_manager->createXMLTree(navmesh);
+}   // readNavmesh
+
+// -----------------------------------------------------------------------------
+void ArenaGraph::loadNavmesh(const XMLNode *xml)
+{
+    if (!xml || xml->getName() != "navmesh")
     {
         Log::error("ArenaGraph", "NavMesh is invalid.");
-        delete xml;
         return;
     }
 
@@ -109,7 +146,8 @@ void ArenaGraph::loadNavmesh(const std::string &navmesh)
                 {
                     Log::error("ArenaGraph", "Unsupported type '%s' found"
                         "in '%s' - ignored.",
-                        xml_node_node->getName().c_str(), navmesh.c_str());
+                        xml_node_node->getName().c_str(),
+                        xml->getFileName().c_str());
                     continue;
                 }
 
@@ -132,7 +170,8 @@ void ArenaGraph::loadNavmesh(const std::string &navmesh)
                 {
                     Log::error("ArenaGraph", "Unsupported type '%s'"
                         " found in '%s' - ignored.",
-                        xml_node_node->getName().c_str(), navmesh.c_str());
+                        xml_node_node->getName().c_str(),
+                        xml->getFileName().c_str());
                     continue;
                 }
 
@@ -170,7 +209,6 @@ void ArenaGraph::loadNavmesh(const std::string &navmesh)
             m_all_nodes[i]->setHeightTesting(min, max);
         }
     }
-    delete xml;
 
 }   // loadNavmesh
 
@@ -178,9 +216,10 @@ void ArenaGraph::loadNavmesh(const std::string &navmesh)
 void ArenaGraph::buildGraph()
 {
     const unsigned int n_nodes = getNumNodes();
+    if (n_nodes >= NO_PARENT)
+        Log::fatal("ArenaGraph", "Too many nodes (%d) in navmesh.", n_nodes);
 
-    m_distance_matrix = std::vector<std::vector<float>>
-        (n_nodes, std::vector<float>(n_nodes, 9999.9f));
+    m_distance_matrix.assign(n_nodes * n_nodes, 9999.9f);
     for (unsigned int i = 0; i < n_nodes; i++)
     {
         ArenaNode* cur_node = getNode(i);
@@ -188,22 +227,19 @@ void ArenaGraph::buildGraph()
         {
             Vec3 diff = getNode(adjacent)->getCenter() - cur_node->getCenter();
             float distance = diff.length();
-            m_distance_matrix[i][adjacent] = distance;
+            m_distance_matrix[i * n_nodes + adjacent] = distance;
         }
-        m_distance_matrix[i][i] = 0.0f;
+        m_distance_matrix[i * n_nodes + i] = 0.0f;
     }
 
     // Allocate and initialise the previous node data structure:
-    m_parent_node = std::vector<std::vector<int16_t>>
-        (n_nodes, std::vector<int16_t>(n_nodes, Graph::UNKNOWN_SECTOR));
+    m_parent_node.assign(n_nodes * n_nodes, (uint16_t)NO_PARENT);
     for (unsigned int i = 0; i < n_nodes; i++)
     {
         for (unsigned int j = 0; j < n_nodes; j++)
         {
-            if (i == j || m_distance_matrix[i][j] >= 9899.9f)
-                m_parent_node[i][j] = -1;
-            else
-                m_parent_node[i][j] = i;
+            if (i != j && m_distance_matrix[i * n_nodes + j] < 9899.9f)
+                m_parent_node[i * n_nodes + j] = (uint16_t)i;
         }   // for j
     }   // for i
 
@@ -212,10 +248,12 @@ void ArenaGraph::buildGraph()
 // ----------------------------------------------------------------------------
 /** Dijkstra shortest path computation. It computes the shortest distance from
  *  the specified node 'source' to all other nodes. At the end of the
- *  computation, m_distance_matrix[i][j] stores the shortest path distance from
- *  source to j and m_parent_node[source][j] stores the last vertex visited on
- *  the shortest path from i to j before visiting j. Suppose the shortest path
- *  from i to j is i->......->k->j  then m_parent_node[i][j] = k
+ *  computation, m_distance_matrix[source*n+j] stores the shortest path
+ *  distance from source to j and m_parent_node[source*n+j] stores the last
+ *  vertex visited on the shortest path from source to j before visiting j.
+ *  Suppose the shortest path from i to j is i->......->k->j  then
+ *  m_parent_node[i*n+j] = k. Only the values of source are modified, so
+ *  this can be called for different sources in parallel.
  */
 void ArenaGraph::computeDijkstra(int source)
 {
@@ -235,6 +273,8 @@ void ArenaGraph::computeDijkstra(int source)
     IndDistPair begin(source, 0.0f);
     queue.push(begin);
     const unsigned int n = getNumNodes();
+    float* distance = &m_distance_matrix[source * n];
+    uint16_t* parent = &m_parent_node[source * n];
     std::vector<bool> visited;
     visited.resize(n, false);
     while (!queue.empty())
@@ -246,17 +286,20 @@ void ArenaGraph::computeDijkstra(int source)
         if (visited[cur_index]) continue;
         visited[cur_index] = true;
 
-        for (const int& adjacent : getNode(cur_index)->getAdjacentNodes())
+        ArenaNode* cur_node = getNode(cur_index);
+        for (const int& adjacent : cur_node->getAdjacentNodes())
         {
             // Distance already computed, can be ignored
             if (visited[adjacent]) continue;
 
-            float new_dist =
-                current.second + m_distance_matrix[cur_index][adjacent];
-            if (new_dist < m_distance_matrix[source][adjacent])
+            // The distances from other nodes might be computed at the same
+            // time, so the length of the edge is computed like in buildGraph
+            Vec3 diff = getNode(adjacent)->getCenter() - cur_node->getCenter();
+            float new_dist = current.second + diff.length();
+            if (new_dist < distance[adjacent])
             {
-                m_distance_matrix[source][adjacent] = new_dist;
-                m_parent_node[source][adjacent] = cur_index;
+                distance[adjacent] = new_dist;
+                parent[adjacent] = (uint16_t)cur_index;
             }
             IndDistPair pair(adjacent, new_dist);
             queue.push(pair);
@@ -264,15 +307,168 @@ void ArenaGraph::computeDijkstra(int source)
     }
 }   // computeDijkstra
 
+// ----------------------------------------------------------------------------
+/** Computes the shortest paths from all nodes, using all available cores.
+ */
+void ArenaGraph::computeAllDijkstra()
+{
+    const unsigned int n = getNumNodes();
+    std::atomic<unsigned int> next_source(0);
+    auto compute = [this, n, &next_source]()
+    {
+        while (true)
+        {
+            const unsigned int source = next_source.fetch_add(1);
+            if (source >= n)
+                return;
+            computeDijkstra(source);
+        }
+    };
+
+    // Small navmeshes are computed faster than starting threads
+    unsigned int num_threads = n < 100 ? 1 : std::thread::hardware_concurrency();
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < num_threads; i++)
+        threads.emplace_back(compute);
+    compute();
+    for (std::thread& t : threads)
+        t.join();
+}   // computeAllDijkstra
+
+// ----------------------------------------------------------------------------
+/** Returns a hash of the content of the navmesh file, which is used to find
+ *  the cached shortest paths of it. Returns 0 if the file can't be read.
+ */
+uint64_t ArenaGraph::getNavmeshHash(const std::string &navmesh)
+{
+    io::IReadFile* file =
+        file_manager->getFileSystem()->createAndOpenFile(navmesh.c_str());
+    if (!file)
+        return 0;
+    std::vector<uint8_t> data(file->getSize());
+    const bool success = data.empty() ||
+        file->read(data.data(), (unsigned)data.size()) == (int)data.size();
+    file->drop();
+    if (!success)
+        return 0;
+
+    // 64 bit FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (uint8_t c : data)
+    {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash == 0 ? 1 : hash;
+}   // getNavmeshHash
+
+// ----------------------------------------------------------------------------
+/** Returns the file in which the shortest paths of a navmesh are cached.
+ *  \param hash Hash of the navmesh file.
+ */
+std::string ArenaGraph::getCacheFile(uint64_t hash)
+{
+    char name[32];
+    sprintf(name, "%016llx.stkag", (unsigned long long)hash);
+    return file_manager->getCachedDataDir() + "navmesh/" + name;
+}   // getCacheFile
+
+// ----------------------------------------------------------------------------
+/** Loads the cached shortest paths for the navmesh, returns true if
+ *  successful. The file contains the cache version, number of nodes and
+ *  navmesh hash, followed by m_distance_matrix and m_parent_node.
+ *  \param hash Hash of the navmesh file, 0 if it can't be used.
+ */
+bool ArenaGraph::loadShortestPaths(uint64_t hash)
+{
+    if (hash == 0)
+        return false;
+    // This does not use irrlicht's file system, which is not thread-safe
+    const std::string path = getCacheFile(hash);
+    io::IReadFile* file = irr::io::createReadFile(path.c_str());
+    if (!file)
+        return false;
+
+    const unsigned int n = getNumNodes();
+    const unsigned int size = n * n;
+    uint8_t version = 0;
+    uint32_t num_nodes = 0;
+    uint64_t file_hash = 0;
+    bool success =
+        file->getSize() == (long)(13 + size * (sizeof(float) +
+                                               sizeof(uint16_t))) &&
+        file->read(&version, 1) == 1 && version == CACHE_VERSION &&
+        file->read(&num_nodes, 4) == 4 && num_nodes == n &&
+        file->read(&file_hash, 8) == 8 && file_hash == hash;
+
+    std::vector<float> distance_matrix(size);
+    std::vector<uint16_t> parent_node(size);
+    if (success)
+    {
+        const int distance_size = int(size * sizeof(float));
+        const int parent_size = int(size * sizeof(uint16_t));
+        success = size == 0 ||
+            (file->read(distance_matrix.data(), distance_size) ==
+                distance_size &&
+             file->read(parent_node.data(), parent_size) == parent_size);
+    }
+    file->drop();
+
+    if (!success)
+    {
+        Log::warn("ArenaGraph", "Invalid navmesh cache '%s' ignored.",
+            path.c_str());
+        return false;
+    }
+    // Keeps recently used files when the cache directory is limited
+    file_manager->touchFile(path);
+    std::swap(m_distance_matrix, distance_matrix);
+    std::swap(m_parent_node, parent_node);
+    return true;
+}   // loadShortestPaths
+
+// ----------------------------------------------------------------------------
+/** Saves the shortest paths, so that they don't need to be computed when
+ *  the navmesh is loaded again.
+ *  \param hash Hash of the navmesh file, 0 if it can't be used.
+ */
+void ArenaGraph::saveShortestPaths(uint64_t hash) const
+{
+    if (hash == 0)
+        return;
+    const std::string path = getCacheFile(hash);
+    io::IWriteFile* file = irr::io::createWriteFile(path.c_str(),
+        false/*append*/);
+    if (!file)
+    {
+        Log::warn("ArenaGraph", "Can't write navmesh cache '%s'.",
+            path.c_str());
+        return;
+    }
+    const uint8_t version = CACHE_VERSION;
+    const uint32_t num_nodes = getNumNodes();
+    file->write(&version, 1);
+    file->write(&num_nodes, 4);
+    file->write(&hash, 8);
+    if (num_nodes > 0)
+    {
+        file->write(m_distance_matrix.data(),
+            (unsigned)(m_distance_matrix.size() * sizeof(float)));
+        file->write(m_parent_node.data(),
+            (unsigned)(m_parent_node.size() * sizeof(uint16_t)));
+    }
+    file->drop();
+}   // saveShortestPaths
+
 // ----------------------------------------------------------------------------
 /** THIS FUNCTION IS ONLY USED FOR UNIT-TESTING, to verify that the new
  *  Dijkstra algorithm gives the same results.
  *  computeFloydWarshall() computes the shortest distance between any two
- *  nodes. At the end of the computation, m_distance_matrix[i][j] stores the
- *  shortest path distance from i to j and m_parent_node[i][j] stores the last
- *  vertex visited on the shortest path from i to j before visiting j. Suppose
- *  the shortest path from i to j is i->......->k->j  then
- *  m_parent_node[i][j] = k
+ *  nodes. At the end of the computation, m_distance_matrix[i*n+j] stores the
+ *  shortest path distance from i to j and m_parent_node[i*n+j] stores the
+ *  last vertex visited on the shortest path from i to j before visiting j.
+ *  Suppose the shortest path from i to j is i->......->k->j  then
+ *  m_parent_node[i*n+j] = k
  */
 void ArenaGraph::computeFloydWarshall()
 {
@@ -284,12 +480,14 @@ void ArenaGraph::computeFloydWarshall()
         {
             for (unsigned int j = 0; j < n; j++)
             {
-                if ((m_distance_matrix[i][k] + m_distance_matrix[k][j]) <
-                    m_distance_matrix[i][j])
+                if ((m_distance_matrix[i * n + k] +
+                     m_distance_matrix[k * n + j]) <
+                    m_distance_matrix[i * n + j])
                 {
-                    m_distance_matrix[i][j] =
-                        m_distance_matrix[i][k] + m_distance_matrix[k][j];
-                    m_parent_node[i][j] = m_parent_node[k][j];
+                    m_distance_matrix[i * n + j] =
+                        m_distance_matrix[i * n + k] +
+                        m_distance_matrix[k * n + j];
+                    m_parent_node[i * n + j] = m_parent_node[k * n + j];
                 }
             }
         }
@@ -341,7 +539,8 @@ void ArenaGraph::setNearbyNodesOfAllNodes()
         // Get the distance to all nodes at i
         ArenaNode* cur_node = getNode(i);
         std::vector<int> nearby_nodes;
-        std::vector<float> dist = m_distance_matrix[i];
+        std::vector<float> dist(m_distance_matrix.begin() + i * getNumNodes(),
+            m_distance_matrix.begin() + (i + 1) * getNumNodes());
 
         // Skip the same node
         dist[i] = 999999.0f;
@@ -362,14 +561,14 @@ void ArenaGraph::setNearbyNodesOfAllNodes()
 /** Determines the full path from 'from' to 'to' and returns it in a
  *  std::vector (in reverse order). Used only for unit testing.
  */
-std::vector<int16_t> ArenaGraph::getPathFromTo(int from, int to,
-                      const std::vector< std::vector< int16_t > >& parent_node)
+std::vector<int> ArenaGraph::getPathFromTo(int from, int to, unsigned int n,
+                                      const std::vector<uint16_t>& parent_node)
 {
-    std::vector<int16_t> path;
+    std::vector<int> path;
     path.push_back(to);
     while(from!=to)
     {
-        to = parent_node[from][to];
+        to = parent_node[from * n + to];
         path.push_back(to);
     }
     return path;
@@ -380,21 +579,43 @@ std::vector<int16_t> ArenaGraph::getPathFromTo(int from, int to,
  *  Instead of using hand-tuned test cases we use the tested, verified and
  *  easier to understand Floyd-Warshall algorithm to compute the distances,
  *  and check if the (significanty faster) Dijkstra algorithm gives the same
- *  results. For now we use the cave mesh as test case.
+ *  results. For now we use the cave mesh as test case. It also tests that
+ *  the cached results are the same as the computed ones.
  */
 void ArenaGraph::unitTesting()
 {
     Track *track = track_manager->getTrack("cave");
     std::string navmesh_file_name=track->getTrackFile("navmesh.xml");
 
+    // The constructor either computes the results and caches them, or loads
+    // the cached results
+    uint64_t hash;
+    XMLNode* navmesh = readNavmesh(navmesh_file_name, &hash);
+    ArenaGraph* ag = new ArenaGraph(navmesh, hash);
+    delete navmesh;
+    std::vector<float> cached_distance_matrix = ag->m_distance_matrix;
+    std::vector<uint16_t> cached_parent_node = ag->m_parent_node;
+    if (!ag->loadShortestPaths(hash) ||
+        ag->m_distance_matrix != cached_distance_matrix ||
+        ag->m_parent_node != cached_parent_node)
+    {
+        Log::error("ArenaGraph", "Cached shortest paths are different.");
+    }
+
+    ag->buildGraph();
     double s = StkTime::getRealTime();
-    ArenaGraph* ag = new ArenaGraph(navmesh_file_name);
+    ag->computeAllDijkstra();
     double e = StkTime::getRealTime();
     Log::error("Time", "Dijkstra       %lf", e-s);
+    if (ag->m_distance_matrix != cached_distance_matrix ||
+        ag->m_parent_node != cached_parent_node)
+    {
+        Log::error("ArenaGraph", "Cached shortest paths are different.");
+    }
 
     // Save the Dijkstra results
-    std::vector< std::vector< float > > distance_matrix = ag->m_distance_matrix;
-    std::vector< std::vector< int16_t > > parent_node = ag->m_parent_node;
+    std::vector<float> distance_matrix = ag->m_distance_matrix;
+    std::vector<uint16_t> parent_node = ag->m_parent_node;
     ag->buildGraph();
 
     // Now compute results with Floyd-Warshall
@@ -404,15 +625,17 @@ void ArenaGraph::unitTesting()
     Log::error("Time", "Floyd-Warshall %lf", e-s);
 
     int error_count = 0;
-    for(unsigned int i=0; i<ag->m_distance_matrix.size(); i++)
+    const unsigned int n = ag->getNumNodes();
+    for(unsigned int i=0; i<n; i++)
     {
-        for(unsigned int j=0; j<ag->m_distance_matrix[i].size(); j++)
+        for(unsigned int j=0; j<n; j++)
         {
-            if(ag->m_distance_matrix[i][j] - distance_matrix[i][j] > 0.001f)
+            if(ag->m_distance_matrix[i*n+j] - distance_matrix[i*n+j] > 0.001f)
             {
                 Log::error("ArenaGraph",
                            "Incorrect distance %d, %d: Dijkstra: %f F.W.: %f",
-                           i, j, distance_matrix[i][j], ag->m_distance_matrix[i][j]);
+                           i, j, distance_matrix[i*n+j],
+                           ag->m_distance_matrix[i*n+j]);
                 error_count++;
             }    // if distance is too different
 
@@ -424,16 +647,16 @@ void ArenaGraph::unitTesting()
             // debugging in the feature
 #undef TEST_PARENT_POLY_EVEN_THOUGH_MANY_FALSE_POSITIVES
 #ifdef TEST_PARENT_POLY_EVEN_THOUGH_MANY_FALSE_POSITIVES
-            if(ag->m_parent_node[i][j] != parent_node[i][j])
+            if(ag->m_parent_node[i*n+j] != parent_node[i*n+j])
             {
                 error_count++;
-                std::vector<int16_t> dijkstra_path = getPathFromTo(i, j, parent_node);
-                std::vector<int16_t> floyd_path = getPathFromTo(i, j, ag->m_parent_node);
+                std::vector<int> dijkstra_path = getPathFromTo(i, j, n, parent_node);
+                std::vector<int> floyd_path = getPathFromTo(i, j, n, ag->m_parent_node);
                 if(dijkstra_path.size()!=floyd_path.size())
                 {
                     Log::error("ArenaGraph",
                                "Incorrect path length %d, %d: Dijkstra: %d F.W.: %d",
-                               i, j, parent_node[i][j], ag->m_parent_node[i][j]);
+                               i, j, parent_node[i*n+j], ag->m_parent_node[i*n+j]);
                     continue;
                 }
                 Log::error("ArenaGraph", "Path problems from %d to %d:",
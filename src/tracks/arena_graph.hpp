@@ -21,6 +21,7 @@
 
 #include "tracks/graph.hpp"
 #include "utils/cpp2011.hpp"
+#include "utils/types.hpp"
 
 #include <set>
 
@@ -34,11 +35,20 @@ class XMLNode;
 class ArenaGraph : public Graph
 {
 private:
-    /** The actual graph data structure, it is an adjacency matrix. */
-    std::vector<std::vector<float>> m_distance_matrix;
+    /** Version of the cached shortest path tables, increase if the format
+     *  or the computation of the tables changes. */
+    static const uint8_t CACHE_VERSION = 1;
 
-    /** The matrix that is used to store computed shortest paths. */
-    std::vector<std::vector<int16_t>> m_parent_node;
+    /** Stored in m_parent_node if there is no path. */
+    static const uint16_t NO_PARENT = 0xffff;
+
+    /** The shortest distance from node i to node j is stored at index
+     *  i*n+j, before computeDijkstra it is an adjacency matrix. */
+    std::vector<float> m_distance_matrix;
+
+    /** The last node before node j on the shortest path from node i to j is
+     *  stored at index i*n+j, NO_PARENT if there is no such path. */
+    std::vector<uint16_t> m_parent_node;
 
     /** Used in soccer mode to colorize the goal lines in minimap. */
     std::set<int> m_red_node;
@@ -48,7 +58,7 @@ private:
     // ------------------------------------------------------------------------
     void loadGoalNodes(const XMLNode *node);
     // ------------------------------------------------------------------------
-    void loadNavmesh(const std::string &navmesh);
+    void loadNavmesh(const XMLNode *xml);
     // ------------------------------------------------------------------------
     void buildGraph();
     // ------------------------------------------------------------------------
@@ -56,10 +66,20 @@ private:
     // ------------------------------------------------------------------------
     void computeDijkstra(int n);
     // ------------------------------------------------------------------------
+    void computeAllDijkstra();
+    // ------------------------------------------------------------------------
     void computeFloydWarshall();
     // ------------------------------------------------------------------------
-    static std::vector<int16_t> getPathFromTo(int from, int to,
-                     const std::vector< std::vector< int16_t > >& parent_node);
+    static uint64_t getNavmeshHash(const std::string &navmesh);
+    // ------------------------------------------------------------------------
+    static std::string getCacheFile(uint64_t hash);
+    // ------------------------------------------------------------------------
+    bool loadShortestPaths(uint64_t hash);
+    // ------------------------------------------------------------------------
+    void saveShortestPaths(uint64_t hash) const;
+    // ------------------------------------------------------------------------
+    static std::vector<int> getPathFromTo(int from, int to, unsigned int n,
+                                  const std::vector<uint16_t>& parent_node);
     // ------------------------------------------------------------------------
     virtual bool hasLapLine() const OVERRIDE                  { return false; }
     // ------------------------------------------------------------------------
@@ -70,7 +90,10 @@ public:
     // ------------------------------------------------------------------------
     static void unitTesting();
     // ------------------------------------------------------------------------
-    ArenaGraph(const std::string &navmesh, const XMLNode *node = NULL);
+    static XMLNode* readNavmesh(const std::string &navmesh, uint64_t *hash);
+    // ------------------------------------------------------------------------
+    ArenaGraph(const XMLNode *navmesh, uint64_t hash,
+               const XMLNode *node = NULL);
     // ------------------------------------------------------------------------
     virtual ~ArenaGraph() {}
     // ------------------------------------------------------------------------
@@ -84,7 +107,8 @@ public:
     {
         if (i == Graph::UNKNOWN_SECTOR || j == Graph::UNKNOWN_SECTOR)
             return Graph::UNKNOWN_SECTOR;
-        return (int)(m_parent_node[j][i]);
+        const uint16_t parent = m_parent_node[j * getNumNodes() + i];
+        return parent == NO_PARENT ? Graph::UNKNOWN_SECTOR : (int)parent;
     }
     // ------------------------------------------------------------------------
     /** Returns the distance between any two nodes */
@@ -92,7 +116,7 @@ public:
     {
         if (from == Graph::UNKNOWN_SECTOR || to == Graph::UNKNOWN_SECTOR)
             return 99999.0f;
-        return m_distance_matrix[from][to];
+        return m_distance_matrix[from * getNumNodes() + to];
     }
 
 };   // ArenaGraph
@@ -32,18 +32,20 @@
 
 // ----------------------------------------------------------------------------
 /** Constructor, loads the graph information for a given set of quads
- *  from a graph file.
+ *  from a graph file. The files are read by the caller, since irrlicht's
+ *  file system is not thread-safe and this can be called by a worker thread.
  *  \param quad_file_name Name of the file of all quads
- *  \param graph_file_name Name of the file describing the actual graph
+ *  \param quads The file of all quads, NULL if it can't be read.
+ *  \param graph The file describing the actual graph, NULL if there is none.
  */
 DriveGraph::DriveGraph(const std::string &quad_file_name,
-                       const std::string &graph_file_name,
+                       const XMLNode *quads, const XMLNode *graph,
                        const bool reverse) : m_reverse(reverse)
 {
     m_lap_length    = 0;
     m_quad_filename = quad_file_name;
     Graph::setGraph(this);
-    load(quad_file_name, graph_file_name);
+    load(quads, graph);
 }   // DriveGraph
 
 // ----------------------------------------------------------------------------
@@ -84,18 +86,16 @@ void DriveGraph::getPoint(const XMLNode *xml,
 }   // getPoint
 
 // ----------------------------------------------------------------------------
-/** Loads a drive graph from a file.
- *  \param filename Name of the quad file to load.
- *  \param filename Name of the graph file to load.
+/** Loads a drive graph from its files.
+ *  \param quad The quad file to load.
+ *  \param xml The graph file to load.
  */
-void DriveGraph::load(const std::string &quad_file_name,
-                      const std::string &filename)
+void DriveGraph::load(const XMLNode *quad, const XMLNode *xml)
 {
-    XMLNode *quad = file_manager->createXMLTree(quad_file_name);
     if (!quad || quad->getName() != "quads")
     {
-        Log::error("DriveGraph : Quad xml '%s' not found.", filename.c_str());
-        delete quad;
+        Log::error("DriveGraph : Quad xml '%s' not found.",
+                   m_quad_filename.c_str());
         return;
     }
 
@@ -110,7 +110,7 @@ void DriveGraph::load(const std::string &quad_file_name,
         if (!(xml_node->getName() == "quad" || xml_node->getName() == "height-testing"))
         {
             Log::warn("DriveGraph: Unsupported node type '%s' found in '%s' - ignored.",
-                xml_node->getName().c_str(), filename.c_str());
+                xml_node->getName().c_str(), m_quad_filename.c_str());
             continue;
         }
         if (xml_node->getName() == "height-testing")
@@ -158,9 +158,6 @@ void DriveGraph::load(const std::string &quad_file_name,
         m_all_nodes[i]->setHeightTesting(min_height_testing,
             max_height_testing);
     }
-    delete quad;
-
-    const XMLNode *xml = file_manager->createXMLTree(filename);
 
     if(!xml)
     {
@@ -238,11 +235,11 @@ void DriveGraph::load(const std::string &quad_file_name,
         else
         {
             Log::error("DriveGraph", "Incorrect specification in '%s': '%s' ignored.",
-                    filename.c_str(), xml_node->getName().c_str());
+                    xml->getFileName().c_str(),
+                    xml_node->getName().c_str());
             continue;
         }   // incorrect specification
     }
-    delete xml;
 
     setDefaultSuccessors();
     computeDistanceFromStart(getStartNode(), 0.0f);
@@ -259,6 +256,7 @@ void DriveGraph::load(const std::string &quad_file_name,
             m_lap_length = l;
     }
 
+    createSectorGrid();
     loadBoundingBoxNodes();
 
 }   // load
@@ -60,7 +60,7 @@ private:
     // ------------------------------------------------------------------------
     void addSuccessor(unsigned int from, unsigned int to);
     // ------------------------------------------------------------------------
-    void load(const std::string &quad_file_name, const std::string &filename);
+    void load(const XMLNode *quad, const XMLNode *xml);
     // ------------------------------------------------------------------------
     void getPoint(const XMLNode *xml, const std::string &attribute_name,
                   Vec3 *result) const;
@@ -76,8 +76,8 @@ private:
 public:
     static DriveGraph* get()     { return dynamic_cast<DriveGraph*>(m_graph); }
     // ------------------------------------------------------------------------
-    DriveGraph(const std::string &quad_file_name,
-               const std::string &graph_file_name, const bool reverse);
+    DriveGraph(const std::string &quad_file_name, const XMLNode *quads,
+               const XMLNode *graph, const bool reverse);
     // ------------------------------------------------------------------------
     virtual ~DriveGraph() {}
     // ------------------------------------------------------------------------
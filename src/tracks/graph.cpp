@@ -31,7 +31,12 @@
 #include "tracks/drive_node_2d.hpp"
 #include "tracks/drive_node_3d.hpp"
 #include "tracks/track.hpp"
+#include "utils/benchmark.hpp"
 #include "utils/log.hpp"
+#include "utils/random_generator.hpp"
+
+#include <algorithm>
+#include <limits>
 
 const int Graph::UNKNOWN_SECTOR = -1;
 const float Graph::MIN_HEIGHT_TESTING = -1.0f;
@@ -48,6 +53,11 @@ Graph::Graph()
     m_bb_min      = Vec3( 99999,  99999,  99999);
     m_bb_max      = Vec3(-99999, -99999, -99999);
     memset(m_bb_nodes, 0, 4 * sizeof(int));
+    m_grid_min_x    = 0.0f;
+    m_grid_min_z    = 0.0f;
+    m_grid_cell_size = 1.0f;
+    m_grid_width    = 0;
+    m_grid_height   = 0;
 }  // Graph
 
 // -----------------------------------------------------------------------------
@@ -632,6 +642,12 @@ void Graph::findRoadSector(const Vec3& xyz, int *sector,
                             ? (unsigned int)all_sectors->size()
                             : (unsigned int)m_all_nodes.size();
     *sector = UNKNOWN_SECTOR;
+    if (!all_sectors && !m_grid_start.empty())
+    {
+        int first = indx < (int)m_all_nodes.size() - 1 ? indx + 1 : 0;
+        *sector = findRoadSectorInGrid(xyz, first, ignore_vertical);
+        return;
+    }
     for(unsigned int i=0; i<max_count; i++)
     {
         if(all_sectors)
@@ -704,6 +720,15 @@ int Graph::findOutOfRoadSector(const Vec3& xyz, const int curr_sector,
         current_sector  = curr_sector -10;
         if(current_sector<0) current_sector += getNumNodes();
     }
+    if (!all_sectors && !m_grid_start.empty())
+    {
+        int first = current_sector + 1 == (int)getNumNodes()
+                  ? 0 : current_sector + 1;
+        int sector = findOutOfRoadSectorInGrid(xyz, first, ignore_vertical);
+        if (sector == UNKNOWN_SECTOR)
+            Log::info("Graph", "unknown sector found.");
+        return sector;
+    }
 
     int   min_sector = UNKNOWN_SECTOR;
     float min_dist_2 = 999999.0f*999999.0f;
@@ -774,3 +799,337 @@ void Graph::loadBoundingBoxNodes()
     m_bb_nodes[3] = findOutOfRoadSector(Vec3(m_bb_max.x(), 0, m_bb_max.z()),
         -1/*curr_sector*/, NULL/*all_sectors*/, true/*ignore_vertical*/);
 }   // loadBoundingBoxNodes
+
+//-----------------------------------------------------------------------------
+/** Creates the grid used by findRoadSector and findOutOfRoadSector. Each
+ *  quad is added to all cells overlapped by its bounding box in the x/z
+ *  plane (for 3d quads including the box used in pointInside), so all quads
+ *  containing a point are found in the cell of the point. The only
+ *  exceptions are the quads in m_grid_unbounded_quads.
+ */
+void Graph::createSectorGrid()
+{
+    m_grid_start.clear();
+    m_grid_quads.clear();
+    m_grid_unbounded_quads.clear();
+    const unsigned int n = getNumNodes();
+    if (n == 0)
+        return;
+
+    std::vector<core::rectf> boxes(n);
+    float total_size = 0.0f;
+    for (unsigned int i = 0; i < n; i++)
+    {
+        const Quad* q = getQuad(i);
+        Vec3 bb_min((*q)[0]), bb_max((*q)[0]);
+        for (unsigned int j = 0; j < 4; j++)
+        {
+            bb_min.min((*q)[j]);
+            bb_max.max((*q)[j]);
+            if (q->is3DQuad())
+            {
+                // See BoundingBox3D for the 3d box size
+                bb_min.min((*q)[j] + 5.0f * q->getNormal());
+                bb_max.max((*q)[j] + 5.0f * q->getNormal());
+                bb_min.min((*q)[j] - 1.0f * q->getNormal());
+                bb_max.max((*q)[j] - 1.0f * q->getNormal());
+            }
+        }
+        // Allow for rounding errors in pointInside
+        bb_min -= Vec3(0.01f, 0.0f, 0.01f);
+        bb_max += Vec3(0.01f, 0.0f, 0.01f);
+        boxes[i] = core::rectf(bb_min.getX(), bb_min.getZ(), bb_max.getX(),
+            bb_max.getZ());
+
+        // The box test of 3d quads only compares the signs of the sides of
+        // all faces, which for non-planar quads (or a point on the plane of
+        // the first face) can be true far away from the quad. A 2d quad with
+        // collinear points can contain points on a half plane.
+        const float area_1 = (*q)[2].sideOfLine2D((*q)[0], (*q)[1]);
+        const float area_2 = (*q)[0].sideOfLine2D((*q)[2], (*q)[3]);
+        const float size_2 = ((*q)[2] - (*q)[0]).length2();
+        if (q->is3DQuad() || fabsf(area_1) <= 0.0001f * size_2 ||
+            fabsf(area_2) <= 0.0001f * size_2)
+            m_grid_unbounded_quads.push_back(i);
+        total_size += std::max(bb_max.getX() - bb_min.getX(),
+            bb_max.getZ() - bb_min.getZ());
+    }
+
+    core::rectf grid = boxes[0];
+    for (unsigned int i = 1; i < n; i++)
+    {
+        grid.addInternalPoint(boxes[i].UpperLeftCorner);
+        grid.addInternalPoint(boxes[i].LowerRightCorner);
+    }
+    const float width = grid.getWidth();
+    const float height = grid.getHeight();
+
+    // Cells of about the average quad size, but not more than 16 cells per
+    // quad in total
+    m_grid_cell_size = std::max(total_size / n, 1.0f);
+    if ((width / m_grid_cell_size) * (height / m_grid_cell_size) > 16.0f * n)
+        m_grid_cell_size = sqrtf(width * height / (16.0f * n));
+    m_grid_min_x = grid.UpperLeftCorner.X;
+    m_grid_min_z = grid.UpperLeftCorner.Y;
+    m_grid_width = std::max((int)ceilf(width / m_grid_cell_size), 1);
+    m_grid_height = std::max((int)ceilf(height / m_grid_cell_size), 1);
+
+    // Count the quads of each cell first, then fill them
+    std::vector<unsigned> count(m_grid_width * m_grid_height + 1, 0);
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (unsigned int i = 0; i < n; i++)
+        {
+            const int x0 = getGridCell(boxes[i].UpperLeftCorner.X,
+                m_grid_min_x, m_grid_width);
+            const int x1 = getGridCell(boxes[i].LowerRightCorner.X,
+                m_grid_min_x, m_grid_width);
+            const int z0 = getGridCell(boxes[i].UpperLeftCorner.Y,
+                m_grid_min_z, m_grid_height);
+            const int z1 = getGridCell(boxes[i].LowerRightCorner.Y,
+                m_grid_min_z, m_grid_height);
+            for (int z = z0; z <= z1; z++)
+            {
+                for (int x = x0; x <= x1; x++)
+                {
+                    const int cell = z * m_grid_width + x;
+                    if (pass == 0)
+                        count[cell]++;
+                    else
+                        m_grid_quads[m_grid_start[cell] + count[cell]++] = i;
+                }
+            }
+        }
+        if (pass == 0)
+        {
+            m_grid_start.resize(count.size());
+            unsigned total = 0;
+            for (unsigned int i = 0; i < count.size(); i++)
+            {
+                m_grid_start[i] = total;
+                total += count[i];
+                count[i] = 0;
+            }
+            m_grid_quads.resize(total);
+        }
+    }
+    Log::info("Graph", "Sector grid with %dx%d cells of size %f created, "
+        "%f quads per cell, %u unbounded quads.", m_grid_width, m_grid_height,
+        m_grid_cell_size,
+        (float)m_grid_quads.size() / (m_grid_width * m_grid_height),
+        (unsigned)m_grid_unbounded_quads.size());
+
+    if (Benchmark::isEnabled("graph"))
+        benchmarkSectorGrid();
+}   // createSectorGrid
+
+//-----------------------------------------------------------------------------
+/** Returns the quad containing xyz which is tested first by the linear search
+ *  in findRoadSector, which tests the quads in order starting with first.
+ */
+int Graph::findRoadSectorInGrid(const Vec3& xyz, int first,
+                                bool ignore_vertical) const
+{
+    const int n = getNumNodes();
+    int sector = UNKNOWN_SECTOR;
+    int min_order = n;
+    for (unsigned i = 0; i < m_grid_unbounded_quads.size(); i++)
+    {
+        const int indx = m_grid_unbounded_quads[i];
+        const int order = (indx - first + n) % n;
+        if (order < min_order &&
+            getQuad(indx)->pointInside(xyz, ignore_vertical))
+        {
+            sector = indx;
+            min_order = order;
+        }
+    }
+
+    if (xyz.getX() < m_grid_min_x || xyz.getZ() < m_grid_min_z ||
+        xyz.getX() > m_grid_min_x + m_grid_width * m_grid_cell_size ||
+        xyz.getZ() > m_grid_min_z + m_grid_height * m_grid_cell_size)
+        return sector;
+
+    const int cell =
+        getGridCell(xyz.getZ(), m_grid_min_z, m_grid_height) * m_grid_width +
+        getGridCell(xyz.getX(), m_grid_min_x, m_grid_width);
+    for (unsigned i = m_grid_start[cell]; i < m_grid_start[cell + 1]; i++)
+    {
+        const int indx = m_grid_quads[i];
+        const int order = (indx - first + n) % n;
+        if (order < min_order &&
+            getQuad(indx)->pointInside(xyz, ignore_vertical))
+        {
+            sector = indx;
+            min_order = order;
+        }
+    }
+    return sector;
+}   // findRoadSectorInGrid
+
+//-----------------------------------------------------------------------------
+/** Returns the same sector as the linear search in findOutOfRoadSector, which
+ *  tests the quads in order starting with first. The grid cells are searched
+ *  in rings around the cell of xyz, until no quad outside of the searched
+ *  cells can be closer than the closest quad found.
+ */
+int Graph::findOutOfRoadSectorInGrid(const Vec3& xyz, int first,
+                                     bool ignore_vertical) const
+{
+    const int n = getNumNodes();
+    const int cx = getGridCell(xyz.getX(), m_grid_min_x, m_grid_width);
+    const int cz = getGridCell(xyz.getZ(), m_grid_min_z, m_grid_height);
+
+    // Index 0 is the closest quad which passes the height test (phase 0 in
+    // the linear search), index 1 the closest of any quads (phase 1).
+    int min_sector[2] = { UNKNOWN_SECTOR, UNKNOWN_SECTOR };
+    float min_dist_2[2] = { 999999.0f*999999.0f, 999999.0f*999999.0f };
+    // The linear search only replaces a quad with a closer one, so with the
+    // same distance the quad tested first is used
+    int min_order[2] = { -1, -1 };
+
+    auto test_quad = [&](int indx)
+    {
+        const Quad* q = getQuad(indx);
+        if (q->isIgnored())
+            return;
+        const float dist_2 = q->getDistance2FromPoint(xyz);
+        const int order = (indx - first + n) % n;
+        const float dist = xyz.getY() - q->getMinHeight();
+        const bool height_ok = (dist < 5.0f && dist > -1.0f) ||
+            q->is3DQuad() || ignore_vertical;
+        for (int phase = height_ok ? 0 : 1; phase < 2; phase++)
+        {
+            if (dist_2 < min_dist_2[phase] ||
+                (dist_2 == min_dist_2[phase] && order < min_order[phase]))
+            {
+                min_sector[phase] = indx;
+                min_dist_2[phase] = dist_2;
+                min_order[phase] = order;
+            }
+        }
+    };
+
+    for (int r = 0; ; r++)
+    {
+        // Far away from all quads (or if no quad passes the height test)
+        // testing all quads once is faster than searching more cells
+        if ((2 * r + 1) * (2 * r + 1) > n)
+        {
+            for (int i = 0; i < n; i++)
+                test_quad(i);
+            break;
+        }
+
+        for (int z = std::max(cz - r, 0);
+             z <= std::min(cz + r, m_grid_height - 1); z++)
+        {
+            const bool border_row = z == cz - r || z == cz + r;
+            for (int x = std::max(cx - r, 0);
+                 x <= std::min(cx + r, m_grid_width - 1); x++)
+            {
+                // Only the new ring of cells
+                if (!border_row && x != cx - r && x != cx + r)
+                    continue;
+                const int cell = z * m_grid_width + x;
+                for (unsigned i = m_grid_start[cell];
+                     i < m_grid_start[cell + 1]; i++)
+                    test_quad(m_grid_quads[i]);
+            }
+        }
+
+        // Minimum distance of any quad not in the searched cells
+        float min_outside = std::numeric_limits<float>::max();
+        if (cx + r < m_grid_width - 1)
+        {
+            min_outside = std::min(min_outside, m_grid_min_x +
+                (cx + r + 1) * m_grid_cell_size - xyz.getX());
+        }
+        if (cx - r > 0)
+        {
+            min_outside = std::min(min_outside, xyz.getX() -
+                (m_grid_min_x + (cx - r) * m_grid_cell_size));
+        }
+        if (cz + r < m_grid_height - 1)
+        {
+            min_outside = std::min(min_outside, m_grid_min_z +
+                (cz + r + 1) * m_grid_cell_size - xyz.getZ());
+        }
+        if (cz - r > 0)
+        {
+            min_outside = std::min(min_outside, xyz.getZ() -
+                (m_grid_min_z + (cz - r) * m_grid_cell_size));
+        }
+        // All cells searched
+        if (min_outside == std::numeric_limits<float>::max())
+            break;
+        // Allow for rounding errors in the distance computations
+        min_outside -= 0.01f;
+        if (min_sector[0] != UNKNOWN_SECTOR && min_outside > 0.0f &&
+            min_outside * min_outside > min_dist_2[0])
+            break;
+    }
+    return min_sector[0] != UNKNOWN_SECTOR ? min_sector[0] : min_sector[1];
+}   // findOutOfRoadSectorInGrid
+
+//-----------------------------------------------------------------------------
+/** Compares the results and run time of the sector grid and the linear
+ *  search for random points around the track, enabled by
+ *  --micro-benchmark=graph.
+ */
+void Graph::benchmarkSectorGrid()
+{
+    const int n = getNumNodes();
+    const unsigned int count = 20000;
+    RandomGenerator rg;
+    std::vector<Vec3> points(count);
+    std::vector<int> start_sectors(count);
+    const Vec3 size = m_bb_max - m_bb_min;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        // Include some points outside of the track bounding box
+        points[i] = Vec3(m_bb_min.getX() - 0.1f * size.getX() +
+            1.2f * size.getX() * rg.get(10000) / 10000.0f,
+            m_bb_min.getY() + size.getY() * rg.get(10000) / 10000.0f,
+            m_bb_min.getZ() - 0.1f * size.getZ() +
+            1.2f * size.getZ() * rg.get(10000) / 10000.0f);
+        start_sectors[i] = rg.get(n + 1) - 1;
+    }
+
+    std::vector<int> road[2], out_of_road[2];
+    Benchmark::Timer time_road[2], time_out_of_road[2];
+    std::vector<unsigned> grid_start;
+    // Run the linear search first by removing the grid temporarily
+    for (int grid = 0; grid < 2; grid++)
+    {
+        std::swap(grid_start, m_grid_start);
+        time_road[grid].start();
+        for (unsigned int i = 0; i < count; i++)
+        {
+            int sector = start_sectors[i];
+            findRoadSector(points[i], &sector);
+            road[grid].push_back(sector);
+        }
+        time_road[grid].stop();
+        time_out_of_road[grid].start();
+        for (unsigned int i = 0; i < count; i++)
+        {
+            out_of_road[grid].push_back(
+                findOutOfRoadSector(points[i], start_sectors[i]));
+        }
+        time_out_of_road[grid].stop();
+    }
+
+    unsigned int mismatch = 0;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (road[0][i] != road[1][i] || out_of_road[0][i] != out_of_road[1][i])
+            mismatch++;
+    }
+    Log::info("Graph", "Benchmark of %u points on %d quads, %u mismatches.",
+        count, n, mismatch);
+    Log::info("Graph", "findRoadSector: linear %f ms, grid %f ms.",
+        time_road[0].getTotal(), time_road[1].getTotal());
+    Log::info("Graph", "findOutOfRoadSector: linear %f ms, grid %f ms.",
+        time_out_of_road[0].getTotal(), time_out_of_road[1].getTotal());
+}   // benchmarkSectorGrid
@@ -24,6 +24,7 @@
 
 #include <dimension2d.h>
 
+#include <cmath>
 #include <memory>
 #include <string>
 #include <vector>
@@ -66,6 +67,8 @@ protected:
     // ------------------------------------------------------------------------
     /** Map 4 bounding box points to 4 closest graph nodes. */
     void loadBoundingBoxNodes();
+    // ------------------------------------------------------------------------
+    void createSectorGrid();
 
 private:
     /** The 2d bounding box, used for hashing. */
@@ -75,6 +78,24 @@ private:
     /** The 4 closest graph nodes to the bounding box. */
     int m_bb_nodes[4];
 
+    /** A uniform grid in the x/z plane over all quads, used to find the
+     *  sector of a point without testing all quads. The quads overlapping
+     *  cell i are m_grid_quads[m_grid_start[i]] to
+     *  m_grid_quads[m_grid_start[i+1]-1]. Empty if no grid is used. */
+    std::vector<unsigned> m_grid_start;
+    std::vector<int> m_grid_quads;
+
+    /** Quads for which pointInside can be true outside of their bounding box
+     *  (3d quads, see BoundingBox3D::pointInside, and quads with degenerated
+     *  triangles), they are always tested by findRoadSectorInGrid. */
+    std::vector<int> m_grid_unbounded_quads;
+
+    /** Minimum x and z of the grid, and the size of a grid cell. */
+    float m_grid_min_x, m_grid_min_z, m_grid_cell_size;
+
+    /** Number of grid cells in x and z direction. */
+    int m_grid_width, m_grid_height;
+
     /** The node of the graph mesh. */
     scene::ISceneNode *m_node;
 
@@ -103,6 +124,20 @@ private:
     // ------------------------------------------------------------------------
     void cleanupDebugMesh();
     // ------------------------------------------------------------------------
+    int getGridCell(float v, float min, int size) const
+    {
+        int cell = (int)floorf((v - min) / m_grid_cell_size);
+        return cell < 0 ? 0 : cell >= size ? size - 1 : cell;
+    }
+    // ------------------------------------------------------------------------
+    int findRoadSectorInGrid(const Vec3& xyz, int first,
+                             bool ignore_vertical) const;
+    // ------------------------------------------------------------------------
+    int findOutOfRoadSectorInGrid(const Vec3& xyz, int first,
+                                  bool ignore_vertical) const;
+    // ------------------------------------------------------------------------
+    void benchmarkSectorGrid();
+    // ------------------------------------------------------------------------
     virtual bool hasLapLine() const = 0;
     // ------------------------------------------------------------------------
     virtual void differentNodeColor(int n, video::SColor* c) const = 0;
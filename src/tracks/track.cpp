@@ -62,6 +62,7 @@
 #include "modes/profile_world.hpp"
 #include "network/network_config.hpp"
 #include "network/protocols/server_lobby.hpp"
+#include "network/server_config.hpp"
 #include "physics/physical_object.hpp"
 #include "physics/physics.hpp"
 #include "physics/triangle_mesh.hpp"
@@ -79,6 +80,7 @@
 #include "utils/log.hpp"
 #include "utils/mini_glm.hpp"
 #include "utils/string_utils.hpp"
+#include "utils/time.hpp"
 #include "utils/translation.hpp"
 
 #include <IBillboardTextSceneNode.h>
@@ -89,9 +91,11 @@
 #include <ISceneManager.h>
 #include <SMeshBuffer.h>
 
+#include <algorithm>
 #include <iostream>
 #include <stdexcept>
 #include <sstream>
+#include <thread>
 #include <wchar.h>
 
 using namespace irr;
@@ -100,6 +104,7 @@ using namespace irr;
 const float Track::NOHIT               = -99999.9f;
 bool        Track::m_dont_load_navmesh = false;
 Track      *Track::m_current_track = NULL;
+std::list<Track*> Track::m_server_cached_tracks;
 
 // ----------------------------------------------------------------------------
 Track::Track(const std::string &filename)
@@ -185,6 +190,7 @@ Track::~Track()
     // Note that the music information in m_music is globally managed
     // by the music_manager, and is freed there. So no need to free it
     // here (esp. since various track might share the same music).
+    releaseServerCachedMeshes();
 #ifdef DEBUG
     assert(m_magic_number == 0x17AC3802);
     m_magic_number = 0xDEADBEEF;
@@ -283,6 +289,67 @@ void Track::removeCachedData()
     m_materials_loaded = false;
 }   // cleanCachedData
 
+//-----------------------------------------------------------------------------
+/** Returns true if this is a server which keeps the meshes of the recently
+ *  used tracks in irrlicht's mesh cache. This is only done without graphics,
+ *  since cleanup() drops the textures of all meshes of the track, which
+ *  would leave the cached meshes without textures on a graphical server.
+ */
+bool Track::useServerMeshCache()
+{
+    return ProfileWorld::isNoGraphics() &&
+        NetworkConfig::get()->isNetworking() &&
+        NetworkConfig::get()->isServer() &&
+        ServerConfig::m_track_cache_size > 0;
+}   // useServerMeshCache
+
+//-----------------------------------------------------------------------------
+/** Called at cleanup on a server to keep the meshes loaded by this track in
+ *  irrlicht's mesh cache, and makes this the most recently used track. If
+ *  more than track-cache-size tracks are cached, the meshes of the least
+ *  recently used track are released.
+ */
+void Track::cacheMeshesForServer()
+{
+    // Meshes loaded more than once are in m_all_cached_meshes more than once
+    std::vector<scene::IMesh*> meshes = m_all_cached_meshes;
+    std::sort(meshes.begin(), meshes.end());
+    meshes.erase(std::unique(meshes.begin(), meshes.end()), meshes.end());
+    // Grab the meshes before releasing the previously cached ones, so that
+    // meshes used in both races are not removed from the cache.
+    for (unsigned int i = 0; i < meshes.size(); i++)
+        meshes[i]->grab();
+    releaseServerCachedMeshes();
+    m_server_cached_meshes.swap(meshes);
+    m_server_cached_tracks.push_front(this);
+
+    const unsigned int max_tracks = ServerConfig::m_track_cache_size;
+    while (m_server_cached_tracks.size() > max_tracks)
+        m_server_cached_tracks.back()->releaseServerCachedMeshes();
+}   // cacheMeshesForServer
+
+//-----------------------------------------------------------------------------
+/** Drops the meshes kept by cacheMeshesForServer, and removes them from
+ *  irrlicht's mesh cache if they are not used anymore.
+ */
+void Track::releaseServerCachedMeshes()
+{
+    for (unsigned int i = 0; i < m_server_cached_meshes.size(); i++)
+    {
+        scene::IMesh* mesh = m_server_cached_meshes[i];
+        if (mesh->getReferenceCount() == 1)
+        {
+            mesh->drop();
+            continue;
+        }
+        mesh->drop();
+        if (mesh->getReferenceCount() == 1)
+            irr_driver->removeMeshFromCache(mesh);
+    }
+    m_server_cached_meshes.clear();
+    m_server_cached_tracks.remove(this);
+}   // releaseServerCachedMeshes
+
 //-----------------------------------------------------------------------------
 /** Prepates the track for a new race. This function must be called after all
  *  karts are created, since the check objects allocate data structures
@@ -377,6 +444,9 @@ void Track::cleanup()
 #endif
 
 
+    if (useServerMeshCache())
+        cacheMeshesForServer();
+
     // The m_all_cached_mesh contains each mesh loaded from a file, which
     // means that the mesh is stored in irrlichts mesh cache. To clean
     // everything loaded by this track, we drop the ref count for each mesh
@@ -506,6 +576,11 @@ void Track::cleanup()
     m_meta_library.clear();
     Scripting::ScriptEngine::getInstance()->cleanupCache();
 
+    // The disk caches get a new file whenever a track changes
+    file_manager->limitCachedDataDir("physics");
+    file_manager->limitCachedDataDir("navmesh");
+    file_manager->limitCachedDataDir("scripts");
+
     m_current_track = NULL;
 }   // cleanup
 
@@ -727,11 +802,49 @@ void Track::startMusic() const
         music_manager->clearCurrentMusic();
 }   // startMusic
 
+//-----------------------------------------------------------------------------
+Track::GraphFiles::GraphFiles()
+{
+    m_quads        = NULL;
+    m_graph        = NULL;
+    m_navmesh      = NULL;
+    m_navmesh_hash = 0;
+}   // GraphFiles
+
+//-----------------------------------------------------------------------------
+Track::GraphFiles::~GraphFiles()
+{
+    delete m_quads;
+    delete m_graph;
+    delete m_navmesh;
+}   // ~GraphFiles
+
+//-----------------------------------------------------------------------------
+/** Reads the files needed by loadGraph. This uses irrlicht's file system,
+ *  so it must be called by the main thread.
+ *  \param files On return contains the files of the graph.
+ */
+void Track::readGraphFiles(unsigned int mode_id, GraphFiles *files) const
+{
+    if (!m_is_arena && !m_is_soccer && !m_is_cutscene)
+    {
+        files->m_quads = file_manager->createXMLTree(m_root +
+                                            m_all_modes[mode_id].m_quad_name);
+        files->m_graph = file_manager->createXMLTree(m_root +
+                                           m_all_modes[mode_id].m_graph_name);
+    }
+    else if ((m_is_arena || m_is_soccer) && !m_is_cutscene && m_has_navmesh)
+    {
+        files->m_navmesh = ArenaGraph::readNavmesh(m_root + "navmesh.xml",
+                                                   &files->m_navmesh_hash);
+    }
+}   // readGraphFiles
+
 //-----------------------------------------------------------------------------
 /** Loads the quad graph for arena, i.e. the definition of all quads, and the
  *  way they are connected to each other. Input file name is hardcoded for now
  */
-void Track::loadArenaGraph(const XMLNode &node)
+void Track::loadArenaGraph(const XMLNode &node, const GraphFiles &files)
 {
     // Determine if rotate minimap is needed for soccer mode (for blue team)
     // Only need to test local player
@@ -750,7 +863,8 @@ void Track::loadArenaGraph(const XMLNode &node)
         }
     }
 
-    ArenaGraph* graph = new ArenaGraph(m_root+"navmesh.xml", &node);
+    ArenaGraph* graph = new ArenaGraph(files.m_navmesh, files.m_navmesh_hash,
+                                       &node);
     Graph::setGraph(graph);
 
     if(Graph::get()->getNumNodes()==0)
@@ -758,10 +872,6 @@ void Track::loadArenaGraph(const XMLNode &node)
         Log::warn("track", "No graph nodes defined for track '%s'\n",
                 m_filename.c_str());
     }
-    else
-    {
-        loadMinimap();
-    }
 }   // loadArenaGraph
 
 //-----------------------------------------------------------------------------
@@ -792,10 +902,11 @@ btQuaternion Track::getArenaStartRotation(const Vec3& xyz, float heading)
 /** Loads the drive graph, i.e. the definition of all quads, and the way
  *  they are connected to each other.
  */
-void Track::loadDriveGraph(unsigned int mode_id, const bool reverse)
+void Track::loadDriveGraph(unsigned int mode_id, const bool reverse,
+                           const GraphFiles &files)
 {
-    new DriveGraph(m_root+m_all_modes[mode_id].m_quad_name,
-        m_root+m_all_modes[mode_id].m_graph_name, reverse);
+    new DriveGraph(m_root+m_all_modes[mode_id].m_quad_name, files.m_quads,
+                   files.m_graph, reverse);
 
     // setGraph is done in DriveGraph constructor
     assert(DriveGraph::get());
@@ -817,11 +928,84 @@ void Track::loadDriveGraph(unsigned int mode_id, const bool reverse)
                 "kart mode, but not with AIs\n");
         }
     }
+}   // loadDriveGraph
+
+//-----------------------------------------------------------------------------
+/** Loads the drive graph or the arena graph of this track, if it has one.
+ *  This does not render the minimap, so it can be called by a worker thread.
+ *  \param root The scene node of the track.
+ *  \param files The files of the graph, read by readGraphFiles().
+ *  \return The time in milliseconds needed to load the graph.
+ */
+int Track::loadGraph(unsigned int mode_id, const bool reverse,
+                     const XMLNode &root, const GraphFiles &files)
+{
+    const uint64_t start = StkTime::getMonoTimeMs();
+    if (!m_is_arena && !m_is_soccer && !m_is_cutscene)
+        loadDriveGraph(mode_id, reverse, files);
+    else if ((m_is_arena || m_is_soccer) && !m_is_cutscene && m_has_navmesh)
+        loadArenaGraph(root, files);
+    return (int)(StkTime::getMonoTimeMs() - start);
+}   // loadGraph
+
+//-----------------------------------------------------------------------------
+/** Creates everything that depends on the graph once it is loaded: the
+ *  minimap, the item manager and the default start positions.
+ *  \param root The scene node of the track.
+ */
+void Track::finishGraphLoading(const XMLNode &root)
+{
+    if (Graph::get() && Graph::get()->getNumNodes() > 0)
+        loadMinimap();
+    main_loop->renderGUI(3340);
+
+    if (NetworkConfig::get()->isNetworking())
+        NetworkItemManager::create();
     else
     {
-        loadMinimap();
+        // Seed random engine locally, benchmark runs must be reproducible
+        uint32_t seed = ProfileWorld::isBenchmarkMode() ?
+            0 : (uint32_t)StkTime::getTimeSinceEpoch();
+        ItemManager::updateRandomSeed(seed);
+        ItemManager::create();
+        powerup_manager->setRandomSeed(seed);
     }
-}   // loadDriveGraph
+    main_loop->renderGUI(3360);
+
+    // Set the default start positions. Node that later the default
+    // positions can still be overwritten.
+    float forwards_distance  = 1.5f;
+    float sidewards_distance = 3.0f;
+    float upwards_distance   = 0.1f;
+    int   karts_per_row      = 2;
+
+    const XMLNode *default_start = root.getNode("default-start");
+    if (default_start)
+    {
+        default_start->get("forwards-distance",  &forwards_distance );
+        default_start->get("sidewards-distance", &sidewards_distance);
+        default_start->get("upwards-distance",   &upwards_distance  );
+        default_start->get("karts-per-row",      &karts_per_row     );
+    }
+
+    if (!m_is_arena && !m_is_soccer && !m_is_cutscene)
+    {
+        if (race_manager->getMinorMode() == RaceManager::MINOR_MODE_FOLLOW_LEADER)
+        {
+            // In a FTL race the non-leader karts are placed at the end of the
+            // field, so we need all start positions.
+            m_start_transforms.resize(stk_config->m_max_karts);
+        }
+        else
+            m_start_transforms.resize(race_manager->getNumberOfKarts());
+        DriveGraph::get()->setDefaultStartPositions(&m_start_transforms,
+                                                   karts_per_row,
+                                                   forwards_distance,
+                                                   sidewards_distance,
+                                                   upwards_distance);
+    }
+    main_loop->renderGUI(3400);
+}   // finishGraphLoading
 
 // -----------------------------------------------------------------------------
 
@@ -910,7 +1094,12 @@ void Track::createPhysicsModel(unsigned int main_track_count)
         uploadNodeVertexBuffer(m_all_nodes[i]);
     }
     main_loop->renderGUI(5580);
-    m_track_mesh->createPhysicalBody(m_friction);
+    // The BVH of the track is cached on servers, since building it takes a
+    // noticeable time for big tracks, which servers load for every race
+    m_track_mesh->createPhysicalBody(m_friction,
+        (btCollisionObject::CollisionFlags)0,
+        /*use_bvh_cache*/NetworkConfig::get()->isNetworking() &&
+        NetworkConfig::get()->isServer());
     main_loop->renderGUI(5585);
     m_gfx_effect_mesh->createCollisionShape();
     main_loop->renderGUI(5590);
@@ -1490,7 +1679,9 @@ bool Track::loadMainTrack(const XMLNode &root)
 // ----------------------------------------------------------------------------
 void Track::freeCachedMeshVertexBuffer()
 {
-    if (ProfileWorld::isNoGraphics())
+    // The physics are created from the vertices again if a cached mesh
+    // is used by the next race.
+    if (ProfileWorld::isNoGraphics() && !useServerMeshCache())
     {
         for (unsigned i = 0; i < m_all_cached_meshes.size(); i++)
             m_all_cached_meshes[i]->freeMeshVertexBuffer();
@@ -1769,6 +1960,7 @@ static void recursiveUpdatePhysics(std::vector<TrackObject*>& tos)
 void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
 {
     assert(!m_current_track);
+    const uint64_t load_start = StkTime::getMonoTimeMs();
 
     // Use m_filename to also get the path, not only the identifier
     STKTexManager::getInstance()
@@ -1846,6 +2038,7 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
         (void)e;
     }
     main_loop->renderGUI(3300);
+    const uint64_t materials_end = StkTime::getMonoTimeMs();
 
     // Start building the scene graph
     // Soccer field with navmesh requires it
@@ -1862,6 +2055,7 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
            <<"', aborting.";
         throw std::runtime_error(msg.str());
     }
+    const uint64_t scene_end = StkTime::getMonoTimeMs();
 
     m_current_track = this;
 
@@ -1889,57 +2083,31 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
     }
     main_loop->renderGUI(3320);
 
-    if (!m_is_arena && !m_is_soccer && !m_is_cutscene) 
-        loadDriveGraph(mode_id, reverse_track);
-    else if ((m_is_arena || m_is_soccer) && !m_is_cutscene && m_has_navmesh)
-        loadArenaGraph(*root);
-    main_loop->renderGUI(3340);
-
-    if (NetworkConfig::get()->isNetworking())
-        NetworkItemManager::create();
-    else
-    {
-        // Seed random engine locally
-        uint32_t seed = (uint32_t)StkTime::getTimeSinceEpoch();
-        ItemManager::updateRandomSeed(seed);
-        ItemManager::create();
-        powerup_manager->setRandomSeed(seed);
-    }
-    main_loop->renderGUI(3360);
-
-    // Set the default start positions. Node that later the default
-    // positions can still be overwritten.
-    float forwards_distance  = 1.5f;
-    float sidewards_distance = 3.0f;
-    float upwards_distance   = 0.1f;
-    int   karts_per_row      = 2;
-
-    const XMLNode *default_start = root->getNode("default-start");
-    if (default_start)
+    // The minimap needs the graph and clears the scene, so with graphics
+    // the graph is loaded before the scene is built. Without graphics no
+    // minimap is rendered, so the graph is built by a worker thread while
+    // the main track model is loaded. Nothing else may use the graph, the
+    // item manager or the start positions before the thread is joined.
+    // Irrlicht's file system is not thread-safe, so the files of the graph
+    // are read here and the thread only builds the graph from them.
+    int graph_time = 0;
+    GraphFiles graph_files;
+    readGraphFiles(mode_id, &graph_files);
+    std::thread graph_thread;
+    if (ProfileWorld::isNoGraphics())
     {
-        default_start->get("forwards-distance",  &forwards_distance );
-        default_start->get("sidewards-distance", &sidewards_distance);
-        default_start->get("upwards-distance",   &upwards_distance  );
-        default_start->get("karts-per-row",      &karts_per_row     );
+        graph_thread = std::thread([this, mode_id, reverse_track, root,
+                                    &graph_files, &graph_time]()
+            {
+                graph_time = loadGraph(mode_id, reverse_track, *root,
+                                       graph_files);
+            });
     }
-
-    if (!m_is_arena && !m_is_soccer && !m_is_cutscene)
+    else
     {
-        if (race_manager->getMinorMode() == RaceManager::MINOR_MODE_FOLLOW_LEADER)
-        {
-            // In a FTL race the non-leader karts are placed at the end of the
-            // field, so we need all start positions.
-            m_start_transforms.resize(stk_config->m_max_karts);
-        }
-        else
-            m_start_transforms.resize(race_manager->getNumberOfKarts());
-        DriveGraph::get()->setDefaultStartPositions(&m_start_transforms,
-                                                   karts_per_row,
-                                                   forwards_distance,
-                                                   sidewards_distance,
-                                                   upwards_distance);
+        graph_time = loadGraph(mode_id, reverse_track, *root, graph_files);
+        finishGraphLoading(*root);
     }
-    main_loop->renderGUI(3400);
 
     // we need to check for fog before loading the main track model
     if (const XMLNode *node = root->getNode("sun"))
@@ -1993,8 +2161,25 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
         node->get("xyz", &m_godrays_position);
     }
 
-    loadMainTrack(*root);
+    const uint64_t main_track_start = StkTime::getMonoTimeMs();
+    try
+    {
+        loadMainTrack(*root);
+    }
+    catch (...)
+    {
+        if (graph_thread.joinable())
+            graph_thread.join();
+        throw;
+    }
+    const uint64_t main_track_end = StkTime::getMonoTimeMs();
+    if (graph_thread.joinable())
+    {
+        graph_thread.join();
+        finishGraphLoading(*root);
+    }
     main_loop->renderGUI(4700);
+    const uint64_t objects_start = StkTime::getMonoTimeMs();
 
     unsigned int main_track_count = (unsigned int)m_all_nodes.size();
 
@@ -2045,6 +2230,7 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
     // Init all track objects
     m_track_object_manager->init();
     main_loop->renderGUI(5300);
+    const uint64_t objects_end = StkTime::getMonoTimeMs();
 
 
     // ---- Fog
@@ -2164,8 +2350,10 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
     for (auto* obj : objs_removing)
         m_track_object_manager->removeObject(obj);
 
+    const uint64_t physics_start = StkTime::getMonoTimeMs();
     createPhysicsModel(main_track_count);
     main_loop->renderGUI(5600);
+    const uint64_t physics_end = StkTime::getMonoTimeMs();
 
     freeCachedMeshVertexBuffer();
 
@@ -2204,6 +2392,18 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
     delete root;
     main_loop->renderGUI(5800);
 
+    const uint64_t load_end = StkTime::getMonoTimeMs();
+    Log::info("Track", "Loaded '%s' in %d ms: materials %d ms, scene %d ms, "
+              "graph %d ms%s, main model %d ms, objects %d ms, physics %d ms, "
+              "items %d ms.", m_ident.c_str(), (int)(load_end - load_start),
+              (int)(materials_end - load_start),
+              (int)(scene_end - materials_end), graph_time,
+              ProfileWorld::isNoGraphics() ? " (in parallel)" : "",
+              (int)(main_track_end - main_track_start),
+              (int)(objects_end - objects_start),
+              (int)(physics_end - physics_start),
+              (int)(load_end - physics_end));
+
     if (auto sl = LobbyProtocol::get<ServerLobby>())
         sl->saveInitialItems();
 
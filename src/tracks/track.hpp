@@ -26,6 +26,7 @@
   * objects.
   */
 
+#include <list>
 #include <string>
 #include <vector>
 
@@ -37,6 +38,7 @@ using namespace irr;
 
 #include "utils/aligned_array.hpp"
 #include "utils/translation.hpp"
+#include "utils/types.hpp"
 #include "utils/vec3.hpp"
 #include "utils/ptr_vector.hpp"
 
@@ -159,6 +161,15 @@ private:
       */
     std::vector<scene::IMesh*>      m_detached_cached_meshes;
 
+    /** On a server, the meshes of this track which are kept in irrlicht's
+     *  mesh cache after the race, so that loading this track again does not
+     *  read and parse the models again. */
+    std::vector<scene::IMesh*>      m_server_cached_meshes;
+
+    /** The tracks which have their meshes cached on a server, the most
+     *  recently used track first. */
+    static std::list<Track*>        m_server_cached_tracks;
+
     /** A list of all textures loaded by the track, so that they can
      *  be removed from the cache at cleanup time. */
     std::vector<video::ITexture*>   m_all_cached_textures;
@@ -390,9 +401,28 @@ private:
     /** The number of laps that is predefined in a track info dialog. */
     int m_actual_number_of_laps;
 
+    /** The files of the drive graph or the navmesh. They are read by the
+     *  main thread, since irrlicht's file system is not thread-safe and the
+     *  graph can be loaded by a worker thread. */
+    struct GraphFiles
+    {
+        XMLNode *m_quads;
+        XMLNode *m_graph;
+        XMLNode *m_navmesh;
+        /** Hash of the navmesh file, 0 if its cache can't be used. */
+        uint64_t m_navmesh_hash;
+        GraphFiles();
+        ~GraphFiles();
+    };
+
     void loadTrackInfo();
-    void loadDriveGraph(unsigned int mode_id, const bool reverse);
-    void loadArenaGraph(const XMLNode &node);
+    void readGraphFiles(unsigned int mode_id, GraphFiles *files) const;
+    void loadDriveGraph(unsigned int mode_id, const bool reverse,
+                        const GraphFiles &files);
+    void loadArenaGraph(const XMLNode &node, const GraphFiles &files);
+    int  loadGraph(unsigned int mode_id, const bool reverse,
+                   const XMLNode &root, const GraphFiles &files);
+    void finishGraphLoading(const XMLNode &root);
     btQuaternion getArenaStartRotation(const Vec3& xyz, float heading);
     bool loadMainTrack(const XMLNode &node);
     void loadMinimap();
@@ -402,6 +432,9 @@ private:
     void loadCurves(const XMLNode &node);
     void handleSky(const XMLNode &root, const std::string &filename);
     void freeCachedMeshVertexBuffer();
+    void cacheMeshesForServer();
+    void releaseServerCachedMeshes();
+    static bool useServerMeshCache();
 public:
 
     /** Static function to get the current track. NULL if no current
@@ -0,0 +1,239 @@
+//  SuperTuxKart - a fun racing game with go-kart
+//
+//  Copyright (C) 2019  SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "utils/allocation_counter.hpp"
+
+#ifdef COUNT_ALLOCATIONS
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef WIN32
+#  include <malloc.h>
+#endif
+
+namespace
+{
+    // Both are constant initialised, so they can be used by allocations
+    // done during static initialisation.
+    std::atomic<bool>     g_counting(false);
+    std::atomic<uint64_t> g_count(0);
+
+    // ------------------------------------------------------------------------
+    void* countedAlloc(std::size_t size)
+    {
+        if (g_counting.load(std::memory_order_relaxed))
+            g_count.fetch_add(1, std::memory_order_relaxed);
+        return malloc(size == 0 ? 1 : size);
+    }   // countedAlloc
+
+#ifdef __cpp_aligned_new
+    // ------------------------------------------------------------------------
+    void* countedAlignedAlloc(std::size_t size, std::align_val_t alignment)
+    {
+        if (g_counting.load(std::memory_order_relaxed))
+            g_count.fetch_add(1, std::memory_order_relaxed);
+        if (size == 0)
+            size = 1;
+#ifdef WIN32
+        return _aligned_malloc(size, (std::size_t)alignment);
+#else
+        void* p = NULL;
+        if (posix_memalign(&p, (std::size_t)alignment, size) != 0)
+            return NULL;
+        return p;
+#endif
+    }   // countedAlignedAlloc
+
+    // ------------------------------------------------------------------------
+    void alignedFree(void* p)
+    {
+#ifdef WIN32
+        _aligned_free(p);
+#else
+        free(p);
+#endif
+    }   // alignedFree
+#endif
+}   // namespace
+
+// All replaceable forms of new and delete are replaced, so that the sized
+// and aligned forms used by C++14/17 compilers never mix allocators.
+// ----------------------------------------------------------------------------
+void* operator new(std::size_t size)
+{
+    void* p = countedAlloc(size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}   // operator new
+
+// ----------------------------------------------------------------------------
+void* operator new[](std::size_t size)
+{
+    void* p = countedAlloc(size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}   // operator new[]
+
+// ----------------------------------------------------------------------------
+void* operator new(std::size_t size, const std::nothrow_t&) throw()
+{
+    return countedAlloc(size);
+}   // operator new
+
+// ----------------------------------------------------------------------------
+void* operator new[](std::size_t size, const std::nothrow_t&) throw()
+{
+    return countedAlloc(size);
+}   // operator new[]
+
+// ----------------------------------------------------------------------------
+void operator delete(void* p) throw()
+{
+    free(p);
+}   // operator delete
+
+// ----------------------------------------------------------------------------
+void operator delete[](void* p) throw()
+{
+    free(p);
+}   // operator delete[]
+
+// ----------------------------------------------------------------------------
+void operator delete(void* p, const std::nothrow_t&) throw()
+{
+    free(p);
+}   // operator delete
+
+// ----------------------------------------------------------------------------
+void operator delete[](void* p, const std::nothrow_t&) throw()
+{
+    free(p);
+}   // operator delete[]
+
+#ifdef __cpp_sized_deallocation
+// ----------------------------------------------------------------------------
+void operator delete(void* p, std::size_t) throw()
+{
+    free(p);
+}   // operator delete
+
+// ----------------------------------------------------------------------------
+void operator delete[](void* p, std::size_t) throw()
+{
+    free(p);
+}   // operator delete[]
+#endif
+
+#ifdef __cpp_aligned_new
+// ----------------------------------------------------------------------------
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    void* p = countedAlignedAlloc(size, alignment);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}   // operator new
+
+// ----------------------------------------------------------------------------
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    void* p = countedAlignedAlloc(size, alignment);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}   // operator new[]
+
+// ----------------------------------------------------------------------------
+void* operator new(std::size_t size, std::align_val_t alignment,
+                   const std::nothrow_t&) noexcept
+{
+    return countedAlignedAlloc(size, alignment);
+}   // operator new
+
+// ----------------------------------------------------------------------------
+void* operator new[](std::size_t size, std::align_val_t alignment,
+                     const std::nothrow_t&) noexcept
+{
+    return countedAlignedAlloc(size, alignment);
+}   // operator new[]
+
+// ----------------------------------------------------------------------------
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    alignedFree(p);
+}   // operator delete
+
+// ----------------------------------------------------------------------------
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+    alignedFree(p);
+}   // operator delete[]
+
+// ----------------------------------------------------------------------------
+void operator delete(void* p, std::align_val_t,
+                     const std::nothrow_t&) noexcept
+{
+    alignedFree(p);
+}   // operator delete
+
+// ----------------------------------------------------------------------------
+void operator delete[](void* p, std::align_val_t,
+                       const std::nothrow_t&) noexcept
+{
+    alignedFree(p);
+}   // operator delete[]
+
+// ----------------------------------------------------------------------------
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+    alignedFree(p);
+}   // operator delete
+
+// ----------------------------------------------------------------------------
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept
+{
+    alignedFree(p);
+}   // operator delete[]
+#endif
+
+// ============================================================================
+/** Starts or stops counting allocations. The count is not reset. */
+void AllocationCounter::enable(bool enable)
+{
+    g_counting.store(enable);
+}   // enable
+
+// ----------------------------------------------------------------------------
+/** Returns if allocations are currently counted. */
+bool AllocationCounter::isEnabled()
+{
+    return g_counting.load();
+}   // isEnabled
+
+// ----------------------------------------------------------------------------
+/** Returns the number of allocations done while counting was enabled. */
+uint64_t AllocationCounter::getCount()
+{
+    return g_count.load();
+}   // getCount
+
+#endif
@@ -0,0 +1,47 @@
+//  SuperTuxKart - a fun racing game with go-kart
+//
+//  Copyright (C) 2019  SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_ALLOCATION_COUNTER_HPP
+#define HEADER_ALLOCATION_COUNTER_HPP
+
+#include "utils/types.hpp"
+
+/** \ingroup utils
+ *  Counts the calls to the global operator new, used by the benchmarks.
+ *  Counting is only compiled in with the cmake option COUNT_ALLOCATIONS,
+ *  which replaces the global operator new and delete. Otherwise no
+ *  allocation is counted, and isAvailable() returns false. Allocations
+ *  done with malloc (e.g. by bullet or irrlicht) are never counted.
+ */
+class AllocationCounter
+{
+public:
+#ifdef COUNT_ALLOCATIONS
+    static void     enable(bool enable);
+    static bool     isEnabled();
+    static uint64_t getCount();
+    static bool     isAvailable() { return true; }
+#else
+    static void     enable(bool enable) {}
+    static bool     isEnabled() { return false; }
+    static uint64_t getCount() { return 0; }
+    static bool     isAvailable() { return false; }
+#endif
+};   // AllocationCounter
+
+#endif
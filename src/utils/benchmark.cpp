@@ -0,0 +1,125 @@
+//  SuperTuxKart - a fun racing game with go-kart
+//
+//  Copyright (C) 2019  SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "utils/benchmark.hpp"
+
+#include "network/network_string.hpp"
+#include "network/peer_table.hpp"
+#include "network/protocol_manager.hpp"
+#include "network/rewind_queue.hpp"
+#include "replay/replay_play.hpp"
+#include "utils/log.hpp"
+#include "utils/string_utils.hpp"
+
+std::set<std::string> Benchmark::m_enabled;
+
+namespace
+{
+    struct BenchmarkInfo
+    {
+        const char* m_name;
+        /** Runs the benchmark, NULL for benchmarks which are run by their
+         *  module when a race is started. */
+        void (*m_run)();
+    };
+
+    const BenchmarkInfo g_all_benchmarks[] =
+    {
+        // Compares the sector grid with the linear search of the drive
+        // graph when a track is loaded.
+        { "graph",            NULL                      },
+        // Compares item hit tests using the item grid with testing all
+        // items when a race starts.
+        { "item",             NULL                      },
+        { "network-string",   NetworkString::benchmark  },
+        { "peer-table",       PeerTable::benchmark      },
+        { "protocol-manager", ProtocolManager::benchmark },
+        { "replay",           ReplayPlay::benchmark     },
+        { "rewind-queue",     RewindQueue::benchmark    },
+    };
+}   // namespace
+
+// ----------------------------------------------------------------------------
+/** Enables the benchmarks in a comma separated list of names.
+ *  \return False if a name is unknown, in which case nothing is enabled.
+ */
+bool Benchmark::enable(const std::string& names)
+{
+    std::set<std::string> enabled;
+    for (const std::string& name : StringUtils::split(names, ','))
+    {
+        bool found = false;
+        for (const BenchmarkInfo& info : g_all_benchmarks)
+            found = found || name == info.m_name;
+        if (!found)
+        {
+            Log::error("Benchmark", "Unknown benchmark '%s', use one of %s.",
+                name.c_str(), getNames().c_str());
+            return false;
+        }
+        enabled.insert(name);
+    }
+    m_enabled = enabled;
+    return true;
+}   // enable
+
+// ----------------------------------------------------------------------------
+/** Returns true if an enabled benchmark is run during a race, so the game
+ *  must be started after runModuleBenchmarks().
+ */
+bool Benchmark::needsRace()
+{
+    for (const BenchmarkInfo& info : g_all_benchmarks)
+    {
+        if (!info.m_run && isEnabled(info.m_name))
+            return true;
+    }
+    return false;
+}   // needsRace
+
+// ----------------------------------------------------------------------------
+/** Runs all enabled benchmarks which don't need a race.
+ *  \return True if at least one benchmark was run.
+ */
+bool Benchmark::runModuleBenchmarks()
+{
+    bool run = false;
+    for (const BenchmarkInfo& info : g_all_benchmarks)
+    {
+        if (!info.m_run || !isEnabled(info.m_name))
+            continue;
+        Log::info("Benchmark", "Running the %s benchmark.", info.m_name);
+        info.m_run();
+        run = true;
+    }
+    return run;
+}   // runModuleBenchmarks
+
+// ----------------------------------------------------------------------------
+/** Returns the names of all benchmarks, separated by commas. */
+std::string Benchmark::getNames()
+{
+    std::string names;
+    for (const BenchmarkInfo& info : g_all_benchmarks)
+    {
+        if (!names.empty())
+            names += ", ";
+        names += info.m_name;
+    }
+    return names;
+}   // getNames
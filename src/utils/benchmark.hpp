@@ -0,0 +1,92 @@
+//  SuperTuxKart - a fun racing game with go-kart
+//
+//  Copyright (C) 2019  SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_BENCHMARK_HPP
+#define HEADER_BENCHMARK_HPP
+
+#include <chrono>
+#include <set>
+#include <string>
+
+/** \ingroup utils
+ *  Selects and runs the micro benchmarks of the different modules, which
+ *  are enabled with --micro-benchmark=name1,name2. Most benchmarks only
+ *  test their module and are run by runModuleBenchmarks() before the game
+ *  starts. The ones which need a loaded track (see needsRace()) check
+ *  isEnabled() when the race is started.
+ */
+class Benchmark
+{
+public:
+    /** Measures the time between start() and stop(), and keeps the total,
+     *  the maximum and the number of all measurements. All times are in
+     *  milliseconds. */
+    class Timer
+    {
+    private:
+        std::chrono::steady_clock::time_point m_start;
+        double       m_total;
+        double       m_max;
+        unsigned int m_count;
+    public:
+        Timer() : m_total(0.0), m_max(0.0), m_count(0) { start(); }
+        // --------------------------------------------------------------------
+        void start() { m_start = std::chrono::steady_clock::now(); }
+        // --------------------------------------------------------------------
+        /** Ends a measurement and returns its time. */
+        double stop()
+        {
+            const double t = std::chrono::duration<double, std::milli>
+                (std::chrono::steady_clock::now() - m_start).count();
+            m_total += t;
+            if (t > m_max)
+                m_max = t;
+            m_count++;
+            return t;
+        }   // stop
+        // --------------------------------------------------------------------
+        double getTotal() const { return m_total; }
+        // --------------------------------------------------------------------
+        double getMax() const { return m_max; }
+        // --------------------------------------------------------------------
+        unsigned int getCount() const { return m_count; }
+        // --------------------------------------------------------------------
+        double getAverage() const
+        {
+            return m_count > 0 ? m_total / m_count : 0.0;
+        }   // getAverage
+    };   // Timer
+
+private:
+    /** Names of all enabled benchmarks. */
+    static std::set<std::string> m_enabled;
+
+public:
+    static bool        enable(const std::string& names);
+    static bool        needsRace();
+    static bool        runModuleBenchmarks();
+    static std::string getNames();
+    // ------------------------------------------------------------------------
+    /** Returns true if the benchmark with the given name was enabled. */
+    static bool isEnabled(const std::string& name)
+    {
+        return m_enabled.find(name) != m_enabled.end();
+    }   // isEnabled
+};   // Benchmark
+
+#endif
@@ -20,10 +20,22 @@
 
 #include "config/user_config.hpp"
 #include "network/network_config.hpp"
-
+#include "utils/string_utils.hpp"
+#include "utils/time.hpp"
+#include "utils/vs.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <map>
+#include <mutex>
 #include <stdio.h>
+#include <thread>
 
 #ifdef ANDROID
 #  include <android/log.h>
@@ -42,6 +54,142 @@ size_t        Log::m_buffer_size = 1;
 bool          Log::m_console_log = true;
 Synchronised<std::vector<struct Log::LineInfo> > Log::m_line_buffer;
 
+namespace
+{
+    const char *g_level_names[] = { "debug", "verbose  ", "info   ",
+                                    "warn   ", "error  ", "fatal  " };
+
+    /** Maximum length of a formatted message. */
+    const int MAX_LENGTH = 4096;
+
+    /** Number of lines the queue of the writer thread can hold, must be a
+     *  power of 2. */
+    const size_t QUEUE_SIZE = 4096;
+
+    /** One line in the queue of the writer thread. The message is only
+     *  formatted by the thread logging it, the prefix, time and level are
+     *  added by the writer thread. The strings keep their capacity when the
+     *  entry is reused, so queueing a line usually does not allocate. */
+    struct QueueEntry
+    {
+        /** Sequence number of this entry (see queueMessage). */
+        std::atomic<size_t> m_sequence;
+        int                 m_level;
+        /** Time added to lines on servers, or 0. */
+        std::time_t         m_time;
+        char                m_component[32];
+        std::string         m_prefix;
+        std::string         m_message;
+    };   // QueueEntry
+
+    /** The queue is a bounded multi producer, single consumer ring of
+     *  entries: an entry can be written by a producer if its sequence number
+     *  is equal to the enqueue position, and read by the writer thread if
+     *  it is equal to the dequeue position + 1. It is never freed, since
+     *  another thread could still be writing into it while exiting. */
+    QueueEntry*         g_queue = NULL;
+    std::atomic<size_t> g_enqueue_pos(0);
+    /** Only used by the writer thread. */
+    size_t              g_dequeue_pos = 0;
+    /** Position up to which all lines have been written, used to flush. */
+    std::atomic<size_t> g_written_pos(0);
+    /** Number of lines dropped because the queue was full. */
+    std::atomic<size_t> g_dropped(0);
+
+    std::thread         g_writer_thread;
+    /** True while lines are to be queued for the writer thread. */
+    std::atomic<bool>   g_writer_running(false);
+    /** Number of threads which might be queueing a line, see
+     *  stopWriterThread(). */
+    std::atomic<int>    g_writer_producers(0);
+    /** Tells the writer thread to exit after writing all queued lines. */
+    std::atomic<bool>   g_writer_stop(false);
+    /** True while the writer thread waits for g_writer_cv, so producers
+     *  only lock g_writer_mutex to wake it up. */
+    std::atomic<bool>   g_writer_sleeping(false);
+    std::mutex              g_writer_mutex;
+    std::condition_variable g_writer_cv;
+
+    /** If the log file uses the binary format, see tools/decode_log.py. */
+    bool                g_binary_file = false;
+    /** Maximum number of lines below warning level per second and
+     *  component written by the writer thread, or 0 for no limit. */
+    unsigned            g_rate_limit  = 0;
+    /** Name of the log file, the binary log file adds .bin to it. */
+    std::string         g_file_name;
+
+    // ------------------------------------------------------------------------
+    /** Adds a message to the queue of the writer thread. Lines below warning
+     *  level are dropped if the queue is full, other lines wait for the
+     *  writer thread to make room.
+     */
+    void queueMessage(int level, const char *component,
+                      const std::string &prefix, std::time_t time,
+                      const char *format, VALIST args)
+    {
+        char message[MAX_LENGTH + 1];
+        int length = vsnprintf(message, MAX_LENGTH, format, args);
+        if (length < 0)
+            length = 0;
+        else if (length > MAX_LENGTH - 1)
+            length = MAX_LENGTH - 1;
+
+        QueueEntry *entry;
+        size_t pos = g_enqueue_pos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            entry = &g_queue[pos & (QUEUE_SIZE - 1)];
+            size_t sequence = entry->m_sequence.load(std::memory_order_acquire);
+            if (sequence == pos)
+            {
+                if (g_enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                    std::memory_order_relaxed))
+                    break;
+            }
+            else if (sequence < pos)
+            {
+                // The queue is full
+                if (level < Log::LL_WARN)
+                {
+                    g_dropped.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                std::this_thread::yield();
+                pos = g_enqueue_pos.load(std::memory_order_relaxed);
+            }
+            else
+                pos = g_enqueue_pos.load(std::memory_order_relaxed);
+        }
+
+        entry->m_level = level;
+        entry->m_time  = time;
+        strncpy(entry->m_component, component,
+                sizeof(entry->m_component) - 1);
+        entry->m_component[sizeof(entry->m_component) - 1] = 0;
+        entry->m_prefix = prefix;
+        entry->m_message.assign(message, length);
+        entry->m_sequence.store(pos + 1, std::memory_order_release);
+
+        // Either this sees that the writer thread sleeps, or the writer
+        // thread sees this line before it sleeps (see writerThread)
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (g_writer_sleeping.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(g_writer_mutex);
+            g_writer_cv.notify_one();
+        }
+    }   // queueMessage
+
+    // ------------------------------------------------------------------------
+    void appendUInt(std::string *data, uint64_t value, int bytes)
+    {
+        // Little endian independent of the platform
+        for (int i = 0; i < bytes; i++)
+            data->push_back((char)((value >> (8 * i)) & 0xff));
+    }   // appendUInt
+
+}   // namespace
+
 // ----------------------------------------------------------------------------
 /** Selects background/foreground colors for the message depending on
  *  log level. It is only called if messages are not redirected to a file.
@@ -143,9 +291,28 @@ void Log::printMessage(int level, const char *component, const char *format,
 
     if (level < m_min_log_level) return;
 
-    static const char *names[] = { "debug", "verbose  ", "info   ",
-                                  "warn   ", "error  ", "fatal  " };
-    const int MAX_LENGTH = 4096;
+    const char **names = g_level_names;
+    std::time_t time = 0;
+#ifndef ANDROID
+    if (NetworkConfig::get()->isNetworking() &&
+        NetworkConfig::get()->isServer())
+        time = std::time(nullptr);
+#endif
+
+    // stopWriterThread() waits for all threads which have seen that the
+    // writer thread is running
+    g_writer_producers.fetch_add(1);
+    if (g_writer_running.load())
+    {
+        queueMessage(level, component, m_prefix, time, format, args);
+        g_writer_producers.fetch_sub(1);
+        // Make sure a fatal error is written before exiting
+        if (level == LL_FATAL)
+            flushBuffers();
+        return;
+    }
+    g_writer_producers.fetch_sub(1);
+
     char line[MAX_LENGTH + 1];
     int index = 0;
     int remaining = MAX_LENGTH;
@@ -156,17 +323,13 @@ void Log::printMessage(int level, const char *component, const char *format,
         remaining = MAX_LENGTH - index > 0 ? MAX_LENGTH - index : 0;
     }
 
-#ifndef ANDROID
-    if (NetworkConfig::get()->isNetworking() &&
-        NetworkConfig::get()->isServer())
+    if (time != 0)
     {
-        std::time_t result = std::time(nullptr);
         index += snprintf (line + index, remaining,
-            "%.24s [%s] %s: ", std::asctime(std::localtime(&result)),
+            "%.24s [%s] %s: ", std::asctime(std::localtime(&time)),
             names[level], component);
     }
     else
-#endif
     {
         index += snprintf (line + index, remaining,
             "[%s] %s: ", names[level], component);
@@ -208,6 +371,42 @@ void Log::printMessage(int level, const char *component, const char *format,
     flushBuffers();
 }   // printMessage
 
+// ----------------------------------------------------------------------------
+/** Writes the specified line to the terminal (or the android log), using a
+ *  colour depending on the level if colours are enabled.
+ *  \param line The line to write.
+ *  \param level Message level. Only used to select terminal colour.
+ */
+void Log::writeConsoleLine(const char *line, int level)
+{
+    setTerminalColor((LogLevel)level);
+    if (m_console_log)
+    {
+#ifdef ANDROID
+        android_LogPriority alp;
+        switch (level)
+        {
+            // STK is using the levels slightly different from android
+            // (debug lowest, verbose above it; while android reverses
+            // this order. So to get the same behaviour (e.g. filter
+            // out debug message, but still get verbose, we swap
+            // the order here.
+        case LL_VERBOSE: alp = ANDROID_LOG_DEBUG;   break;
+        case LL_DEBUG:   alp = ANDROID_LOG_VERBOSE; break;
+        case LL_INFO:    alp = ANDROID_LOG_INFO;    break;
+        case LL_WARN:    alp = ANDROID_LOG_WARN;    break;
+        case LL_ERROR:   alp = ANDROID_LOG_ERROR;   break;
+        case LL_FATAL:   alp = ANDROID_LOG_FATAL;   break;
+        default:         alp = ANDROID_LOG_FATAL;
+        }
+        __android_log_print(alp, "SuperTuxKart", "%s", line);
+#else
+        printf("%s", line);
+#endif
+    }
+    resetTerminalColor();  // this prints a \n
+}   // writeConsoleLine
+
 // ----------------------------------------------------------------------------
 /** Writes the specified line to the various output devices, e.g. terminal,
  *  log file etc. If log messages are not redirected to a file, it tries to
@@ -221,39 +420,14 @@ void Log::writeLine(const char *line, int level)
     // If we don't have a console file, write to stdout and hope for the best
     if (m_buffer_size <= 1 || !m_file_stdout)
     {
-        setTerminalColor((LogLevel)level);
-        if (m_console_log)
-        {
-#ifdef ANDROID
-            android_LogPriority alp;
-            switch (level)
-            {
-                // STK is using the levels slightly different from android
-                // (debug lowest, verbose above it; while android reverses
-                // this order. So to get the same behaviour (e.g. filter
-                // out debug message, but still get verbose, we swap
-                // the order here.
-            case LL_VERBOSE: alp = ANDROID_LOG_DEBUG;   break;
-            case LL_DEBUG:   alp = ANDROID_LOG_VERBOSE; break;
-            case LL_INFO:    alp = ANDROID_LOG_INFO;    break;
-            case LL_WARN:    alp = ANDROID_LOG_WARN;    break;
-            case LL_ERROR:   alp = ANDROID_LOG_ERROR;   break;
-            case LL_FATAL:   alp = ANDROID_LOG_FATAL;   break;
-            default:         alp = ANDROID_LOG_FATAL;
-            }
-            __android_log_print(alp, "SuperTuxKart", "%s", line);
-#else
-            printf("%s", line);
-#endif
-        }
-        resetTerminalColor();  // this prints a \n
+        writeConsoleLine(line, level);
     }
 
 #if defined(_MSC_FULL_VER) && defined(_DEBUG)
     if (m_buffer_size <= 1) OutputDebugString(line);
 #endif
 
-    if (m_file_stdout) fprintf(m_file_stdout, "%s", line);
+    if (m_file_stdout && !g_binary_file) fprintf(m_file_stdout, "%s", line);
 
 #ifdef WIN32
     if (level >= LL_FATAL)
@@ -269,11 +443,274 @@ void Log::toggleConsoleLog(bool val)
     m_console_log = val;
 }   // toggleConsoleLog
 
+// ----------------------------------------------------------------------------
+/** The main loop of the writer thread: it takes all lines from the queue,
+ *  writes them to the console, and writes them to the log file with one
+ *  write per batch. Then it waits until a line is queued if the queue was
+ *  empty.
+ */
+void Log::writerThread()
+{
+    VS::setThreadName("Log");
+
+    struct RateInfo
+    {
+        uint64_t m_second;
+        unsigned m_count;
+        unsigned m_suppressed;
+    };
+    std::map<std::string, RateInfo> rates;
+    std::map<std::string, uint16_t> component_ids;
+    std::string file_data, line;
+
+    auto write_entry = [&](int level, const std::string &component,
+                           const std::string &prefix, std::time_t time,
+                           const std::string &message)
+    {
+        const bool text_file = m_file_stdout && !g_binary_file;
+        if (m_console_log || text_file || level == LL_FATAL)
+        {
+            line.clear();
+            if (!prefix.empty())
+                line.append(prefix).append(" ");
+            if (time != 0)
+                line.append(std::asctime(std::localtime(&time)), 24)
+                    .append(" ");
+            line.append("[").append(g_level_names[level]).append("] ")
+                .append(component).append(": ").append(message)
+                .append("\n");
+            writeConsoleLine(line.c_str(), level);
+            if (text_file)
+                file_data.append(line);
+#ifdef WIN32
+            if (level >= LL_FATAL)
+            {
+                MessageBoxA(NULL, line.c_str(), "SuperTuxKart - Fatal error",
+                            MB_OK);
+            }
+#endif
+        }
+        if (!m_file_stdout || !g_binary_file)
+            return;
+
+        // Components are written once with an id used by all later lines
+        auto it = component_ids.find(component);
+        if (it == component_ids.end())
+        {
+            it = component_ids.emplace(component,
+                (uint16_t)component_ids.size()).first;
+            file_data.push_back(0);
+            appendUInt(&file_data, it->second, 2);
+            appendUInt(&file_data, component.size(), 1);
+            file_data.append(component);
+        }
+        const size_t prefix_size = std::min<size_t>(prefix.size(), 255);
+        file_data.push_back(1);
+        appendUInt(&file_data, level, 1);
+        appendUInt(&file_data, it->second, 2);
+        appendUInt(&file_data, time, 8);
+        appendUInt(&file_data, prefix_size, 1);
+        file_data.append(prefix, 0, prefix_size);
+        appendUInt(&file_data, message.size(), 2);
+        file_data.append(message);
+    };   // write_entry
+
+    while (true)
+    {
+        // Read before emptying the queue, so all lines queued before
+        // stopping are written
+        const bool stop = g_writer_stop.load();
+        const uint64_t second = StkTime::getMonoTimeMs() / 1000;
+        size_t count = 0;
+        while (true)
+        {
+            QueueEntry *entry = &g_queue[g_dequeue_pos & (QUEUE_SIZE - 1)];
+            if (entry->m_sequence.load(std::memory_order_acquire) !=
+                g_dequeue_pos + 1)
+                break;
+            count++;
+            bool suppressed = false;
+            if (g_rate_limit > 0 && entry->m_level < LL_WARN)
+            {
+                auto it = rates.find(entry->m_component);
+                if (it == rates.end())
+                {
+                    it = rates.emplace(entry->m_component,
+                                       RateInfo{second, 0, 0}).first;
+                }
+                if (it->second.m_second != second)
+                {
+                    it->second.m_second = second;
+                    it->second.m_count  = 0;
+                }
+                if (++it->second.m_count > g_rate_limit)
+                {
+                    it->second.m_suppressed++;
+                    suppressed = true;
+                }
+            }
+            if (!suppressed)
+            {
+                write_entry(entry->m_level, entry->m_component,
+                            entry->m_prefix, entry->m_time,
+                            entry->m_message);
+            }
+            entry->m_sequence.store(g_dequeue_pos + QUEUE_SIZE,
+                                    std::memory_order_release);
+            g_dequeue_pos++;
+        }
+
+        for (auto &r : rates)
+        {
+            if (r.second.m_suppressed == 0 ||
+                (r.second.m_second == second && !stop))
+                continue;
+            write_entry(LL_WARN, "Log", "", 0, StringUtils::insertValues(
+                "%d lines of %s were suppressed in one second.",
+                r.second.m_suppressed, r.first.c_str()));
+            r.second.m_suppressed = 0;
+        }
+        const size_t dropped = g_dropped.exchange(0);
+        if (dropped > 0)
+        {
+            write_entry(LL_WARN, "Log", "", 0, StringUtils::insertValues(
+                "Log queue full, %d lines were dropped.", (int)dropped));
+        }
+
+        if (!file_data.empty())
+        {
+            fwrite(file_data.data(), 1, file_data.size(), m_file_stdout);
+            fflush(m_file_stdout);
+            file_data.clear();
+        }
+        if (m_console_log)
+            fflush(stdout);
+        g_written_pos.store(g_dequeue_pos, std::memory_order_release);
+
+        if (stop)
+            break;
+        if (count > 0)
+            continue;
+
+        std::unique_lock<std::mutex> lock(g_writer_mutex);
+        g_writer_sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        QueueEntry *entry = &g_queue[g_dequeue_pos & (QUEUE_SIZE - 1)];
+        if (entry->m_sequence.load(std::memory_order_acquire) !=
+            g_dequeue_pos + 1 && !g_writer_stop.load())
+        {
+            bool suppressed = false;
+            for (auto &r : rates)
+                suppressed = suppressed || r.second.m_suppressed > 0;
+            // Report suppressed lines once their second is over
+            if (suppressed)
+                g_writer_cv.wait_for(lock, std::chrono::seconds(1));
+            else
+                g_writer_cv.wait(lock);
+        }
+        g_writer_sleeping.store(false, std::memory_order_relaxed);
+    }
+}   // writerThread
+
+// ----------------------------------------------------------------------------
+/** Starts a thread that writes all log messages, so that the threads logging
+ *  only need to format the message and add it to a lock-free queue. This
+ *  is meant for servers, where the network and game threads should not
+ *  wait for the console or the log file.
+ *  \param binary_file If true, the log file is replaced by a file using a
+ *         compact binary format (with .bin added to its name), which can be
+ *         converted to text with tools/decode_log.py.
+ */
+void Log::startWriterThread(bool binary_file)
+{
+    if (g_writer_thread.joinable())
+        return;
+
+    if (!g_queue)
+    {
+        g_queue = new QueueEntry[QUEUE_SIZE];
+        for (size_t i = 0; i < QUEUE_SIZE; i++)
+            g_queue[i].m_sequence.store(i);
+        // Writes the remaining lines when exit() is called
+        atexit(stopWriterThread);
+    }
+
+    if (binary_file && !m_file_stdout)
+    {
+        Log::warn("Log", "No log file, binary log file is not used.");
+    }
+    else if (binary_file)
+    {
+        std::string name = g_file_name + ".bin";
+        FILE *f = fopen(name.c_str(), "wb");
+        if (!f)
+        {
+            Log::error("Log", "Can not open binary log file '%s'.",
+                       name.c_str());
+        }
+        else
+        {
+            Log::info("Log", "Log messages will be written to %s.",
+                      name.c_str());
+            fclose(m_file_stdout);
+            m_file_stdout = f;
+            g_binary_file = true;
+            // Magic and version of the format
+            fwrite("STKLOG\0\1", 1, 8, m_file_stdout);
+        }
+    }
+
+    g_writer_stop.store(false);
+    g_writer_thread = std::thread(&Log::writerThread);
+    g_writer_running.store(true);
+}   // startWriterThread
+
+// ----------------------------------------------------------------------------
+/** Stops the writer thread after all queued lines are written. Later lines
+ *  are written directly again (to the console only if the log file is
+ *  binary).
+ */
+void Log::stopWriterThread()
+{
+    if (!g_writer_thread.joinable())
+        return;
+    g_writer_running.store(false);
+    // Threads which are still queueing a line (possibly waiting for room in
+    // the queue) need the writer thread to finish it
+    while (g_writer_producers.load() > 0)
+        std::this_thread::yield();
+    {
+        std::lock_guard<std::mutex> lock(g_writer_mutex);
+        g_writer_stop.store(true);
+        g_writer_cv.notify_one();
+    }
+    g_writer_thread.join();
+}   // stopWriterThread
+
+// ----------------------------------------------------------------------------
+/** Sets the maximum number of lines below warning level written per second
+ *  for each component by the writer thread, 0 disables the limit. The
+ *  number of suppressed lines is logged afterwards.
+ */
+void Log::setRateLimit(unsigned n)
+{
+    g_rate_limit = n;
+}   // setRateLimit
+
 // ----------------------------------------------------------------------------
 /** Flushes all stored log messages to the various output devices (thread safe).
+ *  If the writer thread is used, this waits until it has written all lines
+ *  queued so far.
  */
 void Log::flushBuffers()
 {
+    if (g_writer_running.load())
+    {
+        const size_t pos = g_enqueue_pos.load();
+        while (g_written_pos.load() < pos && g_writer_running.load())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
     m_line_buffer.lock();
     for (unsigned int i = 0; i < m_line_buffer.getData().size(); i++)
     {
@@ -291,6 +728,7 @@ void Log::flushBuffers()
  */
 void Log::openOutputFiles(const std::string &logout)
 {
+    g_file_name = logout;
     m_file_stdout = fopen(logout.c_str(), "w");
     if (!m_file_stdout)
     {
@@ -308,6 +746,7 @@ void Log::openOutputFiles(const std::string &logout)
 /** Function to close output files */
 void Log::closeOutputFiles()
 {
+    stopWriterThread();
     fclose(m_file_stdout);
 } // closeOutputFiles
 
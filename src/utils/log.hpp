@@ -83,7 +83,9 @@ private:
 
     static void setTerminalColor(LogLevel level);
     static void resetTerminalColor();
+    static void writeConsoleLine(const char *line, int level);
     static void writeLine(const char *line, int level);
+    static void writerThread();
 
     static void printMessage(int level, const char *component,
                              const char *format, VALIST va_list);
@@ -121,6 +123,9 @@ public:
     static void closeOutputFiles();
     static void flushBuffers();
     static void toggleConsoleLog(bool val);
+    static void startWriterThread(bool binary_file);
+    static void stopWriterThread();
+    static void setRateLimit(unsigned n);
 
     // ------------------------------------------------------------------------
     /** Sets the number of lines to buffer. Setting the buffer size to a 
@@ -75,10 +75,19 @@ Profiler profiler;
 #endif
 // --- End portable precise timer ---
 
+// Number of events in the ring buffer of each thread, must be a power of 2
+#define RING_SIZE    16384
+// Pushes are dropped when less than this number of events can be added to
+// a ring buffer, so that the pops of already recorded events still fit
+#define RING_HEADROOM   64
+
+thread_local Profiler::ThreadData* Profiler::m_this_thread_data = NULL;
+
 //-----------------------------------------------------------------------------
 Profiler::Profiler()
 {
     m_time_last_sync      = getTimeMilliseconds();
+    m_time_start          = m_time_last_sync;
     m_time_between_sync   = 0.0;
     m_freeze_state        = UNFROZEN;
 
@@ -88,12 +97,13 @@ Profiler::Profiler()
     m_max_frames          = 20 * 120;
     m_current_frame       = 0;
     m_has_wrapped_around  = false;
-    m_threads_used = 1;
 }   // Profile
 
 //-----------------------------------------------------------------------------
 Profiler::~Profiler()
 {
+    for (unsigned int i = 0; i < m_all_threads_data.size(); i++)
+        delete m_all_threads_data[i];
 }   // ~Profiler
 
 //-----------------------------------------------------------------------------
@@ -102,41 +112,110 @@ Profiler::~Profiler()
  *  graphics). */
 void Profiler::init()
 {
-    const int MAX_THREADS = 10;
-    m_all_threads_data.resize(MAX_THREADS);
-    m_thread_mapping.resize(MAX_THREADS);
-
-    // Add this thread to the thread mapping
-    m_thread_mapping[0] = pthread_self();
     m_gpu_times.resize(Q_LAST * m_max_frames);
+    m_frame_start.resize(m_max_frames);
+    m_frame_start[m_current_frame] = m_time_last_sync;
+
+    // Register this thread first, so that the main thread is drawn at the
+    // top and has thread id 0.
+    ThreadData* td = getThreadData();
+    m_lock.lock();
+    td->m_name = "Main";
+    m_lock.unlock();
 }   // init
 
 //-----------------------------------------------------------------------------
-/** Returns a unique index for a thread. If the calling thread is not yet in
- *  the mapping, it will assign a new unique id to this thread. This function
- *  is NOT thread-safe and must be called from a properly protected code
- *  section. */
-int Profiler::getThreadID()
+/** Returns the data of the calling thread. If the calling thread did not
+ *  use the profiler before, its data is created and gets the next thread id.
+ *  Only the first call in each thread needs the lock.
+ */
+Profiler::ThreadData* Profiler::getThreadData()
 {
-    pthread_t thread = pthread_self();
-    int i = 0;
-    while(i < m_threads_used)
+    if (m_this_thread_data)
+        return m_this_thread_data;
+
+    ThreadData* td = new ThreadData();
+    td->m_ring.resize(RING_SIZE);
+
+    m_lock.lock();
+    td->m_thread_id = (int)m_all_threads_data.size();
+    td->m_name = "Thread " + StringUtils::toString(td->m_thread_id);
+#if defined(__linux__) && defined(__GLIBC__) && defined(__GLIBC_MINOR__)
+#if __GLIBC__ > 2 || __GLIBC_MINOR__ > 11
+    // Use the name set by VS::setThreadName if there is one
+    char name[64];
+    if (pthread_getname_np(pthread_self(), name, sizeof(name)) == 0 &&
+        name[0] != 0)
+        td->m_name = name;
+#endif
+#endif
+    m_all_threads_data.push_back(td);
+    m_lock.unlock();
+
+    m_this_thread_data = td;
+    return td;
+}   // getThreadData
+
+//-----------------------------------------------------------------------------
+/** Returns the event id for a marker name. The name pointers are cached in
+ *  each thread, so the lock is only needed the first time a thread uses a
+ *  name.
+ */
+int Profiler::getEventID(ThreadData* td, const char* name,
+                         const video::SColor& colour)
+{
+    std::unordered_map<const char*, int>::const_iterator p =
+        td->m_event_id_by_name_pointer.find(name);
+    if (p != td->m_event_id_by_name_pointer.end())
+        return p->second;
+
+    m_lock.lock();
+    int event_id;
+    std::map<std::string, int>::const_iterator i = m_event_ids.find(name);
+    if (i == m_event_ids.end())
     {
-        if (memcmp( &m_thread_mapping[i],
-                    &thread,
-                    sizeof(thread)) ==0 )
-        {
-            return i;
-        }
-        i++;
-    }   // for i <m_threads_used
+        event_id = (int)m_event_names.size();
+        m_event_ids[name] = event_id;
+        m_event_names.push_back(name);
+        m_event_colours.push_back(colour);
+    }
+    else
+        event_id = i->second;
+    m_lock.unlock();
 
-    assert(m_threads_used < (int)m_thread_mapping.size());
-    m_thread_mapping[m_threads_used] = thread;
-    m_threads_used++;
+    td->m_event_id_by_name_pointer[name] = event_id;
+    return event_id;
+}   // getEventID
 
-    return m_threads_used - 1;
-}   // getThreadID
+//-----------------------------------------------------------------------------
+/** Adds a push (event_id >= 0) or pop (event_id = -1) to the ring buffer of
+ *  a thread. This is only called by the thread owning the buffer, and does
+ *  not lock.
+ */
+void Profiler::addRawEvent(ThreadData* td, int event_id, double time)
+{
+    uint32_t write = td->m_write_index.load(std::memory_order_relaxed);
+    uint32_t used  = write - td->m_read_index.load(std::memory_order_acquire);
+    if (td->m_skipped_depth > 0 ||
+        (event_id >= 0 && used > RING_SIZE - RING_HEADROOM))
+    {
+        // The ring buffer is (nearly) full because the events are not
+        // processed quickly enough. Skip this event, and if it is a push
+        // all events nested in it and its pop.
+        if (event_id >= 0)
+            td->m_skipped_depth++;
+        else
+            td->m_skipped_depth--;
+        return;
+    }
+    if (used >= RING_SIZE)
+        return;
+
+    RawEvent &e = td->m_ring[write & (RING_SIZE - 1)];
+    e.m_time     = time;
+    e.m_event_id = event_id;
+    td->m_write_index.store(write + 1, std::memory_order_release);
+}   // addRawEvent
 
 //-----------------------------------------------------------------------------
 /// Push a new marker that starts now
@@ -147,31 +226,8 @@ void Profiler::pushCPUMarker(const char* name, const video::SColor& colour)
          m_freeze_state == FROZEN || m_freeze_state == WAITING_FOR_UNFREEZE )
         return;
 
-    // We need to look before getting the thread id (since this might
-    // be a new thread which changes the structure).
-    m_lock.lock();
-    int thread_id = getThreadID();
-
-    ThreadData &td = m_all_threads_data[thread_id];
-    AllEventData::iterator i = td.m_all_event_data.find(name);
-    double  start = getTimeMilliseconds() - m_time_last_sync;
-    if (i != td.m_all_event_data.end())
-    {
-        i->second.setStart(m_current_frame, start, (int)td.m_event_stack.size());
-    }
-    else
-    {
-        EventData ed(colour, m_max_frames);
-        ed.setStart(m_current_frame, start, (int)td.m_event_stack.size());
-        td.m_all_event_data[name] = ed;
-        // Ordered headings is used to determine the order in which the
-        // bar graph is drawn. Outer profiling events will be added first,
-        // so they will be drawn first, which gives the proper nested
-        // displayed of events.
-        td.m_ordered_headings.push_back(name);
-    }
-    td.m_event_stack.push_back(name);
-    m_lock.unlock();
+    ThreadData* td = getThreadData();
+    addRawEvent(td, getEventID(td, name, colour), getTimeMilliseconds());
 }   // pushCPUMarker
 
 //-----------------------------------------------------------------------------
@@ -182,29 +238,71 @@ void Profiler::popCPUMarker()
     if( !UserConfigParams::m_profiler_enabled ||
         m_freeze_state == FROZEN || m_freeze_state == WAITING_FOR_UNFREEZE )
         return;
-    double now = getTimeMilliseconds();
 
-    m_lock.lock();
-    int thread_id = getThreadID();
-    ThreadData &td = m_all_threads_data[thread_id];
+    addRawEvent(getThreadData(), -1, getTimeMilliseconds());
+}   // popCPUMarker
 
-    // When the profiler gets enabled (which happens in the middle of the
-    // main loop), there can be some pops without matching pushes (for one
-    // frame) - ignore those events.
-    if (td.m_event_stack.size() == 0)
+//-----------------------------------------------------------------------------
+/** Processes all events recorded in the ring buffers up to the given time,
+ *  and adds them to the markers of the current frame and to the trace.
+ *  Events recorded later are left in the ring buffers, so that they are
+ *  added to the next frame. This must be called with m_lock held.
+ *  \param now Time (in ms) up to which the events are processed.
+ */
+void Profiler::processEvents(double now)
+{
+    for (unsigned int i = 0; i < m_all_threads_data.size(); i++)
     {
-        m_lock.unlock();
-        return;
-    }
-
-    assert(td.m_event_stack.size() > 0);
-
-    const std::string &name = td.m_event_stack.back();
-    td.m_all_event_data[name].setEnd(m_current_frame, now - m_time_last_sync);
-
-    td.m_event_stack.pop_back();
-    m_lock.unlock();
-}   // popCPUMarker
+        ThreadData* td = m_all_threads_data[i];
+        uint32_t read  = td->m_read_index.load(std::memory_order_relaxed);
+        uint32_t write = td->m_write_index.load(std::memory_order_acquire);
+        while (read != write)
+        {
+            const RawEvent &e = td->m_ring[read & (RING_SIZE - 1)];
+            if (e.m_time > now)
+                break;
+            if (e.m_event_id >= 0)
+            {
+                if (e.m_event_id >= (int)td->m_all_event_data.size())
+                    td->m_all_event_data.resize(e.m_event_id + 1);
+                EventData &ed = td->m_all_event_data[e.m_event_id];
+                if (!ed.hasMarkers())
+                {
+                    ed = EventData(m_event_colours[e.m_event_id],
+                                   m_max_frames);
+                    // Ordered headings is used to determine the order in
+                    // which the bar graph is drawn. Outer profiling events
+                    // will be added first, so they will be drawn first,
+                    // which gives the proper nested displayed of events.
+                    td->m_ordered_headings.push_back(e.m_event_id);
+                }
+                ed.setStart(m_current_frame, e.m_time - m_time_last_sync,
+                            (int)td->m_event_stack.size());
+                OpenEvent oe;
+                oe.m_event_id = e.m_event_id;
+                oe.m_start    = e.m_time;
+                td->m_event_stack.push_back(oe);
+            }
+            // When the profiler gets enabled (which happens in the middle of
+            // the main loop), there can be some pops without matching pushes
+            // (for one frame) - ignore those events.
+            else if (!td->m_event_stack.empty())
+            {
+                const OpenEvent &oe = td->m_event_stack.back();
+                td->m_all_event_data[oe.m_event_id]
+                    .setEnd(m_current_frame, e.m_time - m_time_last_sync);
+                TraceEvent te;
+                te.m_start    = oe.m_start;
+                te.m_duration = e.m_time - oe.m_start;
+                te.m_event_id = oe.m_event_id;
+                td->m_trace.push_back(te);
+                td->m_event_stack.pop_back();
+            }
+            read++;
+        }   // while read != write
+        td->m_read_index.store(read, std::memory_order_release);
+    }   // for i in threads
+}   // processEvents
 
 //-----------------------------------------------------------------------------
 /** Switches the profiler either on or off.
@@ -238,6 +336,8 @@ void Profiler::synchronizeFrame()
     double now = getTimeMilliseconds();
 
     m_lock.lock();
+    processEvents(now);
+
     // Set index to next frame
     int next_frame = m_current_frame+1;
     if (next_frame >= m_max_frames)
@@ -249,13 +349,14 @@ void Profiler::synchronizeFrame()
     // First finish all markers that are currently in progress, and add
     // a new start marker for the next frame. So e.g. if a thread is busy in
     // one event while the main thread syncs the frame, this event will get
-    // split into two parts in two consecutive frames
-    for (int i = 0; i < m_threads_used; i++)
+    // split into two parts in two consecutive frames. The trace keeps the
+    // start time, so the event is not split there.
+    for (unsigned int i = 0; i < m_all_threads_data.size(); i++)
     {
-        ThreadData &td = m_all_threads_data[i];
-        for(unsigned int j=0; j<td.m_event_stack.size(); j++)
+        ThreadData* td = m_all_threads_data[i];
+        for(unsigned int j=0; j<td->m_event_stack.size(); j++)
         {
-            EventData &ed = td.m_all_event_data[td.m_event_stack[j]];
+            EventData &ed = td->m_all_event_data[td->m_event_stack[j].m_event_id];
             ed.setEnd(m_current_frame, now-m_time_last_sync);
             ed.setStart(next_frame, 0, j);
         }   // for j in event stack
@@ -266,16 +367,28 @@ void Profiler::synchronizeFrame()
         // The new entries for the circular buffer need to be cleared
         // to make sure the new values are not accumulated on top of
         // the data from a previous frame.
-        for (int i = 0; i < m_threads_used; i++)
+        for (unsigned int i = 0; i < m_all_threads_data.size(); i++)
         {
-            ThreadData &td = m_all_threads_data[i];
-            AllEventData &aed = td.m_all_event_data;
-            AllEventData::iterator k;
-            for (k = aed.begin(); k != aed.end(); ++k)
-                k->second.getMarker(next_frame).clear();
+            ThreadData* td = m_all_threads_data[i];
+            for (unsigned int k = 0; k < td->m_ordered_headings.size(); k++)
+            {
+                td->m_all_event_data[td->m_ordered_headings[k]]
+                    .getMarker(next_frame).clear();
+            }
+        }
+
+        // Remove the events of the frame which is overwritten from the
+        // trace, so it covers the same frames as the markers.
+        double oldest = m_frame_start[(next_frame + 1) % m_max_frames];
+        for (unsigned int i = 0; i < m_all_threads_data.size(); i++)
+        {
+            std::deque<TraceEvent> &trace = m_all_threads_data[i]->m_trace;
+            while (!trace.empty() && trace.front().m_start < oldest)
+                trace.pop_front();
         }
     }   // is has wrapped around
 
+    m_frame_start[next_frame] = now;
     m_current_frame = next_frame;
 
     // Remember the date of last synchronization
@@ -299,12 +412,20 @@ void Profiler::draw()
     PROFILER_PUSH_CPU_MARKER("ProfilerDraw", 0xFF, 0xFF, 0x00);
     video::IVideoDriver*    driver = irr_driver->getVideoDriver();
 
+    // Use this thread to compute start and end time. All other
+    // threads might have 'unfinished' events, or multiple identical events
+    // in this frame (i.e. start time would be incorrect).
+    int thread_id = getThreadData()->m_thread_id;
+
+    // The lock is kept while drawing, since other threads can add new
+    // threads and event names.
+    m_lock.lock();
+
     // Current frame points to the frame in which currently data is
     // being accumulated. Draw the previous (i.e. complete) frame.
-    m_lock.lock();
     int indx = m_current_frame - 1;
     if (indx < 0) indx = m_max_frames - 1;
-    m_lock.unlock();
+    int threads_used = (int)m_all_threads_data.size();
 
     drawBackground();
 
@@ -324,18 +445,14 @@ void Profiler::draw()
     double start = 99999.0f;
     double end   = -1.0f;
 
-    // Use this thread to compute start and end time. All other
-    // threads might have 'unfinished' events, or multiple identical events
-    // in this frame (i.e. start time would be incorrect).
-    int thread_id = getThreadID();
-    AllEventData &aed = m_all_threads_data[thread_id].m_all_event_data;
-    AllEventData::iterator j;
-    for (j = aed.begin(); j != aed.end(); ++j)
+    const ThreadData* this_td = m_all_threads_data[thread_id];
+    for (unsigned int k = 0; k < this_td->m_ordered_headings.size(); k++)
     {
-        const Marker &marker = j->second.getMarker(indx);
+        const Marker &marker = this_td->m_all_event_data
+                             [this_td->m_ordered_headings[k]].getMarker(indx);
         start = std::min(start, marker.getStart());
         end = std::max(end, marker.getEnd());
-    }   // for j in events
+    }   // for k in events
 
 
     const double duration = end - start;
@@ -344,21 +461,22 @@ void Profiler::draw()
     // Get the mouse pos
     core::vector2di mouse_pos = GUIEngine::EventHandler::get()->getMousePos();
 
-    std::stack<AllEventData::iterator> hovered_markers;
-    for (int i = 0; i < m_threads_used; i++)
+    // Stores thread id and event id of the hovered markers
+    std::stack<std::pair<int, int> > hovered_markers;
+    for (int i = 0; i < threads_used; i++)
     {
-        ThreadData &td = m_all_threads_data[i];
-        AllEventData &aed = td.m_all_event_data;
+        const ThreadData* td = m_all_threads_data[i];
 
         // Thread 1 has 'proper' start and end events (assuming that each
         // event is at most called once). But all other threads might have
         // multiple start and end events, so the recorder start time is only
         // of the last event and so can not be used to draw the bar graph
         double start_xpos = 0;
-        for(int k=0; k<(int)td.m_ordered_headings.size(); k++)
+        for(int k=0; k<(int)td->m_ordered_headings.size(); k++)
         {
-            AllEventData::iterator j = aed.find(td.m_ordered_headings[k]);
-            const Marker &marker = j->second.getMarker(indx);
+            int event_id = td->m_ordered_headings[k];
+            const EventData &ed = td->m_all_event_data[event_id];
+            const Marker &marker = ed.getMarker(indx);
             if (i == thread_id)
                 start_xpos = factor*marker.getStart();
             core::rect<s32> pos((s32)(x_offset + start_xpos),
@@ -373,21 +491,21 @@ void Profiler::draw()
             pos.UpperLeftCorner.Y  += 2 * (int)marker.getLayer();
             pos.LowerRightCorner.Y -= 2 * (int)marker.getLayer();
 
-            GL32_draw2DRectangle(j->second.getColour(), pos);
+            GL32_draw2DRectangle(ed.getColour(), pos);
             // If the mouse cursor is over the marker, get its information
             if (pos.isPointInside(mouse_pos))
             {
-                hovered_markers.push(j);
+                hovered_markers.push(std::make_pair(i, event_id));
             }
 
-        }   // for j in AllEventdata
+        }   // for k in ordered headings
     }   // for i in threads
 
 
     // GPU profiler
     QueryPerf hovered_gpu_marker = Q_LAST;
     long hovered_gpu_marker_elapsed = 0;
-    int gpu_y = int(y_offset + m_threads_used*line_height + line_height/2);
+    int gpu_y = int(y_offset + threads_used*line_height + line_height/2);
     float total = 0;
     for (unsigned i = 0; i < Q_LAST; i++)
     {
@@ -438,7 +556,7 @@ void Profiler::draw()
     {
         s32 x_sync = (s32)(x_offset + factor*m_time_between_sync);
         s32 y_up_sync = (s32)(MARGIN_Y*screen_size.Height);
-        s32 y_down_sync = (s32)( (MARGIN_Y + (2+m_threads_used)*LINE_HEIGHT)
+        s32 y_down_sync = (s32)( (MARGIN_Y + (2+threads_used)*LINE_HEIGHT)
                                 * screen_size.Height                         );
 
         GL32_draw2DRectangle(video::SColor(0xFF, 0x00, 0x00, 0x00),
@@ -453,11 +571,13 @@ void Profiler::draw()
         core::stringw text;
         while(!hovered_markers.empty())
         {
-            AllEventData::iterator j = hovered_markers.top();
-            const Marker &marker = j->second.getMarker(indx);
+            int thread = hovered_markers.top().first;
+            int event_id = hovered_markers.top().second;
+            const Marker &marker = m_all_threads_data[thread]
+                                 ->m_all_event_data[event_id].getMarker(indx);
             std::ostringstream oss;
             oss.precision(4);
-            oss << j->first << " [" << (marker.getDuration()) << " ms / ";
+            oss << m_event_names[event_id] << " [" << (marker.getDuration()) << " ms / ";
             oss.precision(3);
             oss << marker.getDuration()*100.0 / duration << "%]" << std::endl;
             text += oss.str().c_str();
@@ -474,6 +594,7 @@ void Profiler::draw()
                        video::SColor(0xFF, 0xFF, 0x00, 0x00));
         }
     }
+    m_lock.unlock();
 
     PROFILER_POP_CPU_MARKER();
 #endif
@@ -534,38 +655,70 @@ void Profiler::drawBackground()
 }   // drawBackground
 
 //-----------------------------------------------------------------------------
-/** Saves the collected profile data to a file. Filename is based on the
- *  stdout name (with -profile appended).
+/** Returns the string quoted and escaped for a JSON file. */
+static std::string toJSONString(const std::string& s)
+{
+    std::string result = "\"";
+    for (unsigned int i = 0; i < s.size(); i++)
+    {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\')
+        {
+            result += '\\';
+            result += c;
+        }
+        else if (c < 0x20)
+        {
+            char hex[8];
+            snprintf(hex, sizeof(hex), "\\u%04x", c);
+            result += hex;
+        }
+        else
+            result += c;
+    }
+    result += '"';
+    return result;
+}   // toJSONString
+
+//-----------------------------------------------------------------------------
+/** Saves the collected profile data to files. Filenames are based on the
+ *  stdout name. The CPU markers of all threads of the buffered frames are
+ *  written (with .profile.json appended) in the trace event format, which
+ *  can be opened with chrome://tracing or https://ui.perfetto.dev. The GPU
+ *  times are written with .profile-gpu appended.
  */
 void Profiler::writeToFile()
 {
     m_lock.lock();
+    processEvents(getTimeMilliseconds());
     std::string base_name =
                file_manager->getUserConfigFile(file_manager->getStdoutName());
     // First CPU data
-    for (int thread_id = 0; thread_id < m_threads_used; thread_id++)
+    std::ofstream f(base_name + ".profile.json");
+    f.setf(std::ios::fixed, std::ios::floatfield);
+    f.precision(3);
+    f << "{\"traceEvents\":[";
+    bool first = true;
+    for (unsigned int i = 0; i < m_all_threads_data.size(); i++)
     {
-        std::ofstream f(base_name + ".profile-cpu-" +
-                        StringUtils::toString(thread_id) );
-        ThreadData &td = m_all_threads_data[thread_id];
-        f << "#  ";
-        for (unsigned int i = 0; i < td.m_ordered_headings.size(); i++)
-            f << "\"" << td.m_ordered_headings[i] << "(" << i+1 <<")\"   ";
-        f << std::endl;
-        int start = m_has_wrapped_around ? m_current_frame + 1 : 0;
-        if (start > m_max_frames) start -= m_max_frames;
-        while (start != m_current_frame)
+        const ThreadData* td = m_all_threads_data[i];
+        f << (first ? "\n" : ",\n")
+          << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+          << td->m_thread_id << ",\"args\":{\"name\":"
+          << toJSONString(td->m_name) << "}}";
+        first = false;
+        for (unsigned int j = 0; j < td->m_trace.size(); j++)
         {
-            for (unsigned int i = 0; i < td.m_ordered_headings.size(); i++)
-            {
-                const EventData &ed = td.m_all_event_data[td.m_ordered_headings[i]];
-                f << int(ed.getMarker(start).getDuration()*1000) << " ";
-            }   // for i i new_headings
-            f << std::endl;
-            start = (start + 1) % m_max_frames;
-        }   // while start != m_current_frame
-        f.close();
-    }   // for all thread_ids
+            // Times in the trace are in microseconds
+            const TraceEvent &te = td->m_trace[j];
+            f << ",\n{\"name\":" << toJSONString(m_event_names[te.m_event_id])
+              << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << td->m_thread_id
+              << ",\"ts\":" << (te.m_start - m_time_start) * 1000.0
+              << ",\"dur\":" << te.m_duration * 1000.0 << "}";
+        }   // for j in trace
+    }   // for i in threads
+    f << "\n],\"displayTimeUnit\":\"ms\"}" << std::endl;
+    f.close();
 
     std::ofstream f_gpu(base_name + ".profile-gpu");
     f_gpu << "# ";
@@ -590,4 +743,28 @@ void Profiler::writeToFile()
     f_gpu.close();
     m_lock.unlock();
 
-}   // writeFile
+}   // writeToFile
+
+//-----------------------------------------------------------------------------
+/** Returns the accumulated time (in ms) of each event since the profiler was
+ *  enabled, added up over all threads. Unlike the markers these times are not
+ *  limited to the buffered frames, so they can be used for long runs.
+ *  \param times On return contains the total time for each event name.
+ */
+void Profiler::getTotalTimes(std::map<std::string, double>* times)
+{
+    times->clear();
+    m_lock.lock();
+    processEvents(getTimeMilliseconds());
+    for (unsigned int i = 0; i < m_all_threads_data.size(); i++)
+    {
+        const ThreadData* td = m_all_threads_data[i];
+        for (unsigned int k = 0; k < td->m_ordered_headings.size(); k++)
+        {
+            int event_id = td->m_ordered_headings[k];
+            (*times)[m_event_names[event_id]] +=
+                td->m_all_event_data[event_id].getTotalTime();
+        }
+    }
+    m_lock.unlock();
+}   // getTotalTimes
@@ -24,6 +24,8 @@
 #include <pthread.h>
 
 #include <assert.h>
+#include <atomic>
+#include <deque>
 #include <iostream>
 #include <list>
 #include <map>
@@ -31,6 +33,7 @@
 #include <stack>
 #include <streambuf>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 enum QueryPerf
@@ -170,12 +173,17 @@ private:
         /** Vector of all buffered markers. */
         std::vector<Marker> m_all_markers;
 
+        /** Accumulated duration of all markers of this event, which is not
+         *  limited by the size of the buffer. */
+        double m_total_time;
+
     public:
-        EventData() {}
+        EventData() { m_total_time = 0; }
         EventData(video::SColor colour, int max_size)
         {
             m_all_markers.resize(max_size);
             m_colour = colour;
+            m_total_time = 0;
         }   // EventData
         // --------------------------------------------------------------------
         /** Records the start of an event for a given frame. */
@@ -189,6 +197,7 @@ private:
         void setEnd(size_t frame, double end)
         {
             assert(frame < m_all_markers.capacity());
+            m_total_time += end - m_all_markers[frame].getStart();
             m_all_markers[frame].setEnd(end);
         }   // setEnd
         // --------------------------------------------------------------------
@@ -198,48 +207,124 @@ private:
         /** Returns the colour for this event. */
         video::SColor getColour() const { return m_colour;  }
         // --------------------------------------------------------------------
+        /** Returns the accumulated duration of this event. */
+        double getTotalTime() const { return m_total_time; }
+        // --------------------------------------------------------------------
+        /** Returns if this event was recorded, i.e. if it has a buffer. */
+        bool hasMarkers() const { return !m_all_markers.empty(); }
+        // --------------------------------------------------------------------
     };   // EventData
 
     // ========================================================================
-    /** The mapping of event names to the corresponding EventData. */
-    typedef std::map<std::string, EventData> AllEventData;
+    /** A push or pop of a marker as recorded by the thread which called
+     *  pushCPUMarker or popCPUMarker. */
+    struct RawEvent
+    {
+        /** Time of the event in ms. */
+        double m_time;
+        /** Id of the pushed event, or -1 for a pop. */
+        int    m_event_id;
+    };   // RawEvent
+
+    // ========================================================================
+    /** A finished event in the trace which is written by writeToFile. */
+    struct TraceEvent
+    {
+        double m_start;
+        double m_duration;
+        int    m_event_id;
+    };   // TraceEvent
+
+    // ========================================================================
+    /** An event which is pushed but not popped yet. */
+    struct OpenEvent
+    {
+        int    m_event_id;
+        /** Start time of the event in ms, not relative to the last sync. */
+        double m_start;
+    };   // OpenEvent
+
     // ========================================================================
     struct ThreadData
     {
+        /** Index of this thread, which is used as thread id in the trace. */
+        int m_thread_id;
+
+        /** Name of the thread. */
+        std::string m_name;
+
+        /** Single producer single consumer ring buffer of the events
+         *  recorded by this thread. Only this thread writes to it, and the
+         *  events are processed by the thread calling synchronizeFrame. */
+        std::vector<RawEvent> m_ring;
+
+        /** Index of the next event written by this thread. */
+        std::atomic<uint32_t> m_write_index;
+
+        /** Index of the next event to be processed. */
+        std::atomic<uint32_t> m_read_index;
+
+        /** Number of pushes not recorded because the ring buffer was full,
+         *  whose pops must be skipped too. Only used by this thread. */
+        int m_skipped_depth;
+
+        /** Maps the name pointers used in pushCPUMarker to the event ids.
+         *  The names are string literals, so the pointers never change.
+         *  Only used by this thread. */
+        std::unordered_map<const char*, int> m_event_id_by_name_pointer;
+
+        /** The events of this thread indexed by event id. Entries for
+         *  events which never occurred in this thread have no markers. */
+        std::vector<EventData> m_all_event_data;
+
         /** Stack of events to detect nesting. */
-        std::vector< std::string > m_event_stack;
+        std::vector<OpenEvent> m_event_stack;
 
-        /** This stores the event names in the order in which they occur.
+        /** This stores the event ids in the order in which they occur.
         *  This means that 'outer' events occur here before any child
         *  events. This list is then used to determine the order in which the
         *  bar graphs are drawn, which results in the proper nesting of events.*/
-        std::vector<std::string> m_ordered_headings;
+        std::vector<int> m_ordered_headings;
 
-        AllEventData m_all_event_data;
+        /** Finished events of the buffered frames, oldest first. */
+        std::deque<TraceEvent> m_trace;
+
+        ThreadData() : m_write_index(0), m_read_index(0), m_skipped_depth(0)
+        {
+        }
     };   // class ThreadData
 
     // ========================================================================
 
-    /** Data structure containing all currently buffered markers. The index
-     *  is the thread id. */
-    std::vector< ThreadData> m_all_threads_data;
+    /** Data of all threads which used the profiler, the index is the
+     *  thread id. */
+    std::vector<ThreadData*> m_all_threads_data;
+
+    /** The data of the calling thread, NULL if it did not use the
+     *  profiler yet. */
+    static thread_local ThreadData* m_this_thread_data;
+
+    /** The names of all events, indexed by event id. */
+    std::vector<std::string> m_event_names;
+
+    /** The colours of all events, indexed by event id. */
+    std::vector<video::SColor> m_event_colours;
 
-    /** A mapping of thread_t pointers to a unique integer (starting from 0).*/
-    std::vector<pthread_t> m_thread_mapping;
+    /** Maps event names to event ids. */
+    std::map<std::string, int> m_event_ids;
 
     /** Buffer for the GPU times (in ms). */
     std::vector<int> m_gpu_times;
 
-    /** Counts the threads used, i.e. registered in m_thread_mapping. */
-    int m_threads_used;
+    /** Start time of each buffered frame (in ms). */
+    std::vector<double> m_frame_start;
 
     /** Index of the current frame in the buffer. */
     int m_current_frame;
 
-    /** We don't need the bool, but easiest way to get a lock for the whole
-     *  instance (since we need to avoid that a synch is done which changes
-     *  the current frame while another threaded uses this variable, or
-     *  while a new thread is added. */
+    /** Protects the event names, the list of threads, and all data which
+     *  is used to process the recorded events. It is not used when
+     *  markers are pushed or popped by a known thread. */
     Synchronised<bool> m_lock;
 
     /** True if the circular buffer has wrapped around. */
@@ -256,10 +341,9 @@ private:
     /** Time between now and last sync, used to scale the GUI bar. */
     double m_time_between_sync;
 
-    /** List of all event names. This list is sorted to make sure
-     *  if the circular buffer is dumped more than once the order
-     *  of events remains the same. */
-    std::vector<std::string> m_all_event_names;
+    /** Time at which the profiler was created, used as time 0 in the
+     *  trace file. */
+    double m_time_start;
 
     // Handling freeze/unfreeze by clicking on the display
     enum FreezeState
@@ -273,8 +357,12 @@ private:
     FreezeState     m_freeze_state;
 
 private:
-    int  getThreadID();
-    void drawBackground();
+    ThreadData* getThreadData();
+    int         getEventID(ThreadData* td, const char* name,
+                           const video::SColor& colour);
+    void        addRawEvent(ThreadData* td, int event_id, double time);
+    void        processEvents(double now);
+    void        drawBackground();
 
 public:
              Profiler();
@@ -288,6 +376,7 @@ public:
     void     draw();
     void     onClick(const core::vector2di& mouse_pos);
     void     writeToFile();
+    void     getTotalTimes(std::map<std::string, double>* times);
 
     // ------------------------------------------------------------------------
     bool isFrozen() const { return m_freeze_state == FROZEN; }
@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+
+# usage: decode_log.py stdout.log.bin > stdout.log
+#
+# Converts a binary log file written with --log-binary to the text format
+# of the normal log file.
+#
+# The file starts with "STKLOG\0" and a version byte, followed by records
+# which all start with a type byte (all numbers are little endian):
+# 0: component: uint16 id, uint8 length, name
+# 1: line: uint8 level, uint16 component id, uint64 time (0 if the line
+#    has no time), uint8 length, prefix, uint16 length, message
+
+import struct
+import sys
+import time
+
+LEVEL_NAMES = ["debug", "verbose  ", "info   ", "warn   ", "error  ",
+               "fatal  "]
+
+def readString(data, offset, size_format):
+    size = struct.calcsize(size_format)
+    (length,) = struct.unpack_from(size_format, data, offset)
+    offset += size
+    return data[offset:offset + length].decode("utf-8", "replace"), \
+           offset + length
+
+def decode(data, out):
+    if data[:7] != b"STKLOG\0" or data[7:8] != b"\1":
+        sys.stderr.write("Not a binary log file of version 1.\n")
+        return 1
+    components = {}
+    offset = 8
+    while offset < len(data):
+        record_type = data[offset]
+        offset += 1
+        if record_type == 0:
+            (cid,) = struct.unpack_from("<H", data, offset)
+            components[cid], offset = readString(data, offset + 2, "<B")
+        elif record_type == 1:
+            level, cid, line_time = struct.unpack_from("<BHQ", data, offset)
+            prefix, offset = readString(data, offset + 11, "<B")
+            message, offset = readString(data, offset, "<H")
+            line = ""
+            if prefix:
+                line += prefix + " "
+            if line_time != 0:
+                line += time.asctime(time.localtime(line_time)) + " "
+            line += "[%s] %s: %s\n" % (LEVEL_NAMES[level],
+                                       components.get(cid, "?"), message)
+            out.write(line)
+        else:
+            sys.stderr.write("Unknown record type %d at offset %d.\n"
+                             % (record_type, offset - 1))
+            return 1
+    return 0
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        print("Usage: decode_log.py FILE")
+        sys.exit(1)
+    with open(sys.argv[1], "rb") as f:
+        sys.exit(decode(f.read(), sys.stdout))